@@ -34,6 +34,9 @@ struct vdso_constants {
     // Number of bytes in an instruction cache line.
     uint32_t icache_line_size;
 
+    // CPU features supported by every CPU, as ZX_*_FEATURE_* flags.
+    uint32_t cpu_features;
+
     // Conversion factor for zx_ticks_get return values to seconds.
     uint64_t ticks_per_second;
 
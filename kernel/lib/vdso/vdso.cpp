@@ -16,8 +16,13 @@
 #include <vm/vm.h>
 #include <vm/vm_aspace.h>
 #include <vm/vm_object.h>
+#include <zircon/features.h>
 #include <zircon/types.h>
 
+#ifdef ARCH_ARM64
+#include <arch/arm64/feature.h>
+#endif
+
 #include "vdso-code.h"
 
 // This is defined in assembly by vdso-image.S; vdso-code.h
@@ -222,6 +227,28 @@ const VDso* VDso::Create() {
         "vDSO constants", vdso->vmo()->vmo(), VDSO_DATA_CONSTANTS);
     uint64_t per_second = ticks_per_second();
 
+#ifdef ARCH_ARM64
+    // The ZX_ARM64_FEATURE_ISA_* flags match the kernel's own.
+    static_assert(ZX_ARM64_FEATURE_ISA_FP == ARM64_FEATURE_ISA_FP &&
+                  ZX_ARM64_FEATURE_ISA_ASIMD == ARM64_FEATURE_ISA_ASIMD &&
+                  ZX_ARM64_FEATURE_ISA_AES == ARM64_FEATURE_ISA_AES &&
+                  ZX_ARM64_FEATURE_ISA_PMULL == ARM64_FEATURE_ISA_PMULL &&
+                  ZX_ARM64_FEATURE_ISA_SHA1 == ARM64_FEATURE_ISA_SHA1 &&
+                  ZX_ARM64_FEATURE_ISA_SHA2 == ARM64_FEATURE_ISA_SHA2 &&
+                  ZX_ARM64_FEATURE_ISA_CRC32 == ARM64_FEATURE_ISA_CRC32 &&
+                  ZX_ARM64_FEATURE_ISA_ATOMICS == ARM64_FEATURE_ISA_ATOMICS &&
+                  ZX_ARM64_FEATURE_ISA_RDM == ARM64_FEATURE_ISA_RDM &&
+                  ZX_ARM64_FEATURE_ISA_SHA3 == ARM64_FEATURE_ISA_SHA3 &&
+                  ZX_ARM64_FEATURE_ISA_SM3 == ARM64_FEATURE_ISA_SM3 &&
+                  ZX_ARM64_FEATURE_ISA_SM4 == ARM64_FEATURE_ISA_SM4 &&
+                  ZX_ARM64_FEATURE_ISA_DP == ARM64_FEATURE_ISA_DP &&
+                  ZX_ARM64_FEATURE_ISA_DPB == ARM64_FEATURE_ISA_DPB,
+                  "feature flags do not match");
+    uint32_t cpu_features = arm64_features;
+#else
+    uint32_t cpu_features = 0;
+#endif
+
     // Initialize the constants that should be visible to the vDSO.
     // Rather than assigning each member individually, do this with
     // struct assignment and a compound literal so that the compiler
@@ -230,6 +257,7 @@ const VDso* VDso::Create() {
         arch_max_num_cpus(),
         arch_dcache_line_size(),
         arch_icache_line_size(),
+        cpu_features,
         per_second,
         pmm_count_total_bytes(),
     };
@@ -535,10 +535,12 @@ void fshost_start(void) {
 
     // create a local loader service backed directly by the primary bootfs
     // to allow us to load the fshost (since we don't have filesystems before
-    // the fshost starts up).
+    // the fshost starts up). bootfs never changes, so the objects loaded
+    // from it can be cached and shared.
     zx_handle_t svc;
     if ((loader_service_create("bootfs-loader", &loader_ops,
                                &bootfs, &loader_service) != ZX_OK) ||
+        (loader_service_enable_cache(loader_service) != ZX_OK) ||
         (loader_service_connect(loader_service, &svc) != ZX_OK)) {
         printf("devmgr: cannot create loader service\n");
         exit(1);
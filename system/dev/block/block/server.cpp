@@ -45,19 +45,33 @@ void OutOfBandRespond(const zx::fifo& fifo, zx_status_t status, txnid_t txnid) {
     }
 }
 
+// Completes |msg|, along with any messages which were merged with it.
+void MsgComplete(block_msg_t* msg, zx_status_t status) {
+    while (msg != nullptr) {
+        // Since iobuf is a RefPtr, it lives at least as long as the txn,
+        // and is not discarded underneath the block device driver.
+        ZX_DEBUG_ASSERT(msg->iobuf != nullptr || msg->opcode == BLOCKIO_SYNC);
+        ZX_DEBUG_ASSERT(msg->txn != nullptr);
+        // The message may be reused as soon as it completes.
+        block_msg_t* next = msg->next;
+        msg->next = nullptr;
+        // Hold an extra copy of the 'blktxn' refptr; if we don't, and 'msg->txn' is
+        // the last copy, then when we nullify 'msg->txn' in Complete we end up
+        // trying to unlock a lock in a deleted BlockTxn.
+        auto blktxn = msg->txn;
+        // Pass msg to complete so 'msg->txn' can be nullified while protected
+        // by the BlockTransaction's lock.
+        blktxn->Complete(msg, status);
+        msg = next;
+    }
+}
+
+// Completes an operation which was issued to the device.
 void BlockComplete(void* cookie, zx_status_t status) {
     block_msg_t* msg = static_cast<block_msg_t*>(cookie);
-    // Since iobuf is a RefPtr, it lives at least as long as the txn,
-    // and is not discarded underneath the block device driver.
-    ZX_DEBUG_ASSERT(msg->iobuf != nullptr);
-    ZX_DEBUG_ASSERT(msg->txn != nullptr);
-    // Hold an extra copy of the 'blktxn' refptr; if we don't, and 'msg->txn' is
-    // the last copy, then when we nullify 'msg->txn' in Complete we end up
-    // trying to unlock a lock in a deleted BlockTxn.
-    auto blktxn = msg->txn;
-    // Pass msg to complete so 'msg->txn' can be nullified while protected
-    // by the BlockTransaction's lock.
-    blktxn->Complete(msg, status);
+    BlockServer* server = msg->server;
+    MsgComplete(msg, status);
+    server->OpComplete();
 }
 
 void BlockCompleteIotxn(iotxn_t* txn, void* cookie) {
@@ -70,6 +84,36 @@ void BlockCompleteCb(block_op_t* bop, zx_status_t status) {
     free(bop);
 }
 
+void BlockFlushCompleteCb(block_op_t* bop, zx_status_t status) {
+    // Devices without a volatile write cache have nothing to flush.
+    if (status == ZX_ERR_NOT_SUPPORTED) {
+        status = ZX_OK;
+    }
+    BlockComplete(bop->cookie, status);
+    free(bop);
+}
+
+// Returns true if the requests access overlapping blocks of the device, and
+// at least one of them modifies them.
+bool Conflicts(const block_pending_t& a, const block_pending_t& b) {
+    if (a.msg->opcode == BLOCKIO_READ && b.msg->opcode == BLOCKIO_READ) {
+        return false;
+    }
+    return a.dev_offset < b.dev_offset + b.length && b.dev_offset < a.dev_offset + a.length;
+}
+
+// Returns true if |next| can be merged onto the end of an operation which
+// currently covers |length| blocks starting at |op|.
+bool CanMerge(const block_pending_t& op, uint64_t length, const block_pending_t& next,
+              uint64_t max_xfer) {
+    return next.msg->opcode == op.msg->opcode &&
+           next.vmo == op.vmo &&
+           next.dev_offset == op.dev_offset + length &&
+           next.vmo_offset == op.vmo_offset + length &&
+           (max_xfer == 0 || length + next.length <= max_xfer) &&
+           length + next.length <= fbl::numeric_limits<uint32_t>::max();
+}
+
 }  // namespace
 
 void BlockServer::Queue(uint32_t flags, zx_handle_t vmo, uint64_t length,
@@ -80,7 +124,7 @@ void BlockServer::Queue(uint32_t flags, zx_handle_t vmo, uint64_t length,
         zx_status_t status;
         if ((status = iotxn_alloc_vmo(&txn, IOTXN_ALLOC_POOL, vmo,
                                       vmo_offset * bsz, length * bsz)) != ZX_OK) {
-            BlockComplete(msg, status);
+            MsgComplete(msg, status);
             return;
         }
         txn->flags = flags;
@@ -88,11 +132,15 @@ void BlockServer::Queue(uint32_t flags, zx_handle_t vmo, uint64_t length,
         txn->offset = dev_offset * bsz;
         txn->cookie = msg;
         txn->complete_cb = BlockCompleteIotxn;
+        {
+            fbl::AutoLock lock(&inflight_lock_);
+            inflight_++;
+        }
         iotxn_queue(dev_, txn);
     } else {
         block_op_t* bop = (block_op_t*) malloc(block_op_size_);
         if (bop == nullptr) {
-            BlockComplete(msg, ZX_ERR_NO_MEMORY);
+            MsgComplete(msg, ZX_ERR_NO_MEMORY);
             return;
         }
         bop->command = (msg->opcode == BLOCKIO_READ) ? BLOCK_OP_READ : BLOCK_OP_WRITE;
@@ -103,10 +151,102 @@ void BlockServer::Queue(uint32_t flags, zx_handle_t vmo, uint64_t length,
         bop->rw.pages = NULL;
         bop->completion_cb = BlockCompleteCb;
         bop->cookie = msg;
+        {
+            fbl::AutoLock lock(&inflight_lock_);
+            inflight_++;
+        }
         bp_.ops->queue(bp_.ctx, bop);
     }
 }
 
+void BlockServer::OpComplete() {
+    fbl::AutoLock lock(&inflight_lock_);
+    ZX_DEBUG_ASSERT(inflight_ > 0);
+    if (--inflight_ == 0) {
+        completion_signal(&idle_);
+    }
+}
+
+void BlockServer::WaitIdle() {
+    while (true) {
+        {
+            fbl::AutoLock lock(&inflight_lock_);
+            if (inflight_ == 0) {
+                return;
+            }
+            completion_reset(&idle_);
+        }
+        completion_wait(&idle_, ZX_TIME_INFINITE);
+    }
+}
+
+void BlockServer::Pend(const block_pending_t& op) {
+    for (size_t i = 0; i < pending_count_; i++) {
+        if (Conflicts(pending_[i], op)) {
+            IssuePending();
+            break;
+        }
+    }
+    ZX_DEBUG_ASSERT(pending_count_ < fbl::count_of(pending_));
+    pending_[pending_count_++] = op;
+}
+
+void BlockServer::IssuePending() {
+    // Stable insertion sort by device offset; there are at most
+    // BLOCK_FIFO_MAX_DEPTH pending requests.
+    for (size_t i = 1; i < pending_count_; i++) {
+        block_pending_t op = pending_[i];
+        size_t j = i;
+        for (; j > 0 && pending_[j - 1].dev_offset > op.dev_offset; j--) {
+            pending_[j] = pending_[j - 1];
+        }
+        pending_[j] = op;
+    }
+
+    const uint64_t max_xfer = info_.max_transfer_size / info_.block_size;
+    size_t i = 0;
+    while (i < pending_count_) {
+        const block_pending_t& op = pending_[i];
+        uint64_t length = op.length;
+        uint32_t flags = op.msg->flags;
+        block_msg_t* tail = op.msg;
+        for (i++; i < pending_count_ && CanMerge(op, length, pending_[i], max_xfer); i++) {
+            length += pending_[i].length;
+            flags |= pending_[i].msg->flags;
+            tail->next = pending_[i].msg;
+            tail = tail->next;
+        }
+        Queue(flags, op.vmo, length, op.vmo_offset, op.dev_offset, op.msg);
+    }
+    pending_count_ = 0;
+}
+
+void BlockServer::Barrier(block_msg_t* msg) {
+    IssuePending();
+    WaitIdle();
+
+    if (bp_.ops == NULL) {
+        // Iotxn-based devices have no flush operation; draining the
+        // operations which preceded the barrier is the best we can do.
+        MsgComplete(msg, ZX_OK);
+        return;
+    }
+    block_op_t* bop = (block_op_t*) malloc(block_op_size_);
+    if (bop == nullptr) {
+        MsgComplete(msg, ZX_ERR_NO_MEMORY);
+        return;
+    }
+    bop->command = BLOCK_OP_FLUSH;
+    bop->completion_cb = BlockFlushCompleteCb;
+    bop->cookie = msg;
+    {
+        fbl::AutoLock lock(&inflight_lock_);
+        inflight_++;
+    }
+    bp_.ops->queue(bp_.ctx, bop);
+    WaitIdle();
+}
+
 BlockTransaction::BlockTransaction(zx_handle_t fifo, txnid_t txnid) :
     fifo_(fifo), flags_(0), ctr_(0) {
     memset(&response_, 0, sizeof(response_));
@@ -355,6 +495,23 @@ zx_status_t BlockServer::Serve() {
                 continue;
             }
 
+            if ((requests[i].opcode & BLOCKIO_OP_MASK) == BLOCKIO_SYNC) {
+                block_msg_t* msg;
+                if (txns_[txnid]->Enqueue(wants_reply, &msg) != ZX_OK) {
+                    continue;
+                }
+                ZX_DEBUG_ASSERT(msg->txn == nullptr);
+                msg->txn = txns_[txnid];
+                msg->server = this;
+                msg->next = nullptr;
+                msg->opcode = BLOCKIO_SYNC;
+                // Don't block other users of the server while waiting for the
+                // device.
+                server_lock.release();
+                Barrier(msg);
+                continue;
+            }
+
             auto iobuf = tree_.find(vmoid);
             if (!iobuf.IsValid()) {
                 // Operation which is not accessing a valid vmo
@@ -381,6 +538,8 @@ zx_status_t BlockServer::Serve() {
                 msg->txn = txns_[txnid];
                 ZX_DEBUG_ASSERT(msg->iobuf == nullptr);
                 msg->iobuf = iobuf.CopyPointer();
+                msg->server = this;
+                msg->next = nullptr;
 
                 // Hack to ensure that the vmo is valid.
                 // In the future, this code will be responsible for pinning VMO pages,
@@ -388,15 +547,29 @@ zx_status_t BlockServer::Serve() {
                 size_t bsz = info_.block_size;
                 status = iobuf->ValidateVmoHack(bsz * requests[i].length,
                                                 bsz * requests[i].vmo_offset);
+                msg->opcode = requests[i].opcode & BLOCKIO_OP_MASK;
                 if (status != ZX_OK) {
-                    BlockComplete(msg, status);
+                    MsgComplete(msg, status);
                     break;
                 }
 
-                msg->opcode = requests[i].opcode & BLOCKIO_OP_MASK;
+                block_pending_t op;
+                op.msg = msg;
+                op.vmo = iobuf->vmo();
+                op.length = requests[i].length;
+                op.vmo_offset = requests[i].vmo_offset;
+                op.dev_offset = requests[i].dev_offset;
 
                 const uint64_t max_xfer = info_.max_transfer_size / bsz;
                 if (max_xfer != 0 && max_xfer < requests[i].length) {
+                    // Requests which must be split are issued immediately,
+                    // after any pending requests they conflict with.
+                    for (size_t j = 0; j < pending_count_; j++) {
+                        if (Conflicts(pending_[j], op)) {
+                            IssuePending();
+                            break;
+                        }
+                    }
                     uint64_t len_remaining = requests[i].length;
                     uint64_t vmo_offset = requests[i].vmo_offset;
                     uint64_t dev_offset = requests[i].dev_offset;
@@ -419,17 +592,11 @@ zx_status_t BlockServer::Serve() {
                     }
                     ZX_DEBUG_ASSERT(len_remaining == 0);
                 } else {
-                    Queue(msg->flags, iobuf->vmo(), requests[i].length,
-                          requests[i].vmo_offset, requests[i].dev_offset, msg);
+                    Pend(op);
                 }
 
                 break;
             }
-            case BLOCKIO_SYNC: {
-                // TODO(smklein): It might be more useful to have this on a per-vmo basis
-                fprintf(stderr, "Warning: BLOCKIO_SYNC is currently unimplemented\n");
-                break;
-            }
             case BLOCKIO_CLOSE_VMO: {
                 // TODO(smklein): Ensure that "iobuf" is not being used by
                 // any in-flight txns.
@@ -443,11 +610,15 @@ zx_status_t BlockServer::Serve() {
             }
             }
         }
+
+        // Issue the reads and writes received in this batch.
+        IssuePending();
     }
 }
 
 BlockServer::BlockServer(zx_device_t* dev, block_protocol_t* bp) :
-    dev_(dev), bp_(*bp), block_op_size_(0), last_id_(VMOID_INVALID + 1) {
+    dev_(dev), bp_(*bp), block_op_size_(0), last_id_(VMOID_INVALID + 1),
+    pending_count_(0), inflight_(0) {
     size_t actual;
     device_ioctl(dev_, IOCTL_BLOCK_GET_INFO, nullptr, 0, &info_, sizeof(info_), &actual);
 }
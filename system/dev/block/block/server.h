@@ -10,6 +10,7 @@
 
 #include <zircon/device/block.h>
 #include <ddk/protocol/block.h>
+#include <sync/completion.h>
 #include <zircon/thread_annotations.h>
 #include <zircon/types.h>
 
@@ -50,15 +51,32 @@ private:
 
 constexpr uint32_t kTxnFlagRespond = 0x00000001; // Should a reponse be sent when we hit ctr?
 
+class BlockServer;
 class BlockTransaction;
 
-typedef struct {
+typedef struct block_msg block_msg_t;
+
+struct block_msg {
     fbl::RefPtr<BlockTransaction> txn;
     fbl::RefPtr<IoBuffer> iobuf;
+    BlockServer* server;
+    // Other messages merged into the same operation on the device, which
+    // complete along with this one.
+    block_msg_t* next;
     uint32_t opcode;
     uint32_t flags;
     uint32_t sub_txns;
-} block_msg_t;
+};
+
+// A read or write which has been received from the fifo, but not yet issued
+// to the device. The units of length, vmo_offset, and dev_offset are 'blocks'.
+typedef struct {
+    block_msg_t* msg;
+    zx_handle_t vmo;
+    uint64_t length;
+    uint64_t vmo_offset;
+    uint64_t dev_offset;
+} block_pending_t;
 
 class BlockTransaction : public fbl::RefCounted<BlockTransaction> {
 public:
@@ -112,6 +130,9 @@ public:
 
     void ShutDown();
 
+    // Called once an operation issued to the device has completed.
+    void OpComplete();
+
     ~BlockServer();
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(BlockServer);
@@ -120,6 +141,24 @@ private:
     zx_status_t Read(block_fifo_request_t* requests, uint32_t* count);
     zx_status_t FindVmoIDLocked(vmoid_t* out) TA_REQ(server_lock_);
 
+    // Holds a read or write until the end of the current batch of requests
+    // (or the next barrier), so that it may be reordered and merged with
+    // other requests. Requests which conflict with one already pending cause
+    // the pending requests to be issued first.
+    void Pend(const block_pending_t& op);
+
+    // Sorts the pending requests by device offset, merges adjacent ones, and
+    // issues them to the device.
+    void IssuePending();
+
+    // Issues all pending requests, waits for every in-flight operation to
+    // complete, and flushes the device's write cache before completing |msg|.
+    // No request received after the barrier is issued until it completes.
+    void Barrier(block_msg_t* msg);
+
+    // Blocks until no operations are in flight on the device.
+    void WaitIdle();
+
     // The units of length, vmo_offset, and dev_offset are 'blocks'.
     void Queue(uint32_t flags, zx_handle_t vmo, uint64_t length,
                uint64_t vmo_offset, uint64_t dev_offset, block_msg_t* msg);
@@ -134,6 +173,16 @@ private:
     fbl::WAVLTree<vmoid_t, fbl::RefPtr<IoBuffer>> tree_ TA_GUARDED(server_lock_);
     fbl::RefPtr<BlockTransaction> txns_[MAX_TXN_COUNT] TA_GUARDED(server_lock_);
     vmoid_t last_id_ TA_GUARDED(server_lock_);
+
+    // Only accessed by the serving thread.
+    block_pending_t pending_[BLOCK_FIFO_MAX_DEPTH];
+    size_t pending_count_;
+
+    // Tracks operations which have been issued to the device but have not
+    // yet completed, so that barriers can wait for them.
+    fbl::Mutex inflight_lock_;
+    size_t inflight_ TA_GUARDED(inflight_lock_);
+    completion_t idle_;
 };
 
 #else
@@ -53,7 +53,8 @@ int InitThread(void* arg) {
 // Public methods
 
 Device::Device(zx_device_t* parent)
-    : DeviceType(parent), info_(nullptr), active_(false), tasks_(0), mapped_(0), base_(nullptr),
+    : DeviceType(parent), info_(nullptr), num_workers_(0), active_(false), tasks_(0), mapped_(0),
+      base_(nullptr),
       last_(0), head_(nullptr), tail_(nullptr) {}
 
 Device::~Device() {}
@@ -155,13 +156,14 @@ zx_status_t Device::Init() {
         xprintf("bitmap allocation failed: %s\n", zx_status_get_string(rc));
         return rc;
     }
-    // TODO(aarongreen): Investigate performance implications of adding more workers.
     if ((rc = zx::port::create(0, &port_)) != ZX_OK) {
         xprintf("zx::port::create failed: %s\n", zx_status_get_string(rc));
         return rc;
     }
-    for (size_t i = 0; i < kNumWorkers; ++i) {
-        if ((rc = workers_[i].Start(this, *volume, port_)) != ZX_OK) {
+    size_t num_workers = fbl::clamp(static_cast<size_t>(zx_system_get_num_cpus()), size_t(1),
+                                    kMaxWorkers);
+    for (; num_workers_ < num_workers; ++num_workers_) {
+        if ((rc = workers_[num_workers_].Start(this, *volume, port_)) != ZX_OK) {
             return rc;
         }
     }
@@ -313,7 +315,7 @@ void Device::DdkUnbind() {
     packet.key = 0;
     packet.type = ZX_PKT_TYPE_USER;
     packet.status = ZX_ERR_STOP;
-    for (size_t i = 0; i < kNumWorkers; ++i) {
+    for (size_t i = 0; i < num_workers_; ++i) {
         port_.queue(&packet, 1);
     }
     port_.reset();
@@ -328,8 +330,7 @@ void Device::DdkRelease() {
     if (rc != ZX_OK) {
         xprintf("WARNING: init thread returned %s\n", zx_status_get_string(rc));
     }
-    for (size_t i = 0; i < kNumWorkers; ++i) {
-
+    for (size_t i = 0; i < num_workers_; ++i) {
         workers_[i].Stop();
     }
     if (mapped_ != 0 && (rc = zx::vmar::root_self().unmap(mapped_, info_->mapped_len)) != ZX_OK) {
@@ -433,13 +434,26 @@ void Device::BlockComplete(block_op_t* block, zx_status_t rc) {
         return;
     }
 
-    zx_port_packet_t packet;
-    packet.key = 0;
-    packet.type = ZX_PKT_TYPE_USER;
-    packet.status = ZX_ERR_NEXT;
-    memcpy(packet.user.c8, &block, sizeof(block));
-    if ((rc = device->port_.queue(&packet, 1)) != ZX_OK) {
-        device->BlockRelease(block, rc);
+    device->DispatchBlock(block);
+}
+
+void Device::BlockTransformed(block_op_t* block, uint32_t pieces, zx_status_t rc) {
+    extra_op_t* extra = BlockToExtra(block);
+    if (rc != ZX_OK) {
+        zx_status_t expected = ZX_OK;
+        extra->status.compare_exchange_strong(&expected, rc, fbl::memory_order_seq_cst,
+                                              fbl::memory_order_seq_cst);
+    }
+    if (extra->pending.fetch_sub(pieces) != pieces) {
+        return;
+    }
+
+    // This was the last piece.
+    rc = extra->status.load();
+    if (rc != ZX_OK || block->command != BLOCK_OP_WRITE) {
+        BlockRelease(block, rc);
+    } else {
+        BlockForward(block);
     }
 }
 
@@ -542,8 +556,6 @@ void Device::ReleaseBlocks(uint64_t off, uint64_t len) {
 }
 
 void Device::ProcessBlock(block_op_t* block, uint64_t off) {
-    zx_status_t rc;
-
     extra_op_t* extra = BlockToExtra(block);
     extra->buf = base_ + (off * info_->blk.block_size);
     extra->len = block->rw.length * info_->blk.block_size;
@@ -560,16 +572,42 @@ void Device::ProcessBlock(block_op_t* block, uint64_t off) {
     block->completion_cb = BlockComplete;
     block->cookie = this;
 
-    // Set remaining fields and pass along
+    // Reads are decrypted once the parent device completes them; writes are encrypted first.
+    if (block->command == BLOCK_OP_READ) {
+        BlockForward(block);
+    } else {
+        DispatchBlock(block);
+    }
+}
+
+void Device::DispatchBlock(block_op_t* block) {
+    zx_status_t rc;
+    extra_op_t* extra = BlockToExtra(block);
+
+    // Keep each piece block-aligned, and large enough that the cost of handing it to a worker is
+    // small compared to that of transforming it.
+    uint64_t block_size = info_->blk.block_size;
+    uint64_t blocks = extra->len / block_size;
+    uint64_t pieces = fbl::min<uint64_t>(fbl::max(extra->len / kMinPieceLen, 1U), num_workers_);
+    uint64_t piece_blocks = (blocks + pieces - 1) / pieces;
+    pieces = (blocks + piece_blocks - 1) / piece_blocks;
+    extra->pending.store(static_cast<uint32_t>(pieces));
+    extra->status.store(ZX_OK);
+
     zx_port_packet_t packet;
     packet.key = 0;
     packet.type = ZX_PKT_TYPE_USER;
     packet.status = ZX_ERR_NEXT;
-    memcpy(packet.user.c8, &block, sizeof(block));
-    if (block->command == BLOCK_OP_READ) {
-        BlockForward(block);
-    } else if ((rc = port_.queue(&packet, 1)) != ZX_OK) {
-        BlockRelease(block, rc);
+    packet.user.u64[0] = reinterpret_cast<uintptr_t>(block);
+    for (uint64_t i = 0; i < pieces; ++i) {
+        uint64_t off = i * piece_blocks * block_size;
+        packet.user.u64[1] = off;
+        packet.user.u64[2] = fbl::min(piece_blocks * block_size, extra->len - off);
+        if ((rc = port_.queue(&packet, 1)) != ZX_OK) {
+            // Abandon the pieces which were not queued.
+            BlockTransformed(block, static_cast<uint32_t>(pieces - i), rc);
+            return;
+        }
     }
 }
 
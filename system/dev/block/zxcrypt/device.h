@@ -79,6 +79,10 @@ public:
     // Send |block| to the parent of the device stored in |txn->cookie|.
     void BlockForward(block_op_t* block) __TA_EXCLUDES(mtx_);
 
+    // Called by a worker once it has transformed |pieces| pieces of |block|, with the result |rc|.
+    // Once every piece is done, a write is forwarded to the parent device and a read is completed.
+    void BlockTransformed(block_op_t* block, uint32_t pieces, zx_status_t rc) __TA_EXCLUDES(mtx_);
+
     // I/O callback invoked by the parent device.  Stored in |block->completion_cb| by |BlockQueue|.
     static void BlockComplete(block_op_t* block, zx_status_t rc) __TA_EXCLUDES(mtx_);
 
@@ -93,9 +97,13 @@ public:
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Device);
 
-    // TODO(aarongreen): Investigate performance impact of changing this.
-    // Number of encrypting/decrypting workers
-    static const size_t kNumWorkers = 2;
+    // Maximum number of encrypting/decrypting workers.  One is started for each CPU, up to this
+    // limit.
+    static const size_t kMaxWorkers = 32;
+
+    // Requests are split into pieces of at least this many bytes so that several workers may
+    // transform them concurrently.
+    static const uint32_t kMinPieceLen = 64 * 1024;
 
 #ifdef IOTXN_LEGACY_SUPPORT
     // Indicates the number of "adapter" |iotxn_t|s and |block_op_t|s available in the pools below
@@ -127,6 +135,10 @@ private:
     // and send it to a worker.
     void ProcessBlock(block_op_t* block, uint64_t offset) __TA_EXCLUDES(mtx_);
 
+    // Splits the cryptographic transformation of |block| into pieces, and sends them to the
+    // workers.
+    void DispatchBlock(block_op_t* block) __TA_EXCLUDES(mtx_);
+
     // Defer this |block| request until later, due to insufficient memory for cryptographic
     // transformations.
     void EnqueueBlock(block_op_t* block) __TA_EXCLUDES(mtx_);
@@ -197,8 +209,10 @@ private:
 
     // The |Init| thread, used to configure and add the device.
     thrd_t init_;
-    // Threads that performs encryption/decryption.
-    Worker workers_[kNumWorkers];
+    // Threads that performs encryption/decryption.  |num_workers_| is set in |Init|, before the
+    // device is made visible.
+    Worker workers_[kMaxWorkers];
+    size_t num_workers_;
     // Port used to send write/read operations to be encrypted/decrypted.
     zx::port port_;
     // Primary lock for accessing the fields below
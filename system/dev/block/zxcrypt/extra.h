@@ -5,6 +5,7 @@
 #pragma once
 
 #include <ddk/protocol/block.h>
+#include <fbl/atomic.h>
 #include <zircon/listnode.h>
 #include <zircon/syscalls/port.h>
 #include <zircon/types.h>
@@ -25,6 +26,11 @@ struct extra_op_t {
     uint64_t off;    // VMO offset in BYTES
     zx_handle_t vmo; // VMO of the requester
 
+    // Large requests are transformed in several pieces by different workers.  These track the
+    // number of pieces still outstanding, and the first error any of them encountered.
+    fbl::atomic<uint32_t> pending;
+    fbl::atomic<zx_status_t> status;
+
     void (*completion_cb)(block_op_t* block, zx_status_t status);
     void* cookie;
 };
@@ -61,39 +61,61 @@ zx_status_t Worker::Start(Device* device, const Volume& volume, const zx::port&
 }
 
 zx_status_t Worker::Loop() {
-    zx_status_t rc;
     ZX_DEBUG_ASSERT(device_);
-    zx_port_packet_t packet;
-    while (port_.wait(zx::time::infinite(), &packet, 1) == ZX_OK && packet.status == ZX_ERR_NEXT) {
-        block_op_t* block = reinterpret_cast<block_op_t*>(packet.user.u64[0]);
-        extra_op_t* ex = device_->BlockToExtra(block);
-        size_t actual;
-        switch (block->command) {
-        case BLOCK_OP_WRITE:
-            if ((rc = zx_vmo_read(ex->vmo, ex->buf, ex->off, ex->len, &actual)) != ZX_OK ||
-                (rc = encrypt_.Encrypt(ex->buf, ex->num, ex->len, ex->buf) != ZX_OK)) {
-                device_->BlockRelease(block, rc);
+    zx_port_packet_t packets[kMaxBatch];
+    bool stopping = false;
+    while (!stopping) {
+        // Wait for a packet, then take any others which are already queued.  A worker takes at
+        // most one request to stop, so that every worker receives one.
+        size_t n = 0;
+        zx::time deadline = zx::time::infinite();
+        while (n < kMaxBatch && port_.wait(deadline, &packets[n], 1) == ZX_OK) {
+            deadline = zx::time();
+            if (packets[n++].status != ZX_ERR_NEXT) {
                 break;
             }
-            device_->BlockForward(block);
+        }
+        if (n == 0) {
             break;
-
-        case BLOCK_OP_READ:
-            if ((rc = decrypt_.Decrypt(ex->buf, ex->num, ex->len, ex->buf)) != ZX_OK ||
-                (rc = zx_vmo_write(ex->vmo, ex->buf, ex->off, ex->len, &actual)) != ZX_OK) {
-                device_->BlockRelease(block, rc);
-                break;
+        }
+        for (size_t i = 0; i < n; ++i) {
+            if (packets[i].status == ZX_ERR_NEXT) {
+                ProcessPiece(packets[i]);
+            } else {
+                stopping = true;
             }
-            device_->BlockRelease(block, ZX_OK);
-            break;
-
-        default:
-            device_->BlockRelease(block, ZX_ERR_NOT_SUPPORTED);
         }
     }
     return ZX_OK;
 }
 
+void Worker::ProcessPiece(const zx_port_packet_t& packet) {
+    zx_status_t rc;
+    block_op_t* block = reinterpret_cast<block_op_t*>(packet.user.u64[0]);
+    uint64_t off = packet.user.u64[1];
+    size_t len = packet.user.u64[2];
+    extra_op_t* ex = device_->BlockToExtra(block);
+    uint8_t* buf = ex->buf + off;
+    size_t actual;
+    switch (block->command) {
+    case BLOCK_OP_WRITE:
+        if ((rc = zx_vmo_read(ex->vmo, buf, ex->off + off, len, &actual)) == ZX_OK) {
+            rc = encrypt_.Encrypt(buf, ex->num + off, len, buf);
+        }
+        break;
+
+    case BLOCK_OP_READ:
+        if ((rc = decrypt_.Decrypt(buf, ex->num + off, len, buf)) == ZX_OK) {
+            rc = zx_vmo_write(ex->vmo, buf, ex->off + off, len, &actual);
+        }
+        break;
+
+    default:
+        rc = ZX_ERR_NOT_SUPPORTED;
+    }
+    device_->BlockTransformed(block, 1, rc);
+}
+
 zx_status_t Worker::Stop() {
     zx_status_t rc;
 
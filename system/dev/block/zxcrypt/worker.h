@@ -46,6 +46,13 @@ public:
 private:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Worker);
 
+    // Maximum number of packets taken from the port at once.
+    static const size_t kMaxBatch = 16;
+
+    // Encrypts or decrypts the piece of a request described by |packet|, and reports the result to
+    // the device.
+    void ProcessPiece(const zx_port_packet_t& packet);
+
     // The cipher objects used to perform cryptographic.  See notes on "random access" in
     // crypto/cipher.h.
     crypto::Cipher encrypt_;
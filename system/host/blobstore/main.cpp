@@ -32,6 +32,7 @@ namespace {
 
 typedef struct {
     bool readonly = false;
+    bool compress = false;
     uint64_t data_blocks = blobstore::kStartBlockMinimum; // Account for reserved blocks
     fbl::Vector<fbl::String> blob_list;
 } blob_options_t;
@@ -62,6 +63,7 @@ int do_blobstore_add_blobs(fbl::unique_fd fd, const blob_options_t& options) {
     if (blobstore_create(&bs, fbl::move(fd)) < 0) {
         return -1;
     }
+    bs->SetCompression(options.compress);
 
     struct rlimit rlp;
     if (getrlimit(RLIMIT_NOFILE, &rlp) != 0) {
@@ -131,20 +133,24 @@ off_t calculate_total_size(off_t data_blocks) {
     return (data_blocks + blobstore::DataStartBlock(info)) * blobstore::kBlobstoreBlockSize;
 }
 
-off_t calculate_blob_blocks(off_t data_size) {
-    blobstore::blobstore_inode_t node;
-    node.blob_size = data_size;
-    return MerkleTreeBlocks(node) + BlobDataBlocks(node);
-}
-
 zx_status_t process_blob(char* blob_name, blob_options_t* options) {
-    struct stat s;
-    if (stat(blob_name, &s) < 0) {
-        fprintf(stderr, "Failed to stat blob %s\n", blob_name);
+    fbl::unique_fd data_fd(open(blob_name, O_RDONLY, 0644));
+    if (!data_fd) {
+        fprintf(stderr, "Failed to open blob %s\n", blob_name);
         return ZX_ERR_IO;
     }
 
-    options->data_blocks += calculate_blob_blocks(s.st_size);
+    // With --compress, size the image for the compressed blobs rather than
+    // the raw files.
+    uint64_t blob_blocks;
+    zx_status_t status = blobstore::blobstore_blob_blocks(data_fd.get(), options->compress,
+                                                          &blob_blocks);
+    if (status != ZX_OK) {
+        fprintf(stderr, "Failed to size blob %s: %d\n", blob_name, status);
+        return status;
+    }
+
+    options->data_blocks += blob_blocks;
     options->blob_list.push_back(blob_name);
     return ZX_OK;
 }
@@ -228,7 +234,9 @@ struct {
 
 int usage() {
     fprintf(stderr,
-            "usage: blobstore <file-or-device>[@<size>] <command> [ <arg>* ]\n"
+            "usage: blobstore [ <options>* ] <file-or-device>[@<size>] <command> [ <arg>* ]\n"
+            "\n"
+            "options: --compress  Store blobs LZ4 compressed when it saves space\n"
             "\n");
     for (unsigned n = 0; n < (sizeof(CMDS) / sizeof(CMDS[0])); n++) {
         fprintf(stderr, "%9s %-10s %s\n", n ? "" : "commands:",
@@ -255,6 +263,8 @@ int process_args(int argc, char** argv, CommandFunction* func, blob_options_t* o
     while (argc > 1) {
         if (!strcmp(argv[0], "--readonly")) {
             options->readonly = true;
+        } else if (!strcmp(argv[0], "--compress")) {
+            options->compress = true;
         } else {
             break;
         }
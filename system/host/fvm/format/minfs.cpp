@@ -61,21 +61,24 @@ zx_status_t MinfsFormat::MakeFvmReady(size_t slice_size, uint32_t vpart_index) {
     size_t kBlocksPerSlice = fvm_info_.slice_size / minfs::kMinfsBlockSize;
     uint32_t ibm_blocks = info_.abm_block - info_.ibm_block;
     uint32_t abm_blocks = info_.ino_block - info_.abm_block;
-    uint32_t ino_blocks = info_.dat_block - info_.ino_block;
+    uint32_t ino_blocks = info_.jnl_block - info_.ino_block;
+    uint32_t jnl_blocks = info_.dat_block - info_.jnl_block;
     uint32_t dat_blocks = info_.block_count;
 
     fvm_info_.ibm_slices = (ibm_blocks + kBlocksPerSlice - 1) / kBlocksPerSlice;
     fvm_info_.abm_slices = (abm_blocks + kBlocksPerSlice - 1) / kBlocksPerSlice;
     fvm_info_.ino_slices = (ino_blocks + kBlocksPerSlice - 1) / kBlocksPerSlice;
+    fvm_info_.jnl_slices = (jnl_blocks + kBlocksPerSlice - 1) / kBlocksPerSlice;
     fvm_info_.dat_slices = (dat_blocks + kBlocksPerSlice - 1) / kBlocksPerSlice;
     fvm_info_.vslice_count = 1 + fvm_info_.ibm_slices + fvm_info_.abm_slices +
-                             fvm_info_.ino_slices + fvm_info_.dat_slices;
+                             fvm_info_.ino_slices + fvm_info_.jnl_slices + fvm_info_.dat_slices;
 
     xprintf("Minfs: slice_size is %" PRIu64 "u, kBlocksPerSlice is %zu\n", fvm_info_.slice_size,
             kBlocksPerSlice);
     xprintf("Minfs: ibm_blocks: %u, ibm_slices: %u\n", ibm_blocks, fvm_info_.ibm_slices);
     xprintf("Minfs: abm_blocks: %u, abm_slices: %u\n", abm_blocks, fvm_info_.abm_slices);
     xprintf("Minfs: ino_blocks: %u, ino_slices: %u\n", ino_blocks, fvm_info_.ino_slices);
+    xprintf("Minfs: jnl_blocks: %u, jnl_slices: %u\n", jnl_blocks, fvm_info_.jnl_slices);
     xprintf("Minfs: dat_blocks: %u, dat_slices: %u\n", dat_blocks, fvm_info_.dat_slices);
 
     fvm_info_.inode_count = static_cast<uint32_t>(fvm_info_.ino_slices * fvm_info_.slice_size /
@@ -86,6 +89,7 @@ zx_status_t MinfsFormat::MakeFvmReady(size_t slice_size, uint32_t vpart_index) {
     fvm_info_.ibm_block = minfs::kFVMBlockInodeBmStart;
     fvm_info_.abm_block = minfs::kFVMBlockDataBmStart;
     fvm_info_.ino_block = minfs::kFVMBlockInodeStart;
+    fvm_info_.jnl_block = minfs::kFVMBlockJournalStart;
     fvm_info_.dat_block = minfs::kFVMBlockDataStart;
     fvm_info_.flags |= minfs::kMinfsFlagFVM;
 
@@ -129,10 +133,17 @@ zx_status_t MinfsFormat::GetVsliceRange(unsigned extent_index, vslice_info_t* vs
         vslice_info->vslice_start = minfs::kFVMBlockInodeStart;
         vslice_info->slice_count = fvm_info_.ino_slices;
         vslice_info->block_offset = info_.ino_block;
-        vslice_info->block_count = info_.dat_block - info_.ino_block;
+        vslice_info->block_count = info_.jnl_block - info_.ino_block;
         return ZX_OK;
     }
     case 4: {
+        vslice_info->vslice_start = minfs::kFVMBlockJournalStart;
+        vslice_info->slice_count = fvm_info_.jnl_slices;
+        vslice_info->block_offset = info_.jnl_block;
+        vslice_info->block_count = info_.dat_block - info_.jnl_block;
+        return ZX_OK;
+    }
+    case 5: {
         vslice_info->vslice_start = minfs::kFVMBlockDataStart;
         vslice_info->slice_count = fvm_info_.dat_slices;
         vslice_info->block_offset = info_.dat_block;
@@ -147,7 +158,7 @@ zx_status_t MinfsFormat::GetVsliceRange(unsigned extent_index, vslice_info_t* vs
 zx_status_t MinfsFormat::GetSliceCount(uint32_t* slices_out) const {
     CheckFvmReady();
     *slices_out = 1 + fvm_info_.ibm_slices + fvm_info_.abm_slices + fvm_info_.ino_slices
-                  + fvm_info_.dat_slices;
+                  + fvm_info_.jnl_slices + fvm_info_.dat_slices;
     return ZX_OK;
 }
 
@@ -32,6 +32,10 @@ int main(int argc, char** argv) {
     fbl::unique_ptr<uint8_t[]> tree(nullptr);
     char strbuf[Digest::kLength * 2 + 1];
     Digest digest;
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (num_cpus < 1) {
+        num_cpus = 1;
+    }
     for (size_t i = 1; i < argc; ++i) {
         const char* arg = argv[i];
         if (stat(arg, &info) < 0) {
@@ -69,7 +73,7 @@ int main(int argc, char** argv) {
             return 1;
         }
         zx_status_t rc =
-            MerkleTree::Create(data, info.st_size, tree.get(), len, &digest);
+            MerkleTree::CreateParallel(data, info.st_size, tree.get(), len, &digest, num_cpus);
         if (info.st_size != 0 && munmap(data, info.st_size) != 0) {
             perror("munmap");
             fprintf(stderr, "[-] Failed to munmap '%s.\n", arg);
@@ -226,7 +226,7 @@ IOCTL_WRAPPER_IN(ioctl_block_fvm_upgrade, IOCTL_BLOCK_FVM_UPGRADE, upgrade_req_t
 //    This response is sent once all operations either complete or a single operation fails.
 //    At this point, step (1) may begin again without reallocating the txn.
 //
-// For BLOCKIO_READ and BLOCKIO_WRITE, N may be greater than 1.
+// For BLOCKIO_READ, BLOCKIO_WRITE, and BLOCKIO_SYNC, N may be greater than 1.
 // Otherwise, N == 1 (skipping step (1) in the protocol above).
 //
 // Notes:
@@ -253,10 +253,20 @@ IOCTL_WRAPPER_IN(ioctl_block_fvm_upgrade, IOCTL_BLOCK_FVM_UPGRADE, upgrade_req_t
 // blocks, into the VMO associated with 'vmoid', starting at 'vmo_offset' blocks.  If the
 // transaction is out of range, for example if 'length' is too large or if 'dev_offset' is beyond
 // the end of the device, ZX_ERR_OUT_OF_RANGE is returned.
+//
+// Reads and writes which are not separated by a BLOCKIO_SYNC may be reordered and merged with
+// one another before being issued to the device, although requests which access overlapping
+// blocks (where at least one of them is a write) are issued in the order they were received.
+//
+// BLOCKIO_SYNC acts as a barrier: it completes once all previously received requests (on any
+// txnid) have completed and the device's write cache has been flushed, and no request received
+// after it is issued to the device until then.  The 'vmoid', 'length', and offset fields are
+// ignored.  For example, a client may send a series of writes followed by
+// (OP = Sync | Want Reply) on the same txnid to learn when all of the writes are durable.
 
 #define BLOCKIO_READ 0x0001      // Reads from the Block device into the VMO
 #define BLOCKIO_WRITE 0x0002     // Writes to the Block device from the VMO
-#define BLOCKIO_SYNC 0x0003      // Unimplemented
+#define BLOCKIO_SYNC 0x0003      // Flushes and orders all previous requests; see above
 #define BLOCKIO_CLOSE_VMO 0x0004 // Detaches the VMO from the block device; closes the handle to it.
 #define BLOCKIO_OP_MASK 0x00FF
 
@@ -209,6 +209,12 @@ struct zx_loader_svc_msg {
 // obtain a new loader service connection/context
 // arg=0, data[] empty, request includes channel for new connection
 
+#define LOADER_SVC_OP_LOAD_OBJECTS 9
+// arg=0, data[] object names (each asciiz, one after another),
+// at most ZX_CHANNEL_MAX_MSG_HANDLES of them
+// reply arg=status of the first object that could not be loaded, or ZX_OK
+// reply includes a vmo handle for each object before that one, in order
+
 #ifdef __cplusplus
 }
 #endif
@@ -31,6 +31,7 @@ namespace {
 
 typedef struct {
     bool readonly = false;
+    bool compress = false;
     uint64_t data_blocks = blobstore::kStartBlockMinimum; // Account for reserved blocks
     fbl::Vector<fbl::String> blob_list;
 } blob_options_t;
@@ -48,8 +49,10 @@ int do_blobstore_mount(fbl::unique_fd fd, const blob_options_t& options) {
         readonly = block_info.flags & BLOCK_FLAG_READONLY;
     }
 
+    blobstore::MountOptions mount_options;
+    mount_options.compress = options.compress;
     fbl::RefPtr<blobstore::VnodeBlob> vn;
-    if (blobstore::blobstore_mount(&vn, fbl::move(fd)) < 0) {
+    if (blobstore::blobstore_mount(&vn, fbl::move(fd), mount_options) < 0) {
         return -1;
     }
     zx_handle_t h = zx_get_startup_handle(PA_HND(PA_USER0, 0));
@@ -61,6 +64,10 @@ int do_blobstore_mount(fbl::unique_fd fd, const blob_options_t& options) {
     async::Loop loop;
     fs::Vfs vfs(loop.async());
     vfs.SetReadonly(readonly);
+    if (vfs.EnableDentryCache() != ZX_OK) {
+        FS_TRACE_ERROR("blobstore: Could not allocate dentry cache\n");
+        return -1;
+    }
     zx_status_t status;
     if ((status = vfs.ServeDirectory(fbl::move(vn), zx::channel(h))) != ZX_OK) {
         return status;
@@ -110,6 +117,7 @@ int usage() {
             "usage: blobstore [ <options>* ] <command> [ <arg>* ]\n"
             "\n"
             "options: --readonly  Mount filesystem read-only\n"
+            "         --compress  Store new blobs LZ4 compressed when it saves space\n"
             "\n"
             "On Fuchsia, blobstore takes the block device argument by handle.\n"
             "This can make 'blobstore' commands hard to invoke from command line.\n"
@@ -137,6 +145,8 @@ int process_args(int argc, char** argv, CommandFunction* func, blob_options_t* o
     while (argc > 1) {
         if (!strcmp(argv[0], "--readonly")) {
             options->readonly = true;
+        } else if (!strcmp(argv[0], "--compress")) {
+            options->compress = true;
         } else {
             break;
         }
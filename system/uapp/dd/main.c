@@ -14,6 +14,8 @@
 #include <sys/stat.h>
 #include <unistd.h>
 
+#include <zircon/syscalls.h>
+
 int usage(void) {
     fprintf(stderr, "usage: dd [OPTIONS]\n");
     fprintf(stderr, "dd can be used to convert and copy files\n");
@@ -170,6 +172,8 @@ int main(int argc, const char** argv) {
     // Size of remaining "partial" transfer from input / to output.
     size_t record_in_partial = 0;
     size_t record_out_partial = 0;
+    // Time at which copying started
+    zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
 
     if (*options.input == '\0') {
         in = STDIN_FILENO;
@@ -281,7 +285,10 @@ int main(int argc, const char** argv) {
 done:
     printf("%zu+%u records in\n", records_in, record_in_partial ? 1 : 0);
     printf("%zu+%u records out\n", records_out, record_out_partial ? 1 : 0);
-    printf("%zu bytes copied\n", records_out * options.output_bs + record_out_partial);
+    size_t copied = records_out * options.output_bs + record_out_partial;
+    double secs = (double)(zx_clock_get(ZX_CLOCK_MONOTONIC) - start) / 1000000000.0;
+    printf("%zu bytes copied, %.3f s, %.1f MB/s\n", copied, secs,
+           secs > 0 ? (double)copied / (1024 * 1024) / secs : 0.0);
 
     if (in != -1) {
         close(in);
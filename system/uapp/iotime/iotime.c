@@ -4,6 +4,7 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -99,10 +100,13 @@ static zx_time_t iotime_block(int is_read, int fd, size_t total, size_t bufsz) {
     return iotime_posix(is_read, fd, total, bufsz);
 }
 
-static zx_time_t iotime_fifo(char* dev, int is_read, int fd, size_t total, size_t bufsz) {
+// Keeps up to |depth| transactions of |bufsz| bytes in flight at once, each
+// using its own txnid and its own region of the VMO.
+static zx_time_t iotime_fifo(char* dev, int is_read, int fd, size_t total, size_t bufsz,
+                             size_t depth) {
     zx_status_t r;
     zx_handle_t vmo;
-    if ((r = zx_vmo_create(bufsz, 0, &vmo)) != ZX_OK) {
+    if ((r = zx_vmo_create(bufsz * depth, 0, &vmo)) != ZX_OK) {
         fprintf(stderr, "error: out of memory %d\n", r);
         return ZX_TIME_INFINITE;
     }
@@ -119,10 +123,14 @@ static zx_time_t iotime_fifo(char* dev, int is_read, int fd, size_t total, size_
         return ZX_TIME_INFINITE;
     }
 
-    txnid_t txnid;
-    if (ioctl_block_alloc_txn(fd, &txnid) != sizeof(txnid)) {
-        fprintf(stderr, "error: cannot allocate txn for '%s'\n", dev);
-        return ZX_TIME_INFINITE;
+    txnid_t txnids[MAX_TXN_COUNT];
+    bool busy[MAX_TXN_COUNT];
+    for (size_t i = 0; i < depth; i++) {
+        if (ioctl_block_alloc_txn(fd, &txnids[i]) != sizeof(txnids[i])) {
+            fprintf(stderr, "error: cannot allocate txn for '%s'\n", dev);
+            return ZX_TIME_INFINITE;
+        }
+        busy[i] = false;
     }
 
     zx_handle_t dup;
@@ -145,43 +153,66 @@ static zx_time_t iotime_fifo(char* dev, int is_read, int fd, size_t total, size_
 
     zx_time_t t0 = zx_clock_get(ZX_CLOCK_MONOTONIC);
     size_t n = total;
+    size_t slot = 0;
     while (n > 0) {
+        if (busy[slot]) {
+            if ((r = block_fifo_wait(client, txnids[slot])) != ZX_OK) {
+                fprintf(stderr, "error: block_fifo_wait error %d\n", r);
+                return ZX_TIME_INFINITE;
+            }
+            busy[slot] = false;
+        }
         size_t xfer = (n > bufsz) ? bufsz : n;
         block_fifo_request_t request = {
-            .txnid = txnid,
+            .txnid = txnids[slot],
             .vmoid = vmoid,
             .opcode = is_read ? BLOCKIO_READ : BLOCKIO_WRITE,
             .length = xfer / info.block_size,
-            .vmo_offset = 0,
+            .vmo_offset = (slot * bufsz) / info.block_size,
             .dev_offset = (total - n) / info.block_size,
         };
-        if ((r = block_fifo_txn(client, &request, 1)) != ZX_OK) {
-            fprintf(stderr, "error: block_fifo_txn error %d\n", r);
+        if ((r = block_fifo_txn_async(client, &request, 1, NULL, NULL)) != ZX_OK) {
+            fprintf(stderr, "error: block_fifo_txn_async error %d\n", r);
             return ZX_TIME_INFINITE;
         }
+        busy[slot] = true;
+        slot = (slot + 1) % depth;
         n -= xfer;
     }
+    for (size_t i = 0; i < depth; i++) {
+        if (busy[i] && (r = block_fifo_wait(client, txnids[i])) != ZX_OK) {
+            fprintf(stderr, "error: block_fifo_wait error %d\n", r);
+            return ZX_TIME_INFINITE;
+        }
+    }
     zx_time_t t1 = zx_clock_get(ZX_CLOCK_MONOTONIC);
     return t1 - t0;
 }
 
 static int usage(void) {
     fprintf(stderr,
-            "usage: iotime <read|write> <posix|block|fifo> <device|--ramdisk> <bytes> <bufsize>\n\n"
+            "usage: iotime <read|write> <posix|block|fifo> <device|--ramdisk> <bytes> <bufsize>"
+            " [<depth>]\n\n"
             "        <bytes> and <bufsize> must be a multiple of 4k for block mode\n"
-            "        --ramdisk only supported for block mode\n");
+            "        --ramdisk only supported for block mode\n"
+            "        <depth> is the number of transactions kept in flight in fifo mode"
+            " (default 1, max %d)\n", MAX_TXN_COUNT);
     return -1;
 }
 
 
 int main(int argc, char** argv) {
-    if (argc != 6) {
+    if (argc != 6 && argc != 7) {
         return usage();
     }
 
     int is_read = !strcmp(argv[1], "read");
     size_t total = number(argv[4]);
     size_t bufsz = number(argv[5]);
+    size_t depth = (argc == 7) ? number(argv[6]) : 1;
+    if (depth == 0 || depth > MAX_TXN_COUNT) {
+        return usage();
+    }
 
     int fd;
     if (!strcmp(argv[3], "--ramdisk")) {
@@ -206,7 +237,7 @@ int main(int argc, char** argv) {
     } else if (!strcmp(argv[2], "block")) {
         res = iotime_block(is_read, fd, total, bufsz);
     } else if (!strcmp(argv[2], "fifo")) {
-        res = iotime_fifo(argv[3], is_read, fd, total, bufsz);
+        res = iotime_fifo(argv[3], is_read, fd, total, bufsz, depth);
     } else {
         fprintf(stderr, "error: unknown mode '%s'\n", argv[2]);
         return -1;
@@ -26,6 +26,10 @@
 
 namespace {
 
+// The number of threads which dispatch filesystem requests, including the
+// thread which runs the loop.
+constexpr uint32_t kDispatchThreads = 4;
+
 int do_minfs_check(fbl::unique_ptr<minfs::Bcache> bc, int argc, char** argv) {
     return minfs_check(fbl::move(bc));
 }
@@ -41,11 +45,24 @@ int do_minfs_mount(fbl::unique_ptr<minfs::Bcache> bc, bool readonly) {
     fs::Vfs vfs(loop.async());
     trace::TraceProvider trace_provider(loop.async());
     vfs.SetReadonly(readonly);
+    // Minfs locks its own vnodes, so requests on distinct files and
+    // directories may be dispatched concurrently.
+    vfs.SetFineGrainedLocking(true);
+    if (vfs.EnableDentryCache() != ZX_OK) {
+        FS_TRACE_ERROR("minfs: Could not allocate dentry cache\n");
+        return -1;
+    }
 
     if (MountAndServe(&vfs, fbl::move(bc), zx::channel(h)) != ZX_OK) {
         return -1;
     }
 
+    for (uint32_t i = 1; i < kDispatchThreads; i++) {
+        if (loop.StartThread("minfs-dispatch") != ZX_OK) {
+            FS_TRACE_ERROR("minfs: Could not start dispatch thread\n");
+            break;
+        }
+    }
     loop.Run();
     return 0;
 }
@@ -26,6 +26,7 @@ MODULE_STATIC_LIBS := \
     system/ulib/zxcpp \
     system/ulib/fbl \
     system/ulib/sync \
+    third_party/ulib/cksum \
 
 MODULE_LIBS := \
     system/ulib/async.default \
@@ -13,6 +13,10 @@
 
 namespace {
 
+// Distinct names, more than each thread caches.
+constexpr unsigned kNumDistinctNames = 1024;
+char g_distinct_names[kNumDistinctNames][16];
+
 void RunBenchmarks(bool tracing_enabled) {
     Run("is enabled", [] {
         trace_is_enabled();
@@ -103,6 +107,24 @@ void RunBenchmarks(bool tracing_enabled) {
                              "k5", "string5", "k6", "string6", "k7", "string7", "k8", "string8");
     });
 
+    for (unsigned num_threads = 2; num_threads <= kMaxThreads; num_threads *= 2) {
+        RunOnThreads("TRACE_DURATION_BEGIN macro with 0 arguments", num_threads, [] {
+            TRACE_DURATION_BEGIN("+enabled", "name");
+        });
+
+        RunOnThreads("TRACE_DURATION_BEGIN macro with 4 int32 arguments", num_threads, [] {
+            TRACE_DURATION_BEGIN("+enabled", "name",
+                                 "k1", 1, "k2", 2, "k3", 3, "k4", 4);
+        });
+    }
+
+    for (unsigned i = 0; i < kNumDistinctNames; i++)
+        snprintf(g_distinct_names[i], sizeof(g_distinct_names[i]), "name%u", i);
+    Run("TRACE_DURATION_BEGIN macro with 0 arguments and many distinct names", [] {
+        static unsigned next;
+        TRACE_DURATION_BEGIN("+enabled", g_distinct_names[next++ % kNumDistinctNames]);
+    });
+
     if (tracing_enabled) {
         Run("TRACE_DURATION_BEGIN macro with 0 arguments for disabled category", [] {
             TRACE_DURATION_BEGIN("-disabled", "name");
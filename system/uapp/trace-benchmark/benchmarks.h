@@ -5,11 +5,14 @@
 #pragma once
 
 #include <stdio.h>
+#include <threads.h>
 
+#include <zircon/assert.h>
 #include <zircon/syscalls.h>
 
 static constexpr unsigned kWarmUpIterations = 100;
 static constexpr unsigned kRunIterations = 1000000;
+static constexpr unsigned kMaxThreads = 8;
 
 // Measures how long it takes to run some number of iterations of a closure.
 // Returns a value in microseconds.
@@ -38,6 +41,39 @@ void Run(const char* test_name, const T& closure) {
            kRunIterations, run_time, run_time / kRunIterations);
 }
 
+// Runs a closure repeatedly on several threads at once and prints its
+// timing on each thread, averaged across the threads.
+template <typename T>
+void RunOnThreads(const char* test_name, unsigned num_threads, const T& closure) {
+    ZX_DEBUG_ASSERT(num_threads <= kMaxThreads);
+    printf("* %s on %u threads...\n", test_name, num_threads);
+
+    struct ThreadState {
+        const T* closure;
+        float run_time;
+    } states[kMaxThreads];
+    thrd_t threads[kMaxThreads];
+    for (unsigned i = 0; i < num_threads; i++) {
+        states[i] = ThreadState{&closure, 0.f};
+        int result = thrd_create(&threads[i], [](void* arg) {
+            auto state = static_cast<ThreadState*>(arg);
+            Measure(kWarmUpIterations, *state->closure);
+            state->run_time = Measure(kRunIterations, *state->closure);
+            return 0;
+        }, &states[i]);
+        ZX_ASSERT(result == thrd_success);
+    }
+
+    float run_time = 0.f;
+    for (unsigned i = 0; i < num_threads; i++) {
+        thrd_join(threads[i], nullptr);
+        run_time += states[i].run_time;
+    }
+    run_time /= static_cast<float>(num_threads);
+    printf("  - run: %u iterations per thread in %.1f us, %.3f us per iteration\n\n",
+           kRunIterations, run_time, run_time / kRunIterations);
+}
+
 // Runs benchmarks which need tracing disabled.
 void RunTracingDisabledBenchmarks();
 
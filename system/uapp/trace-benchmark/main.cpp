@@ -18,7 +18,8 @@
 namespace {
 
 // Trace buffer size.
-// Should be sized so it does not overflow during the test.
+// In oneshot mode, records are dropped once the buffer fills; circular mode
+// keeps writing them for the whole run.
 static constexpr size_t kBufferSizeBytes = 16 * 1024 * 1024;
 
 class BenchmarkHandler : public trace::TraceHandler {
@@ -27,12 +28,12 @@ public:
         : loop_(loop), buffer_(new uint8_t[kBufferSizeBytes], kBufferSizeBytes) {
     }
 
-    void Start() {
-        zx_status_t status = trace_start_engine(loop_->async(), this,
-                                                buffer_.get(), buffer_.size());
+    void Start(trace_buffering_mode_t mode, const char* mode_name) {
+        zx_status_t status = trace_start_engine_with_mode(loop_->async(), this, mode,
+                                                          buffer_.get(), buffer_.size());
         ZX_DEBUG_ASSERT(status == ZX_OK);
 
-        puts("\nTrace started\n");
+        printf("\nTrace started in %s mode\n\n", mode_name);
     }
 
 private:
@@ -54,6 +55,24 @@ private:
     fbl::Array<uint8_t> buffer_;
 };
 
+// Runs the tracing enabled benchmarks, then stops the trace and waits for
+// it to finish.
+void RunTraced(async::Loop* loop, bool run_ntrace) {
+    async::Task task(0u);
+    task.set_handler([run_ntrace](async_t* async, zx_status_t status) {
+        RunTracingEnabledBenchmarks();
+        if (run_ntrace)
+            RunNoTraceBenchmarks();
+
+        trace_stop_engine(ZX_OK);
+        return ASYNC_TASK_FINISHED;
+    });
+    task.Post(loop->async());
+
+    loop->Run(); // run until quit
+    loop->ResetQuit();
+}
+
 } // namespace
 
 int main(int argc, char** argv) {
@@ -61,18 +80,11 @@ int main(int argc, char** argv) {
     BenchmarkHandler handler(&loop);
 
     RunTracingDisabledBenchmarks();
-    handler.Start();
-
-    async::Task task(0u);
-    task.set_handler([](async_t* async, zx_status_t status) {
-        RunTracingEnabledBenchmarks();
-        RunNoTraceBenchmarks();
 
-        trace_stop_engine(ZX_OK);
-        return ASYNC_TASK_FINISHED;
-    });
-    task.Post(loop.async());
+    handler.Start(TRACE_BUFFERING_MODE_ONESHOT, "oneshot");
+    RunTraced(&loop, true);
 
-    loop.Run(); // run until quit
+    handler.Start(TRACE_BUFFERING_MODE_CIRCULAR, "circular");
+    RunTraced(&loop, false);
     return 0;
 }
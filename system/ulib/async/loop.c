@@ -38,6 +38,15 @@ typedef struct thread_record {
     thrd_t thread;
 } thread_record_t;
 
+// An entry in the pending task heap.  The deadline is copied out of the task
+// so that sifting does not need to touch each task, and the sequence number
+// breaks ties so that tasks with equal deadlines run in the order posted.
+typedef struct task_entry {
+    zx_time_t deadline;
+    uint64_t seq;
+    async_task_t* task;
+} task_entry_t;
+
 typedef struct async_loop {
     async_t async; // must be first
     async_loop_config_t config; // immutable
@@ -47,12 +56,19 @@ typedef struct async_loop {
     _Atomic async_loop_state_t state;
     atomic_uint active_threads; // number of active dispatch threads
 
-    mtx_t lock; // guards the lists and the dispatching tasks flag
-    bool dispatching_tasks; // true while the loop is busy dispatching tasks
+    mtx_t lock; // guards the wait and thread lists
     list_node_t wait_list; // most recently added first
-    list_node_t task_list; // pending tasks, earliest deadline first
-    list_node_t due_list; // due tasks, earliest deadline first
     list_node_t thread_list; // earliest created thread first
+
+    // Tasks have a lock of their own so that threads dispatching waits and
+    // packets do not contend with the thread dispatching tasks.
+    mtx_t task_lock; // guards the task heap, the due list, and the dispatching tasks flag
+    atomic_bool dispatching_tasks; // true while the loop is busy dispatching tasks
+    task_entry_t* task_heap; // pending tasks, min-heap ordered by deadline then sequence
+    size_t task_count; // number of entries in |task_heap|
+    size_t task_capacity; // number of entries allocated for |task_heap|
+    uint64_t task_seq; // sequence number of the next task to be posted
+    list_node_t due_list; // due tasks, earliest deadline first
 } async_loop_t;
 
 static zx_status_t async_loop_run_once(async_loop_t* loop, zx_time_t deadline);
@@ -63,7 +79,8 @@ static zx_status_t async_loop_dispatch_packet(async_loop_t* loop, async_receiver
                                               zx_status_t status, const zx_packet_user_t* data);
 static void async_loop_wake_threads(async_loop_t* loop);
 static zx_status_t async_loop_wait_async(async_loop_t* loop, async_wait_t* wait);
-static void async_loop_insert_task_locked(async_loop_t* loop, async_task_t* task);
+static zx_status_t async_loop_insert_task_locked(async_loop_t* loop, async_task_t* task);
+static void async_loop_remove_task_locked(async_loop_t* loop, size_t index);
 static void async_loop_restart_timer_locked(async_loop_t* loop);
 static void async_loop_invoke_prologue(async_loop_t* loop);
 static void async_loop_invoke_epilogue(async_loop_t* loop);
@@ -96,6 +113,28 @@ static inline async_task_t* node_to_task(list_node_t* node) {
     return FROM_NODE(async_task_t, node);
 }
 
+// A pending task records its position in the heap in its state so that it
+// can be canceled in O(log n).  The second word is zero while the task is in
+// the heap, which distinguishes it from a task on |due_list| (whose list node
+// has two non-null links) and from an idle task (whose state is all zero).
+static inline bool task_in_heap(async_task_t* task) {
+    return task->state.reserved[0] != 0u && task->state.reserved[1] == 0u;
+}
+
+static inline size_t task_heap_index(async_task_t* task) {
+    return task->state.reserved[0] - 1u;
+}
+
+static inline void task_set_heap_index(async_task_t* task, size_t index) {
+    task->state.reserved[0] = index + 1u;
+    task->state.reserved[1] = 0u;
+}
+
+static inline void task_clear_state(async_task_t* task) {
+    task->state.reserved[0] = 0u;
+    task->state.reserved[1] = 0u;
+}
+
 zx_status_t async_loop_create(const async_loop_config_t* config, async_t** out_async) {
     ZX_DEBUG_ASSERT(out_async);
 
@@ -104,13 +143,14 @@ zx_status_t async_loop_create(const async_loop_config_t* config, async_t** out_a
         return ZX_ERR_NO_MEMORY;
     atomic_init(&loop->state, ASYNC_LOOP_RUNNABLE);
     atomic_init(&loop->active_threads, 0u);
+    atomic_init(&loop->dispatching_tasks, false);
 
     loop->async.ops = &async_loop_ops;
     if (config)
         loop->config = *config;
     mtx_init(&loop->lock, mtx_plain);
+    mtx_init(&loop->task_lock, mtx_plain);
     list_initialize(&loop->wait_list);
-    list_initialize(&loop->task_list);
     list_initialize(&loop->due_list);
     list_initialize(&loop->thread_list);
 
@@ -144,6 +184,8 @@ void async_loop_destroy(async_t* async) {
     zx_handle_close(loop->port);
     zx_handle_close(loop->timer);
     mtx_destroy(&loop->lock);
+    mtx_destroy(&loop->task_lock);
+    free(loop->task_heap);
     free(loop);
 }
 
@@ -176,8 +218,9 @@ void async_loop_shutdown(async_t* async) {
             async_loop_invoke_epilogue(loop);
         }
     }
-    while ((node = list_remove_head(&loop->task_list))) {
-        async_task_t* task = node_to_task(node);
+    while (loop->task_count) {
+        async_task_t* task = loop->task_heap[0].task;
+        async_loop_remove_task_locked(loop, 0u);
         if (task->flags & ASYNC_FLAG_HANDLE_SHUTDOWN) {
             async_loop_invoke_prologue(loop);
             async_loop_invoke_task_handler(loop, task, ZX_ERR_CANCELED);
@@ -289,61 +332,63 @@ static zx_status_t async_loop_dispatch_tasks(async_loop_t* loop) {
     // to cancel a later task which has also come due.  At most one thread
     // can dispatch tasks at any given moment (to preserve serial ordering).
     // Timer restarts are suppressed until we run out of tasks to dispatch.
-    mtx_lock(&loop->lock);
-    if (!loop->dispatching_tasks) {
-        loop->dispatching_tasks = true;
+    //
+    // Other threads woken by the timer while tasks are being dispatched can
+    // return without taking the lock: the dispatching thread restarts the
+    // timer once it is done, which covers any tasks that came due meanwhile.
+    if (atomic_load_explicit(&loop->dispatching_tasks, memory_order_acquire))
+        return ZX_OK;
+
+    mtx_lock(&loop->task_lock);
+    if (!atomic_load_explicit(&loop->dispatching_tasks, memory_order_relaxed)) {
+        atomic_store_explicit(&loop->dispatching_tasks, true, memory_order_release);
 
         // Extract all of the tasks that are due into |due_list| for dispatch
         // unless we already have some waiting from a previous iteration which
         // we would like to process in order.
-        list_node_t* node;
         if (list_is_empty(&loop->due_list)) {
             zx_time_t due_time = zx_clock_get(ZX_CLOCK_MONOTONIC);
-            list_node_t* tail = NULL;
-            list_for_every(&loop->task_list, node) {
-                if (node_to_task(node)->deadline > due_time)
-                    break;
-                tail = node;
-            }
-            if (tail) {
-                list_node_t* head = loop->task_list.next;
-                loop->task_list.next = tail->next;
-                tail->next->prev = &loop->task_list;
-                loop->due_list.next = head;
-                head->prev = &loop->due_list;
-                loop->due_list.prev = tail;
-                tail->next = &loop->due_list;
+            while (loop->task_count && loop->task_heap[0].deadline <= due_time) {
+                async_task_t* task = loop->task_heap[0].task;
+                async_loop_remove_task_locked(loop, 0u);
+                list_add_tail(&loop->due_list, task_to_node(task));
             }
         }
 
         // Dispatch all due tasks.  Note that they might be canceled concurrently
         // so we need to grab the lock during each iteration to fetch the next
-        // item from the list.
+        // item from the list.  Repeating tasks are requeued in the same critical
+        // section so that each task costs a single lock acquisition.
+        list_node_t* node;
         while ((node = list_remove_head(&loop->due_list))) {
             async_task_t* task = node_to_task(node);
-            mtx_unlock(&loop->lock);
+            mtx_unlock(&loop->task_lock);
 
             // Invoke the handler.  Note that it might destroy itself.
             async_loop_invoke_prologue(loop);
             async_task_result_t result = async_loop_invoke_task_handler(loop, task, ZX_OK);
-
-            mtx_lock(&loop->lock);
-            if (result == ASYNC_TASK_REPEAT)
-                async_loop_insert_task_locked(loop, task);
-            mtx_unlock(&loop->lock);
-
             async_loop_invoke_epilogue(loop);
 
-            mtx_lock(&loop->lock);
+            mtx_lock(&loop->task_lock);
+            if (result == ASYNC_TASK_REPEAT) {
+                zx_status_t status = async_loop_insert_task_locked(loop, task);
+                if (status != ZX_OK) {
+                    mtx_unlock(&loop->task_lock);
+                    async_loop_invoke_prologue(loop);
+                    async_loop_invoke_task_handler(loop, task, status);
+                    async_loop_invoke_epilogue(loop);
+                    mtx_lock(&loop->task_lock);
+                }
+            }
             async_loop_state_t state = atomic_load_explicit(&loop->state, memory_order_acquire);
             if (state != ASYNC_LOOP_RUNNABLE)
                 break;
         }
 
-        loop->dispatching_tasks = false;
+        atomic_store_explicit(&loop->dispatching_tasks, false, memory_order_release);
         async_loop_restart_timer_locked(loop);
     }
-    mtx_unlock(&loop->lock);
+    mtx_unlock(&loop->task_lock);
     return ZX_OK;
 }
 
@@ -474,17 +519,18 @@ static zx_status_t async_loop_post_task(async_t* async, async_task_t* task) {
     if (atomic_load_explicit(&loop->state, memory_order_acquire) == ASYNC_LOOP_SHUTDOWN)
         return ZX_ERR_BAD_STATE;
 
-    mtx_lock(&loop->lock);
+    mtx_lock(&loop->task_lock);
 
-    async_loop_insert_task_locked(loop, task);
-    if (!loop->dispatching_tasks &&
-        task_to_node(task)->prev == &loop->task_list) {
+    zx_status_t status = async_loop_insert_task_locked(loop, task);
+    if (status == ZX_OK &&
+        !atomic_load_explicit(&loop->dispatching_tasks, memory_order_relaxed) &&
+        task_heap_index(task) == 0u) {
         // Task inserted at head.  Earliest deadline changed.
         async_loop_restart_timer_locked(loop);
     }
 
-    mtx_unlock(&loop->lock);
-    return ZX_OK;
+    mtx_unlock(&loop->task_lock);
+    return status;
 }
 
 static zx_status_t async_loop_cancel_task(async_t* async, async_task_t* task) {
@@ -496,25 +542,29 @@ static zx_status_t async_loop_cancel_task(async_t* async, async_task_t* task) {
     // destroyed in case the client is counting on the handler not being
     // invoked again past this point.  Also, the task we're removing here
     // might be present in the dispatcher's |due_list| if it is pending
-    // dispatch instead of in the loop's |task_list| as usual.  The same
-    // logic works in both cases.
-
-    mtx_lock(&loop->lock);
-    list_node_t* node = task_to_node(task);
-    if (!list_in_list(node)) {
-        mtx_unlock(&loop->lock);
-        return ZX_ERR_NOT_FOUND;
-    }
-
-    if (!loop->dispatching_tasks &&
-        node->prev == &loop->task_list &&
-        node->next != &loop->task_list &&
-        node_to_task(node->next)->deadline > task->deadline) {
-        // The head task was canceled and following task has a later deadline.
-        async_loop_restart_timer_locked(loop);
+    // dispatch instead of in the loop's |task_heap| as usual.
+
+    mtx_lock(&loop->task_lock);
+    if (task_in_heap(task)) {
+        size_t index = task_heap_index(task);
+        ZX_DEBUG_ASSERT(index < loop->task_count && loop->task_heap[index].task == task);
+        zx_time_t deadline = loop->task_heap[index].deadline;
+        async_loop_remove_task_locked(loop, index);
+        if (!atomic_load_explicit(&loop->dispatching_tasks, memory_order_relaxed) &&
+            index == 0u && loop->task_count &&
+            loop->task_heap[0].deadline > deadline) {
+            // The head task was canceled and following task has a later deadline.
+            async_loop_restart_timer_locked(loop);
+        }
+    } else {
+        list_node_t* node = task_to_node(task);
+        if (!list_in_list(node)) {
+            mtx_unlock(&loop->task_lock);
+            return ZX_ERR_NOT_FOUND;
+        }
+        list_delete(node);
     }
-    list_delete(node);
-    mtx_unlock(&loop->lock);
+    mtx_unlock(&loop->task_lock);
     return ZX_OK;
 }
 
@@ -542,27 +592,89 @@ static zx_status_t async_loop_wait_async(async_loop_t* loop, async_wait_t* wait)
                                 ZX_WAIT_ASYNC_ONCE);
 }
 
-static void async_loop_insert_task_locked(async_loop_t* loop, async_task_t* task) {
-    // TODO(ZX-976): We assume that tasks are inserted in quasi-monotonic order and
-    // that insertion into the task queue will typically take no more than a few steps.
-    // If this assumption proves false and the cost of insertion becomes a problem, we
-    // should consider using a more efficient representation for maintaining order.
-    list_node_t* node;
-    for (node = loop->task_list.prev; node != &loop->task_list; node = node->prev) {
-        if (task->deadline >= node_to_task(node)->deadline)
+static inline bool task_entry_before(const task_entry_t* a, const task_entry_t* b) {
+    return a->deadline < b->deadline || (a->deadline == b->deadline && a->seq < b->seq);
+}
+
+static inline void async_loop_place_task_locked(async_loop_t* loop, size_t index,
+                                                task_entry_t entry) {
+    loop->task_heap[index] = entry;
+    task_set_heap_index(entry.task, index);
+}
+
+static void async_loop_sift_up_locked(async_loop_t* loop, size_t index) {
+    task_entry_t entry = loop->task_heap[index];
+    while (index > 0u) {
+        size_t parent = (index - 1u) / 2u;
+        if (!task_entry_before(&entry, &loop->task_heap[parent]))
+            break;
+        async_loop_place_task_locked(loop, index, loop->task_heap[parent]);
+        index = parent;
+    }
+    async_loop_place_task_locked(loop, index, entry);
+}
+
+static void async_loop_sift_down_locked(async_loop_t* loop, size_t index) {
+    task_entry_t entry = loop->task_heap[index];
+    for (;;) {
+        size_t child = index * 2u + 1u;
+        if (child >= loop->task_count)
             break;
+        if (child + 1u < loop->task_count &&
+            task_entry_before(&loop->task_heap[child + 1u], &loop->task_heap[child]))
+            child++;
+        if (!task_entry_before(&loop->task_heap[child], &entry))
+            break;
+        async_loop_place_task_locked(loop, index, loop->task_heap[child]);
+        index = child;
+    }
+    async_loop_place_task_locked(loop, index, entry);
+}
+
+static zx_status_t async_loop_insert_task_locked(async_loop_t* loop, async_task_t* task) {
+    if (loop->task_count == loop->task_capacity) {
+        size_t capacity = loop->task_capacity ? loop->task_capacity * 2u : 16u;
+        task_entry_t* heap = realloc(loop->task_heap, capacity * sizeof(task_entry_t));
+        if (!heap)
+            return ZX_ERR_NO_MEMORY;
+        loop->task_heap = heap;
+        loop->task_capacity = capacity;
+    }
+
+    size_t index = loop->task_count++;
+    loop->task_heap[index] = (task_entry_t){
+        .deadline = task->deadline,
+        .seq = loop->task_seq++,
+        .task = task};
+    async_loop_sift_up_locked(loop, index);
+    return ZX_OK;
+}
+
+static void async_loop_remove_task_locked(async_loop_t* loop, size_t index) {
+    ZX_DEBUG_ASSERT(index < loop->task_count);
+
+    task_clear_state(loop->task_heap[index].task);
+    size_t last = --loop->task_count;
+    if (index == last)
+        return;
+
+    // Move the last entry into the hole, then restore the heap property in
+    // whichever direction it was violated.
+    loop->task_heap[index] = loop->task_heap[last];
+    if (index > 0u &&
+        task_entry_before(&loop->task_heap[index], &loop->task_heap[(index - 1u) / 2u])) {
+        async_loop_sift_up_locked(loop, index);
+    } else {
+        async_loop_sift_down_locked(loop, index);
     }
-    list_add_after(node, task_to_node(task));
 }
 
 static void async_loop_restart_timer_locked(async_loop_t* loop) {
     zx_time_t deadline;
     if (list_is_empty(&loop->due_list)) {
-        list_node_t* head = list_peek_head(&loop->task_list);
-        if (!head)
+        if (!loop->task_count)
             return;
-        async_task_t* task = node_to_task(head);
-        deadline = task->deadline;
+        deadline = loop->task_heap[0].deadline;
         if (deadline == ZX_TIME_INFINITE)
             return;
     } else {
@@ -14,6 +14,7 @@
 #include <zircon/assert.h>
 #include <zircon/types.h>
 #include <fbl/algorithm.h>
+#include <fbl/array.h>
 #include <fbl/macros.h>
 #include <fbl/type_support.h>
 
@@ -31,6 +32,11 @@ constexpr size_t LastIdx(size_t bitmax) {
     return (bitmax - 1) / kBits;
 }
 
+// The number of summary levels maintained by summarized bitmaps.  Level 0 has
+// one bit per word of the bitmap, and each subsequent level has one bit per
+// word of the level below it.
+const size_t kSummaryLevels = 2;
+
 // Base class for RawGenericBitmap, to reduce what needs to be templated.
 class RawBitmapBase : public Bitmap {
 public:
@@ -72,11 +78,36 @@ public:
     // Clear all bits in the bitmap.
     void ClearAll() override;
 
+    // Recomputes the summary of the bitmap, if it has one.  This must be
+    // called after the underlying storage is modified directly, e.g. after
+    // reading the bitmap from disk.
+    void RebuildSummary();
+
 protected:
+    // Allocates summary levels for the current storage size in |storage|, and
+    // builds them from the bitmap.  The summary only speeds up searches, so if
+    // it cannot be allocated it is dropped, and the bitmap continues to work
+    // without it.
+    void ResetSummary(fbl::Array<size_t>* storage);
+
+    // Updates the summary bits covering words [first_idx, last_idx] of the
+    // bitmap.
+    void UpdateSummary(size_t first_idx, size_t last_idx);
+
     // The size of this bitmap, in bits.
     size_t size_ = 0;
     // Owned by bits_, cached
     size_t* data_ = nullptr;
+
+    // Summary levels, owned by the derived class and cached.  A bit is set in
+    // |full_[l]| if the word it covers in the level below is all ones, and in
+    // |empty_[l]| if that word is all zeros (at level 0) or if the word in
+    // |empty_[l - 1]| is all ones.  These are null for bitmaps without a
+    // summary.
+    size_t* full_[kSummaryLevels] = {};
+    size_t* empty_[kSummaryLevels] = {};
+    // The number of bits in each summary level.
+    size_t summary_bits_[kSummaryLevels] = {};
 };
 
 // A simple bitmap backed by generic storage.
@@ -87,7 +118,13 @@ protected:
 //      To access the underlying storage.
 //   - zx_status_t Grow(size_t size)
 //      (optional) To expand the underlying storage to fit at least |size| bytes.
-template <typename Storage>
+//
+// If |Summarized| is true, the bitmap additionally maintains in-memory summary
+// levels which track fully set and fully clear words, allowing |Scan| and
+// |Find| to skip over large uniform regions rather than reading every word.
+// The summary is kept outside of |Storage|, so the storage layout is the same
+// either way.
+template <typename Storage, bool Summarized = false>
 class RawBitmapGeneric final : public RawBitmapBase {
 public:
     RawBitmapGeneric() = default;
@@ -125,6 +162,9 @@ public:
 
         // Clear the partial bits not included in the new "size_t"s.
         Clear(old_size, fbl::min(old_len * kBits, size_));
+        if (Summarized) {
+            ResetSummary(&summary_);
+        }
         return ZX_OK;
     }
 
@@ -140,6 +180,9 @@ public:
         size_ = size;
         if (size_ == 0) {
             data_ = nullptr;
+            if (Summarized) {
+                ResetSummary(&summary_);
+            }
             return ZX_OK;
         }
         size_t last_idx = LastIdx(size);
@@ -148,6 +191,9 @@ public:
             return status;
         }
         data_ = static_cast<size_t*>(bits_.GetData());
+        if (Summarized) {
+            ResetSummary(&summary_);
+        }
         ClearAll();
         return ZX_OK;
     }
@@ -160,6 +206,12 @@ public:
 private:
     // The storage backing this bitmap.
     Storage bits_;
+    // The storage backing the summary levels, if any.
+    fbl::Array<size_t> summary_;
 };
 
+// A bitmap with summary levels; see RawBitmapGeneric.
+template <typename Storage>
+using SummarizedRawBitmapGeneric = RawBitmapGeneric<Storage, true>;
+
 } // namespace bitmap
@@ -10,6 +10,7 @@
 
 #include <zircon/types.h>
 #include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
 #include <fbl/macros.h>
 
 namespace {
@@ -57,10 +58,108 @@ size_t CountZeros(size_t idx, size_t value) {
 }
 #undef CTZ
 
+// Returns the number of words needed to hold |bits| bits.
+constexpr size_t WordCount(size_t bits) {
+    return (bits + bitmap::kBits - 1) / bitmap::kBits;
+}
+
+// Sets or clears bit |bit| of |words|.
+void AssignBit(size_t* words, size_t bit, bool value) {
+    size_t mask = static_cast<size_t>(1) << (bit % bitmap::kBits);
+    if (value) {
+        words[bit / bitmap::kBits] |= mask;
+    } else {
+        words[bit / bitmap::kBits] &= ~mask;
+    }
+}
+
+// Returns the lesser of |end| and the index of the first bit at or after
+// |bit| in summary level |level| of |skip| which is not set, i.e. the first
+// word in the level below which can not be skipped.  Whole words of this level
+// which are set are in turn skipped using the level above.
+size_t SkipWords(const size_t* const* skip, size_t level, size_t bit, size_t end) {
+    const size_t* words = skip[level];
+    while (bit < end) {
+        size_t idx = FirstIdx(bit);
+        size_t value = ~words[idx] & GetMask(true, false, bit, 0);
+        if (value != 0) {
+            return fbl::min(end, CountZeros(idx, value));
+        }
+        bit = (idx + 1) * bitmap::kBits;
+        if (level + 1 < bitmap::kSummaryLevels && bit < end) {
+            bit = SkipWords(skip, level + 1, idx + 1, WordCount(end)) * bitmap::kBits;
+        }
+    }
+    return end;
+}
+
 } // namespace
 
 namespace bitmap {
 
+void RawBitmapBase::RebuildSummary() {
+    if (full_[0] == nullptr) {
+        return;
+    }
+    UpdateSummary(0, summary_bits_[0] - 1);
+}
+
+void RawBitmapBase::ResetSummary(fbl::Array<size_t>* storage) {
+    storage->reset();
+    for (size_t level = 0; level < kSummaryLevels; ++level) {
+        full_[level] = nullptr;
+        empty_[level] = nullptr;
+        summary_bits_[level] = 0;
+    }
+    if (size_ == 0) {
+        return;
+    }
+
+    size_t words[kSummaryLevels];
+    size_t total = 0;
+    size_t bits = LastIdx(size_) + 1;
+    for (size_t level = 0; level < kSummaryLevels; ++level) {
+        words[level] = WordCount(bits);
+        summary_bits_[level] = bits;
+        total += 2 * words[level];
+        bits = words[level];
+    }
+    fbl::AllocChecker ac;
+    size_t* summary = new (&ac) size_t[total];
+    if (!ac.check()) {
+        for (size_t level = 0; level < kSummaryLevels; ++level) {
+            summary_bits_[level] = 0;
+        }
+        return;
+    }
+    memset(summary, 0, total * sizeof(size_t));
+    storage->reset(summary, total);
+    for (size_t level = 0; level < kSummaryLevels; ++level) {
+        full_[level] = summary;
+        summary += words[level];
+        empty_[level] = summary;
+        summary += words[level];
+    }
+    RebuildSummary();
+}
+
+void RawBitmapBase::UpdateSummary(size_t first_idx, size_t last_idx) {
+    const size_t ones = ~static_cast<size_t>(0);
+    for (size_t level = 0; level < kSummaryLevels; ++level) {
+        for (size_t i = first_idx; i <= last_idx; ++i) {
+            if (level == 0) {
+                AssignBit(full_[0], i, data_[i] == ones);
+                AssignBit(empty_[0], i, data_[i] == 0);
+            } else {
+                AssignBit(full_[level], i, full_[level - 1][i] == ones);
+                AssignBit(empty_[level], i, empty_[level - 1][i] == ones);
+            }
+        }
+        first_idx /= kBits;
+        last_idx /= kBits;
+    }
+}
+
 zx_status_t RawBitmapBase::Shrink(size_t size) {
     if (size > size_) {
         return ZX_ERR_NO_MEMORY;
@@ -76,9 +175,18 @@ size_t RawBitmapBase::Scan(size_t bitoff, size_t bitmax, bool is_set) const {
     }
     size_t first_idx = FirstIdx(bitoff);
     size_t last_idx = LastIdx(bitmax);
+    // Words which are entirely |is_set| can be skipped using the summary.
+    const size_t* const* skip = is_set ? full_ : empty_;
     size_t i = first_idx;
     size_t value = 0;
     for (i = first_idx; i <= last_idx; ++i) {
+        if (i != first_idx && skip[0] != nullptr) {
+            i = SkipWords(skip, 0, i, last_idx + 1);
+            if (i > last_idx) {
+                value = 0;
+                break;
+            }
+        }
         value = GetMask(i == first_idx, i == last_idx, bitoff, bitmax);
         if (is_set) {
             // If is_set=true, invert the mask, OR it with the value, and invert
@@ -136,6 +244,9 @@ zx_status_t RawBitmapBase::Set(size_t bitoff, size_t bitmax) {
         data_[i] |=
                 GetMask(i == first_idx, i == last_idx, bitoff, bitmax);
     }
+    if (full_[0] != nullptr) {
+        UpdateSummary(first_idx, last_idx);
+    }
     return ZX_OK;
 }
 
@@ -152,6 +263,9 @@ zx_status_t RawBitmapBase::Clear(size_t bitoff, size_t bitmax) {
         data_[i] &=
                 ~(GetMask(i == first_idx, i == last_idx, bitoff, bitmax));
     }
+    if (full_[0] != nullptr) {
+        UpdateSummary(first_idx, last_idx);
+    }
     return ZX_OK;
 }
 
@@ -163,6 +277,7 @@ void RawBitmapBase::ClearAll() {
     for (size_t i = 0; i <= last_idx; ++i) {
         data_[i] = 0;
     }
+    RebuildSummary();
 }
 
 } // namespace bitmap
@@ -20,6 +20,7 @@
 #include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <fbl/array.h>
+#include <fbl/atomic.h>
 #include <fbl/limits.h>
 #include <fbl/unique_ptr.h>
 #include <pretty/hexdump.h>
@@ -400,6 +401,171 @@ bool close_vmo_helper(fifo_client_t* client, test_vmo_object_t* obj, txnid_t txn
     return true;
 }
 
+bool blkdev_test_fifo_sync(void) {
+    BEGIN_TEST;
+    uint64_t blk_size, blk_count;
+    int fd = get_testdev(&blk_size, &blk_count);
+    zx_handle_t fifo;
+    ssize_t expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+    txnid_t txnid;
+    expected = sizeof(txnid_t);
+    ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnid), expected, "Failed to allocate txn");
+
+    constexpr size_t kBlocks = 8;
+    uint64_t vmo_size = blk_size * kBlocks;
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(vmo_size, 0, &vmo), ZX_OK, "Failed to create VMO");
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[vmo_size]);
+    ASSERT_TRUE(ac.check(), "");
+    fill_random(buf.get(), vmo_size);
+    size_t actual;
+    ASSERT_EQ(zx_vmo_write(vmo, buf.get(), 0, vmo_size, &actual), ZX_OK, "");
+
+    vmoid_t vmoid;
+    expected = sizeof(vmoid_t);
+    zx_handle_t xfer_vmo;
+    ASSERT_EQ(zx_handle_duplicate(vmo, ZX_RIGHT_SAME_RIGHTS, &xfer_vmo), ZX_OK, "");
+    ASSERT_EQ(ioctl_block_attach_vmo(fd, &xfer_vmo, &vmoid), expected,
+              "Failed to attach vmo");
+
+    // Write adjacent blocks in reverse order, so they may be reordered and
+    // merged by the server, followed by a barrier in the same transaction.
+    block_fifo_request_t requests[kBlocks + 1];
+    for (size_t i = 0; i < kBlocks; i++) {
+        requests[i].txnid      = txnid;
+        requests[i].vmoid      = vmoid;
+        requests[i].opcode     = BLOCKIO_WRITE;
+        requests[i].length     = 1;
+        requests[i].vmo_offset = kBlocks - 1 - i;
+        requests[i].dev_offset = kBlocks - 1 - i;
+    }
+    requests[kBlocks].txnid      = txnid;
+    requests[kBlocks].vmoid      = VMOID_INVALID;
+    requests[kBlocks].opcode     = BLOCKIO_SYNC;
+    requests[kBlocks].length     = 0;
+    requests[kBlocks].vmo_offset = 0;
+    requests[kBlocks].dev_offset = 0;
+
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), ZX_OK, "");
+    ASSERT_EQ(block_fifo_txn(client, &requests[0], fbl::count_of(requests)), ZX_OK, "");
+
+    // A barrier on its own is also valid.
+    ASSERT_EQ(block_fifo_txn(client, &requests[kBlocks], 1), ZX_OK, "");
+
+    // Read the blocks back in a single request.
+    fbl::unique_ptr<uint8_t[]> out(new (&ac) uint8_t[vmo_size]());
+    ASSERT_TRUE(ac.check(), "");
+    ASSERT_EQ(zx_vmo_write(vmo, out.get(), 0, vmo_size, &actual), ZX_OK, "");
+    requests[0].opcode     = BLOCKIO_READ;
+    requests[0].length     = kBlocks;
+    requests[0].vmo_offset = 0;
+    requests[0].dev_offset = 0;
+    ASSERT_EQ(block_fifo_txn(client, &requests[0], 1), ZX_OK, "");
+    ASSERT_EQ(zx_vmo_read(vmo, out.get(), 0, vmo_size, &actual), ZX_OK, "");
+    ASSERT_EQ(memcmp(buf.get(), out.get(), vmo_size), 0, "Read data not equal to written data");
+
+    requests[0].opcode = BLOCKIO_CLOSE_VMO;
+    ASSERT_EQ(block_fifo_txn(client, &requests[0], 1), ZX_OK, "");
+
+    ASSERT_EQ(zx_handle_close(vmo), ZX_OK, "");
+    block_fifo_release_client(client);
+    ASSERT_EQ(ioctl_block_fifo_close(fd), ZX_OK, "Failed to close fifo");
+    close(fd);
+    END_TEST;
+}
+
+static void async_complete(void* cookie, zx_status_t status) {
+    if (status == ZX_OK) {
+        static_cast<fbl::atomic<size_t>*>(cookie)->fetch_add(1);
+    }
+}
+
+bool blkdev_test_fifo_async(void) {
+    BEGIN_TEST;
+    uint64_t blk_size, blk_count;
+    int fd = get_testdev(&blk_size, &blk_count);
+    zx_handle_t fifo;
+    ssize_t expected = sizeof(fifo);
+    ASSERT_EQ(ioctl_block_get_fifos(fd, &fifo), expected, "Failed to get FIFO");
+
+    // Keep one single-block write in flight on each of several txnids.
+    constexpr size_t kTxns = 8;
+    txnid_t txnids[kTxns];
+    expected = sizeof(txnid_t);
+    for (size_t i = 0; i < kTxns; i++) {
+        ASSERT_EQ(ioctl_block_alloc_txn(fd, &txnids[i]), expected, "Failed to allocate txn");
+    }
+
+    uint64_t vmo_size = blk_size * kTxns;
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(vmo_size, 0, &vmo), ZX_OK, "Failed to create VMO");
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> buf(new (&ac) uint8_t[vmo_size]);
+    ASSERT_TRUE(ac.check(), "");
+    fill_random(buf.get(), vmo_size);
+    size_t actual;
+    ASSERT_EQ(zx_vmo_write(vmo, buf.get(), 0, vmo_size, &actual), ZX_OK, "");
+
+    vmoid_t vmoid;
+    expected = sizeof(vmoid_t);
+    zx_handle_t xfer_vmo;
+    ASSERT_EQ(zx_handle_duplicate(vmo, ZX_RIGHT_SAME_RIGHTS, &xfer_vmo), ZX_OK, "");
+    ASSERT_EQ(ioctl_block_attach_vmo(fd, &xfer_vmo, &vmoid), expected,
+              "Failed to attach vmo");
+
+    fifo_client_t* client;
+    ASSERT_EQ(block_fifo_create_client(fifo, &client), ZX_OK, "");
+
+    fbl::atomic<size_t> completed(0);
+    block_fifo_request_t request;
+    request.vmoid  = vmoid;
+    request.opcode = BLOCKIO_WRITE;
+    request.length = 1;
+    for (size_t i = 0; i < kTxns; i++) {
+        request.txnid      = txnids[i];
+        request.vmo_offset = i;
+        request.dev_offset = i;
+        ASSERT_EQ(block_fifo_txn_async(client, &request, 1, async_complete, &completed), ZX_OK,
+                  "");
+    }
+    // A txnid may only have one outstanding transaction.
+    request.txnid = txnids[0];
+    ASSERT_EQ(block_fifo_txn_async(client, &request, 1, nullptr, nullptr), ZX_ERR_UNAVAILABLE,
+              "");
+    for (size_t i = 0; i < kTxns; i++) {
+        ASSERT_EQ(block_fifo_wait(client, txnids[i]), ZX_OK, "");
+    }
+    ASSERT_EQ(completed.load(), kTxns, "Not all callbacks were invoked");
+
+    // Read everything back, and compare.
+    fbl::unique_ptr<uint8_t[]> out(new (&ac) uint8_t[vmo_size]());
+    ASSERT_TRUE(ac.check(), "");
+    ASSERT_EQ(zx_vmo_write(vmo, out.get(), 0, vmo_size, &actual), ZX_OK, "");
+    request.txnid      = txnids[0];
+    request.opcode     = BLOCKIO_READ;
+    request.length     = kTxns;
+    request.vmo_offset = 0;
+    request.dev_offset = 0;
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), ZX_OK, "");
+    ASSERT_EQ(zx_vmo_read(vmo, out.get(), 0, vmo_size, &actual), ZX_OK, "");
+    ASSERT_EQ(memcmp(buf.get(), out.get(), vmo_size), 0, "Read data not equal to written data");
+
+    request.opcode = BLOCKIO_CLOSE_VMO;
+    ASSERT_EQ(block_fifo_txn(client, &request, 1), ZX_OK, "");
+
+    for (size_t i = 0; i < kTxns; i++) {
+        ioctl_block_free_txn(fd, &txnids[i]);
+    }
+    ASSERT_EQ(zx_handle_close(vmo), ZX_OK, "");
+    block_fifo_release_client(client);
+    ASSERT_EQ(ioctl_block_fifo_close(fd), ZX_OK, "Failed to close fifo");
+    close(fd);
+    END_TEST;
+}
+
 bool blkdev_test_fifo_multiple_vmo(void) {
     BEGIN_TEST;
     // Set up the initial handshake connection with the blkdev
@@ -921,6 +1087,8 @@ RUN_TEST(blkdev_test_multiple)
 RUN_TEST(blkdev_test_fifo_no_op)
 RUN_TEST(blkdev_test_fifo_basic)
 //RUN_TEST(blkdev_test_fifo_whole_disk)
+RUN_TEST(blkdev_test_fifo_sync)
+RUN_TEST(blkdev_test_fifo_async)
 RUN_TEST(blkdev_test_fifo_multiple_vmo)
 RUN_TEST(blkdev_test_fifo_multiple_vmo_multithreaded)
 // TODO(smklein): Test ops across different vmos
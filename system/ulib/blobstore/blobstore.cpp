@@ -24,6 +24,7 @@
 #define ZXDEBUG 0
 
 #include <blobstore/blobstore.h>
+#include <blobstore/compression.h>
 
 using digest::Digest;
 using digest::MerkleTree;
@@ -151,14 +152,111 @@ zx_status_t VnodeBlob::InitVmos() {
         return status;
     }
 
+    if ((inode->flags & kBlobFlagLZ4Compressed) == 0) {
+        ReadTxn txn(blobstore_.get());
+        txn.Enqueue(vmoid_, 0, inode->start_block + DataStartBlock(blobstore_->info_),
+                    BlobDataBlocks(*inode) + MerkleTreeBlocks(*inode));
+        if ((status = txn.Flush()) != ZX_OK) {
+            return status;
+        }
+
+        return Verify();
+    }
+
+    // Compressed blobs are read into a separate VMO, and are decompressed
+    // into |blob_| (and verified) one range of chunks at a time, as they are
+    // accessed.
+    const uint64_t merkle_blocks = MerkleTreeBlocks(*inode);
+    if (inode->num_blocks <= merkle_blocks) {
+        FS_TRACE_ERROR("blobstore: Compressed blob has no data blocks\n");
+        BlobCloseHandles();
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    const uint64_t compressed_blocks = inode->num_blocks - merkle_blocks;
+    if ((status = MappedVmo::Create(compressed_blocks * kBlobstoreBlockSize, "blob-compressed",
+                                    &compressed_)) != ZX_OK) {
+        FS_TRACE_ERROR("Failed to initialize compressed vmo; error: %d\n", status);
+        BlobCloseHandles();
+        return status;
+    }
+    if ((status = blobstore_->AttachVmo(compressed_->GetVmo(), &compressed_vmoid_)) != ZX_OK) {
+        FS_TRACE_ERROR("Failed to attach VMO to block device; error: %d\n", status);
+        compressed_ = nullptr;
+        BlobCloseHandles();
+        return status;
+    }
+    if ((status = decompressed_.Reset(CompressedChunkCount(inode->blob_size))) != ZX_OK) {
+        ReleaseCompressed();
+        BlobCloseHandles();
+        return status;
+    }
+
+    const uint64_t dev_start = inode->start_block + DataStartBlock(blobstore_->info_);
     ReadTxn txn(blobstore_.get());
-    txn.Enqueue(vmoid_, 0, inode->start_block + DataStartBlock(blobstore_->info_),
-                BlobDataBlocks(*inode) + MerkleTreeBlocks(*inode));
+    if (merkle_blocks > 0) {
+        txn.Enqueue(vmoid_, 0, dev_start, merkle_blocks);
+    }
+    txn.Enqueue(compressed_vmoid_, 0, dev_start + merkle_blocks, compressed_blocks);
     if ((status = txn.Flush()) != ZX_OK) {
         return status;
     }
 
-    return Verify();
+    return CompressionCheck(compressed_->GetData(), compressed_->GetSize(), inode->blob_size);
+}
+
+zx_status_t VnodeBlob::EnsureDecompressed(uint64_t off, uint64_t len) {
+    if (compressed_ == nullptr) {
+        return ZX_OK;
+    }
+    TRACE_DURATION("blobstore", "Blobstore::EnsureDecompressed", "off", off, "len", len);
+
+    const blobstore_inode_t* inode = blobstore_->GetNode(map_index_);
+    const size_t chunk_count = decompressed_.size();
+    const size_t chunk_end = fbl::min(chunk_count, static_cast<size_t>(
+        fbl::round_up(off + len, kCompressionChunkSize) / kCompressionChunkSize));
+    size_t chunk = off / kCompressionChunkSize;
+
+    Digest d;
+    d = reinterpret_cast<const uint8_t*>(&digest_[0]);
+    while (chunk < chunk_end) {
+        // Find the next run of chunks which have not yet been decompressed.
+        size_t start = decompressed_.Scan(chunk, chunk_end, true);
+        if (start == chunk_end) {
+            break;
+        }
+        size_t end = decompressed_.Scan(start, chunk_end, false);
+
+        zx_status_t status = Decompress(compressed_->GetData(), compressed_->GetSize(),
+                                        inode->blob_size, start, end, GetData());
+        if (status != ZX_OK) {
+            return status;
+        }
+
+        // The Merkle tree describes the uncompressed data, so the freshly
+        // decompressed range can be verified independently of the rest.
+        uint64_t data_off = start * kCompressionChunkSize;
+        uint64_t data_end = fbl::min<uint64_t>(end * kCompressionChunkSize, inode->blob_size);
+        status = MerkleTree::Verify(GetData(), inode->blob_size, GetMerkle(),
+                                    MerkleTree::GetTreeLength(inode->blob_size), data_off,
+                                    data_end - data_off, d);
+        if (status != ZX_OK) {
+            return status;
+        }
+        decompressed_.Set(start, end);
+        chunk = end;
+    }
+
+    if (decompressed_.Get(0, chunk_count)) {
+        ReleaseCompressed();
+    }
+    return ZX_OK;
+}
+
+void VnodeBlob::ReleaseCompressed() {
+    if (compressed_ != nullptr) {
+        blobstore_->DetachVmo(compressed_vmoid_);
+        compressed_ = nullptr;
+    }
 }
 
 uint64_t VnodeBlob::SizeData() const {
@@ -205,6 +303,10 @@ zx_status_t VnodeBlob::SpaceAllocate(uint64_t size_data) {
     memset(inode->merkle_root_hash, 0, Digest::kLength);
     inode->blob_size = size_data;
     inode->num_blocks = MerkleTreeBlocks(*inode) + BlobDataBlocks(*inode);
+    inode->flags = 0;
+
+    // Blobs which fit within a single block cannot shrink when compressed.
+    compress_ = blobstore_->compress_ && BlobDataBlocks(*inode) > 1;
 
     // Open VMOs, so we can begin writing after allocate succeeds.
     if ((status = MappedVmo::Create(inode->num_blocks * kBlobstoreBlockSize, "blob", &blob_)) != ZX_OK) {
@@ -238,7 +340,60 @@ zx_status_t VnodeBlob::WriteShared(WriteTxn* txn, size_t start, size_t len, uint
     uint64_t n = start / kBlobstoreBlockSize;
     uint64_t n_end = (start + len + kBlobstoreBlockSize - 1) / kBlobstoreBlockSize;
     txn->Enqueue(vmoid_, n, n + start_block + DataStartBlock(blobstore_->info_), n_end - n);
-    return txn->Flush();
+    return txn->FlushAsync(this);
+}
+
+zx_status_t VnodeBlob::WriteCompressed(WriteTxn* txn) {
+    TRACE_DURATION("blobstore", "Blobstore::WriteCompressed");
+
+    blobstore_inode_t* inode = blobstore_->GetNode(map_index_);
+    const uint64_t merkle_blocks = MerkleTreeBlocks(*inode);
+    const uint64_t data_blocks = BlobDataBlocks(*inode);
+    const size_t buffer_max = fbl::round_up(CompressionBufferMax(inode->blob_size),
+                                            kBlobstoreBlockSize);
+
+    zx_status_t status;
+    size_t compressed_size;
+    if ((status = MappedVmo::Create(buffer_max, "blob-compressed", &compressed_)) != ZX_OK) {
+        return status;
+    } else if ((status = Compress(GetData(), inode->blob_size, compressed_->GetData(),
+                                  buffer_max, &compressed_size)) != ZX_OK) {
+        compressed_ = nullptr;
+        return status;
+    }
+
+    const uint64_t compressed_blocks = fbl::round_up(compressed_size, kBlobstoreBlockSize) /
+                                       kBlobstoreBlockSize;
+    if (compressed_blocks >= data_blocks) {
+        // Compression didn't save any space; store the blob as-is.
+        compressed_ = nullptr;
+        return WriteShared(txn, 0, (merkle_blocks + data_blocks) * kBlobstoreBlockSize,
+                           inode->start_block);
+    }
+
+    if ((status = blobstore_->AttachVmo(compressed_->GetVmo(), &compressed_vmoid_)) != ZX_OK) {
+        compressed_ = nullptr;
+        return status;
+    }
+
+    // Give back the tail of the allocation. These blocks have not yet been
+    // marked allocated on disk, since the bitmap is written in WriteMetadata.
+    blobstore_->FreeBlocks(data_blocks - compressed_blocks,
+                           inode->start_block + merkle_blocks + compressed_blocks);
+    inode->num_blocks = merkle_blocks + compressed_blocks;
+    inode->flags |= kBlobFlagLZ4Compressed;
+
+    const uint64_t dev_start = inode->start_block + DataStartBlock(blobstore_->info_);
+    if (merkle_blocks > 0) {
+        txn->Enqueue(vmoid_, 0, dev_start, merkle_blocks);
+    }
+    txn->Enqueue(compressed_vmoid_, 0, dev_start + merkle_blocks, compressed_blocks);
+    status = txn->Flush();
+
+    // The uncompressed blob remains in |blob_|, so the compressed copy is no
+    // longer needed.
+    ReleaseCompressed();
+    return status;
 }
 
 void* VnodeBlob::GetData() const {
@@ -256,10 +411,18 @@ zx_status_t VnodeBlob::WriteMetadata() {
 
     assert(GetState() == kBlobStateDataWrite);
 
+    // The blob's data and Merkle tree may still be in flight; they must reach
+    // the disk before the node which references them, and the blob must not
+    // become readable if any of them failed to.
+    zx_status_t status;
+    if ((status = blobstore_->TxnDrain(this)) != ZX_OK) {
+        return status;
+    }
+
     // All data has been written to the containing VMO
     SetState(kBlobStateReadable);
     if (readable_event_.is_valid()) {
-        zx_status_t status = readable_event_.signal(0u, ZX_USER_SIGNAL_0);
+        status = readable_event_.signal(0u, ZX_USER_SIGNAL_0);
         if (status != ZX_OK) {
             SetState(kBlobStateError);
             return status;
@@ -317,10 +480,13 @@ zx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actua
             return status;
         }
 
-        status = WriteShared(&txn, offset, len, inode->start_block);
-        if (status != ZX_OK) {
-            SetState(kBlobStateError);
-            return status;
+        // Compressed blobs are only written to disk once all data is present.
+        if (!compress_) {
+            status = WriteShared(&txn, offset, len, inode->start_block);
+            if (status != ZX_OK) {
+                SetState(kBlobStateError);
+                return status;
+            }
         }
 
         *actual = to_write;
@@ -339,8 +505,9 @@ zx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actua
             Digest digest;
             void* merkle_data = GetMerkle();
             const void* blob_data = GetData();
-            if (MerkleTree::Create(blob_data, inode->blob_size, merkle_data,
-                                   merkle_size, &digest) != ZX_OK) {
+            if (MerkleTree::CreateParallel(blob_data, inode->blob_size, merkle_data,
+                                           merkle_size, &digest,
+                                           zx_system_get_num_cpus()) != ZX_OK) {
                 SetState(kBlobStateError);
                 return status;
             } else if (digest != digest_) {
@@ -349,10 +516,12 @@ zx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actua
                 return status;
             }
 
-            status = WriteShared(&txn, 0, merkle_size, inode->start_block);
-            if (status != ZX_OK) {
-                SetState(kBlobStateError);
-                return status;
+            if (!compress_) {
+                status = WriteShared(&txn, 0, merkle_size, inode->start_block);
+                if (status != ZX_OK) {
+                    SetState(kBlobStateError);
+                    return status;
+                }
             }
         } else if ((status = Verify()) != ZX_OK) {
             // Small blobs may not have associated Merkle Trees, and will
@@ -362,6 +531,11 @@ zx_status_t VnodeBlob::WriteInternal(const void* data, size_t len, size_t* actua
             return status;
         }
 
+        if (compress_ && (status = WriteCompressed(&txn)) != ZX_OK) {
+            SetState(kBlobStateError);
+            return status;
+        }
+
         // No more data to write. Flush to disk.
         if ((status = WriteMetadata()) != ZX_OK) {
             SetState(kBlobStateError);
@@ -403,6 +577,10 @@ zx_status_t VnodeBlob::CopyVmo(zx_rights_t rights, zx_handle_t* out) {
     }
 
     auto inode = blobstore_->GetNode(map_index_);
+    if ((status = EnsureDecompressed(0, inode->blob_size)) != ZX_OK) {
+        return status;
+    }
+
     // TODO(smklein): Only clone / verify the part of the vmo that
     // was requested.
     const size_t data_start = MerkleTreeBlocks(*inode) * kBlobstoreBlockSize;
@@ -441,6 +619,9 @@ zx_status_t VnodeBlob::ReadInternal(void* data, size_t len, size_t off, size_t*
     if (len > (inode->blob_size - off)) {
         len = inode->blob_size - off;
     }
+    if ((status = EnsureDecompressed(off, len)) != ZX_OK) {
+        return status;
+    }
 
     const size_t data_start = MerkleTreeBlocks(*inode) * kBlobstoreBlockSize;
     return zx_vmo_read(blob_->GetVmo(), data, data_start + off, len, actual);
@@ -573,11 +754,10 @@ zx_status_t Blobstore::NewBlob(const Digest& digest, fbl::RefPtr<VnodeBlob>* out
 zx_status_t Blobstore::ReleaseBlob(VnodeBlob* vn) {
     TRACE_DURATION("blobstore", "Blobstore::ReleaseBlob");
 
-    // TODO(smklein): What if kBlobFlagSync is set? Do we risk writing out
-    // parts of the blob AFTER it has been deleted?
-    // Ex: open, alloc, disk write async start, unlink, release, disk write async end.
-    // FWIW, this isn't a problem right now with synchronous writes, but it
-    // would become a problem with asynchronous writes.
+    // The blob's in-flight writes must not outlive it, nor land after its
+    // blocks have been freed (and possibly reallocated).
+    TxnDrain(vn);
+
     switch (vn->GetState()) {
     case kBlobStateEmpty: {
         // There are no in-memory or on-disk structures allocated.
@@ -724,6 +904,17 @@ zx_status_t Blobstore::AttachVmo(zx_handle_t vmo, vmoid_t* out) {
     return ZX_OK;
 }
 
+zx_status_t Blobstore::DetachVmo(vmoid_t vmoid) {
+    // Any in-flight transaction may be using the VMO.
+    TxnDrain();
+
+    block_fifo_request_t request;
+    request.txnid = TxnId();
+    request.vmoid = vmoid;
+    request.opcode = BLOCKIO_CLOSE_VMO;
+    return Txn(&request, 1);
+}
+
 zx_status_t Blobstore::AddInodes() {
     TRACE_DURATION("blobstore", "Blobstore::AddInodes");
 
@@ -831,8 +1022,79 @@ Blobstore::Blobstore(fbl::unique_fd fd, const blobstore_info_t* info)
     memcpy(&info_, info, sizeof(blobstore_info_t));
 }
 
+zx_status_t Blobstore::TxnAsync(block_fifo_request_t* requests, size_t count,
+                               VnodeBlob* owner) {
+    TRACE_DURATION("blobstore", "Blobstore::TxnAsync", "count", count);
+    if (async_txn_count_ == 0) {
+        return Txn(requests, count);
+    }
+
+    uint64_t dev_start = UINT64_MAX;
+    uint64_t dev_end = 0;
+    for (size_t i = 0; i < count; i++) {
+        dev_start = fbl::min(dev_start, requests[i].dev_offset);
+        dev_end = fbl::max(dev_end, requests[i].dev_offset + requests[i].length);
+    }
+    for (size_t i = 0; i < async_txn_count_; i++) {
+        AsyncTxn* txn = &async_txns_[i];
+        if (txn->busy && dev_start < txn->dev_end && txn->dev_start < dev_end) {
+            WaitAsync(txn);
+        }
+    }
+
+    AsyncTxn* txn = &async_txns_[async_next_];
+    if (txn->busy) {
+        WaitAsync(txn);
+    }
+    for (size_t i = 0; i < count; i++) {
+        requests[i].txnid = txn->txnid;
+    }
+    zx_status_t status = block_fifo_txn_async(fifo_client_, requests, count, nullptr, nullptr);
+    if (status != ZX_OK) {
+        return status;
+    }
+    txn->busy = true;
+    txn->dev_start = dev_start;
+    txn->dev_end = dev_end;
+    txn->owner = owner;
+    async_next_ = (async_next_ + 1) % async_txn_count_;
+    return ZX_OK;
+}
+
+void Blobstore::WaitAsync(AsyncTxn* txn) {
+    zx_status_t status = block_fifo_wait(fifo_client_, txn->txnid);
+    if (status != ZX_OK && txn->owner != nullptr) {
+        txn->owner->SetAsyncError(status);
+    }
+    txn->busy = false;
+    txn->owner = nullptr;
+}
+
+zx_status_t Blobstore::TxnDrain(VnodeBlob* owner) {
+    TRACE_DURATION("blobstore", "Blobstore::TxnDrain", "owner", owner);
+    for (size_t i = 0; i < async_txn_count_; i++) {
+        if (async_txns_[i].busy && async_txns_[i].owner == owner) {
+            WaitAsync(&async_txns_[i]);
+        }
+    }
+    return owner->GetAsyncError();
+}
+
+void Blobstore::TxnDrain() {
+    TRACE_DURATION("blobstore", "Blobstore::TxnDrain");
+    for (size_t i = 0; i < async_txn_count_; i++) {
+        if (async_txns_[i].busy) {
+            WaitAsync(&async_txns_[i]);
+        }
+    }
+}
+
 Blobstore::~Blobstore() {
     if (fifo_client_ != nullptr) {
+        TxnDrain();
+        for (size_t i = 0; i < async_txn_count_; i++) {
+            ioctl_block_free_txn(Fd(), &async_txns_[i].txnid);
+        }
         ioctl_block_free_txn(Fd(), &txnid_);
         ioctl_block_fifo_close(Fd());
         block_fifo_release_client(fifo_client_);
@@ -871,6 +1133,13 @@ zx_status_t Blobstore::Create(fbl::unique_fd fd, const blobstore_info_t* info,
         return status;
     }
 
+    // Additional txnids allow data writes to be pipelined. If none can be
+    // allocated, TxnAsync falls back to synchronous transactions.
+    while (fs->async_txn_count_ < kMaxAsyncTxns &&
+           ioctl_block_alloc_txn(fs->Fd(), &fs->async_txns_[fs->async_txn_count_].txnid) >= 0) {
+        fs->async_txn_count_++;
+    }
+
     // Keep the block_map_ aligned to a block multiple
     if ((status = fs->block_map_.Reset(BlockMapBlocks(fs->info_) * kBlobstoreBlockBits)) < 0) {
         fprintf(stderr, "blobstore: Could not reset block bitmap\n");
@@ -930,7 +1199,12 @@ zx_status_t Blobstore::LoadBitmaps() {
     ReadTxn txn(this);
     txn.Enqueue(block_map_vmoid_, 0, BlockMapStartBlock(info_), BlockMapBlocks(info_));
     txn.Enqueue(node_map_vmoid_, 0, NodeMapStartBlock(info_), NodeMapBlocks(info_));
-    return txn.Flush();
+    zx_status_t status = txn.Flush();
+    if (status != ZX_OK) {
+        return status;
+    }
+    block_map_.RebuildSummary();
+    return ZX_OK;
 }
 
 zx_status_t blobstore_create(fbl::RefPtr<Blobstore>* out, fbl::unique_fd blockfd) {
@@ -969,13 +1243,15 @@ zx_status_t blobstore_create(fbl::RefPtr<Blobstore>* out, fbl::unique_fd blockfd
     return ZX_OK;
 }
 
-zx_status_t blobstore_mount(fbl::RefPtr<VnodeBlob>* out, fbl::unique_fd blockfd) {
+zx_status_t blobstore_mount(fbl::RefPtr<VnodeBlob>* out, fbl::unique_fd blockfd,
+                            const MountOptions& options) {
     zx_status_t status;
     fbl::RefPtr<Blobstore> fs;
 
     if ((status = blobstore_create(&fs, fbl::move(blockfd))) != ZX_OK) {
         return status;
     }
+    fs->SetCompression(options.compress);
 
     if ((status = fs->GetRootBlob(out)) != ZX_OK) {
         fprintf(stderr, "blobstore: mount failed; could not get root blob\n");
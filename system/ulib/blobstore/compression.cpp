@@ -0,0 +1,137 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
+
+#include <fbl/algorithm.h>
+#include <fs/trace.h>
+#include <lz4/lz4.h>
+#include <zircon/assert.h>
+
+#include <blobstore/compression.h>
+
+namespace blobstore {
+namespace {
+
+// Returns the uncompressed length of chunk |n| in a blob of |blob_size| bytes.
+size_t ChunkLength(uint64_t blob_size, uint64_t n) {
+    uint64_t offset = n * kCompressionChunkSize;
+    return static_cast<size_t>(fbl::min<uint64_t>(blob_size - offset, kCompressionChunkSize));
+}
+
+const uint64_t* ChunkTable(const void* compressed) {
+    uintptr_t addr = reinterpret_cast<uintptr_t>(compressed);
+    return reinterpret_cast<const uint64_t*>(addr + sizeof(blobstore_compression_header_t));
+}
+
+} // namespace
+
+size_t CompressionBufferMax(uint64_t blob_size) {
+    uint64_t chunks = CompressedChunkCount(blob_size);
+    return CompressionTableSize(blob_size) +
+           chunks * LZ4_compressBound(kCompressionChunkSize);
+}
+
+zx_status_t Compress(const void* data, uint64_t blob_size, void* out, size_t out_max,
+                     size_t* out_actual) {
+    if (out_max < CompressionBufferMax(blob_size)) {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+
+    const uint64_t chunks = CompressedChunkCount(blob_size);
+    blobstore_compression_header_t* header =
+        reinterpret_cast<blobstore_compression_header_t*>(out);
+    header->magic = kCompressionMagic;
+    header->chunk_count = chunks;
+
+    uint64_t* table = const_cast<uint64_t*>(ChunkTable(out));
+    const size_t table_size = CompressionTableSize(blob_size);
+    const char* src = static_cast<const char*>(data);
+    char* payload = static_cast<char*>(out) + table_size;
+    const size_t payload_max = out_max - table_size;
+
+    uint64_t offset = 0;
+    for (uint64_t n = 0; n < chunks; n++) {
+        const size_t len = ChunkLength(blob_size, n);
+        const char* chunk = src + n * kCompressionChunkSize;
+        table[n] = offset;
+
+        int r = LZ4_compress_default(chunk, payload + offset, static_cast<int>(len),
+                                     static_cast<int>(payload_max - offset));
+        if (r <= 0 || static_cast<size_t>(r) >= len) {
+            // Incompressible chunks are stored verbatim; a payload which is
+            // exactly as long as the chunk itself is never LZ4 encoded.
+            memcpy(payload + offset, chunk, len);
+            r = static_cast<int>(len);
+        }
+        offset += r;
+    }
+    table[chunks] = offset;
+
+    *out_actual = table_size + offset;
+    return ZX_OK;
+}
+
+zx_status_t CompressionCheck(const void* compressed, size_t compressed_size, uint64_t blob_size) {
+    const size_t table_size = CompressionTableSize(blob_size);
+    if (compressed_size < table_size) {
+        FS_TRACE_ERROR("blobstore: Compressed blob too small for chunk table\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    auto header = reinterpret_cast<const blobstore_compression_header_t*>(compressed);
+    const uint64_t chunks = CompressedChunkCount(blob_size);
+    if (header->magic != kCompressionMagic || header->chunk_count != chunks) {
+        FS_TRACE_ERROR("blobstore: Bad compression header\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    const uint64_t* table = ChunkTable(compressed);
+    const size_t payload_size = compressed_size - table_size;
+    if (table[0] != 0 || table[chunks] > payload_size) {
+        FS_TRACE_ERROR("blobstore: Compressed payload out of range\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    for (uint64_t n = 0; n < chunks; n++) {
+        if (table[n + 1] <= table[n] || table[n + 1] - table[n] > ChunkLength(blob_size, n)) {
+            FS_TRACE_ERROR("blobstore: Bad compressed chunk table\n");
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+    }
+    return ZX_OK;
+}
+
+zx_status_t Decompress(const void* compressed, size_t compressed_size, uint64_t blob_size,
+                       uint64_t chunk_start, uint64_t chunk_end, void* out) {
+    ZX_DEBUG_ASSERT(chunk_start <= chunk_end);
+    if (chunk_end > CompressedChunkCount(blob_size)) {
+        return ZX_ERR_OUT_OF_RANGE;
+    }
+
+    const uint64_t* table = ChunkTable(compressed);
+    const char* payload = static_cast<const char*>(compressed) + CompressionTableSize(blob_size);
+    char* dst = static_cast<char*>(out);
+
+    for (uint64_t n = chunk_start; n < chunk_end; n++) {
+        const size_t len = ChunkLength(blob_size, n);
+        const size_t src_len = static_cast<size_t>(table[n + 1] - table[n]);
+        const char* src = payload + table[n];
+        char* chunk = dst + n * kCompressionChunkSize;
+
+        if (src_len == len) {
+            memcpy(chunk, src, len);
+            continue;
+        }
+        int r = LZ4_decompress_safe(src, chunk, static_cast<int>(src_len), static_cast<int>(len));
+        if (r < 0 || static_cast<size_t>(r) != len) {
+            FS_TRACE_ERROR("blobstore: Failed to decompress chunk %" PRIu64 "\n", n);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+    }
+    return ZX_OK;
+}
+
+} // namespace blobstore
@@ -23,6 +23,7 @@
 
 #define ZXDEBUG 0
 
+#include <blobstore/compression.h>
 #include <blobstore/format.h>
 #include <blobstore/fsck.h>
 #include <blobstore/host.h>
@@ -149,6 +150,73 @@ zx_status_t blobstore_create_sparse(fbl::RefPtr<Blobstore>* out, fbl::unique_fd
 
 std::mutex add_blob_mutex_;
 
+namespace {
+
+// Compresses the blob, leaving |out| null if doing so would not save at
+// least one block; in that case the blob is stored uncompressed.
+zx_status_t CompressBlob(const void* blob_data, uint64_t blob_size,
+                         fbl::unique_ptr<uint8_t[]>* out, size_t* out_size) {
+    const uint64_t data_blocks = fbl::round_up(blob_size, kBlobstoreBlockSize) /
+                                 kBlobstoreBlockSize;
+    if (data_blocks <= 1) {
+        return ZX_OK;
+    }
+
+    fbl::AllocChecker ac;
+    size_t compressed_max = CompressionBufferMax(blob_size);
+    fbl::unique_ptr<uint8_t[]> compressed(new (&ac) uint8_t[compressed_max]);
+    size_t compressed_size;
+    zx_status_t status;
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    } else if ((status = Compress(blob_data, blob_size, compressed.get(), compressed_max,
+                                  &compressed_size)) != ZX_OK) {
+        return status;
+    }
+    if (fbl::round_up(compressed_size, kBlobstoreBlockSize) / kBlobstoreBlockSize <
+        data_blocks) {
+        *out = fbl::move(compressed);
+        *out_size = compressed_size;
+    }
+    return ZX_OK;
+}
+
+} // namespace
+
+zx_status_t blobstore_blob_blocks(int data_fd, bool compress, uint64_t* out_blocks) {
+    struct stat s;
+    if (fstat(data_fd, &s) < 0) {
+        return ZX_ERR_BAD_STATE;
+    }
+
+    blobstore_inode_t inode;
+    inode.blob_size = s.st_size;
+    *out_blocks = MerkleTreeBlocks(inode) + BlobDataBlocks(inode);
+    if (!compress || s.st_size == 0) {
+        return ZX_OK;
+    }
+
+    void* blob_data = mmap(nullptr, s.st_size, PROT_READ, MAP_PRIVATE, data_fd, 0);
+    if (blob_data == MAP_FAILED) {
+        return ZX_ERR_BAD_STATE;
+    }
+    auto auto_unmap = fbl::MakeAutoCall([blob_data, s]() {
+        munmap(blob_data, s.st_size);
+    });
+
+    fbl::unique_ptr<uint8_t[]> compressed;
+    size_t compressed_size;
+    zx_status_t status;
+    if ((status = CompressBlob(blob_data, s.st_size, &compressed, &compressed_size)) != ZX_OK) {
+        return status;
+    }
+    if (compressed != nullptr) {
+        *out_blocks = MerkleTreeBlocks(inode) +
+                      fbl::round_up(compressed_size, kBlobstoreBlockSize) / kBlobstoreBlockSize;
+    }
+    return ZX_OK;
+}
+
 zx_status_t blobstore_add_blob(Blobstore* bs, int data_fd) {
     // Mmap user-provided file, create the corresponding merkle tree
     struct stat s;
@@ -168,11 +236,22 @@ zx_status_t blobstore_add_blob(Blobstore* bs, int data_fd) {
     digest::Digest digest;
     fbl::AllocChecker ac;
     size_t merkle_size = MerkleTree::GetTreeLength(s.st_size);
+    long num_cpus = sysconf(_SC_NPROCESSORS_ONLN);
     auto merkle_tree = fbl::unique_ptr<uint8_t[]>(new (&ac) uint8_t[merkle_size]);
     if (!ac.check()) {
         return ZX_ERR_NO_MEMORY;
-    } else if ((status = MerkleTree::Create(blob_data, s.st_size, merkle_tree.get(),
-                                  merkle_size, &digest)) != ZX_OK) {
+    } else if ((status = MerkleTree::CreateParallel(blob_data, s.st_size, merkle_tree.get(),
+                                                    merkle_size, &digest,
+                                                    num_cpus > 1 ? num_cpus : 1)) != ZX_OK) {
+        return status;
+    }
+
+    // Compress the blob (outside of the lock, so multiple blobs may be
+    // compressed concurrently).
+    fbl::unique_ptr<uint8_t[]> compressed;
+    size_t compressed_size = 0;
+    if (bs->CompressionEnabled() &&
+        (status = CompressBlob(blob_data, s.st_size, &compressed, &compressed_size)) != ZX_OK) {
         return status;
     }
 
@@ -189,11 +268,23 @@ zx_status_t blobstore_add_blob(Blobstore* bs, int data_fd) {
     inode_block->SetSize(s.st_size);
     blobstore_inode_t* inode = inode_block->GetInode();
 
+    const void* stored_data = blob_data;
+    size_t stored_size = s.st_size;
+    if (compressed != nullptr) {
+        inode->flags |= kBlobFlagLZ4Compressed;
+        inode->num_blocks = MerkleTreeBlocks(*inode) +
+                            fbl::round_up(compressed_size, kBlobstoreBlockSize) /
+                            kBlobstoreBlockSize;
+        stored_data = compressed.get();
+        stored_size = compressed_size;
+    }
+
     if ((status = bs->AllocateBlocks(inode->num_blocks,
                                      reinterpret_cast<size_t*>(&inode->start_block))) != ZX_OK) {
         fprintf(stderr, "error: No blocks available\n");
         return status;
-    } else if ((status = bs->WriteData(inode, merkle_tree.get(), blob_data)) != ZX_OK) {
+    } else if ((status = bs->WriteData(inode, merkle_tree.get(), stored_data,
+                                       stored_size)) != ZX_OK) {
         return status;
     } else if ((status = bs->WriteBitmap(inode->num_blocks, inode->start_block)) != ZX_OK) {
         return status;
@@ -222,6 +313,7 @@ zx_status_t blobstore_fsck(fbl::unique_fd fd, off_t start, off_t end,
 void InodeBlock::SetSize(size_t size) {
     inode_->blob_size = size;
     inode_->num_blocks = MerkleTreeBlocks(*inode_) + BlobDataBlocks(*inode_);
+    inode_->flags = 0;
 }
 
 Blobstore::Blobstore(fbl::unique_fd fd, off_t offset, const info_block_t& info_block,
@@ -292,6 +384,7 @@ zx_status_t Blobstore::LoadBitmap() {
             memcpy(bmdata, cache_.blk, kBlobstoreBlockSize);
         }
     }
+    block_map_.RebuildSummary();
     return ZX_OK;
 }
 
@@ -384,8 +477,10 @@ zx_status_t Blobstore::WriteNode(fbl::unique_ptr<InodeBlock> ino_block) {
     return WriteBlock(cache_.bno, cache_.blk);
 }
 
-zx_status_t Blobstore::WriteData(blobstore_inode_t* inode, void* merkle_data, void* blob_data) {
-    for (size_t n = 0; n < MerkleTreeBlocks(*inode); n++) {
+zx_status_t Blobstore::WriteData(blobstore_inode_t* inode, const void* merkle_data,
+                                 const void* blob_data, size_t blob_data_size) {
+    const uint64_t merkle_blocks = MerkleTreeBlocks(*inode);
+    for (size_t n = 0; n < merkle_blocks; n++) {
         const void* data = fs::GetBlock<kBlobstoreBlockSize>(merkle_data, n);
         uint64_t bno = data_start_block_ + inode->start_block + n;
         zx_status_t status;
@@ -394,21 +489,22 @@ zx_status_t Blobstore::WriteData(blobstore_inode_t* inode, void* merkle_data, vo
         }
     }
 
-    for (size_t n = 0; n < BlobDataBlocks(*inode); n++) {
+    // For compressed blobs, |blob_data| holds the compressed form of the blob.
+    for (size_t n = 0; n < inode->num_blocks - merkle_blocks; n++) {
         const void* data = fs::GetBlock<kBlobstoreBlockSize>(blob_data, n);
 
         // If we try to write a block, will it be reaching beyond the end of the
         // mapped file?
         size_t off = n * kBlobstoreBlockSize;
         uint8_t last_data[kBlobstoreBlockSize];
-        if (inode->blob_size < off + kBlobstoreBlockSize) {
+        if (blob_data_size < off + kBlobstoreBlockSize) {
             // Read the partial block from a block-sized buffer which zero-pads the data.
             memset(last_data, 0, kBlobstoreBlockSize);
-            memcpy(last_data, data, inode->blob_size - off);
+            memcpy(last_data, data, blob_data_size - off);
             data = last_data;
         }
 
-        uint64_t bno = data_start_block_ + inode->start_block + MerkleTreeBlocks(*inode) + n;
+        uint64_t bno = data_start_block_ + inode->start_block + merkle_blocks + n;
         zx_status_t status;
         if ((status = WriteBlock(bno, data)) != ZX_OK) {
             return status;
@@ -12,6 +12,7 @@
 #endif
 
 #include <bitmap/raw-bitmap.h>
+#include <bitmap/storage.h>
 #include <digest/digest.h>
 #include <fbl/algorithm.h>
 #include <fbl/intrusive_double_list.h>
@@ -45,6 +46,10 @@ using WriteTxn = fs::WriteTxn<kBlobstoreBlockSize, Blobstore>;
 using ReadTxn = fs::ReadTxn<kBlobstoreBlockSize, Blobstore>;
 using digest::Digest;
 
+// The maximum number of asynchronous transactions kept in flight to the
+// block device at once.
+constexpr size_t kMaxAsyncTxns = 8;
+
 typedef uint32_t BlobFlags;
 
 // clang-format off
@@ -105,6 +110,18 @@ public:
         map_index_ = i;
     }
 
+    // Records the failure of an asynchronous write of the blob, to be
+    // reported when the blob's metadata is written.
+    void SetAsyncError(zx_status_t status) {
+        if (async_status_ == ZX_OK) {
+            async_status_ = status;
+        }
+    }
+
+    zx_status_t GetAsyncError() const {
+        return async_status_;
+    }
+
     uint64_t SizeData() const;
 
     // Constructs the "directory" blob
@@ -162,6 +179,9 @@ private:
     zx_status_t Unlink(fbl::StringPiece name, bool must_be_dir) final;
     zx_status_t Mmap(int flags, size_t len, size_t* off, zx_handle_t* out) final;
     void Sync(SyncCallback closure) final;
+    // Only the root directory may be cached: a cached blob would hold its
+    // data in memory, and keep failed writes from releasing their space.
+    bool IsDentryCacheable() const final { return IsDirectory(); }
 
     // Read both VMOs into memory, if we haven't already.
     //
@@ -175,7 +195,20 @@ private:
     // InitVmos() must have already been called for this blob.
     zx_status_t Verify() const;
 
+    // For compressed blobs, decompresses and verifies the chunks covering
+    // [off, off + len) of the blob data which have not already been
+    // decompressed. Once every chunk is available, the compressed copy of
+    // the blob is released.
+    //
+    // Uncompressed blobs are always fully available after InitVmos().
+    zx_status_t EnsureDecompressed(uint64_t off, uint64_t len);
+    void ReleaseCompressed();
+
     zx_status_t WriteShared(WriteTxn* txn, size_t start, size_t len, uint64_t start_block);
+    // Compresses the fully written blob and writes it, along with the
+    // Merkle tree, to disk. If compression does not save any blocks, the
+    // blob is written uncompressed.
+    zx_status_t WriteCompressed(WriteTxn* txn);
     // Called by Blob once the last write has completed, updating the
     // on-disk metadata.
     zx_status_t WriteMetadata();
@@ -195,8 +228,20 @@ private:
     fbl::unique_ptr<MappedVmo> blob_{};
     vmoid_t vmoid_{};
 
+    // Set when the blob should be compressed once all data has been written.
+    bool compress_{};
+    // The compressed form of the blob, as stored on disk after the Merkle
+    // tree. Only held while some chunks have not yet been decompressed into
+    // blob_, or while a compressed blob is being written.
+    fbl::unique_ptr<MappedVmo> compressed_{};
+    vmoid_t compressed_vmoid_{};
+    // Chunks of a compressed blob which have been decompressed and verified.
+    bitmap::RawBitmapGeneric<bitmap::DefaultStorage> decompressed_{};
+
     zx::event readable_event_{};
     uint64_t bytes_written_{};
+    // The first error encountered by the blob's asynchronous writes.
+    zx_status_t async_status_ = ZX_OK;
     uint8_t digest_[Digest::kLength]{};
 
     size_t map_index_{};
@@ -215,6 +260,12 @@ struct MerkleRootTraits {
     }
 };
 
+// Options which may be provided when mounting Blobstore.
+struct MountOptions {
+    // Store newly written blobs LZ4 compressed, if doing so saves space.
+    bool compress = false;
+};
+
 class Blobstore : public fbl::RefCounted<Blobstore> {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Blobstore);
@@ -223,6 +274,8 @@ public:
     static zx_status_t Create(fbl::unique_fd blockfd, const blobstore_info_t* info,
                               fbl::RefPtr<Blobstore>* out);
 
+    void SetCompression(bool compress) { compress_ = compress; }
+
     zx_status_t Unmount();
     virtual ~Blobstore();
 
@@ -253,10 +306,28 @@ public:
     zx_status_t Readdir(fs::vdircookie_t* cookie, void* dirents, size_t len, size_t* out_actual);
 
     zx_status_t AttachVmo(zx_handle_t vmo, vmoid_t* out);
+    zx_status_t DetachVmo(vmoid_t vmoid);
     zx_status_t Txn(block_fifo_request_t* requests, size_t count) {
         TRACE_DURATION("blobstore", "Blobstore::Txn", "count", count);
         return block_fifo_txn(fifo_client_, requests, count);
     }
+
+    // Sends a transaction on behalf of |owner| without waiting for it to
+    // complete, keeping up to |kMaxAsyncTxns| transactions in flight. A
+    // transaction which touches blocks accessed by an in-flight transaction
+    // waits for it first, so writes to the same blocks land in order.
+    //
+    // Errors from asynchronous transactions are recorded on their owner,
+    // and reported by |TxnDrain(owner)|.
+    zx_status_t TxnAsync(block_fifo_request_t* requests, size_t count, VnodeBlob* owner);
+
+    // Waits for the transactions sent on behalf of |owner| to complete,
+    // returning the first error encountered by any of them.
+    zx_status_t TxnDrain(VnodeBlob* owner);
+
+    // Waits for all transactions sent by |TxnAsync| to complete. Errors are
+    // left recorded on the blobs which sent them.
+    void TxnDrain();
     uint32_t BlockSize() const { return block_info_.block_size; }
 
     txnid_t TxnId() const { return txnid_; }
@@ -307,6 +378,21 @@ private:
     // "construction".
     zx_status_t CreateFsId();
 
+    // A transaction slot used by TxnAsync. |dev_start| and |dev_end| bound
+    // the device blocks accessed by the in-flight transaction, which was
+    // sent on behalf of |owner|.
+    struct AsyncTxn {
+        txnid_t txnid;
+        bool busy;
+        uint64_t dev_start;
+        uint64_t dev_end;
+        VnodeBlob* owner;
+    };
+
+    // Waits for the in-flight transaction in |txn| to complete, recording
+    // any error on its owner.
+    void WaitAsync(AsyncTxn* txn);
+
     // VnodeBlobs exist in the WAVLTree as long as one or more reference exists;
     // when the Vnode is deleted, it is immediately removed from the WAVL tree.
     using WAVLTreeByMerkle = fbl::WAVLTree<const uint8_t*,
@@ -319,6 +405,9 @@ private:
     block_info_t block_info_{};
     fifo_client_t* fifo_client_{};
     txnid_t txnid_{};
+    AsyncTxn async_txns_[kMaxAsyncTxns]{};
+    size_t async_txn_count_{};
+    size_t async_next_{};
     RawBitmap block_map_{};
     vmoid_t block_map_vmoid_{};
     fbl::unique_ptr<MappedVmo> node_map_{};
@@ -326,11 +415,13 @@ private:
     fbl::unique_ptr<MappedVmo> info_vmo_{};
     vmoid_t info_vmoid_{};
     uint64_t fs_id_{};
+    bool compress_{};
 };
 
 zx_status_t blobstore_create(fbl::RefPtr<Blobstore>* out, fbl::unique_fd blockfd);
 
 //TODO(planders): Update blobstore to use unique_fd.
-zx_status_t blobstore_mount(fbl::RefPtr<VnodeBlob>* out, fbl::unique_fd blockfd);
+zx_status_t blobstore_mount(fbl::RefPtr<VnodeBlob>* out, fbl::unique_fd blockfd,
+                            const MountOptions& options);
 
 } // namespace blobstore
@@ -24,9 +24,9 @@
 namespace blobstore {
 
 #ifdef __Fuchsia__
-using RawBitmap = bitmap::RawBitmapGeneric<bitmap::VmoStorage>;
+using RawBitmap = bitmap::SummarizedRawBitmapGeneric<bitmap::VmoStorage>;
 #else
-using RawBitmap = bitmap::RawBitmapGeneric<bitmap::DefaultStorage>;
+using RawBitmap = bitmap::SummarizedRawBitmapGeneric<bitmap::DefaultStorage>;
 #endif
 
 void* GetBlock(const RawBitmap& bitmap, uint32_t blkno);
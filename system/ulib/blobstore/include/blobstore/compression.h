@@ -0,0 +1,43 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// This file contains the chunked LZ4 compression routines shared between
+// host and target implementations of Blobstore.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <zircon/types.h>
+
+#include <blobstore/format.h>
+
+namespace blobstore {
+
+// Returns the maximum number of bytes required to hold the compressed form
+// of a blob which is |blob_size| bytes long, including the chunk table.
+size_t CompressionBufferMax(uint64_t blob_size);
+
+// Compresses |blob_size| bytes of |data| into |out|, which must be at least
+// |CompressionBufferMax(blob_size)| bytes long.
+//
+// On success, |*out_actual| is set to the number of bytes of |out| which
+// constitute the compressed blob.
+zx_status_t Compress(const void* data, uint64_t blob_size, void* out, size_t out_max,
+                     size_t* out_actual);
+
+// Validates the header and chunk table of a compressed blob which holds
+// |blob_size| bytes of uncompressed data within |compressed_size| bytes.
+zx_status_t CompressionCheck(const void* compressed, size_t compressed_size, uint64_t blob_size);
+
+// Decompresses chunks [chunk_start, chunk_end) of the |compressed| blob into
+// |out|, which must be large enough to hold the entire uncompressed blob.
+// Chunk |n| is written to |out| at offset |n * kCompressionChunkSize|.
+//
+// |compressed| must have been validated with |CompressionCheck|.
+zx_status_t Decompress(const void* compressed, size_t compressed_size, uint64_t blob_size,
+                       uint64_t chunk_start, uint64_t chunk_end, void* out);
+
+} // namespace blobstore
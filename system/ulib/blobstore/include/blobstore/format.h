@@ -23,7 +23,7 @@ namespace blobstore {
 
 constexpr uint64_t kBlobstoreMagic0  = (0xac2153479e694d21ULL);
 constexpr uint64_t kBlobstoreMagic1  = (0x985000d4d4d3d314ULL);
-constexpr uint32_t kBlobstoreVersion = 0x00000004;
+constexpr uint32_t kBlobstoreVersion = 0x00000005;
 
 constexpr uint32_t kBlobstoreFlagClean      = 1;
 constexpr uint32_t kBlobstoreFlagDirty      = 2;
@@ -108,13 +108,17 @@ constexpr uint64_t kStartBlockFree     = 0;
 constexpr uint64_t kStartBlockReserved = 1;
 constexpr uint64_t kStartBlockMinimum  = 2; // Smallest 'data' block possible
 
+// Flags which may be set on an individual blob node.
+constexpr uint32_t kBlobFlagLZ4Compressed = 0x00000001; // Data is stored as LZ4 chunks
+
 using digest::Digest;
 typedef struct {
     uint8_t  merkle_root_hash[Digest::kLength];
     uint64_t start_block;
     uint64_t num_blocks;
     uint64_t blob_size;
-    uint64_t reserved;
+    uint32_t flags;
+    uint32_t reserved;
 } blobstore_inode_t;
 
 static_assert(sizeof(blobstore_inode_t) == kBlobstoreInodeSize,
@@ -127,4 +131,36 @@ constexpr uint64_t BlobDataBlocks(const blobstore_inode_t& blobNode) {
     return fbl::round_up(blobNode.blob_size, kBlobstoreBlockSize) / kBlobstoreBlockSize;
 }
 
+// Compressed blobs store their data as a sequence of independently compressed
+// chunks, so that any range of the blob may be decompressed without touching
+// the rest of it. The data section of a compressed blob (which immediately
+// follows the Merkle tree) is laid out as:
+//
+// - blobstore_compression_header_t
+// - uint64_t chunk_offsets[chunk_count + 1], relative to the end of the table
+// - Compressed chunk payloads
+//
+// Each chunk covers kCompressionChunkSize bytes of uncompressed data (the last
+// chunk may be shorter). The Merkle tree always describes the uncompressed data.
+constexpr uint64_t kCompressionMagic     = (0x346c7a6d6265636fULL);
+constexpr uint32_t kCompressionChunkSize = (1 << 16);
+
+static_assert(kCompressionChunkSize % digest::MerkleTree::kNodeSize == 0,
+              "Compression chunks must be aligned to Merkle tree nodes");
+
+typedef struct {
+    uint64_t magic;
+    uint64_t chunk_count;
+} blobstore_compression_header_t;
+
+constexpr uint64_t CompressedChunkCount(uint64_t blob_size) {
+    return fbl::round_up(blob_size, kCompressionChunkSize) / kCompressionChunkSize;
+}
+
+// Size of the header and chunk table preceding compressed payloads.
+constexpr uint64_t CompressionTableSize(uint64_t blob_size) {
+    return sizeof(blobstore_compression_header_t) +
+           (CompressedChunkCount(blob_size) + 1) * sizeof(uint64_t);
+}
+
 } // namespace blobstore
@@ -74,13 +74,21 @@ public:
 
     ~Blobstore() {}
 
+    // Controls whether blobs added to this image are stored LZ4 compressed,
+    // when doing so saves space.
+    void SetCompression(bool compress) { compress_ = compress; }
+    bool CompressionEnabled() const { return compress_; }
+
     // Checks to see if a blob already exists, and if not allocates a new node
     zx_status_t NewBlob(const Digest& digest, fbl::unique_ptr<InodeBlock>* out);
 
     // Allocate |nblocks| starting at |*blkno_out| in memory
     zx_status_t AllocateBlocks(size_t nblocks, size_t* blkno_out);
 
-    zx_status_t WriteData(blobstore_inode_t* inode, void* merkle_data, void* blob_data);
+    // Writes the Merkle tree and |blob_data_size| bytes of (possibly compressed)
+    // |blob_data| to the blocks reserved by |inode|.
+    zx_status_t WriteData(blobstore_inode_t* inode, const void* merkle_data,
+                          const void* blob_data, size_t blob_data_size);
     zx_status_t WriteBitmap(size_t nblocks, size_t start_block);
     zx_status_t WriteNode(fbl::unique_ptr<InodeBlock> ino_block);
     zx_status_t WriteInfo();
@@ -114,6 +122,7 @@ private:
 
     fbl::unique_fd blockfd_;
     bool dirty_;
+    bool compress_ = false;
     off_t offset_;
 
     size_t block_map_start_block_;
@@ -138,6 +147,13 @@ zx_status_t blobstore_create(fbl::RefPtr<Blobstore>* out, fbl::unique_fd blockfd
 // blobstore_add_blob may be called by multiple threads to gain concurrent
 // merkle tree generation. No other methods are thread safe.
 zx_status_t blobstore_add_blob(Blobstore* bs, int data_fd);
+
+// Returns the number of blocks, including its Merkle tree, which the blob in
+// |data_fd| will occupy once added. If |compress| is set, the blob is
+// compressed to find out whether (and how small) it would be stored
+// compressed; this repeats the work of blobstore_add_blob, but lets an image
+// be sized for the blocks its blobs actually use.
+zx_status_t blobstore_blob_blocks(int data_fd, bool compress, uint64_t* out_blocks);
 zx_status_t blobstore_fsck(fbl::unique_fd fd, off_t start, off_t end,
                            const fbl::Vector<size_t>& extent_lengths);
 
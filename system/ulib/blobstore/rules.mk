@@ -12,6 +12,7 @@ MODULE_NAME := blobstore
 
 COMMON_SRCS := \
     $(LOCAL_DIR)/common.cpp \
+    $(LOCAL_DIR)/compression.cpp \
     $(LOCAL_DIR)/fsck.cpp \
 
 # app main
@@ -29,6 +30,7 @@ MODULE_STATIC_LIBS := \
     system/ulib/async.loop \
     system/ulib/block-client \
     system/ulib/digest \
+    third_party/ulib/lz4 \
     third_party/ulib/uboringssl \
     system/ulib/trace \
     system/ulib/zx \
@@ -60,6 +62,7 @@ MODULE_COMPILEFLAGS := \
     -Werror-implicit-function-declaration \
     -Wstrict-prototypes -Wwrite-strings \
     -Isystem/ulib/digest/include \
+    -Ithird_party/ulib/lz4/include \
     -Ithird_party/ulib/uboringssl/include \
     -Isystem/ulib/fbl/include \
     -Isystem/ulib/fs/include \
@@ -31,12 +31,9 @@ namespace blobstore {
 
 VnodeBlob::~VnodeBlob() {
     blobstore_->ReleaseBlob(this);
+    ReleaseCompressed();
     if (blob_ != nullptr) {
-        block_fifo_request_t request;
-        request.txnid = blobstore_->TxnId();
-        request.vmoid = vmoid_;
-        request.opcode = BLOCKIO_CLOSE_VMO;
-        blobstore_->Txn(&request, 1);
+        blobstore_->DetachVmo(vmoid_);
     }
 }
 
@@ -248,7 +245,9 @@ zx_status_t VnodeBlob::Mmap(int flags, size_t len, size_t* off, zx_handle_t* out
         return ZX_ERR_NOT_SUPPORTED;
     }
 
-    zx_rights_t rights = ZX_RIGHT_TRANSFER | ZX_RIGHT_MAP;
+    // Each mapping gets a fresh clone of the immutable blob, which the client
+    // may duplicate and clone again, as fdio_get_vmo does.
+    zx_rights_t rights = ZX_RIGHTS_BASIC | ZX_RIGHT_MAP;
     rights |= (flags & FDIO_MMAP_FLAG_READ) ? ZX_RIGHT_READ : 0;
     rights |= (flags & FDIO_MMAP_FLAG_EXEC) ? ZX_RIGHT_EXECUTE : 0;
     return CopyVmo(rights, out);
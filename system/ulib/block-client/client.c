@@ -3,12 +3,13 @@
 // found in the LICENSE file.
 
 #include <assert.h>
+#include <stdbool.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <zircon/compiler.h>
 #include <zircon/device/block.h>
 #include <zircon/syscalls.h>
-#include <sync/completion.h>
 
 #include "block-client/client.h"
 
@@ -40,11 +41,13 @@ static zx_status_t do_write(zx_handle_t fifo, block_fifo_request_t* request, siz
     }
 }
 
-static zx_status_t do_read(zx_handle_t fifo, block_fifo_response_t* response) {
+// Reads up to 'count' responses from the FIFO, blocking until at least one
+// is available.
+static zx_status_t do_read(zx_handle_t fifo, block_fifo_response_t* response, size_t* count) {
     zx_status_t status;
     while (true) {
-        uint32_t count;
-        status = zx_fifo_read(fifo, response, sizeof(block_fifo_response_t), &count);
+        uint32_t actual;
+        status = zx_fifo_read(fifo, response, sizeof(block_fifo_response_t) * *count, &actual);
         if (status == ZX_ERR_SHOULD_WAIT) {
             zx_signals_t signals;
             if ((status = zx_object_wait_one(fifo,
@@ -56,19 +59,32 @@ static zx_status_t do_read(zx_handle_t fifo, block_fifo_response_t* response) {
             }
             // Try reading again...
         } else {
+            if (status == ZX_OK) {
+                *count = actual;
+            }
             return status;
         }
     }
 }
 
-typedef struct block_completion {
-    completion_t completion;
+typedef struct block_txn {
+    block_fifo_callback_t callback;
+    void* cookie;
     zx_status_t status;
-} block_completion_t;
+    // Set while a response is outstanding for this txnid.
+    bool busy;
+} block_txn_t;
 
 typedef struct fifo_client {
     zx_handle_t fifo;
-    block_completion_t txns[MAX_TXN_COUNT];
+    mtx_t lock;
+    // Signalled whenever a response is processed, or when the thread reading
+    // from the FIFO gives up that role.
+    cnd_t cond;
+    // Only one thread reads from the FIFO at a time; the others wait on
+    // |cond| for it to complete their transactions.
+    bool reading;
+    block_txn_t txns[MAX_TXN_COUNT];
 } fifo_client_t;
 
 zx_status_t block_fifo_create_client(zx_handle_t fifo, fifo_client_t** out) {
@@ -76,6 +92,15 @@ zx_status_t block_fifo_create_client(zx_handle_t fifo, fifo_client_t** out) {
     if (client == NULL) {
         return ZX_ERR_NO_MEMORY;
     }
+    if (mtx_init(&client->lock, mtx_plain) != thrd_success) {
+        free(client);
+        return ZX_ERR_NO_RESOURCES;
+    }
+    if (cnd_init(&client->cond) != thrd_success) {
+        mtx_destroy(&client->lock);
+        free(client);
+        return ZX_ERR_NO_RESOURCES;
+    }
     client->fifo = fifo;
     *out = client;
     return ZX_OK;
@@ -87,45 +112,160 @@ void block_fifo_release_client(fifo_client_t* client) {
     }
 
     zx_handle_close(client->fifo);
+    cnd_destroy(&client->cond);
+    mtx_destroy(&client->lock);
     free(client);
 }
 
-zx_status_t block_fifo_txn(fifo_client_t* client, block_fifo_request_t* requests, size_t count) {
-    if (count == 0) {
-        return ZX_OK;
-    } else if (count > MAX_TXN_MESSAGES) {
-        return ZX_ERR_INVALID_ARGS;
+// Records the responses and invokes the callbacks of any asynchronous
+// transactions they complete. The lock is dropped while callbacks run.
+static void complete_locked(fifo_client_t* client, const block_fifo_response_t* responses,
+                            size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        txnid_t txnid = responses[i].txnid;
+        if (txnid >= MAX_TXN_COUNT || !client->txns[txnid].busy) {
+            // Not a transaction we're waiting on.
+            continue;
+        }
+        block_txn_t* txn = &client->txns[txnid];
+        txn->status = responses[i].status;
+        txn->busy = false;
+        block_fifo_callback_t callback = txn->callback;
+        void* cookie = txn->cookie;
+        txn->callback = NULL;
+        if (callback != NULL) {
+            mtx_unlock(&client->lock);
+            callback(cookie, responses[i].status);
+            mtx_lock(&client->lock);
+        }
     }
+    cnd_broadcast(&client->cond);
+}
 
+static zx_status_t send_locked(fifo_client_t* client, block_fifo_request_t* requests,
+                               size_t count, block_fifo_callback_t callback, void* cookie) {
     txnid_t txnid = requests[0].txnid;
     assert(txnid < MAX_TXN_COUNT);
-    completion_reset(&client->txns[txnid].completion);
-    client->txns[txnid].status = ZX_ERR_IO;
+    block_txn_t* txn = &client->txns[txnid];
+    if (txn->busy) {
+        return ZX_ERR_UNAVAILABLE;
+    }
 
-    zx_status_t status;
     for (size_t i = 0; i < count; i++) {
         assert(requests[i].txnid == txnid);
         requests[i].opcode = (requests[i].opcode & BLOCKIO_OP_MASK) |
                              (i == count - 1 ? BLOCKIO_TXN_END : 0);
     }
-    if ((status = do_write(client->fifo, &requests[0], count)) != ZX_OK) {
-        return status;
+
+    // Mark the transaction busy before writing, since another thread may
+    // read the response as soon as the requests reach the FIFO.
+    txn->callback = callback;
+    txn->cookie = cookie;
+    txn->status = ZX_ERR_IO;
+    txn->busy = true;
+
+    zx_status_t status;
+    mtx_unlock(&client->lock);
+    status = do_write(client->fifo, &requests[0], count);
+    mtx_lock(&client->lock);
+    if (status != ZX_OK) {
+        txn->busy = false;
+        txn->callback = NULL;
     }
+    return status;
+}
 
-    // As expected by the protocol, when we send one "BLOCKIO_TXN_END" message, we
-    // must read a reply message.
-    block_fifo_response_t response;
-    if ((status = do_read(client->fifo, &response)) != ZX_OK) {
-        return status;
+static zx_status_t wait_locked(fifo_client_t* client, txnid_t txnid) {
+    block_fifo_response_t responses[MAX_TXN_COUNT];
+    block_txn_t* txn = &client->txns[txnid];
+    while (txn->busy) {
+        if (client->reading) {
+            // Someone else is reading responses; they'll wake us up when
+            // ours arrives (or when they stop reading).
+            cnd_wait(&client->cond, &client->lock);
+            continue;
+        }
+
+        // As expected by the protocol, every "BLOCKIO_TXN_END" message
+        // receives a single reply. Our reply is still outstanding, so
+        // a blocking read cannot stall forever.
+        client->reading = true;
+        mtx_unlock(&client->lock);
+        size_t count = countof(responses);
+        zx_status_t status = do_read(client->fifo, responses, &count);
+        mtx_lock(&client->lock);
+        client->reading = false;
+        if (status != ZX_OK) {
+            cnd_broadcast(&client->cond);
+            return status;
+        }
+        complete_locked(client, responses, count);
     }
+    return txn->status;
+}
 
-    // Wake up someone who is waiting (it might be ourselves)
-    txnid_t response_txnid = response.txnid;
-    client->txns[response_txnid].status = response.status;
-    completion_signal(&client->txns[response_txnid].completion);
+zx_status_t block_fifo_txn(fifo_client_t* client, block_fifo_request_t* requests, size_t count) {
+    if (count == 0) {
+        return ZX_OK;
+    } else if (count > MAX_TXN_MESSAGES) {
+        return ZX_ERR_INVALID_ARGS;
+    }
 
-    // Wait for someone to signal us
-    completion_wait(&client->txns[txnid].completion, ZX_TIME_INFINITE);
+    mtx_lock(&client->lock);
+    zx_status_t status = send_locked(client, requests, count, NULL, NULL);
+    if (status == ZX_OK) {
+        status = wait_locked(client, requests[0].txnid);
+    }
+    mtx_unlock(&client->lock);
+    return status;
+}
 
-    return client->txns[txnid].status;
+zx_status_t block_fifo_txn_async(fifo_client_t* client, block_fifo_request_t* requests,
+                                 size_t count, block_fifo_callback_t callback, void* cookie) {
+    if (count == 0 || count > MAX_TXN_MESSAGES) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    mtx_lock(&client->lock);
+    zx_status_t status = send_locked(client, requests, count, callback, cookie);
+    mtx_unlock(&client->lock);
+    return status;
+}
+
+zx_status_t block_fifo_wait(fifo_client_t* client, txnid_t txnid) {
+    if (txnid >= MAX_TXN_COUNT) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+
+    mtx_lock(&client->lock);
+    zx_status_t status = wait_locked(client, txnid);
+    mtx_unlock(&client->lock);
+    return status;
+}
+
+zx_status_t block_fifo_poll(fifo_client_t* client) {
+    block_fifo_response_t responses[MAX_TXN_COUNT];
+    mtx_lock(&client->lock);
+    if (client->reading) {
+        // The thread currently reading will process any pending responses.
+        mtx_unlock(&client->lock);
+        return ZX_OK;
+    }
+
+    // Claim the reader role so that no waiter starts a blocking read which
+    // could have its response consumed by us.
+    client->reading = true;
+    zx_status_t status;
+    while (true) {
+        uint32_t count;
+        status = zx_fifo_read(client->fifo, responses, sizeof(responses), &count);
+        if (status != ZX_OK) {
+            break;
+        }
+        complete_locked(client, responses, count);
+    }
+    client->reading = false;
+    cnd_broadcast(&client->cond);
+    mtx_unlock(&client->lock);
+    return status == ZX_ERR_SHOULD_WAIT ? ZX_OK : status;
 }
@@ -14,8 +14,12 @@ __BEGIN_CDECLS
 
 typedef struct fifo_client fifo_client_t;
 
+// Invoked with the status of an asynchronous transaction once its response
+// has been received.
+typedef void (*block_fifo_callback_t)(void* cookie, zx_status_t status);
+
 // Allocates a block fifo client. The client is thread-safe, as long
-// as each thread accessing the client uses a distinct txnid.
+// as no two outstanding transactions use the same txnid.
 zx_status_t block_fifo_create_client(zx_handle_t fifo, fifo_client_t** out);
 
 // Frees a block fifo client
@@ -37,4 +41,28 @@ void block_fifo_release_client(fifo_client_t* client);
 // dev_offset                               read, write
 zx_status_t block_fifo_txn(fifo_client_t* client, block_fifo_request_t* requests, size_t count);
 
+// Sends 'count' block device requests without waiting for a response.
+// Requests are filled in as for |block_fifo_txn|.
+//
+// Returns ZX_ERR_UNAVAILABLE if a transaction is already outstanding on the
+// txnid. By allocating several txnids, a single thread may keep up to
+// MAX_TXN_COUNT transactions in flight.
+//
+// Responses are only read from the FIFO by a thread calling |block_fifo_txn|,
+// |block_fifo_wait|, or |block_fifo_poll|. When the response for this
+// transaction is read, 'callback' (if not NULL) is invoked with 'cookie' on
+// the reading thread. Callbacks must not wait on the client.
+zx_status_t block_fifo_txn_async(fifo_client_t* client, block_fifo_request_t* requests,
+                                 size_t count, block_fifo_callback_t callback, void* cookie);
+
+// Blocks until the transaction outstanding on 'txnid' (if any) completes,
+// and returns its status. Responses for other transactions which are read
+// in the meantime are completed as well.
+zx_status_t block_fifo_wait(fifo_client_t* client, txnid_t txnid);
+
+// Completes every transaction whose response is already available in the FIFO,
+// without blocking. Intended to be called when the FIFO becomes readable, for
+// example from an async_wait_t handler waiting on ZX_FIFO_READABLE.
+zx_status_t block_fifo_poll(fifo_client_t* client);
+
 __END_CDECLS
@@ -58,6 +58,17 @@ public:
     static zx_status_t Create(const void* data, size_t data_len, void* tree,
                               size_t tree_len, Digest* digest);
 
+    // Like |Create|, but spreads the hashing of the tree across up to
+    // |num_threads| threads (including the calling thread).  The data nodes
+    // are divided into groups which each fill one node of the next level up,
+    // and each group's parent node is hashed as soon as the group completes.
+    // The resulting tree and root digest are identical to those produced by
+    // |Create|.  The extra threads come from a pool shared by all callers,
+    // which grows to the largest |num_threads| - 1 requested and is reused
+    // from then on.
+    static zx_status_t CreateParallel(const void* data, size_t data_len, void* tree,
+                                      size_t tree_len, Digest* digest, size_t num_threads);
+
     // Checks the integrity of a the region of data given by the offset and
     // length.  It checks integrity using the given Merkle tree and trusted root
     // digest. |tree_len| must be at least as much as returned by
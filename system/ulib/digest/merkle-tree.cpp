@@ -4,12 +4,14 @@
 
 #include <digest/merkle-tree.h>
 
+#include <pthread.h>
 #include <stdint.h>
 #include <string.h>
 
 #include <digest/digest.h>
 #include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
+#include <fbl/atomic.h>
 #include <fbl/unique_ptr.h>
 #include <zircon/assert.h>
 #include <zircon/errors.h>
@@ -94,6 +96,154 @@ size_t NextAligned(size_t length) {
     return fbl::round_up(NextLength(length), MerkleTree::kNodeSize);
 }
 
+////////
+// Helper functions for creating the tree in parallel.
+
+// Hashes nodes [first, last) of a level of the tree which holds |data_len|
+// bytes of |data| at height |level|.  The digest of node |n| is written to
+// |out + n * Digest::kLength|.  The digests are the same as those produced for
+// the level by |MerkleTree::CreateUpdate|.
+zx_status_t HashNodes(const uint8_t* data, size_t data_len, uint64_t level, size_t first,
+                      size_t last, uint8_t* out) {
+    zx_status_t rc;
+    Digest digest;
+    for (size_t n = first; n < last; ++n) {
+        size_t offset = n * MerkleTree::kNodeSize;
+        if ((rc = DigestInit(&digest, offset | level, data_len - offset)) != ZX_OK) {
+            return rc;
+        }
+        offset += DigestUpdate(&digest, data + offset, offset, data_len - offset);
+        DigestFinal(&digest, offset);
+        if ((rc = digest.CopyTo(out + n * Digest::kLength, Digest::kLength)) != ZX_OK) {
+            return rc;
+        }
+    }
+    return ZX_OK;
+}
+
+// State shared between the threads of |MerkleTree::CreateParallel|.  The data
+// nodes are split into groups of |kDigestsPerNode|, and each group is hashed
+// into a single node of |level1|.  That node is then immediately hashed into
+// |level2|, while it is still hot in the cache.
+struct ParallelCreate {
+    const uint8_t* data;
+    size_t data_len;
+    uint8_t* level1;
+    size_t level1_len;
+    uint8_t* level2;
+    size_t num_groups;
+    fbl::atomic<size_t> next_group;
+    fbl::atomic<zx_status_t> status;
+
+    // The fields below are protected by |gPoolLock|.
+    ParallelCreate* next;
+    // The number of pool threads allowed to help with, and currently helping
+    // with, this tree.
+    size_t max_helpers;
+    size_t helpers;
+};
+
+void* ParallelCreateWorker(void* arg) {
+    ParallelCreate* pc = static_cast<ParallelCreate*>(arg);
+    const size_t num_nodes = fbl::round_up(pc->data_len, MerkleTree::kNodeSize) /
+                             MerkleTree::kNodeSize;
+    size_t group;
+    while (pc->status.load() == ZX_OK &&
+           (group = pc->next_group.fetch_add(1)) < pc->num_groups) {
+        size_t first = group * kDigestsPerNode;
+        size_t last = fbl::min(first + kDigestsPerNode, num_nodes);
+        // Zero the unused digests in the last node of the level.
+        uint8_t* node = pc->level1 + group * MerkleTree::kNodeSize;
+        size_t used = (last - first) * Digest::kLength;
+        memset(node + used, 0, MerkleTree::kNodeSize - used);
+        zx_status_t rc;
+        if ((rc = HashNodes(pc->data, pc->data_len, 0, first, last, pc->level1)) != ZX_OK ||
+            (rc = HashNodes(pc->level1, pc->level1_len, 1, group, group + 1, pc->level2)) !=
+                ZX_OK) {
+            pc->status.store(rc);
+        }
+    }
+    return nullptr;
+}
+
+// Helper threads are shared by every call to |MerkleTree::CreateParallel| in
+// the process, so that concurrent calls (such as the host blobstore tool
+// adding many blobs at once) do not each start a thread per CPU.  The pool
+// only grows, up to the largest number of helpers any one call has asked
+// for, and its threads live until the process exits.
+pthread_mutex_t gPoolLock = PTHREAD_MUTEX_INITIALIZER;
+// Signaled when a tree is added to |gPoolWork|.
+pthread_cond_t gPoolWorkCond = PTHREAD_COND_INITIALIZER;
+// Signaled when a tree's last helper leaves it.
+pthread_cond_t gPoolDoneCond = PTHREAD_COND_INITIALIZER;
+ParallelCreate* gPoolWork = nullptr;
+size_t gPoolThreads = 0;
+
+// Returns a tree which still has unclaimed groups and room for another
+// helper, or null if there are none.
+ParallelCreate* PoolFindWork() {
+    for (ParallelCreate* pc = gPoolWork; pc != nullptr; pc = pc->next) {
+        if (pc->helpers < pc->max_helpers && pc->status.load() == ZX_OK &&
+            pc->next_group.load() < pc->num_groups) {
+            return pc;
+        }
+    }
+    return nullptr;
+}
+
+void* PoolThread(void* arg) {
+    pthread_mutex_lock(&gPoolLock);
+    for (;;) {
+        ParallelCreate* pc;
+        while ((pc = PoolFindWork()) == nullptr) {
+            pthread_cond_wait(&gPoolWorkCond, &gPoolLock);
+        }
+        ++pc->helpers;
+        pthread_mutex_unlock(&gPoolLock);
+        ParallelCreateWorker(pc);
+        pthread_mutex_lock(&gPoolLock);
+        if (--pc->helpers == 0) {
+            pthread_cond_broadcast(&gPoolDoneCond);
+        }
+    }
+    return nullptr;
+}
+
+// Hashes the groups of |pc| on the calling thread and up to |num_helpers|
+// pool threads, returning once all of them are done.
+void PoolRun(ParallelCreate* pc, size_t num_helpers) {
+    pthread_mutex_lock(&gPoolLock);
+    // If fewer threads can be started than requested, the groups are simply
+    // picked up by those which were.
+    while (gPoolThreads < num_helpers) {
+        pthread_t thread;
+        if (pthread_create(&thread, nullptr, PoolThread, nullptr) != 0) {
+            break;
+        }
+        pthread_detach(thread);
+        ++gPoolThreads;
+    }
+    pc->max_helpers = num_helpers;
+    pc->helpers = 0;
+    pc->next = gPoolWork;
+    gPoolWork = pc;
+    pthread_cond_broadcast(&gPoolWorkCond);
+    pthread_mutex_unlock(&gPoolLock);
+
+    ParallelCreateWorker(pc);
+
+    pthread_mutex_lock(&gPoolLock);
+    ParallelCreate** link = &gPoolWork;
+    while (*link != pc) {
+        link = &(*link)->next;
+    }
+    *link = pc->next;
+    while (pc->helpers != 0) {
+        pthread_cond_wait(&gPoolDoneCond, &gPoolLock);
+    }
+    pthread_mutex_unlock(&gPoolLock);
+}
+
 } // namespace
 
 ////////
@@ -116,6 +266,66 @@ zx_status_t MerkleTree::Create(const void* data, size_t data_len, void* tree, si
     return ZX_OK;
 }
 
+zx_status_t MerkleTree::CreateParallel(const void* data, size_t data_len, void* tree,
+                                       size_t tree_len, Digest* digest, size_t num_threads) {
+    zx_status_t rc;
+    // Trees with no more than one node above the data are not worth splitting.
+    size_t level1_len = NextAligned(data_len);
+    size_t num_groups = level1_len / kNodeSize;
+    if (num_threads <= 1 || num_groups <= 1) {
+        return Create(data, data_len, tree, tree_len, digest);
+    }
+    if (tree_len < GetTreeLength(data_len)) {
+        return ZX_ERR_BUFFER_TOO_SMALL;
+    }
+    if (!data || !tree || !digest) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    num_threads = fbl::min(num_threads, num_groups);
+
+    // Hash the data and the first two levels above it.
+    ParallelCreate pc;
+    pc.data = static_cast<const uint8_t*>(data);
+    pc.data_len = data_len;
+    pc.level1 = static_cast<uint8_t*>(tree);
+    pc.level1_len = level1_len;
+    pc.level2 = pc.level1 + level1_len;
+    pc.num_groups = num_groups;
+    pc.next_group.store(0);
+    pc.status.store(ZX_OK);
+    PoolRun(&pc, num_threads - 1);
+    if ((rc = pc.status.load()) != ZX_OK) {
+        return rc;
+    }
+
+    // The remaining levels hold at most 1/|kDigestsPerNode|^2 as many bytes as
+    // the data, so they are hashed on the calling thread.
+    uint64_t level = 2;
+    uint8_t* in = pc.level2;
+    size_t length = NextAligned(level1_len);
+    size_t used = num_groups * Digest::kLength;
+    memset(in + used, 0, length - used);
+    while (length > kNodeSize) {
+        uint8_t* out = in + length;
+        size_t num_nodes = length / kNodeSize;
+        if ((rc = HashNodes(in, length, level, 0, num_nodes, out)) != ZX_OK) {
+            return rc;
+        }
+        size_t next_len = NextAligned(length);
+        used = num_nodes * Digest::kLength;
+        memset(out + used, 0, next_len - used);
+        in = out;
+        length = next_len;
+        ++level;
+    }
+    uint8_t root[Digest::kLength];
+    if ((rc = HashNodes(in, length, level, 0, 1, root)) != ZX_OK) {
+        return rc;
+    }
+    *digest = root;
+    return ZX_OK;
+}
+
 MerkleTree::MerkleTree() : initialized_(false), next_(nullptr), level_(0), offset_(0), length_(0) {}
 
 MerkleTree::~MerkleTree() {}
@@ -31,6 +31,24 @@ static zx_status_t read_at(fdio_t* io, void* buf, size_t len, off_t offset,
     return ZX_OK;
 }
 
+// Asks the server for a private, copy-on-write clone of the file, the same
+// request made by mmap(MAP_PRIVATE), and clones it down to |size| bytes.
+// Servers which cannot map the file reject the request, and zx_vmo_clone
+// rejects a mapping without the duplicate and read rights.
+static zx_status_t clone_file_vmo(fdio_t* io, uint64_t size, zx_handle_t* out_vmo) {
+    zxrio_mmap_data_t data;
+    data.offset = 0;
+    data.length = size;
+    data.flags = FDIO_MMAP_FLAG_READ | FDIO_MMAP_FLAG_EXEC | FDIO_MMAP_FLAG_PRIVATE;
+    zx_status_t status = io->ops->misc(io, ZXRIO_MMAP, 0, sizeof(data), &data, sizeof(data));
+    if (status < 0)
+        return status;
+    zx_handle_t vmo = status;
+    status = zx_vmo_clone(vmo, ZX_VMO_CLONE_COPY_ON_WRITE, data.offset, size, out_vmo);
+    zx_handle_close(vmo);
+    return status;
+}
+
 static zx_status_t read_file_into_vmo(fdio_t* io, zx_handle_t* out_vmo) {
     zx_handle_t current_vmar_handle = zx_vmar_root_self();
 
@@ -44,7 +62,13 @@ static zx_status_t read_file_into_vmo(fdio_t* io, zx_handle_t* out_vmo) {
     uint64_t size = attr.size;
     uint64_t offset = 0;
 
-    zx_status_t status = zx_vmo_create(size, 0, out_vmo);
+    // Cloning the file, if the server allows it, avoids copying the contents
+    // through read messages.
+    zx_status_t status = clone_file_vmo(io, size, out_vmo);
+    if (status == ZX_OK)
+        return ZX_OK;
+
+    status = zx_vmo_create(size, 0, out_vmo);
     if (status != ZX_OK)
         return status;
 
@@ -57,6 +57,9 @@ zx_status_t fdio_pipe_half(zx_handle_t* handle, uint32_t* type);
 // Get a read-only VMO containing the whole contents of the file.
 // This function creates a clone of the underlying VMO when possible, falling
 // back to eagerly reading the contents into a freshly-created VMO.
+// A clone is not a snapshot: if the file is written afterwards (as a memfs
+// file may be), the clone reflects those writes, up to the length the file
+// had when it was cloned.
 zx_status_t fdio_get_vmo(int fd, zx_handle_t* out_vmo);
 
 // Get a read-only handle to the exact VMO used by the file system server to
@@ -58,7 +58,12 @@ __BEGIN_CDECLS
 #define ZXRIO_LINK        (0x0000001a | ZXRIO_ONE_HANDLE)
 #define ZXRIO_MMAP         0x0000001b
 #define ZXRIO_FCNTL        0x0000001c
-#define ZXRIO_NUM_OPS      29
+#define ZXRIO_SETBUFFER   (0x0000001d | ZXRIO_ONE_HANDLE)
+#define ZXRIO_READ_BUFFER  0x0000001e
+#define ZXRIO_READ_AT_BUFFER 0x0000001f
+#define ZXRIO_WRITE_BUFFER 0x00000020
+#define ZXRIO_WRITE_AT_BUFFER 0x00000021
+#define ZXRIO_NUM_OPS      34
 
 #define ZXRIO_OP(n)        ((n) & 0x3FF) // opcode
 #define ZXRIO_HC(n)        (((n) >> 8) & 3) // handle count
@@ -71,7 +76,9 @@ __BEGIN_CDECLS
     "read_at", "write_at", "truncate", "rename", \
     "connect", "bind", "listen", "getsockname", \
     "getpeername", "getsockopt", "setsockopt", "getaddrinfo", \
-    "setattr", "sync", "link", "mmap", "fcntl" }
+    "setattr", "sync", "link", "mmap", \
+    "fcntl", "setbuffer", "read_buffer", "read_at_buffer", \
+    "write_buffer", "write_at_buffer" }
 
 // dispatcher callback return code that there were no messages to read
 #define ERR_DISPATCHER_NO_WORK ZX_ERR_SHOULD_WAIT
@@ -238,6 +245,16 @@ static_assert(FDIO_CHUNK_SIZE >= PATH_MAX, "FDIO_CHUNK_SIZE must be large enough
 // LINK        0          0        <name1>0<name2>0  0           -               -
 // MMAP        maxreply   0        mmap_data_msg     0           mmap_data_msg   vmohandle
 // FCNTL       cmd        flags    0                 flags       -               -
+// SETBUFFER   0          0        -                 0           -               -
+// READ_BUF    maxread    0        -                 newoffset   -               -
+// READ_AT_BUF maxread    offset   -                 0           -               -
+// WRITE_BUF   len        0        -                 newoffset   -               -
+// WRITE_AT_BUF len       offset   -                 0           -               -
+//
+// SETBUFFER attaches the VMO in handle[0] to the connection. The *_BUFFER
+// variants of READ and WRITE then move their bytes through the start of that
+// VMO rather than the message payload, so a single call may transfer up to
+// the size of the VMO.
 //
 // proposed:
 //
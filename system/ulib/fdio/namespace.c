@@ -504,6 +504,7 @@ static fdio_t* fdio_dir_create_locked(fdio_ns_t* ns, mxvn_t* vn, zx_handle_t h)
     } else {
         dir->rio.h = fdio_service_clone(vn->remote);
     }
+    mtx_init(&dir->rio.readahead.lock, mtx_plain);
     dir->ns = ns;
     dir->vn = vn;
     atomic_init(&dir->seq, 0);
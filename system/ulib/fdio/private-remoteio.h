@@ -6,6 +6,50 @@
 
 #include "private.h"
 
+// Largest number of read-ahead requests kept in flight.
+#define FDIO_READAHEAD_MAX 8
+
+typedef struct zxrio_readahead zxrio_readahead_t;
+struct zxrio_readahead {
+    mtx_t lock;
+
+    // Set once the connection is known not to refer to a regular file, or
+    // once it has been closed or unwrapped.
+    bool disabled;
+    // Set once the connection is known to refer to a regular file.
+    bool checked;
+
+    // Consecutive read()s seen since the last other operation.
+    uint32_t streak;
+    // Number of requests to keep in flight.
+    uint32_t window;
+    // Bytes consumed since |window| last grew.
+    size_t consumed;
+
+    // Transaction ids of the outstanding requests, oldest first.
+    zx_txid_t txid[FDIO_READAHEAD_MAX];
+    uint32_t head;
+    uint32_t inflight;
+
+    // Data received but not yet consumed lies in data[start, end).
+    // Allocated once read-ahead first begins.
+    uint8_t* data;
+    size_t start;
+    size_t end;
+    // Seek offset of the server after the last successful reply.
+    int64_t offset;
+    // Set once a reply came back short; no more requests are sent.
+    bool eof;
+    // Error returned by a request, reported by the next read().
+    zx_status_t error;
+    // Value of the process-wide write count when read-ahead last began.
+    uint32_t gen;
+
+    // Calls sent by zxrio_txn() without |lock| held and not yet answered.
+    // Read-ahead does not begin while there are any.
+    uint32_t calls;
+};
+
 typedef struct zxrio zxrio_t;
 struct zxrio {
     // base fdio io object
@@ -19,8 +63,26 @@ struct zxrio {
 
     // transaction id used for synchronous remoteio calls
     _Atomic zx_txid_t txid;
+
+    // VMO shared with the server through ZXRIO_SETBUFFER, used to move
+    // large reads and writes in a single call. Created on first use.
+    zx_handle_t buffer;
+
+    // One of the ZXRIO_BUFFER_* states below.
+    atomic_int buffer_state;
+
+    // Held by the thread currently transferring through |buffer|.
+    atomic_flag buffer_busy;
+
+    // State of read-ahead for sequential reads. Freed along with the
+    // object, once the last reference to it is released.
+    zxrio_readahead_t readahead;
 };
 
+#define ZXRIO_BUFFER_NONE        0
+#define ZXRIO_BUFFER_ATTACHED    1
+#define ZXRIO_BUFFER_UNSUPPORTED 2
+
 // These are for the benefit of namespace.c
 // which needs lower level access to remoteio internals
 
@@ -204,6 +204,16 @@ void __fdio_startup_handles_init(uint32_t num, zx_handle_t handles[],
 
 void __fdio_rchannel_init(void) __attribute__((visibility("hidden")));
 
+// Stores |io| in fdtab entry |fd|, or clears it if |io| is NULL.
+// Must be called with fdio_lock held, or before other threads exist.
+void __fdio_fdtab_set(int fd, fdio_t* io) __attribute__((visibility("hidden")));
+
+// Waits until every fdtab lookup which may have seen an entry cleared
+// before the call has finished. Must be called after clearing an entry
+// and before releasing the reference it held. It blocks, so callers
+// should release fdio_lock first where they can.
+void __fdio_fdtab_sync(void) __attribute__((visibility("hidden")));
+
 typedef struct {
     mtx_t lock;
     mtx_t cwd_lock;
@@ -211,7 +221,10 @@ typedef struct {
     mode_t umask;
     fdio_t* root;
     fdio_t* cwd;
-    fdio_t* fdtab[FDIO_MAX_FD];
+    // Entries are read without fdio_lock held; see __fdio_fd_to_io().
+    _Atomic(fdio_t*) fdtab[FDIO_MAX_FD];
+    // One bit per fdtab entry in use, protected by fdio_lock.
+    uint64_t fdtab_used[(FDIO_MAX_FD + 63) / 64];
     fdio_ns_t* ns;
     char cwd_path[PATH_MAX];
 } fdio_state_t;
@@ -25,6 +25,7 @@
 #include <fdio/namespace.h>
 #include <fdio/remoteio.h>
 #include <fdio/util.h>
+#include <fdio/vfs.h>
 
 #include "private-remoteio.h"
 
@@ -206,7 +207,7 @@ zx_status_t zxrio_txn_handoff(zx_handle_t srv, zx_handle_t reply, zxrio_msg_t* m
 
 // on success, msg->hcount indicates number of valid handles in msg->handle
 // on error there are never any handles
-static zx_status_t zxrio_txn(zxrio_t* rio, zxrio_msg_t* msg) {
+static zx_status_t zxrio_call(zxrio_t* rio, zxrio_msg_t* msg) {
     if (!is_message_valid(msg)) {
         return ZX_ERR_INVALID_ARGS;
     }
@@ -260,6 +261,305 @@ fail_discard_handles:
     return r;
 }
 
+// Sequential read()s of regular files keep up to FDIO_READAHEAD_MAX
+// ZXRIO_READ requests of FDIO_CHUNK_SIZE bytes in flight, so the server
+// reads ahead while the caller processes the data already returned.
+//
+// The requests advance the seek offset of the connection, so before any
+// other operation is sent the outstanding replies are drained and the
+// offset is moved back to the first byte the caller has not consumed.
+//
+// Data read ahead may be overtaken by writes through other connections to
+// the same file. Such writes from this process are counted in
+// zxrio_write_gen, and read-ahead drops its data whenever the count moves.
+// Writes from other processes, or through mappings, are not seen.
+#define FDIO_READAHEAD_SIZE (FDIO_READAHEAD_MAX * FDIO_CHUNK_SIZE)
+
+// Number of consecutive small read()s after which read-ahead begins.
+#define FDIO_READAHEAD_THRESHOLD 2
+
+static atomic_uint zxrio_write_gen;
+
+// Returns true if |op| may change the contents or size of a file.
+static bool zxrio_op_modifies(uint32_t op) {
+    switch (ZXRIO_OP(op)) {
+    case ZXRIO_WRITE:
+    case ZXRIO_WRITE_AT:
+    case ZXRIO_WRITE_BUFFER:
+    case ZXRIO_WRITE_AT_BUFFER:
+    case ZXRIO_TRUNCATE:
+        return true;
+    default:
+        return false;
+    }
+}
+
+static bool zxrio_readahead_pending(zxrio_readahead_t* ra) {
+    return (ra->inflight > 0) || (ra->end > ra->start) || ra->eof || (ra->error < 0);
+}
+
+// Sends requests until |window| are in flight, or the data buffer could
+// not hold their replies.
+static void zxrio_readahead_submit(zxrio_t* rio, zxrio_readahead_t* ra) {
+    if (ra->eof || (ra->error < 0)) {
+        return;
+    }
+    if (ra->start == ra->end) {
+        ra->start = ra->end = 0;
+    } else if (ra->start > 0) {
+        memmove(ra->data, ra->data + ra->start, ra->end - ra->start);
+        ra->end -= ra->start;
+        ra->start = 0;
+    }
+    while ((ra->inflight < ra->window) &&
+           (ra->end + (ra->inflight + 1) * FDIO_CHUNK_SIZE <= FDIO_READAHEAD_SIZE)) {
+        zxrio_msg_t msg;
+        memset(&msg, 0, ZXRIO_HDR_SZ);
+        msg.txid = atomic_fetch_add(&rio->txid, 1);
+        msg.op = ZXRIO_READ;
+        msg.arg = FDIO_CHUNK_SIZE;
+        zx_status_t r = zx_channel_write(rio->h, 0, &msg, ZXRIO_HDR_SZ, NULL, 0);
+        if (r != ZX_OK) {
+            ra->error = r;
+            return;
+        }
+        ra->txid[(ra->head + ra->inflight) % FDIO_READAHEAD_MAX] = msg.txid;
+        ra->inflight++;
+    }
+}
+
+// Waits for the reply to the oldest outstanding request and appends its
+// data to the buffer.
+static void zxrio_readahead_receive(zxrio_t* rio, zxrio_readahead_t* ra) {
+    zxrio_msg_t msg;
+    uint32_t dsize;
+    uint32_t hcount;
+    zx_status_t r;
+    for (;;) {
+        r = zx_channel_read(rio->h, 0, &msg, msg.handle, ZXRIO_HDR_SZ + FDIO_CHUNK_SIZE,
+                            FDIO_MAX_HANDLES, &dsize, &hcount);
+        if (r != ZX_ERR_SHOULD_WAIT) {
+            break;
+        }
+        zx_signals_t pending;
+        r = zx_object_wait_one(rio->h, ZX_CHANNEL_READABLE | ZX_CHANNEL_PEER_CLOSED,
+                               ZX_TIME_INFINITE, &pending);
+        if (r != ZX_OK) {
+            break;
+        }
+        if (!(pending & ZX_CHANNEL_READABLE)) {
+            r = ZX_ERR_PEER_CLOSED;
+            break;
+        }
+    }
+
+    zx_txid_t txid = ra->txid[ra->head];
+    ra->head = (ra->head + 1) % FDIO_READAHEAD_MAX;
+    ra->inflight--;
+
+    if (r != ZX_OK) {
+        ra->error = r;
+        return;
+    }
+    discard_handles(msg.handle, hcount);
+    if (!is_message_reply_valid(&msg, dsize) || (ZXRIO_OP(msg.op) != ZXRIO_STATUS) ||
+        (msg.txid != txid) || (msg.arg > (int32_t)msg.datalen)) {
+        ra->error = ZX_ERR_IO;
+        return;
+    }
+    if (msg.arg < 0) {
+        ra->error = msg.arg;
+        return;
+    }
+    memcpy(ra->data + ra->end, msg.data, msg.arg);
+    ra->end += msg.arg;
+    ra->offset = msg.arg2.off;
+    if (msg.arg < FDIO_CHUNK_SIZE) {
+        ra->eof = true;
+    }
+}
+
+// Drains the outstanding requests, drops the data read ahead and moves
+// the seek offset back to the first byte not yet returned by read().
+static void zxrio_readahead_cancel_locked(zxrio_t* rio, zxrio_readahead_t* ra) {
+    if (!zxrio_readahead_pending(ra)) {
+        return;
+    }
+    while (ra->inflight > 0) {
+        zxrio_readahead_receive(rio, ra);
+    }
+    if (ra->end > ra->start) {
+        zxrio_msg_t msg;
+        memset(&msg, 0, ZXRIO_HDR_SZ);
+        msg.op = ZXRIO_SEEK;
+        msg.arg = SEEK_SET;
+        msg.arg2.off = ra->offset - (int64_t)(ra->end - ra->start);
+        if (zxrio_call(rio, &msg) >= 0) {
+            discard_handles(msg.handle, msg.hcount);
+        }
+    }
+    ra->start = ra->end = 0;
+    ra->eof = false;
+    ra->error = ZX_OK;
+    ra->window = 0;
+    ra->consumed = 0;
+}
+
+// Stops read-ahead for good once the connection is closed or unwrapped.
+// The state itself lives as long as |rio|, as other threads holding a
+// reference may still call read() and find read-ahead disabled.
+static void zxrio_readahead_stop(zxrio_t* rio) {
+    zxrio_readahead_t* ra = &rio->readahead;
+    mtx_lock(&ra->lock);
+    while (ra->inflight > 0) {
+        zxrio_readahead_receive(rio, ra);
+    }
+    ra->disabled = true;
+    ra->start = ra->end = 0;
+    free(ra->data);
+    ra->data = NULL;
+    mtx_unlock(&ra->lock);
+}
+
+// Returns true if the connection refers to a regular file, whose reads
+// have no side effects and may safely be issued ahead of the caller.
+static bool zxrio_readahead_check(zxrio_t* rio) {
+    zxrio_msg_t msg;
+    memset(&msg, 0, ZXRIO_HDR_SZ);
+    msg.op = ZXRIO_STAT;
+    msg.arg = sizeof(vnattr_t);
+    if (zxrio_call(rio, &msg) < 0) {
+        return false;
+    }
+    discard_handles(msg.handle, msg.hcount);
+    if (msg.datalen < sizeof(vnattr_t)) {
+        return false;
+    }
+    vnattr_t attr;
+    memcpy(&attr, msg.data, sizeof(attr));
+    return (attr.mode & V_TYPE_MASK) == V_TYPE_FILE;
+}
+
+// Serves a read() of at most FDIO_CHUNK_SIZE bytes from read-ahead.
+// Returns ZX_ERR_NOT_SUPPORTED if the read should be sent on its own.
+static ssize_t zxrio_readahead_read(zxrio_t* rio, uint8_t* data, size_t len) {
+    zxrio_readahead_t* ra = &rio->readahead;
+    mtx_lock(&ra->lock);
+    if (ra->disabled) {
+        mtx_unlock(&ra->lock);
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    uint32_t gen = atomic_load(&zxrio_write_gen);
+    if (ra->gen != gen) {
+        // The file may have been written since the data was read ahead.
+        zxrio_readahead_cancel_locked(rio, ra);
+    }
+    if (!zxrio_readahead_pending(ra)) {
+        if (ra->streak < FDIO_READAHEAD_THRESHOLD) {
+            ra->streak++;
+            mtx_unlock(&ra->lock);
+            return ZX_ERR_NOT_SUPPORTED;
+        }
+        if (ra->calls > 0) {
+            mtx_unlock(&ra->lock);
+            return ZX_ERR_NOT_SUPPORTED;
+        }
+        if (!ra->checked) {
+            if (!zxrio_readahead_check(rio)) {
+                ra->disabled = true;
+                mtx_unlock(&ra->lock);
+                return ZX_ERR_NOT_SUPPORTED;
+            }
+            ra->checked = true;
+        }
+        if ((ra->data == NULL) && ((ra->data = malloc(FDIO_READAHEAD_SIZE)) == NULL)) {
+            mtx_unlock(&ra->lock);
+            return ZX_ERR_NOT_SUPPORTED;
+        }
+        ra->gen = gen;
+        ra->window = 2;
+    }
+
+    ssize_t count = 0;
+    zx_status_t r = ZX_OK;
+    while (len > 0) {
+        if (ra->end > ra->start) {
+            size_t n = ra->end - ra->start;
+            if (n > len) {
+                n = len;
+            }
+            memcpy(data, ra->data + ra->start, n);
+            ra->start += n;
+            ra->consumed += n;
+            data += n;
+            len -= n;
+            count += n;
+        } else if (ra->inflight > 0) {
+            zxrio_readahead_receive(rio, ra);
+        } else if (ra->error < 0) {
+            // Report errors once the data before them has been consumed.
+            if (count == 0) {
+                r = ra->error;
+                ra->error = ZX_OK;
+            }
+            break;
+        } else if (ra->eof) {
+            // End of file. Stop reading ahead once it has been reported,
+            // as later reads may find the file has grown.
+            if (count == 0) {
+                ra->eof = false;
+                ra->window = 0;
+            }
+            break;
+        } else {
+            zxrio_readahead_submit(rio, ra);
+        }
+    }
+
+    // Grow the window while the caller keeps consuming whole windows.
+    if (ra->consumed >= ra->window * FDIO_CHUNK_SIZE) {
+        ra->consumed = 0;
+        if (ra->window < FDIO_READAHEAD_MAX) {
+            ra->window *= 2;
+        }
+    }
+    zxrio_readahead_submit(rio, ra);
+    mtx_unlock(&ra->lock);
+    return count ? count : r;
+}
+
+// on success, msg->hcount indicates number of valid handles in msg->handle
+// on error there are never any handles
+static zx_status_t zxrio_txn(zxrio_t* rio, zxrio_msg_t* msg) {
+    zxrio_readahead_t* ra = &rio->readahead;
+    uint32_t op = msg->op;
+    zx_status_t r;
+
+    mtx_lock(&ra->lock);
+    zxrio_readahead_cancel_locked(rio, ra);
+    if (ZXRIO_OP(op) != ZXRIO_READ) {
+        ra->streak = 0;
+    }
+    if (ra->checked && !ra->disabled) {
+        // Keep read-ahead from resuming on a regular file until the call
+        // is answered, so that it never reads from before a seek or write.
+        r = zxrio_call(rio, msg);
+    } else {
+        // Other connections may block on a call indefinitely, so |lock|
+        // is released. Read-ahead cannot begin until the call is answered.
+        ra->calls++;
+        mtx_unlock(&ra->lock);
+        r = zxrio_call(rio, msg);
+        mtx_lock(&ra->lock);
+        ra->calls--;
+    }
+    if (zxrio_op_modifies(op)) {
+        atomic_fetch_add(&zxrio_write_gen, 1);
+    }
+    mtx_unlock(&ra->lock);
+    return r;
+}
+
 ssize_t zxrio_ioctl(fdio_t* io, uint32_t op, const void* in_buf,
                     size_t in_len, void* out_buf, size_t out_len) {
     zxrio_t* rio = (zxrio_t*)io;
@@ -359,6 +659,162 @@ ssize_t zxrio_ioctl(fdio_t* io, uint32_t op, const void* in_buf,
     return r;
 }
 
+// Size of the VMO shared with the server for transfers which do not fit in
+// a single message.
+#define FDIO_BUFFER_SIZE (256u * 1024u)
+
+// Claims the shared buffer of |rio| for the calling thread, attaching it to
+// the connection first if needed. Returns false if the buffer cannot be used,
+// in which case the caller falls back to FDIO_CHUNK_SIZE messages.
+static bool zxrio_buffer_acquire(zxrio_t* rio) {
+    if (atomic_load(&rio->buffer_state) == ZXRIO_BUFFER_UNSUPPORTED) {
+        return false;
+    }
+    if (atomic_flag_test_and_set(&rio->buffer_busy)) {
+        // In use by another thread.
+        return false;
+    }
+    if (atomic_load(&rio->buffer_state) == ZXRIO_BUFFER_ATTACHED) {
+        return true;
+    }
+
+    zx_handle_t vmo;
+    zx_handle_t remote;
+    zx_status_t r;
+    if ((r = zx_vmo_create(FDIO_BUFFER_SIZE, 0, &vmo)) != ZX_OK) {
+        goto fail;
+    }
+    if ((r = zx_handle_duplicate(vmo, ZX_RIGHT_TRANSFER | ZX_RIGHT_READ | ZX_RIGHT_WRITE,
+                                 &remote)) != ZX_OK) {
+        zx_handle_close(vmo);
+        goto fail;
+    }
+
+    zxrio_msg_t msg;
+    memset(&msg, 0, ZXRIO_HDR_SZ);
+    msg.op = ZXRIO_SETBUFFER;
+    msg.hcount = 1;
+    msg.handle[0] = remote;
+    if ((r = zxrio_txn(rio, &msg)) < 0) {
+        // Servers which predate ZXRIO_SETBUFFER, or which do not serve
+        // files, are not asked again.
+        zx_handle_close(vmo);
+        atomic_store(&rio->buffer_state, ZXRIO_BUFFER_UNSUPPORTED);
+        goto fail;
+    }
+    discard_handles(msg.handle, msg.hcount);
+    rio->buffer = vmo;
+    atomic_store(&rio->buffer_state, ZXRIO_BUFFER_ATTACHED);
+    return true;
+
+fail:
+    atomic_flag_clear(&rio->buffer_busy);
+    return false;
+}
+
+static void zxrio_buffer_release(zxrio_t* rio) {
+    atomic_flag_clear(&rio->buffer_busy);
+}
+
+// Transfers that need more than one message go through the shared buffer,
+// one round trip per FDIO_BUFFER_SIZE bytes. Returns ZX_ERR_NOT_SUPPORTED if
+// the buffer is unavailable, before any bytes have been transferred.
+static ssize_t write_buffered(zxrio_t* rio, uint32_t op, const uint8_t* data, size_t len,
+                              off_t offset) {
+    if (!zxrio_buffer_acquire(rio)) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    ssize_t count = 0;
+    zx_status_t r = 0;
+    zxrio_msg_t msg;
+    size_t xfer;
+
+    while (len > 0) {
+        xfer = (len > FDIO_BUFFER_SIZE) ? FDIO_BUFFER_SIZE : len;
+
+        size_t actual;
+        if ((r = zx_vmo_write(rio->buffer, data, 0, xfer, &actual)) != ZX_OK) {
+            break;
+        }
+
+        memset(&msg, 0, ZXRIO_HDR_SZ);
+        msg.op = op;
+        msg.arg = xfer;
+        if (op == ZXRIO_WRITE_AT_BUFFER)
+            msg.arg2.off = offset;
+
+        if ((r = zxrio_txn(rio, &msg)) < 0) {
+            break;
+        }
+        discard_handles(msg.handle, msg.hcount);
+
+        if ((size_t)r > xfer) {
+            r = ZX_ERR_IO;
+            break;
+        }
+        count += r;
+        data += r;
+        len -= r;
+        if (op == ZXRIO_WRITE_AT_BUFFER)
+            offset += r;
+        // stop at short write
+        if ((size_t)r < xfer) {
+            break;
+        }
+    }
+    zxrio_buffer_release(rio);
+    return count ? count : r;
+}
+
+static ssize_t read_buffered(zxrio_t* rio, uint32_t op, uint8_t* data, size_t len,
+                             off_t offset) {
+    if (!zxrio_buffer_acquire(rio)) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    ssize_t count = 0;
+    zx_status_t r = 0;
+    zxrio_msg_t msg;
+    size_t xfer;
+
+    while (len > 0) {
+        xfer = (len > FDIO_BUFFER_SIZE) ? FDIO_BUFFER_SIZE : len;
+
+        memset(&msg, 0, ZXRIO_HDR_SZ);
+        msg.op = op;
+        msg.arg = xfer;
+        if (op == ZXRIO_READ_AT_BUFFER)
+            msg.arg2.off = offset;
+
+        if ((r = zxrio_txn(rio, &msg)) < 0) {
+            break;
+        }
+        discard_handles(msg.handle, msg.hcount);
+
+        if ((size_t)r > xfer) {
+            r = ZX_ERR_IO;
+            break;
+        }
+        size_t actual;
+        zx_status_t status;
+        if ((status = zx_vmo_read(rio->buffer, data, 0, r, &actual)) != ZX_OK) {
+            r = status;
+            break;
+        }
+        count += r;
+        data += r;
+        len -= r;
+        if (op == ZXRIO_READ_AT_BUFFER)
+            offset += r;
+
+        // stop at short read
+        if ((size_t)r < xfer) {
+            break;
+        }
+    }
+    zxrio_buffer_release(rio);
+    return count ? count : r;
+}
+
 static ssize_t write_common(uint32_t op, fdio_t* io, const void* _data, size_t len, off_t offset) {
     zxrio_t* rio = (zxrio_t*)io;
     const uint8_t* data = _data;
@@ -367,6 +823,14 @@ static ssize_t write_common(uint32_t op, fdio_t* io, const void* _data, size_t l
     zxrio_msg_t msg;
     ssize_t xfer;
 
+    if (len > FDIO_CHUNK_SIZE) {
+        uint32_t bop = (op == ZXRIO_WRITE_AT) ? ZXRIO_WRITE_AT_BUFFER : ZXRIO_WRITE_BUFFER;
+        if ((r = write_buffered(rio, bop, data, len, offset)) != ZX_ERR_NOT_SUPPORTED) {
+            return r;
+        }
+        r = 0;
+    }
+
     while (len > 0) {
         xfer = (len > FDIO_CHUNK_SIZE) ? FDIO_CHUNK_SIZE : len;
 
@@ -415,6 +879,14 @@ static ssize_t read_common(uint32_t op, fdio_t* io, void* _data, size_t len, off
     zxrio_msg_t msg;
     ssize_t xfer;
 
+    if (len > FDIO_CHUNK_SIZE) {
+        uint32_t bop = (op == ZXRIO_READ_AT) ? ZXRIO_READ_AT_BUFFER : ZXRIO_READ_BUFFER;
+        if ((r = read_buffered(rio, bop, data, len, offset)) != ZX_ERR_NOT_SUPPORTED) {
+            return r;
+        }
+        r = 0;
+    }
+
     while (len > 0) {
         xfer = (len > FDIO_CHUNK_SIZE) ? FDIO_CHUNK_SIZE : len;
 
@@ -449,6 +921,12 @@ static ssize_t read_common(uint32_t op, fdio_t* io, void* _data, size_t len, off
 }
 
 static ssize_t zxrio_read(fdio_t* io, void* _data, size_t len) {
+    if ((len > 0) && (len <= FDIO_CHUNK_SIZE)) {
+        ssize_t r = zxrio_readahead_read((zxrio_t*)io, _data, len);
+        if (r != ZX_ERR_NOT_SUPPORTED) {
+            return r;
+        }
+    }
     return read_common(ZXRIO_READ, io, _data, len, 0);
 }
 
@@ -485,10 +963,16 @@ zx_status_t zxrio_close(fdio_t* io) {
     if ((r = zxrio_txn(rio, &msg)) >= 0) {
         discard_handles(msg.handle, msg.hcount);
     }
+    zxrio_readahead_stop(rio);
 
     zx_handle_t h = rio->h;
     rio->h = 0;
     zx_handle_close(h);
+    if (rio->buffer != ZX_HANDLE_INVALID) {
+        h = rio->buffer;
+        rio->buffer = ZX_HANDLE_INVALID;
+        zx_handle_close(h);
+    }
     if (rio->h2 > 0) {
         h = rio->h2;
         rio->h2 = 0;
@@ -949,6 +1433,11 @@ zx_status_t __zxrio_clone(zx_handle_t h, zx_handle_t* handles, uint32_t* types)
 static zx_status_t zxrio_unwrap(fdio_t* io, zx_handle_t* handles, uint32_t* types) {
     zxrio_t* rio = (void*)io;
     zx_status_t r;
+    // Replies to read-ahead must not reach the new owner of the channel.
+    mtx_lock(&rio->readahead.lock);
+    zxrio_readahead_cancel_locked(rio, &rio->readahead);
+    mtx_unlock(&rio->readahead.lock);
+    zxrio_readahead_stop(rio);
     handles[0] = rio->h;
     types[0] = PA_FDIO_REMOTE;
     if (rio->h2 != 0) {
@@ -958,6 +1447,7 @@ static zx_status_t zxrio_unwrap(fdio_t* io, zx_handle_t* handles, uint32_t* type
     } else {
         r = 1;
     }
+    zx_handle_close(rio->buffer);
     free(io);
     return r;
 }
@@ -1021,5 +1511,6 @@ fdio_t* fdio_remote_create(zx_handle_t h, zx_handle_t e) {
     rio->h = h;
     rio->h2 = e;
     atomic_init(&rio->txid, 1);
+    mtx_init(&rio->readahead.lock, mtx_plain);
     return &rio->io;
 }
@@ -564,6 +564,7 @@ fdio_t* fdio_socket_create(zx_handle_t h, zx_handle_t s, int flags) {
     rio->io.flags = FDIO_FLAG_SOCKET | flags;
     rio->h = h;
     rio->h2 = s;
+    mtx_init(&rio->readahead.lock, mtx_plain);
     return &rio->io;
 }
 
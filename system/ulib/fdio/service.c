@@ -68,15 +68,17 @@ zx_status_t fdio_get_service_handle(int fd, zx_handle_t* out) {
     }
     fdio_t* io = fdio_fdtab[fd];
     io->dupcount--;
-    fdio_fdtab[fd] = NULL;
+    __fdio_fdtab_set(fd, NULL);
     if (io->dupcount > 0) {
         // still alive in other fdtab slots
         // this fd goes away but we can't give away the handle
         mtx_unlock(&fdio_lock);
+        __fdio_fdtab_sync();
         fdio_release(io);
         return ZX_ERR_UNAVAILABLE;
     } else {
         mtx_unlock(&fdio_lock);
+        __fdio_fdtab_sync();
         int r;
         if (io->ops == &zx_svc_ops) {
             // is a service, extract handle
@@ -52,6 +52,75 @@ fdio_state_t __fdio_global_state = {
     .cwd_path = "/",
 };
 
+// fdtab lookups take no lock. While it loads and acquires an entry, each
+// lookup is counted in one of two reader counts, chosen by the low bit of
+// fdtab_epoch. The counts are sharded, and each thread keeps to one shard,
+// so that lookups from different threads do not contend on a cache line.
+// Writers hold fdio_lock to change an entry; after clearing one they call
+// __fdio_fdtab_sync(), which flips the epoch and waits for the old counts
+// to drain, twice, so that no lookup can still be acquiring the entry
+// when the reference held by the table is dropped.
+#define FDTAB_SHARDS 16
+
+typedef struct {
+    zx_futex_t readers[2];
+} __ALIGNED(64) fdtab_shard_t;
+
+static atomic_uint fdtab_epoch;
+static fdtab_shard_t fdtab_shards[FDTAB_SHARDS];
+static atomic_uint fdtab_next_shard;
+static thread_local fdtab_shard_t* fdtab_shard;
+
+// Number of __fdio_fdtab_sync() calls waiting on the reader counts, which
+// lookups must then wake as the counts drain. Syncs are serialized by
+// fdtab_sync_lock, which is never held by lookups.
+static atomic_int fdtab_sync_waiters;
+static mtx_t fdtab_sync_lock = MTX_INIT;
+
+// Stored in an entry while fdio_unbind_from_fd() decides whether it can
+// detach it. Lookups which find it wait for fdio_lock and look again.
+#define FDTAB_BUSY ((fdio_t*)1)
+
+void __fdio_fdtab_set(int fd, fdio_t* io) {
+    uint64_t bit = 1ull << (fd % 64);
+    if (io != NULL) {
+        __fdio_global_state.fdtab_used[fd / 64] |= bit;
+    } else {
+        __fdio_global_state.fdtab_used[fd / 64] &= ~bit;
+    }
+    atomic_store(&fdio_fdtab[fd], io);
+}
+
+void __fdio_fdtab_sync(void) {
+    mtx_lock(&fdtab_sync_lock);
+    atomic_fetch_add(&fdtab_sync_waiters, 1);
+    for (int i = 0; i < 2; i++) {
+        unsigned old = atomic_fetch_add(&fdtab_epoch, 1) & 1;
+        for (int n = 0; n < FDTAB_SHARDS; n++) {
+            zx_futex_t* readers = &fdtab_shards[n].readers[old];
+            int count;
+            while ((count = atomic_load(readers)) != 0) {
+                zx_futex_wait(readers, count, ZX_TIME_INFINITE);
+            }
+        }
+    }
+    atomic_fetch_sub(&fdtab_sync_waiters, 1);
+    mtx_unlock(&fdtab_sync_lock);
+}
+
+// Returns the lowest free fd no less than |starting_fd|, or -1.
+static int fdtab_find_free_locked(int starting_fd) {
+    const uint64_t* used = __fdio_global_state.fdtab_used;
+    for (int fd = starting_fd; fd < FDIO_MAX_FD; fd = (fd & ~63) + 64) {
+        uint64_t avail = ~used[fd / 64] & (~0ull << (fd % 64));
+        if (avail != 0) {
+            fd = (fd & ~63) + __builtin_ctzll(avail);
+            return (fd < FDIO_MAX_FD) ? fd : -1;
+        }
+    }
+    return -1;
+}
+
 // Attaches an fdio to an fdtab slot.
 // The fdio must have been upref'd on behalf of the
 // fdtab prior to binding.
@@ -61,15 +130,11 @@ int fdio_bind_to_fd(fdio_t* io, int fd, int starting_fd) {
     mtx_lock(&fdio_lock);
     if (fd < 0) {
         // A negative fd implies that any free fd value can be used
-        //TODO: bitmap, ffs, etc
-        for (fd = starting_fd; fd < FDIO_MAX_FD; fd++) {
-            if (fdio_fdtab[fd] == NULL) {
-                goto free_fd_found;
-            }
+        if ((fd = fdtab_find_free_locked(starting_fd)) < 0) {
+            errno = EMFILE;
+            mtx_unlock(&fdio_lock);
+            return -1;
         }
-        errno = EMFILE;
-        mtx_unlock(&fdio_lock);
-        return -1;
     } else if (fd >= FDIO_MAX_FD) {
         errno = EINVAL;
         mtx_unlock(&fdio_lock);
@@ -78,21 +143,20 @@ int fdio_bind_to_fd(fdio_t* io, int fd, int starting_fd) {
         io_to_close = fdio_fdtab[fd];
         if (io_to_close) {
             io_to_close->dupcount--;
-            if (io_to_close->dupcount > 0) {
-                // still alive in another fdtab slot
-                fdio_release(io_to_close);
-                io_to_close = NULL;
-            }
         }
     }
 
-free_fd_found:
     io->dupcount++;
-    fdio_fdtab[fd] = io;
+    __fdio_fdtab_set(fd, io);
+    // still alive in another fdtab slot?
+    bool close_io = (io_to_close != NULL) && (io_to_close->dupcount == 0);
     mtx_unlock(&fdio_lock);
 
     if (io_to_close) {
-        io_to_close->ops->close(io_to_close);
+        __fdio_fdtab_sync();
+        if (close_io) {
+            io_to_close->ops->close(io_to_close);
+        }
         fdio_release(io_to_close);
     }
     return fd;
@@ -105,7 +169,7 @@ free_fd_found:
 zx_status_t fdio_unbind_from_fd(int fd, fdio_t** out) {
     zx_status_t status;
     mtx_lock(&fdio_lock);
-    if (fd >= FDIO_MAX_FD) {
+    if ((fd < 0) || (fd >= FDIO_MAX_FD)) {
         status = ZX_ERR_INVALID_ARGS;
         goto done;
     }
@@ -114,16 +178,24 @@ zx_status_t fdio_unbind_from_fd(int fd, fdio_t** out) {
         status = ZX_ERR_INVALID_ARGS;
         goto done;
     }
-    if (io->dupcount > 1) {
+    if ((io->dupcount > 1) || (atomic_load(&io->refcount) > 1)) {
         status = ZX_ERR_UNAVAILABLE;
         goto done;
     }
+    // A lookup may have been acquiring the entry as we checked. Hide it
+    // behind FDTAB_BUSY until such lookups have finished, rather than
+    // clearing it, so that lookups racing with a failed unbind still find
+    // the fd once we release fdio_lock. This waits under fdio_lock, but
+    // only for lookups already underway, which do not block.
+    atomic_store(&fdio_fdtab[fd], FDTAB_BUSY);
+    __fdio_fdtab_sync();
     if (atomic_load(&io->refcount) > 1) {
+        atomic_store(&fdio_fdtab[fd], io);
         status = ZX_ERR_UNAVAILABLE;
         goto done;
     }
+    __fdio_fdtab_set(fd, NULL);
     io->dupcount = 0;
-    fdio_fdtab[fd] = NULL;
     *out = io;
     status = ZX_OK;
 done:
@@ -135,12 +207,31 @@ fdio_t* __fdio_fd_to_io(int fd) {
     if ((fd < 0) || (fd >= FDIO_MAX_FD)) {
         return NULL;
     }
-    fdio_t* io = NULL;
-    mtx_lock(&fdio_lock);
-    if ((io = fdio_fdtab[fd]) != NULL) {
+    fdtab_shard_t* shard = fdtab_shard;
+    if (shard == NULL) {
+        shard = &fdtab_shards[atomic_fetch_add(&fdtab_next_shard, 1) % FDTAB_SHARDS];
+        fdtab_shard = shard;
+    }
+    unsigned epoch = atomic_load(&fdtab_epoch) & 1;
+    atomic_fetch_add(&shard->readers[epoch], 1);
+    fdio_t* io = atomic_load(&fdio_fdtab[fd]);
+    if ((io != NULL) && (io != FDTAB_BUSY)) {
         fdio_acquire(io);
     }
-    mtx_unlock(&fdio_lock);
+    if ((atomic_fetch_sub(&shard->readers[epoch], 1) == 1) &&
+        (atomic_load(&fdtab_sync_waiters) != 0)) {
+        zx_futex_wake(&shard->readers[epoch], UINT32_MAX);
+    }
+    if (io == FDTAB_BUSY) {
+        // fdio_unbind_from_fd() has settled the entry once it releases
+        // fdio_lock.
+        mtx_lock(&fdio_lock);
+        io = fdio_fdtab[fd];
+        if (io != NULL) {
+            fdio_acquire(io);
+        }
+        mtx_unlock(&fdio_lock);
+    }
     return io;
 }
 
@@ -533,31 +624,31 @@ void __libc_extensions_init(uint32_t handle_count,
             // which is for signaling events
             if (((n + 1) < handle_count) &&
                 (handle_info[n] == handle_info[n + 1])) {
-                fdio_fdtab[arg_fd] = fdio_remote_create(h, handle[n + 1]);
+                __fdio_fdtab_set(arg_fd, fdio_remote_create(h, handle[n + 1]));
                 handle_info[n + 1] = 0;
             } else {
-                fdio_fdtab[arg_fd] = fdio_remote_create(h, 0);
+                __fdio_fdtab_set(arg_fd, fdio_remote_create(h, 0));
             }
             fdio_fdtab[arg_fd]->dupcount++;
             break;
         case PA_FDIO_PIPE:
-            fdio_fdtab[arg_fd] = fdio_pipe_create(h);
+            __fdio_fdtab_set(arg_fd, fdio_pipe_create(h));
             fdio_fdtab[arg_fd]->dupcount++;
             break;
         case PA_FDIO_LOGGER:
-            fdio_fdtab[arg_fd] = fdio_logger_create(h);
+            __fdio_fdtab_set(arg_fd, fdio_logger_create(h));
             fdio_fdtab[arg_fd]->dupcount++;
             break;
         case PA_FDIO_SOCKET:
 #if WITH_NEW_SOCKET
-            fdio_fdtab[arg] = fdio_socket_create(h, FDIO_FLAG_SOCKET_CONNECTED);
+            __fdio_fdtab_set(arg, fdio_socket_create(h, FDIO_FLAG_SOCKET_CONNECTED));
             fdio_fdtab[arg]->dupcount++;
             break;
 #else
             // socket objects have a second handle
             if (((n + 1) < handle_count) &&
                 (handle_info[n] == handle_info[n + 1])) {
-                fdio_fdtab[arg_fd] = fdio_socket_create(h, handle[n + 1], FDIO_FLAG_SOCKET_CONNECTED);
+                __fdio_fdtab_set(arg_fd, fdio_socket_create(h, handle[n + 1], FDIO_FLAG_SOCKET_CONNECTED));
                 handle_info[n + 1] = 0;
                 fdio_fdtab[arg_fd]->dupcount++;
             } else {
@@ -608,9 +699,9 @@ void __libc_extensions_init(uint32_t handle_count,
     for (uint32_t n = 0; n < 3; n++) {
         if (fdio_fdtab[n] == NULL) {
             if (use_for_stdio) {
-                fdio_fdtab[n] = use_for_stdio;
+                __fdio_fdtab_set(n, use_for_stdio);
             } else {
-                fdio_fdtab[n] = fdio_null_create();
+                __fdio_fdtab_set(n, fdio_null_create());
             }
             fdio_fdtab[n]->dupcount++;
         }
@@ -647,7 +738,10 @@ void __libc_extensions_fini(void) __TA_ACQUIRE(&fdio_lock) {
     for (int fd = 0; fd < FDIO_MAX_FD; fd++) {
         fdio_t* io = fdio_fdtab[fd];
         if (io) {
-            fdio_fdtab[fd] = NULL;
+            __fdio_fdtab_set(fd, NULL);
+            // fdio_lock stays held from here on, but the sync does not
+            // need it.
+            __fdio_fdtab_sync();
             io->dupcount--;
             if (io->dupcount == 0) {
                 io->ops->close(io);
@@ -1075,14 +1169,16 @@ int close(int fd) {
     }
     fdio_t* io = fdio_fdtab[fd];
     io->dupcount--;
-    fdio_fdtab[fd] = NULL;
+    __fdio_fdtab_set(fd, NULL);
     if (io->dupcount > 0) {
         // still alive in other fdtab slots
         mtx_unlock(&fdio_lock);
+        __fdio_fdtab_sync();
         fdio_release(io);
         return ZX_OK;
     } else {
         mtx_unlock(&fdio_lock);
+        __fdio_fdtab_sync();
         int r = io->ops->close(io);
         fdio_release(io);
         return STATUS(r);
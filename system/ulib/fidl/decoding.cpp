@@ -281,6 +281,13 @@ zx_status_t FidlDecoder::DecodeMessage() {
         return WithError("Message size is smaller than expected");
     }
 
+    // Every handle takes up a slot in the message, so a message with more
+    // handles than that can be rejected before any of it is decoded. The
+    // exact count is checked once the whole message has been walked.
+    if (num_handles_ > num_bytes_ / sizeof(zx_handle_t)) {
+        return WithError("message did not contain the specified number of handles");
+    }
+
     // Any type that calls into ClaimOutOfLineStorage will have a
     // string, vector, struct pointer, or union pointer in the primary
     // message struct. This will force the size of that struct to be a
@@ -467,6 +474,9 @@ zx_status_t FidlDecoder::DecodeMessage() {
             if (out_of_line_offset_ != num_bytes_) {
                 return WithError("message did not decode all provided bytes");
             }
+            if (handle_idx_ != num_handles_) {
+                return WithError("message did not contain the specified number of handles");
+            }
             return ZX_OK;
         }
         }
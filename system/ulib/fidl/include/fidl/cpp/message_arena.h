@@ -0,0 +1,69 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <fidl/cpp/message_buffer.h>
+#include <zircon/types.h>
+
+namespace fidl {
+
+// A fixed set of |MessageBuffer|s which are reused from one message to the
+// next.
+//
+// A server which creates a |MessageBuffer| for every request allocates and
+// frees memory for every request. Instead, each connection can own a
+// |MessageArena| with as many buffers as it has messages in flight at once,
+// so that reading and decoding requests does not allocate.
+//
+// All the buffers are allocated when the |MessageArena| is constructed, and
+// are freed when it is destructed.
+//
+// A |MessageArena| is not thread-safe.
+class MessageArena {
+public:
+    // Creates a |MessageArena| with |buffer_count| buffers for messages of
+    // the given capacities.
+    explicit MessageArena(
+        uint32_t buffer_count = 1u,
+        uint32_t bytes_capacity = ZX_CHANNEL_MAX_MSG_BYTES,
+        uint32_t handles_capacity = ZX_CHANNEL_MAX_MSG_HANDLES);
+
+    ~MessageArena();
+
+    MessageArena(const MessageArena& other) = delete;
+    MessageArena& operator=(const MessageArena& other) = delete;
+
+    // The number of buffers in the arena, which is zero if they could not be
+    // allocated.
+    uint32_t buffer_count() const { return buffer_count_; }
+
+    // The number of buffers which are not in use.
+    uint32_t available_count() const { return free_count_; }
+
+    // Returns a buffer which is not in use, or nullptr if all the buffers are
+    // in use.
+    //
+    // The buffer remains in use until it is passed to |Release()|.
+    MessageBuffer* Acquire();
+
+    // Returns |buffer|, which must have been returned by |Acquire()|, to the
+    // arena.
+    //
+    // Any |Message| backed by |buffer| must no longer be in use.
+    void Release(MessageBuffer* buffer);
+
+private:
+    uint8_t* const storage_;
+    uint32_t buffer_count_;
+    MessageBuffer* buffers_ = nullptr;
+
+    // Stack of the indices of the buffers which are not in use.
+    uint32_t* free_ = nullptr;
+    uint32_t free_count_ = 0u;
+};
+
+} // namespace fidl
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <fidl/cpp/builder.h>
@@ -23,9 +24,26 @@ public:
         uint32_t bytes_capacity = ZX_CHANNEL_MAX_MSG_BYTES,
         uint32_t handles_capacity = ZX_CHANNEL_MAX_MSG_HANDLES);
 
-    // The memory that backs the message is freed by this destructor.
+    // Creates a |MessageBuffer| for messages of the given capacities that is
+    // backed by |storage|, which must hold at least
+    // |GetStorageSize(bytes_capacity, handles_capacity)| bytes and be aligned
+    // to FIDL_ALIGNMENT.
+    //
+    // The constructed |MessageBuffer| does not take ownership of the given
+    // storage.
+    MessageBuffer(void* storage, uint32_t bytes_capacity, uint32_t handles_capacity);
+
+    // The memory that backs the message is freed by this destructor, unless
+    // it was provided by the caller.
     ~MessageBuffer();
 
+    MessageBuffer(const MessageBuffer& other) = delete;
+    MessageBuffer& operator=(const MessageBuffer& other) = delete;
+
+    // The number of bytes of storage needed to back a |MessageBuffer| of the
+    // given capacities.
+    static size_t GetStorageSize(uint32_t bytes_capacity, uint32_t handles_capacity);
+
     // The memory in which bytes can be stored in this buffer.
     uint8_t* bytes() const { return buffer_; }
 
@@ -45,6 +63,7 @@ public:
 
 private:
     uint8_t* const buffer_;
+    const bool owns_buffer_;
     const uint32_t bytes_capacity_;
     const uint32_t handles_capacity_;
 };
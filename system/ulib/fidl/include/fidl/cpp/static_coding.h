@@ -0,0 +1,666 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include <fidl/coding.h>
+#include <fidl/cpp/message_part.h>
+#include <fidl/internal.h>
+#include <fidl/types.h>
+#include <zircon/types.h>
+
+// Statically specialized FIDL coders.
+//
+// |fidl_encode| and |fidl_decode| interpret a |fidl_type_t| coding table at
+// runtime. The templates in this file describe the same wire format as C++
+// types instead, so that the compiler can generate an encoder and decoder
+// specialized to each message:
+//
+//   using EchoRequest = fidl::coding::Struct<
+//       sizeof(echo_request_t),
+//       fidl::coding::Field<offsetof(echo_request_t, value),
+//                           fidl::coding::String<32>>,
+//       fidl::coding::Field<offsetof(echo_request_t, channel),
+//                           fidl::coding::Handle<fidl::kNullable>>>;
+//
+//   status = fidl::StaticEncode<EchoRequest>(bytes, num_bytes, handles,
+//                                            max_handles, &actual_handles,
+//                                            &error_msg);
+//
+// The statically specialized coders accept and produce exactly the same
+// messages as the table-driven ones. Like the coding tables, a description
+// only needs to list the fields which hold handles or out-of-line data.
+// Messages without any such field reduce to a size check. Recursive types
+// cannot be described this way and must use the coding tables.
+
+namespace fidl {
+namespace coding {
+
+// Each type description provides:
+//
+//  - |kSize|, the inline size of the type on the wire;
+//  - |kNeedsCoding|, whether the type holds handles or out-of-line data,
+//    directly or in one of its members;
+//  - |kDepth|, the number of recursion steps the table-driven coders take
+//    to code the type;
+//  - |kMinHandles| and |kMaxHandles|, bounds on the number of handles an
+//    object of the type carries, where UINT32_MAX means unbounded;
+//  - |Code(coder, offset)|, which codes an object of the type at |offset|
+//    in the message.
+
+namespace internal {
+
+constexpr uint32_t SaturatingAdd(uint32_t a, uint32_t b) {
+    return a > UINT32_MAX - b ? UINT32_MAX : a + b;
+}
+
+constexpr uint32_t SaturatingMultiply(uint32_t a, uint32_t b) {
+    return b != 0u && a > UINT32_MAX / b ? UINT32_MAX : a * b;
+}
+
+} // namespace internal
+
+// A primitive type of the same size as |T|, which needs no coding.
+template <typename T>
+struct Primitive {
+    static constexpr uint32_t kSize = static_cast<uint32_t>(sizeof(T));
+    static constexpr bool kNeedsCoding = false;
+    static constexpr uint32_t kDepth = 0u;
+    static constexpr uint32_t kMinHandles = 0u;
+    static constexpr uint32_t kMaxHandles = 0u;
+
+    template <typename Coder>
+    static bool Code(Coder* coder, uint32_t offset) { return true; }
+};
+
+template <FidlNullability Nullable = kNonnullable>
+struct Handle {
+    static constexpr uint32_t kSize = static_cast<uint32_t>(sizeof(zx_handle_t));
+    static constexpr bool kNeedsCoding = true;
+    static constexpr uint32_t kDepth = 1u;
+    static constexpr uint32_t kMinHandles = Nullable == kNullable ? 0u : 1u;
+    static constexpr uint32_t kMaxHandles = 1u;
+
+    template <typename Coder>
+    static bool Code(Coder* coder, uint32_t offset) {
+        return coder->CodeHandle(offset, Nullable);
+    }
+};
+
+template <uint32_t MaxSize = FIDL_MAX_SIZE, FidlNullability Nullable = kNonnullable>
+struct String {
+    static constexpr uint32_t kSize = static_cast<uint32_t>(sizeof(fidl_string_t));
+    static constexpr bool kNeedsCoding = true;
+    static constexpr uint32_t kDepth = 1u;
+    static constexpr uint32_t kMinHandles = 0u;
+    static constexpr uint32_t kMaxHandles = 0u;
+
+    template <typename Coder>
+    static bool Code(Coder* coder, uint32_t offset) {
+        return coder->CodeString(offset, MaxSize, Nullable);
+    }
+};
+
+// An array of |Count| elements of type |Element|.
+template <typename Element, uint32_t Count>
+struct Array {
+    static constexpr uint32_t kSize = Element::kSize * Count;
+    static constexpr bool kNeedsCoding = Element::kNeedsCoding;
+    static constexpr uint32_t kDepth = 1u + Element::kDepth;
+    static constexpr uint32_t kMinHandles =
+        internal::SaturatingMultiply(Element::kMinHandles, Count);
+    static constexpr uint32_t kMaxHandles =
+        internal::SaturatingMultiply(Element::kMaxHandles, Count);
+
+    static_assert(static_cast<uint64_t>(Element::kSize) * Count <= UINT32_MAX,
+                  "Array is too large!");
+
+    template <typename Coder>
+    static bool Code(Coder* coder, uint32_t offset) {
+        if (!kNeedsCoding)
+            return true;
+        for (uint32_t i = 0u; i < Count; i++) {
+            if (!Element::Code(coder, offset + i * Element::kSize))
+                return false;
+        }
+        return true;
+    }
+};
+
+template <typename Element, uint32_t MaxCount = FIDL_MAX_SIZE,
+          FidlNullability Nullable = kNonnullable>
+struct Vector {
+    static constexpr uint32_t kSize = static_cast<uint32_t>(sizeof(fidl_vector_t));
+    static constexpr bool kNeedsCoding = true;
+    static constexpr uint32_t kDepth = 1u + Element::kDepth;
+    static constexpr uint32_t kMinHandles = 0u;
+    static constexpr uint32_t kMaxHandles =
+        internal::SaturatingMultiply(Element::kMaxHandles, MaxCount);
+
+    template <typename Coder>
+    static bool Code(Coder* coder, uint32_t offset) {
+        return coder->template CodeVector<Element>(offset, MaxCount, Nullable);
+    }
+};
+
+// A struct member of type |Type| at byte |Offset| within the struct.
+template <uint32_t Offset, typename FieldType>
+struct Field {
+    static constexpr uint32_t kOffset = Offset;
+    using Type = FieldType;
+};
+
+namespace internal {
+
+template <typename... Fields>
+struct FieldList;
+
+template <>
+struct FieldList<> {
+    static constexpr bool kNeedsCoding = false;
+    static constexpr uint32_t kDepth = 0u;
+    static constexpr uint32_t kMinHandles = 0u;
+    static constexpr uint32_t kMaxHandles = 0u;
+
+    template <typename Coder>
+    static bool Code(Coder* coder, uint32_t offset) { return true; }
+};
+
+template <typename First, typename... Rest>
+struct FieldList<First, Rest...> {
+    static constexpr bool kNeedsCoding =
+        First::Type::kNeedsCoding || FieldList<Rest...>::kNeedsCoding;
+    static constexpr uint32_t kDepth =
+        First::Type::kDepth > FieldList<Rest...>::kDepth ? First::Type::kDepth
+                                                          : FieldList<Rest...>::kDepth;
+    static constexpr uint32_t kMinHandles =
+        SaturatingAdd(First::Type::kMinHandles, FieldList<Rest...>::kMinHandles);
+    static constexpr uint32_t kMaxHandles =
+        SaturatingAdd(First::Type::kMaxHandles, FieldList<Rest...>::kMaxHandles);
+
+    template <typename Coder>
+    static bool Code(Coder* coder, uint32_t offset) {
+        return First::Type::Code(coder, offset + First::kOffset) &&
+               FieldList<Rest...>::Code(coder, offset);
+    }
+};
+
+template <typename... Members>
+struct MemberList;
+
+template <>
+struct MemberList<> {
+    static constexpr bool kNeedsCoding = false;
+    static constexpr uint32_t kDepth = 0u;
+    static constexpr uint32_t kMinHandles = UINT32_MAX;
+    static constexpr uint32_t kMaxHandles = 0u;
+
+    template <typename Coder>
+    static bool Code(Coder* coder, uint32_t index, uint32_t offset) { return true; }
+};
+
+template <typename First, typename... Rest>
+struct MemberList<First, Rest...> {
+    static constexpr bool kNeedsCoding =
+        First::kNeedsCoding || MemberList<Rest...>::kNeedsCoding;
+    static constexpr uint32_t kDepth =
+        First::kDepth > MemberList<Rest...>::kDepth ? First::kDepth
+                                                    : MemberList<Rest...>::kDepth;
+    static constexpr uint32_t kMinHandles =
+        First::kMinHandles < MemberList<Rest...>::kMinHandles ? First::kMinHandles
+                                                              : MemberList<Rest...>::kMinHandles;
+    static constexpr uint32_t kMaxHandles =
+        First::kMaxHandles > MemberList<Rest...>::kMaxHandles ? First::kMaxHandles
+                                                              : MemberList<Rest...>::kMaxHandles;
+
+    template <typename Coder>
+    static bool Code(Coder* coder, uint32_t index, uint32_t offset) {
+        if (index == 0u)
+            return First::Code(coder, offset);
+        return MemberList<Rest...>::Code(coder, index - 1u, offset);
+    }
+};
+
+} // namespace internal
+
+// A struct of |Size| bytes whose members needing coding are |Fields|.
+template <uint32_t Size, typename... Fields>
+struct Struct {
+    static constexpr uint32_t kSize = Size;
+    static constexpr bool kNeedsCoding = internal::FieldList<Fields...>::kNeedsCoding;
+    static constexpr uint32_t kDepth = 1u + internal::FieldList<Fields...>::kDepth;
+    static constexpr uint32_t kMinHandles = internal::FieldList<Fields...>::kMinHandles;
+    static constexpr uint32_t kMaxHandles = internal::FieldList<Fields...>::kMaxHandles;
+
+    template <typename Coder>
+    static bool Code(Coder* coder, uint32_t offset) {
+        return internal::FieldList<Fields...>::Code(coder, offset);
+    }
+};
+
+// A union of |Size| bytes, including its tag, whose members are |Members|.
+//
+// As with the coding tables, every member must be listed, in order, since
+// the tag is an index into them.
+template <uint32_t Size, typename... Members>
+struct Union {
+    static constexpr uint32_t kSize = Size;
+    static constexpr bool kNeedsCoding = true;
+    static constexpr uint32_t kDepth =
+        internal::MemberList<Members...>::kDepth > 1u ? internal::MemberList<Members...>::kDepth
+                                                      : 1u;
+    static constexpr uint32_t kMinHandles = internal::MemberList<Members...>::kMinHandles;
+    static constexpr uint32_t kMaxHandles = internal::MemberList<Members...>::kMaxHandles;
+
+    template <typename Coder>
+    static bool Code(Coder* coder, uint32_t offset) {
+        fidl_union_tag_t tag = *coder->template At<fidl_union_tag_t>(offset);
+        if (tag >= sizeof...(Members))
+            return coder->FailBadUnionTag();
+        return internal::MemberList<Members...>::Code(
+            coder, tag, offset + static_cast<uint32_t>(sizeof(tag)));
+    }
+};
+
+// A nullable pointer to an out-of-line |Struct| or |Union|.
+template <typename Pointee>
+struct Pointer {
+    static constexpr uint32_t kSize = static_cast<uint32_t>(sizeof(void*));
+    static constexpr bool kNeedsCoding = true;
+    static constexpr uint32_t kDepth = Pointee::kDepth;
+    static constexpr uint32_t kMinHandles = 0u;
+    static constexpr uint32_t kMaxHandles = Pointee::kMaxHandles;
+
+    template <typename Coder>
+    static bool Code(Coder* coder, uint32_t offset) {
+        return coder->template CodePointer<Pointee>(offset);
+    }
+};
+
+template <typename T>
+struct IsStruct {
+    static constexpr bool value = false;
+};
+
+template <uint32_t Size, typename... Fields>
+struct IsStruct<Struct<Size, Fields...>> {
+    static constexpr bool value = true;
+};
+
+} // namespace coding
+
+namespace internal {
+
+// State shared by the static encoder and decoder.
+class StaticCoderBase {
+public:
+    template <typename T>
+    T* At(uint32_t offset) const {
+        return reinterpret_cast<T*>(bytes_ + offset);
+    }
+
+    const char* error_msg() const { return error_msg_; }
+    uint32_t out_of_line_offset() const { return out_of_line_offset_; }
+    uint32_t handle_count() const { return handle_idx_; }
+
+protected:
+    StaticCoderBase(void* bytes, uint32_t num_bytes, uint32_t out_of_line_offset)
+        : bytes_(static_cast<uint8_t*>(bytes)), num_bytes_(num_bytes),
+          out_of_line_offset_(out_of_line_offset) {}
+
+    bool Fail(const char* error_msg) {
+        error_msg_ = error_msg;
+        return false;
+    }
+
+    // Returns true when the buffer space is claimed, and false when
+    // the requested claim is too large for bytes_.
+    bool ClaimOutOfLineStorage(uint64_t size, uint32_t* out_offset) {
+        uint64_t aligned_offset = (out_of_line_offset_ + size + FIDL_ALIGNMENT - 1u) &
+                                  ~static_cast<uint64_t>(FIDL_ALIGNMENT - 1u);
+        if (aligned_offset > static_cast<uint64_t>(num_bytes_))
+            return false;
+        *out_offset = out_of_line_offset_;
+        out_of_line_offset_ = static_cast<uint32_t>(aligned_offset);
+        return true;
+    }
+
+    uint8_t* const bytes_;
+    const uint32_t num_bytes_;
+    uint32_t out_of_line_offset_;
+    uint32_t handle_idx_ = 0u;
+    const char* error_msg_ = nullptr;
+};
+
+class StaticEncoder : public StaticCoderBase {
+public:
+    StaticEncoder(void* bytes, uint32_t num_bytes, zx_handle_t* handles, uint32_t max_handles,
+                  uint32_t out_of_line_offset)
+        : StaticCoderBase(bytes, num_bytes, out_of_line_offset),
+          handles_(handles), max_handles_(max_handles) {}
+
+    bool CodeHandle(uint32_t offset, FidlNullability nullable) {
+        zx_handle_t* handle_ptr = At<zx_handle_t>(offset);
+        if (nullable == kNullable && *handle_ptr == ZX_HANDLE_INVALID)
+            return true;
+        if (handle_idx_ == max_handles_)
+            return Fail("message encoded too many handles");
+        handles_[handle_idx_++] = *handle_ptr;
+        *handle_ptr = FIDL_HANDLE_PRESENT;
+        return true;
+    }
+
+    bool CodeString(uint32_t offset, uint32_t max_size, FidlNullability nullable) {
+        fidl_string_t* string_ptr = At<fidl_string_t>(offset);
+        if (string_ptr->data == nullptr) {
+            if (nullable != kNullable)
+                return Fail("message tried to encode an absent non-nullable string");
+            return true;
+        }
+        if (string_ptr->size > max_size)
+            return Fail("message tried to encode too large of a bounded string");
+        uint32_t data_offset = 0u;
+        if (!ClaimOutOfLineStorage(string_ptr->size, string_ptr->data, &data_offset))
+            return Fail("encoding a string with incorrectly placed data");
+        string_ptr->data = reinterpret_cast<char*>(FIDL_ALLOC_PRESENT);
+        return true;
+    }
+
+    template <typename Element>
+    bool CodeVector(uint32_t offset, uint32_t max_count, FidlNullability nullable) {
+        fidl_vector_t* vector_ptr = At<fidl_vector_t>(offset);
+        if (vector_ptr->data == nullptr) {
+            if (nullable != kNullable)
+                return Fail("message tried to encode an absent non-nullable vector");
+            return true;
+        }
+        if (vector_ptr->count > max_count)
+            return Fail("message tried to encode too large of a bounded vector");
+        uint32_t data_offset = 0u;
+        if (!ClaimOutOfLineStorage(vector_ptr->count * Element::kSize, vector_ptr->data,
+                                   &data_offset))
+            return Fail("message wanted to store too large of a vector");
+        vector_ptr->data = reinterpret_cast<void*>(FIDL_ALLOC_PRESENT);
+        return CodeElements<Element>(data_offset, vector_ptr->count);
+    }
+
+    template <typename Pointee>
+    bool CodePointer(uint32_t offset) {
+        void** ptr_ptr = At<void*>(offset);
+        if (*ptr_ptr == nullptr)
+            return true;
+        uint32_t pointee_offset = 0u;
+        if (!ClaimOutOfLineStorage(Pointee::kSize, *ptr_ptr, &pointee_offset))
+            return Fail("message wanted to store too large of a nullable struct or union");
+        *ptr_ptr = reinterpret_cast<void*>(FIDL_ALLOC_PRESENT);
+        return Pointee::Code(this, pointee_offset);
+    }
+
+    bool FailBadUnionTag() { return Fail("Tried to encode a bad union discriminant"); }
+
+private:
+    // Out-of-line objects must already be laid out in traversal order, as
+    // for |fidl_encode|.
+    bool ClaimOutOfLineStorage(uint64_t size, const void* storage, uint32_t* out_offset) {
+        if (At<const void>(out_of_line_offset_) != storage)
+            return false;
+        return StaticCoderBase::ClaimOutOfLineStorage(size, out_offset);
+    }
+
+    template <typename Element>
+    bool CodeElements(uint32_t offset, uint64_t count) {
+        if (!Element::kNeedsCoding)
+            return true;
+        for (uint64_t i = 0u; i < count; i++) {
+            if (!Element::Code(this, offset + static_cast<uint32_t>(i) * Element::kSize))
+                return false;
+        }
+        return true;
+    }
+
+    zx_handle_t* const handles_;
+    const uint32_t max_handles_;
+};
+
+class StaticDecoder : public StaticCoderBase {
+public:
+    StaticDecoder(void* bytes, uint32_t num_bytes, const zx_handle_t* handles,
+                  uint32_t num_handles, uint32_t out_of_line_offset)
+        : StaticCoderBase(bytes, num_bytes, out_of_line_offset),
+          handles_(handles), num_handles_(num_handles) {}
+
+    bool CodeHandle(uint32_t offset, FidlNullability nullable) {
+        zx_handle_t* handle_ptr = At<zx_handle_t>(offset);
+        switch (*handle_ptr) {
+        case FIDL_HANDLE_ABSENT:
+            if (nullable == kNullable)
+                return true;
+            break;
+        case FIDL_HANDLE_PRESENT:
+            if (handle_idx_ == num_handles_)
+                return Fail("message decoded too many handles");
+            *handle_ptr = handles_[handle_idx_++];
+            return true;
+        }
+        return Fail("message tried to decode a non-present handle");
+    }
+
+    bool CodeString(uint32_t offset, uint32_t max_size, FidlNullability nullable) {
+        fidl_string_t* string_ptr = At<fidl_string_t>(offset);
+        switch (reinterpret_cast<uintptr_t>(string_ptr->data)) {
+        case FIDL_ALLOC_PRESENT:
+            break;
+        case FIDL_ALLOC_ABSENT:
+            if (nullable != kNullable)
+                return Fail("message tried to decode an absent non-nullable string");
+            if (string_ptr->size != 0u)
+                return Fail("message tried to decode an absent string of non-zero length");
+            return true;
+        default:
+            return Fail("message tried to decode a non-present string");
+        }
+        if (string_ptr->size > max_size)
+            return Fail("message tried to decode too large of a bounded string");
+        uint32_t data_offset = 0u;
+        if (!ClaimOutOfLineStorage(string_ptr->size, &data_offset))
+            return Fail("decoding a string overflowed buffer");
+        string_ptr->data = At<char>(data_offset);
+        return true;
+    }
+
+    template <typename Element>
+    bool CodeVector(uint32_t offset, uint32_t max_count, FidlNullability nullable) {
+        fidl_vector_t* vector_ptr = At<fidl_vector_t>(offset);
+        switch (reinterpret_cast<uintptr_t>(vector_ptr->data)) {
+        case FIDL_ALLOC_PRESENT:
+            break;
+        case FIDL_ALLOC_ABSENT:
+            if (nullable != kNullable)
+                return Fail("message tried to decode an absent non-nullable vector");
+            if (vector_ptr->count != 0u)
+                return Fail("message tried to decode an absent vector of non-zero elements");
+            return true;
+        default:
+            return Fail("message tried to decode a non-present vector");
+        }
+        if (vector_ptr->count > max_count)
+            return Fail("message tried to decode too large of a bounded vector");
+        uint32_t data_offset = 0u;
+        if (!ClaimOutOfLineStorage(vector_ptr->count * Element::kSize, &data_offset))
+            return Fail("message wanted to store too large of a vector");
+        vector_ptr->data = At<void>(data_offset);
+        return CodeElements<Element>(data_offset, vector_ptr->count);
+    }
+
+    template <typename Pointee>
+    bool CodePointer(uint32_t offset) {
+        void** ptr_ptr = At<void*>(offset);
+        switch (reinterpret_cast<uintptr_t>(*ptr_ptr)) {
+        case FIDL_ALLOC_PRESENT:
+            break;
+        case FIDL_ALLOC_ABSENT:
+            return true;
+        default:
+            return Fail("Tried to decode a bad struct or union pointer");
+        }
+        uint32_t pointee_offset = 0u;
+        if (!ClaimOutOfLineStorage(Pointee::kSize, &pointee_offset))
+            return Fail("message wanted to store too large of a nullable struct or union");
+        *ptr_ptr = At<void>(pointee_offset);
+        return Pointee::Code(this, pointee_offset);
+    }
+
+    bool FailBadUnionTag() { return Fail("Tried to decode a bad union discriminant"); }
+
+private:
+    template <typename Element>
+    bool CodeElements(uint32_t offset, uint64_t count) {
+        if (!Element::kNeedsCoding)
+            return true;
+        for (uint64_t i = 0u; i < count; i++) {
+            if (!Element::Code(this, offset + static_cast<uint32_t>(i) * Element::kSize))
+                return false;
+        }
+        return true;
+    }
+
+    const zx_handle_t* const handles_;
+    const uint32_t num_handles_;
+};
+
+inline zx_status_t StaticCodingError(const char* error_msg, const char** error_msg_out) {
+    if (error_msg_out != nullptr)
+        *error_msg_out = error_msg;
+    return ZX_ERR_INVALID_ARGS;
+}
+
+} // namespace internal
+
+// Encodes the message described by |Type| in-place.
+//
+// Behaves exactly like |fidl_encode| given the corresponding coding table.
+template <typename Type>
+zx_status_t StaticEncode(void* bytes, uint32_t num_bytes, zx_handle_t* handles,
+                         uint32_t max_handles, uint32_t* actual_handles_out,
+                         const char** error_msg_out) {
+    static_assert(coding::IsStruct<Type>::value, "Message must be a struct");
+    static_assert(Type::kDepth < FIDL_RECURSION_DEPTH, "Message is nested too deeply");
+
+    if (bytes == nullptr)
+        return internal::StaticCodingError("Cannot encode null bytes", error_msg_out);
+    if (actual_handles_out == nullptr) {
+        return internal::StaticCodingError("Cannot encode with null actual_handles_out",
+                                           error_msg_out);
+    }
+    if (handles == nullptr && max_handles != 0u) {
+        return internal::StaticCodingError(
+            "Cannot provide non-zero handle count and null handle pointer", error_msg_out);
+    }
+    if (Type::kSize > num_bytes)
+        return internal::StaticCodingError("Message size is smaller than expected", error_msg_out);
+
+    uint32_t encoded_bytes = Type::kSize;
+    uint32_t actual_handles = 0u;
+    if (Type::kNeedsCoding) {
+        internal::StaticEncoder encoder(bytes, num_bytes, handles, max_handles, Type::kSize);
+        if (!Type::Code(&encoder, 0u))
+            return internal::StaticCodingError(encoder.error_msg(), error_msg_out);
+        encoded_bytes = encoder.out_of_line_offset();
+        actual_handles = encoder.handle_count();
+    }
+    if (encoded_bytes != num_bytes) {
+        return internal::StaticCodingError("did not encode the entire provided buffer",
+                                           error_msg_out);
+    }
+    *actual_handles_out = actual_handles;
+    return ZX_OK;
+}
+
+// Decodes the message described by |Type| in-place.
+//
+// Behaves exactly like |fidl_decode| given the corresponding coding table.
+template <typename Type>
+zx_status_t StaticDecode(void* bytes, uint32_t num_bytes, const zx_handle_t* handles,
+                         uint32_t num_handles, const char** error_msg_out) {
+    static_assert(coding::IsStruct<Type>::value, "Message must be a struct");
+    static_assert(Type::kDepth < FIDL_RECURSION_DEPTH, "Message is nested too deeply");
+
+    if (bytes == nullptr)
+        return internal::StaticCodingError("Cannot decode null bytes", error_msg_out);
+    if (handles == nullptr && num_handles != 0u) {
+        return internal::StaticCodingError(
+            "Cannot provide non-zero handle count and null handle pointer", error_msg_out);
+    }
+    if (Type::kSize > num_bytes)
+        return internal::StaticCodingError("Message size is smaller than expected", error_msg_out);
+
+    // Reject a message which cannot hold |num_handles| before touching it.
+    // For most messages the bounds are equal and this is the only check of
+    // the handle count which is needed.
+    if (num_handles < Type::kMinHandles || num_handles > Type::kMaxHandles) {
+        return internal::StaticCodingError(
+            "message did not contain the specified number of handles", error_msg_out);
+    }
+
+    uint32_t decoded_bytes = Type::kSize;
+    uint32_t decoded_handles = 0u;
+    if (Type::kNeedsCoding) {
+        internal::StaticDecoder decoder(bytes, num_bytes, handles, num_handles, Type::kSize);
+        if (!Type::Code(&decoder, 0u))
+            return internal::StaticCodingError(decoder.error_msg(), error_msg_out);
+        decoded_bytes = decoder.out_of_line_offset();
+        decoded_handles = decoder.handle_count();
+    }
+    if (decoded_bytes != num_bytes) {
+        return internal::StaticCodingError("message did not decode all provided bytes",
+                                           error_msg_out);
+    }
+    if (decoded_handles != num_handles) {
+        return internal::StaticCodingError(
+            "message did not contain the specified number of handles", error_msg_out);
+    }
+    return ZX_OK;
+}
+
+// Copies |value|, a message described by |Type| which holds neither handles
+// nor out-of-line data, into |bytes| in its encoded form.
+//
+// Such messages have the same encoded and decoded forms, so this is just a
+// bounds check and a memcpy.
+template <typename Type, typename T>
+zx_status_t StaticEncodeCopy(const T& value, BytePart* bytes, const char** error_msg_out) {
+    static_assert(coding::IsStruct<Type>::value, "Message must be a struct");
+    static_assert(!Type::kNeedsCoding, "Message holds handles or out-of-line data");
+    static_assert(sizeof(T) == Type::kSize, "Message type does not match its description");
+
+    if (bytes->capacity() < Type::kSize)
+        return internal::StaticCodingError("Message does not fit in the buffer", error_msg_out);
+    memcpy(bytes->data(), &value, Type::kSize);
+    bytes->set_actual(Type::kSize);
+    return ZX_OK;
+}
+
+// Copies the encoded message in |bytes|, described by |Type| which holds
+// neither handles nor out-of-line data, into |value_out|.
+//
+// Such messages have the same encoded and decoded forms, so this is just a
+// bounds check and a memcpy.
+template <typename Type, typename T>
+zx_status_t StaticDecodeCopy(const BytePart& bytes, T* value_out, const char** error_msg_out) {
+    static_assert(coding::IsStruct<Type>::value, "Message must be a struct");
+    static_assert(!Type::kNeedsCoding, "Message holds handles or out-of-line data");
+    static_assert(sizeof(T) == Type::kSize, "Message type does not match its description");
+
+    if (bytes.actual() != Type::kSize) {
+        return internal::StaticCodingError("message did not decode all provided bytes",
+                                           error_msg_out);
+    }
+    memcpy(value_out, bytes.data(), Type::kSize);
+    return ZX_OK;
+}
+
+} // namespace fidl
@@ -0,0 +1,88 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fidl/cpp/message_arena.h>
+
+#include <stdlib.h>
+
+#include <fidl/types.h>
+#include <zircon/assert.h>
+
+namespace fidl {
+namespace {
+
+size_t AlignUp(size_t offset) {
+    return (offset + FIDL_ALIGNMENT - 1) & ~(FIDL_ALIGNMENT - 1);
+}
+
+// The arena's storage is laid out as:
+//
+//   [MessageBuffer objects][free stack][buffer 0][buffer 1]...
+//
+// with each part aligned to FIDL_ALIGNMENT.
+size_t GetHeaderSize(uint32_t buffer_count) {
+    return AlignUp(sizeof(MessageBuffer) * buffer_count) +
+        AlignUp(sizeof(uint32_t) * buffer_count);
+}
+
+size_t GetSlotSize(uint32_t bytes_capacity, uint32_t handles_capacity) {
+    return AlignUp(MessageBuffer::GetStorageSize(bytes_capacity,
+                                                 handles_capacity));
+}
+
+uint8_t* AllocateStorage(uint32_t buffer_count, uint32_t bytes_capacity,
+                         uint32_t handles_capacity) {
+    uint64_t size = GetHeaderSize(buffer_count) +
+        static_cast<uint64_t>(GetSlotSize(bytes_capacity, handles_capacity)) *
+        buffer_count;
+    if (buffer_count == 0u || size != static_cast<size_t>(size))
+        return nullptr;
+    return static_cast<uint8_t*>(malloc(static_cast<size_t>(size)));
+}
+
+} // namespace
+
+MessageArena::MessageArena(uint32_t buffer_count,
+                           uint32_t bytes_capacity,
+                           uint32_t handles_capacity)
+    : storage_(AllocateStorage(buffer_count, bytes_capacity,
+                               handles_capacity)),
+      buffer_count_(storage_ ? buffer_count : 0u) {
+    if (!storage_)
+        return;
+    buffers_ = reinterpret_cast<MessageBuffer*>(storage_);
+    free_ = reinterpret_cast<uint32_t*>(
+        storage_ + AlignUp(sizeof(MessageBuffer) * buffer_count_));
+    uint8_t* slot = storage_ + GetHeaderSize(buffer_count_);
+    size_t slot_size = GetSlotSize(bytes_capacity, handles_capacity);
+    for (uint32_t i = 0u; i < buffer_count_; i++) {
+        new (&buffers_[i]) MessageBuffer(slot, bytes_capacity,
+                                         handles_capacity);
+        slot += slot_size;
+        // Hand out the buffers in order, starting with the first.
+        free_[i] = buffer_count_ - 1u - i;
+    }
+    free_count_ = buffer_count_;
+}
+
+MessageArena::~MessageArena() {
+    ZX_DEBUG_ASSERT(free_count_ == buffer_count_);
+    for (uint32_t i = 0u; i < buffer_count_; i++)
+        buffers_[i].~MessageBuffer();
+    free(storage_);
+}
+
+MessageBuffer* MessageArena::Acquire() {
+    if (free_count_ == 0u)
+        return nullptr;
+    return &buffers_[free_[--free_count_]];
+}
+
+void MessageArena::Release(MessageBuffer* buffer) {
+    ZX_DEBUG_ASSERT(buffer >= buffers_ && buffer < buffers_ + buffer_count_);
+    ZX_DEBUG_ASSERT(free_count_ < buffer_count_);
+    free_[free_count_++] = static_cast<uint32_t>(buffer - buffers_);
+}
+
+} // namespace fidl
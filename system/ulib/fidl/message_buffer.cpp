@@ -11,12 +11,7 @@ namespace {
 
 uint32_t GetPadding(uint32_t offset) {
     constexpr uint32_t kMask = alignof(zx_handle_t) - 1;
-    return offset & kMask;
-}
-
-size_t GetAllocSize(uint32_t bytes_capacity, uint32_t handles_capacity) {
-    return bytes_capacity + GetPadding(bytes_capacity) +
-        sizeof(zx_handle_t) * handles_capacity;
+    return -offset & kMask;
 }
 
 } // namespace
@@ -24,13 +19,30 @@ size_t GetAllocSize(uint32_t bytes_capacity, uint32_t handles_capacity) {
 MessageBuffer::MessageBuffer(uint32_t bytes_capacity,
                              uint32_t handles_capacity)
     : buffer_(static_cast<uint8_t*>(
-          malloc(GetAllocSize(bytes_capacity, handles_capacity)))),
+          malloc(GetStorageSize(bytes_capacity, handles_capacity)))),
+      owns_buffer_(true),
+      bytes_capacity_(bytes_capacity),
+      handles_capacity_(handles_capacity) {
+}
+
+MessageBuffer::MessageBuffer(void* storage,
+                             uint32_t bytes_capacity,
+                             uint32_t handles_capacity)
+    : buffer_(static_cast<uint8_t*>(storage)),
+      owns_buffer_(false),
       bytes_capacity_(bytes_capacity),
       handles_capacity_(handles_capacity) {
 }
 
 MessageBuffer::~MessageBuffer() {
-    free(buffer_);
+    if (owns_buffer_)
+        free(buffer_);
+}
+
+size_t MessageBuffer::GetStorageSize(uint32_t bytes_capacity,
+                                     uint32_t handles_capacity) {
+    return bytes_capacity + GetPadding(bytes_capacity) +
+        sizeof(zx_handle_t) * handles_capacity;
 }
 
 zx_handle_t* MessageBuffer::handles() const {
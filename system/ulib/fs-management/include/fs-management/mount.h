@@ -61,6 +61,8 @@ typedef struct mount_options {
     // Create the mountpoint directory if it doesn't already exist.
     // Must be false if passed to "fmount".
     bool create_mountpoint;
+    // Store newly written files compressed, where supported (blobstore).
+    bool enable_compression;
 } mount_options_t;
 
 static const mount_options_t default_mount_options = {
@@ -68,6 +70,7 @@ static const mount_options_t default_mount_options = {
     .verbose_mount = false,
     .wait_until_ready = true,
     .create_mountpoint = false,
+    .enable_compression = false,
 };
 
 typedef struct mkfs_options {
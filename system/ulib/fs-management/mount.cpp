@@ -165,11 +165,14 @@ zx_status_t Mounter::MountNativeFs(const char* binary, unique_fd device,
         printf("fs_mount: Launching %s\n", binary);
     }
 
-    const char* argv[3] = {binary};
+    const char* argv[4] = {binary};
     int argc = 1;
     if (options.readonly) {
         argv[argc++] = "--readonly";
     }
+    if (options.enable_compression) {
+        argv[argc++] = "--compress";
+    }
     argv[argc++] = "mount";
     return LaunchAndMount(cb, options, argv, argc);
 }
@@ -11,6 +11,8 @@
 #include <string.h>
 #include <sys/stat.h>
 
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
 #include <fdio/debug.h>
 #include <fdio/io.h>
 #include <fdio/remoteio.h>
@@ -24,6 +26,15 @@
 namespace fs {
 namespace {
 
+// Size of the intermediate buffer used by the *_BUFFER operations.
+constexpr size_t kBounceSize = 64 * 1024;
+
+// Largest transfer accepted by the *_BUFFER operations. The number of bytes
+// transferred is returned in the zx_status_t of the reply, so it must remain
+// well below INT32_MAX, whatever the size of the client's VMO.
+constexpr size_t kMaxBufferTransfer = 16 * 1024 * 1024;
+static_assert(kMaxBufferTransfer < INT32_MAX, "Buffer transfers must fit in the reply");
+
 void WriteDescribeError(zx::channel channel, zx_status_t status) {
     zxrio_describe_t msg;
     memset(&msg, 0, sizeof(msg));
@@ -168,6 +179,105 @@ zx_status_t Connection::Serve() {
     return status;
 }
 
+zx_status_t Connection::ReserveBounce(size_t len) {
+    const size_t size = fbl::min(len, kBounceSize);
+    if (size <= bounce_size_) {
+        return ZX_OK;
+    }
+    fbl::AllocChecker ac;
+    bounce_.reset(new (&ac) uint8_t[size]);
+    if (!ac.check()) {
+        bounce_size_ = 0;
+        return ZX_ERR_NO_MEMORY;
+    }
+    bounce_size_ = size;
+    return ZX_OK;
+}
+
+zx_status_t Connection::ReadToBuffer(size_t len, size_t offset, size_t* out_actual) {
+    if (!buffer_) {
+        return ZX_ERR_BAD_STATE;
+    }
+    if (len > buffer_size_) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    zx_status_t status;
+    if ((status = ReserveBounce(len)) != ZX_OK) {
+        return status;
+    }
+    size_t done = 0;
+    while (done < len) {
+        size_t xfer = fbl::min(len - done, bounce_size_);
+        size_t actual;
+        status = vnode_->Read(bounce_.get(), xfer, offset + done, &actual);
+        if (status == ZX_OK && actual > 0) {
+            ZX_DEBUG_ASSERT(actual <= xfer);
+            size_t written;
+            status = buffer_.write(bounce_.get(), done, actual, &written);
+        }
+        if (status != ZX_OK) {
+            // Report a partial transfer, as the chunked protocol would.
+            if (done > 0) {
+                break;
+            }
+            return status;
+        }
+        done += actual;
+        if (actual < xfer) {
+            break;
+        }
+    }
+    *out_actual = done;
+    return ZX_OK;
+}
+
+zx_status_t Connection::WriteFromBuffer(size_t len, size_t* offset, bool append,
+                                        size_t* out_actual) {
+    if (!buffer_) {
+        return ZX_ERR_BAD_STATE;
+    }
+    if (len > buffer_size_) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    zx_status_t status;
+    if ((status = ReserveBounce(len)) != ZX_OK) {
+        return status;
+    }
+    size_t done = 0;
+    while (done < len) {
+        size_t xfer = fbl::min(len - done, bounce_size_);
+        size_t actual;
+        status = buffer_.read(bounce_.get(), done, xfer, &actual);
+        if (status == ZX_OK) {
+            if (append) {
+                size_t end;
+                status = vnode_->Append(bounce_.get(), xfer, &end, &actual);
+                if (status == ZX_OK) {
+                    *offset = end;
+                }
+            } else {
+                status = vnode_->Write(bounce_.get(), xfer, *offset, &actual);
+                if (status == ZX_OK) {
+                    *offset += actual;
+                }
+            }
+        }
+        if (status != ZX_OK) {
+            if (done > 0) {
+                break;
+            }
+            return status;
+        }
+        ZX_DEBUG_ASSERT(actual <= xfer);
+        done += actual;
+        if (actual < xfer) {
+            break;
+        }
+    }
+    *out_actual = done;
+    return ZX_OK;
+}
+
 zx_status_t Connection::CallHandler() {
     return zxrio_handler(channel_.get(), &Connection::HandleMessageThunk, this);
 }
@@ -307,6 +417,79 @@ zx_status_t Connection::HandleMessage(zxrio_msg_t* msg) {
         }
         return status;
     }
+    case ZXRIO_SETBUFFER: {
+        TRACE_DURATION("vfs", "ZXRIO_SETBUFFER");
+        zx::vmo vmo(msg->handle[0]); // take ownership
+        if (IsPathOnly(flags_)) {
+            return ZX_ERR_BAD_HANDLE;
+        }
+        uint64_t size;
+        zx_status_t status = vmo.get_size(&size);
+        if (status != ZX_OK) {
+            return status;
+        }
+        buffer_ = fbl::move(vmo);
+        buffer_size_ = fbl::min(static_cast<size_t>(size), kMaxBufferTransfer);
+        return ZX_OK;
+    }
+    case ZXRIO_READ_BUFFER: {
+        TRACE_DURATION("vfs", "ZXRIO_READ_BUFFER");
+        if (!IsReadable(flags_)) {
+            return ZX_ERR_BAD_HANDLE;
+        }
+        if (arg < 0) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        size_t actual;
+        zx_status_t status = ReadToBuffer(static_cast<size_t>(arg), offset_, &actual);
+        if (status == ZX_OK) {
+            offset_ += actual;
+            msg->arg2.off = offset_;
+        }
+        return status == ZX_OK ? static_cast<zx_status_t>(actual) : status;
+    }
+    case ZXRIO_READ_AT_BUFFER: {
+        TRACE_DURATION("vfs", "ZXRIO_READ_AT_BUFFER");
+        if (!IsReadable(flags_)) {
+            return ZX_ERR_BAD_HANDLE;
+        }
+        if (arg < 0) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        size_t actual;
+        zx_status_t status = ReadToBuffer(static_cast<size_t>(arg), msg->arg2.off, &actual);
+        return status == ZX_OK ? static_cast<zx_status_t>(actual) : status;
+    }
+    case ZXRIO_WRITE_BUFFER: {
+        TRACE_DURATION("vfs", "ZXRIO_WRITE_BUFFER");
+        if (!IsWritable(flags_)) {
+            return ZX_ERR_BAD_HANDLE;
+        }
+        if (arg < 0) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        size_t actual;
+        zx_status_t status = WriteFromBuffer(static_cast<size_t>(arg), &offset_,
+                                             flags_ & ZX_FS_FLAG_APPEND, &actual);
+        if (status == ZX_OK) {
+            msg->arg2.off = offset_;
+        }
+        return status == ZX_OK ? static_cast<zx_status_t>(actual) : status;
+    }
+    case ZXRIO_WRITE_AT_BUFFER: {
+        TRACE_DURATION("vfs", "ZXRIO_WRITE_AT_BUFFER");
+        if (!IsWritable(flags_)) {
+            return ZX_ERR_BAD_HANDLE;
+        }
+        if (arg < 0) {
+            return ZX_ERR_INVALID_ARGS;
+        }
+        size_t actual;
+        size_t offset = msg->arg2.off;
+        zx_status_t status = WriteFromBuffer(static_cast<size_t>(arg), &offset, false,
+                                             &actual);
+        return status == ZX_OK ? static_cast<zx_status_t>(actual) : status;
+    }
     case ZXRIO_SEEK: {
         TRACE_DURATION("vfs", "ZXRIO_SEEK");
         if (IsPathOnly(flags_)) {
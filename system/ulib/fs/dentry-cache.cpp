@@ -0,0 +1,249 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/alloc_checker.h>
+#include <zircon/assert.h>
+#include <zircon/misc/fnv1hash.h>
+
+#ifdef __Fuchsia__
+#include <fbl/auto_lock.h>
+#endif
+
+#include <fs/dentry-cache.h>
+#include <fs/vnode.h>
+
+namespace fs {
+
+DentryCache::EntryKey DentryCache::Entry::GetKey() const {
+    return EntryKey{parent.get(), fbl::StringPiece(name.data(), name.length())};
+}
+
+size_t DentryCache::Entry::GetHash(const EntryKey& key) {
+    return fnv1a32(key.name.data(), key.name.length()) ^
+           static_cast<size_t>(reinterpret_cast<uintptr_t>(key.parent) >> 4);
+}
+
+DentryCache::DentryCache(size_t max_entries)
+    : max_entries_(max_entries) {
+    ZX_DEBUG_ASSERT(max_entries_ > 0);
+}
+
+DentryCache::~DentryCache() {
+    Clear();
+}
+
+bool DentryCache::Lookup(Vnode* parent, fbl::StringPiece name, fbl::RefPtr<Vnode>* out) {
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&lock_);
+#endif
+    auto iter = entries_.find(EntryKey{parent, name});
+    if (!iter.IsValid()) {
+        stats_.misses++;
+        return false;
+    }
+
+    Entry* entry = &*iter;
+    fbl::RefPtr<Vnode> child;
+    if (entry->child != nullptr) {
+#ifdef __Fuchsia__
+        child = fbl::internal::MakeRefPtrUpgradeFromRaw(entry->child, lock_);
+#else
+        child = fbl::WrapRefPtr(entry->child);
+#endif
+        if (child == nullptr) {
+            // The vnode is being destroyed, and will remove the entry with
+            // |Forget| once it acquires the lock.
+            stats_.misses++;
+            return false;
+        }
+        stats_.hits++;
+    } else {
+        stats_.negative_hits++;
+    }
+    lru_.erase(*entry);
+    lru_.push_front(entry);
+    *out = fbl::move(child);
+    return true;
+}
+
+uint64_t DentryCache::Generation() const {
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&lock_);
+#endif
+    return generation_;
+}
+
+void DentryCache::Insert(fbl::RefPtr<Vnode> parent, fbl::StringPiece name,
+                         fbl::RefPtr<Vnode> child, uint64_t generation) {
+    fbl::unique_ptr<Entry> entry;
+    fbl::unique_ptr<Dir> new_dir;
+    fbl::unique_ptr<Child> new_child;
+    if (parent->IsDentryCacheable() && (child == nullptr || child->IsDentryCacheable())) {
+        fbl::AllocChecker ac;
+        entry.reset(new (&ac) Entry());
+        if (ac.check()) {
+            entry->name = fbl::String(name.data(), name.length(), &ac);
+        }
+        if (ac.check()) {
+            new_dir.reset(new (&ac) Dir());
+        }
+        if (ac.check() && child != nullptr) {
+            new_child.reset(new (&ac) Child());
+        }
+        if (!ac.check()) {
+            entry.reset();
+        }
+    }
+    if (entry == nullptr) {
+        // Whatever was previously cached for this name is no longer valid.
+        Invalidate(parent.get(), name);
+        return;
+    }
+    new_dir->vn = parent.get();
+    entry->parent = fbl::move(parent);
+    entry->child = child.get();
+    entry->child_group = nullptr;
+    const uintptr_t dir_key = new_dir->GetKey();
+
+    fbl::SinglyLinkedList<fbl::unique_ptr<Entry>> dead;
+    {
+#ifdef __Fuchsia__
+        fbl::AutoLock lock(&lock_);
+#endif
+        if (generation != generation_) {
+            // The entry is released (with the references it holds) once
+            // the lock is dropped.
+            dead.push_front(fbl::move(entry));
+            return;
+        }
+        auto existing = entries_.find(entry->GetKey());
+        if (existing.IsValid()) {
+            RemoveLocked(&*existing, &dead);
+        }
+
+        auto dir = dirs_.find(dir_key);
+        if (!dir.IsValid()) {
+            dirs_.insert(fbl::move(new_dir));
+            dir = dirs_.find(dir_key);
+        }
+        entry->dir = &*dir;
+        dir->entries.push_front(entry.get());
+        if (child != nullptr) {
+            // |child| is held by the caller, so it cannot be in the middle
+            // of being destroyed.
+            ZX_DEBUG_ASSERT(child->dentry_cache_ == nullptr || child->dentry_cache_ == this);
+            child->dentry_cache_ = this;
+            new_child->vn = child.get();
+            const uintptr_t child_key = new_child->GetKey();
+            auto group = children_.find(child_key);
+            if (!group.IsValid()) {
+                children_.insert(fbl::move(new_child));
+                group = children_.find(child_key);
+            }
+            entry->child_group = &*group;
+            group->entries.push_front(entry.get());
+        }
+        lru_.push_front(entry.get());
+        entries_.insert(fbl::move(entry));
+
+        while (entries_.size() > max_entries_) {
+            stats_.evictions++;
+            RemoveLocked(&lru_.back(), &dead);
+        }
+    }
+}
+
+void DentryCache::Invalidate(Vnode* parent, fbl::StringPiece name) {
+    fbl::SinglyLinkedList<fbl::unique_ptr<Entry>> dead;
+    {
+#ifdef __Fuchsia__
+        fbl::AutoLock lock(&lock_);
+#endif
+        generation_++;
+        auto iter = entries_.find(EntryKey{parent, name});
+        if (iter.IsValid()) {
+            const Vnode* child = iter->child;
+            RemoveLocked(&*iter, &dead);
+            if (child != nullptr) {
+                // Only the address is used; |child| may already be on its
+                // way to |Forget|.
+                PurgeLocked(child, &dead);
+            }
+        }
+    }
+}
+
+void DentryCache::Purge(Vnode* vn) {
+    fbl::SinglyLinkedList<fbl::unique_ptr<Entry>> dead;
+    {
+#ifdef __Fuchsia__
+        fbl::AutoLock lock(&lock_);
+#endif
+        generation_++;
+        PurgeLocked(vn, &dead);
+    }
+}
+
+void DentryCache::Clear() {
+    fbl::SinglyLinkedList<fbl::unique_ptr<Entry>> dead;
+    {
+#ifdef __Fuchsia__
+        fbl::AutoLock lock(&lock_);
+#endif
+        generation_++;
+        while (!lru_.is_empty()) {
+            RemoveLocked(&lru_.front(), &dead);
+        }
+    }
+}
+
+void DentryCache::Forget(const Vnode* vn) {
+    fbl::SinglyLinkedList<fbl::unique_ptr<Entry>> dead;
+    {
+#ifdef __Fuchsia__
+        fbl::AutoLock lock(&lock_);
+#endif
+        const uintptr_t key = reinterpret_cast<uintptr_t>(vn);
+        // Removing the last entry for a vnode also removes its group.
+        for (auto group = children_.find(key); group.IsValid(); group = children_.find(key)) {
+            RemoveLocked(&group->entries.front(), &dead);
+        }
+    }
+}
+
+void DentryCache::GetStats(dentry_cache_stats_t* out) const {
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&lock_);
+#endif
+    *out = stats_;
+}
+
+void DentryCache::RemoveLocked(Entry* entry,
+                               fbl::SinglyLinkedList<fbl::unique_ptr<Entry>>* dead) {
+    Dir* dir = entry->dir;
+    lru_.erase(*entry);
+    dir->entries.erase(*entry);
+    if (dir->entries.is_empty()) {
+        dirs_.erase(*dir);
+    }
+    Child* group = entry->child_group;
+    if (group != nullptr) {
+        group->entries.erase(*entry);
+        if (group->entries.is_empty()) {
+            children_.erase(*group);
+        }
+    }
+    dead->push_front(entries_.erase(*entry));
+}
+
+void DentryCache::PurgeLocked(const Vnode* vn,
+                              fbl::SinglyLinkedList<fbl::unique_ptr<Entry>>* dead) {
+    const uintptr_t key = reinterpret_cast<uintptr_t>(vn);
+    // Removing the last entry of a directory also removes the directory.
+    for (auto dir = dirs_.find(key); dir.IsValid(); dir = dirs_.find(key)) {
+        RemoveLocked(&dir->entries.front(), dead);
+    }
+}
+
+} // namespace fs
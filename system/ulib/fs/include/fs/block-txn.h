@@ -85,7 +85,19 @@ public:
     // Activate the transaction
     zx_status_t Flush();
 
+    // Activate the transaction without waiting for it to complete, using
+    // the handler's "TxnAsync" method on behalf of |owner|. The handler is
+    // responsible for reporting any failure to |owner| once the transaction
+    // is awaited.
+    template <typename Owner>
+    zx_status_t FlushAsync(Owner* owner);
+
 private:
+    // Converts the enqueued requests to disk block units, and sends them
+    // using |txn|.
+    template <typename TxnFn>
+    zx_status_t Send(TxnFn txn);
+
     TxnHandler* handler_;
     size_t count_;
     block_fifo_request_t requests_[MAX_TXN_MESSAGES];
@@ -93,6 +105,22 @@ private:
 
 template <bool Write, size_t BlockSize, typename TxnHandler>
 inline zx_status_t BlockTxn<vmoid_t, Write, BlockSize, TxnHandler>::Flush() {
+    return Send([this](block_fifo_request_t* requests, size_t count) {
+        return handler_->Txn(requests, count);
+    });
+}
+
+template <bool Write, size_t BlockSize, typename TxnHandler>
+template <typename Owner>
+inline zx_status_t BlockTxn<vmoid_t, Write, BlockSize, TxnHandler>::FlushAsync(Owner* owner) {
+    return Send([this, owner](block_fifo_request_t* requests, size_t count) {
+        return handler_->TxnAsync(requests, count, owner);
+    });
+}
+
+template <bool Write, size_t BlockSize, typename TxnHandler>
+template <typename TxnFn>
+inline zx_status_t BlockTxn<vmoid_t, Write, BlockSize, TxnHandler>::Send(TxnFn txn) {
     // Convert 'filesystem block' units to 'disk block' units.
     const size_t kBlockFactor = BlockSize / handler_->BlockSize();
     for (size_t i = 0; i < count_; i++) {
@@ -103,7 +131,7 @@ inline zx_status_t BlockTxn<vmoid_t, Write, BlockSize, TxnHandler>::Flush() {
     }
     zx_status_t status = ZX_OK;
     if (count_ != 0) {
-        status = handler_->Txn(requests_, count_);
+        status = txn(requests_, count_);
     }
     count_ = 0;
     return status;
@@ -139,6 +167,8 @@ public:
 
     // Activate the transaction (do nothing)
     zx_status_t Flush() { return ZX_OK; }
+    template <typename Owner>
+    zx_status_t FlushAsync(Owner* owner) { return ZX_OK; }
 
 private:
     TxnHandler* handler_;
@@ -17,6 +17,7 @@
 #include <fs/vfs.h>
 #include <fs/vnode.h>
 #include <zx/event.h>
+#include <zx/vmo.h>
 
 namespace fs {
 
@@ -24,6 +25,11 @@ namespace fs {
 // component of a file descriptor).  The Vnode's methods will be invoked
 // in response to RIO protocol messages received over the channel.
 //
+// Messages on a single connection are handled one at a time: the wait on
+// the channel is only re-armed once the previous message has been handled.
+// Connections may therefore be served by a multi-threaded dispatcher,
+// provided the Vfs and its Vnodes are themselves thread-safe.
+//
 // This class is thread-safe.
 class Connection : public fbl::DoublyLinkedListable<fbl::unique_ptr<Connection>> {
 public:
@@ -60,6 +66,18 @@ private:
     static zx_status_t HandleMessageThunk(zxrio_msg_t* msg, void* cookie);
     zx_status_t HandleMessage(zxrio_msg_t* msg);
 
+    // Ensures that |bounce_| can stage transfers of |len| bytes, up to its
+    // maximum size. It is only allocated once buffered transfers are made,
+    // and only as large as they need.
+    zx_status_t ReserveBounce(size_t len);
+
+    // Move |len| bytes between the vnode and the start of |buffer_|,
+    // staging them through |bounce_|. The client holds a handle to the
+    // buffer and may resize it, so it is accessed through the VMO rather
+    // than mapped.
+    zx_status_t ReadToBuffer(size_t len, size_t offset, size_t* out_actual);
+    zx_status_t WriteFromBuffer(size_t len, size_t* offset, bool append, size_t* out_actual);
+
     bool is_waiting() const { return wait_.object() != ZX_HANDLE_INVALID; }
 
     fs::Vfs* const vfs_;
@@ -85,6 +103,13 @@ private:
 
     // Current seek offset.
     size_t offset_{};
+
+    // VMO attached by the client with ZXRIO_SETBUFFER, through which the
+    // *_BUFFER variants of read and write transfer their data.
+    zx::vmo buffer_;
+    size_t buffer_size_{};
+    fbl::unique_ptr<uint8_t[]> bounce_;
+    size_t bounce_size_{};
 };
 
 } // namespace fs
@@ -0,0 +1,190 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <fbl/intrusive_double_list.h>
+#include <fbl/intrusive_hash_table.h>
+#include <fbl/intrusive_single_list.h>
+#include <fbl/macros.h>
+#include <fbl/ref_ptr.h>
+#include <fbl/string.h>
+#include <fbl/string_piece.h>
+#include <fbl/unique_ptr.h>
+#include <zircon/compiler.h>
+#include <zircon/types.h>
+
+#ifdef __Fuchsia__
+#include <fbl/mutex.h>
+#endif
+
+namespace fs {
+
+class Vnode;
+
+// The default number of entries held by a DentryCache.
+constexpr size_t kDentryCacheDefaultSize = 1024;
+
+typedef struct dentry_cache_stats {
+    // Lookups which found a vnode in the cache.
+    uint64_t hits;
+    // Lookups which found a cached record of the name not existing.
+    uint64_t negative_hits;
+    // Lookups which were not answered by the cache.
+    uint64_t misses;
+    // Entries dropped to keep the cache within its capacity.
+    uint64_t evictions;
+} dentry_cache_stats_t;
+
+// A bounded cache of the results of |Vnode::Lookup|, keyed by the parent
+// vnode and the name which was looked up.
+//
+// Positive entries point to the vnode which was found; negative entries
+// record that the name did not exist. Entries are evicted in
+// least-recently-used order.
+//
+// Every entry holds a reference to its parent directory, so that the
+// directories along cached paths stay alive to be walked. Positive entries do
+// not hold a reference to the vnode which was found: once nothing else refers
+// to it, it is released as usual, and its entries are dropped. The cache
+// therefore never keeps a file, or the memory behind it, alive.
+//
+// The cache is not aware of modifications made to directories; anything
+// which adds, removes, or renames a name in a cached directory must call
+// |Invalidate| (and |Purge|, if a directory is removed). Since a lookup may
+// race with such a modification, entries are only inserted if nothing was
+// invalidated since the caller sampled |Generation()|, before consulting
+// the filesystem.
+//
+// This class is thread-safe.
+class DentryCache {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(DentryCache);
+    explicit DentryCache(size_t max_entries);
+    ~DentryCache();
+
+    // Looks up |name| within |parent|.
+    //
+    // Returns true if the cache holds an entry for the name. On a positive
+    // hit, |out| is set to the cached vnode; on a negative hit, |out| is set
+    // to nullptr.
+    bool Lookup(Vnode* parent, fbl::StringPiece name, fbl::RefPtr<Vnode>* out);
+
+    // Returns a counter which is advanced by every invalidation.
+    uint64_t Generation() const;
+
+    // Records that |name| within |parent| refers to |child|, or, if |child|
+    // is nullptr, that |name| does not exist. Replaces any existing entry.
+    //
+    // The entry is discarded if the cache has been invalidated since
+    // |generation| was returned by |Generation()|, as it may be stale.
+    //
+    // If either vnode is not |IsDentryCacheable()|, or the entry cannot be
+    // allocated, any existing entry for the name is dropped instead.
+    void Insert(fbl::RefPtr<Vnode> parent, fbl::StringPiece name, fbl::RefPtr<Vnode> child,
+                uint64_t generation);
+
+    // Drops the entry for |name| within |parent|, if one exists. If the entry
+    // referred to a directory, the entries within that directory are dropped
+    // too.
+    void Invalidate(Vnode* parent, fbl::StringPiece name);
+
+    // Drops every entry within the directory |vn|.
+    void Purge(Vnode* vn);
+
+    // Drops every entry in the cache.
+    void Clear();
+
+    // Drops every entry which refers to |vn|. Called as |vn| is destroyed.
+    void Forget(const Vnode* vn);
+
+    void GetStats(dentry_cache_stats_t* out) const;
+
+private:
+    struct Entry;
+
+    struct EntryKey {
+        const Vnode* parent;
+        fbl::StringPiece name;
+    };
+
+    using LruState = fbl::DoublyLinkedListNodeState<Entry*>;
+    using DirState = fbl::DoublyLinkedListNodeState<Entry*>;
+    using ChildState = fbl::DoublyLinkedListNodeState<Entry*>;
+
+    struct LruTraits {
+        static LruState& node_state(Entry& e) { return e.lru_state; }
+    };
+    struct DirTraits {
+        static DirState& node_state(Entry& e) { return e.dir_state; }
+    };
+    struct ChildTraits {
+        static ChildState& node_state(Entry& e) { return e.child_state; }
+    };
+
+    // Entries grouped by a vnode they share.
+    template <typename Traits>
+    struct Group : public fbl::SinglyLinkedListable<fbl::unique_ptr<Group<Traits>>> {
+        uintptr_t GetKey() const { return reinterpret_cast<uintptr_t>(vn); }
+        static size_t GetHash(uintptr_t key) { return key >> 4; }
+
+        const Vnode* vn;
+        fbl::DoublyLinkedList<Entry*, Traits> entries;
+    };
+    // All entries for names within a single directory.
+    using Dir = Group<DirTraits>;
+    // All positive entries which refer to a single vnode.
+    using Child = Group<ChildTraits>;
+
+    struct Entry : public fbl::SinglyLinkedListable<fbl::unique_ptr<Entry>> {
+        EntryKey GetKey() const;
+        static size_t GetHash(const EntryKey& key);
+
+        Dir* dir;
+        fbl::RefPtr<Vnode> parent;
+        fbl::String name;
+        // nullptr for negative entries. Not a reference; see |Forget|.
+        Vnode* child;
+        Child* child_group;
+
+        LruState lru_state;
+        DirState dir_state;
+        ChildState child_state;
+    };
+
+    struct EntryKeyTraits {
+        static EntryKey GetKey(const Entry& e) { return e.GetKey(); }
+        static bool EqualTo(const EntryKey& a, const EntryKey& b) {
+            return a.parent == b.parent && a.name == b.name;
+        }
+    };
+
+    static constexpr size_t kNumBuckets = 257;
+
+    // Entries which are removed from the cache are moved to |dead|, so the
+    // references they hold may be released after |lock_| is dropped.
+    void RemoveLocked(Entry* entry, fbl::SinglyLinkedList<fbl::unique_ptr<Entry>>* dead)
+        __TA_REQUIRES(lock_);
+    void PurgeLocked(const Vnode* vn, fbl::SinglyLinkedList<fbl::unique_ptr<Entry>>* dead)
+        __TA_REQUIRES(lock_);
+
+    const size_t max_entries_;
+
+#ifdef __Fuchsia__
+    mutable fbl::Mutex lock_;
+#endif
+    fbl::HashTable<EntryKey, fbl::unique_ptr<Entry>, fbl::SinglyLinkedList<fbl::unique_ptr<Entry>>,
+                   size_t, kNumBuckets, EntryKeyTraits> entries_ __TA_GUARDED(lock_);
+    fbl::HashTable<uintptr_t, fbl::unique_ptr<Dir>> dirs_ __TA_GUARDED(lock_);
+    fbl::HashTable<uintptr_t, fbl::unique_ptr<Child>> children_ __TA_GUARDED(lock_);
+    // Most recently used entries are at the front.
+    fbl::DoublyLinkedList<Entry*, LruTraits> lru_ __TA_GUARDED(lock_);
+    dentry_cache_stats_t stats_ __TA_GUARDED(lock_) = {};
+    uint64_t generation_ __TA_GUARDED(lock_) = 0;
+};
+
+} // namespace fs
@@ -8,12 +8,18 @@
 #error "Fuchsia-only header"
 #endif
 
+#include <fbl/mutex.h>
 #include <fs/vfs.h>
 #include <zx/channel.h>
 
 namespace fs {
 
 // RemoteContainer adds support for mounting remote handles on nodes.
+//
+// The remote handle may be checked during a path walk without |vfs_lock_|
+// (when the Vfs uses fine-grained locking), so it is guarded by its own
+// lock. The handle is only attached or detached with |vfs_lock_| held,
+// so a handle returned by GetRemote remains valid while that lock is held.
 class RemoteContainer {
 public:
     constexpr RemoteContainer() {};
@@ -22,7 +28,8 @@ public:
     zx_handle_t GetRemote() const;
     void SetRemote(zx::channel remote);
 private:
-    zx::channel remote_;
+    mutable fbl::Mutex lock_;
+    zx::channel remote_ __TA_GUARDED(lock_);
 };
 
 }
@@ -12,6 +12,7 @@
 #include <fdio/remoteio.h>
 #include <fdio/vfs.h>
 #include <fs/client.h>
+#include <fs/dentry-cache.h>
 #include <zircon/assert.h>
 #include <zircon/compiler.h>
 #include <zircon/device/vfs.h>
@@ -26,6 +27,7 @@
 #include <fbl/mutex.h>
 #endif // __Fuchsia__
 
+#include <fbl/atomic.h>
 #include <fbl/intrusive_double_list.h>
 #include <fbl/macros.h>
 #include <fbl/ref_counted.h>
@@ -104,6 +106,12 @@ private:
 //
 // The Vfs object must outlive the Vnodes which it serves.
 //
+// By default, operations which walk or modify the namespace are serialized
+// by |vfs_lock_|, so filesystems need not protect their directories against
+// concurrent lookups and modifications. Filesystems which lock their own
+// vnodes may call |SetFineGrainedLocking|, after which |vfs_lock_| only
+// protects the set of mount points.
+//
 // This class is thread-safe.
 class Vfs {
 public:
@@ -125,18 +133,41 @@ public:
                       void* out_buf, size_t out_len, size_t* out_actual) __TA_EXCLUDES(vfs_lock_);
 
     // Sets whether this file system is read-only.
-    void SetReadonly(bool value) __TA_EXCLUDES(vfs_lock_);
+    void SetReadonly(bool value);
+
+    // Sets whether Open, Unlink and Readdir may run concurrently with each
+    // other (and Rename and Link with all three). Every Vnode served by this
+    // Vfs must be safe to access from multiple threads at once.
+    //
+    // Must be called before the Vfs begins serving requests.
+    void SetFineGrainedLocking(bool value);
+
+    // Caches the results of looking up names, so repeated walks of the same
+    // paths (including paths which do not exist) do not reach the underlying
+    // filesystem.
+    //
+    // Must be called before the Vfs begins serving requests.
+    zx_status_t EnableDentryCache(size_t max_entries = kDentryCacheDefaultSize);
+
+    // Drops any cached lookup of |name| within |parent|. Operations on names
+    // which pass through the Vfs invalidate the cache automatically;
+    // filesystems which add or remove names by other means must call this.
+    void InvalidateDentry(Vnode* parent, fbl::StringPiece name);
+
+    // Returns ZX_ERR_NOT_SUPPORTED if the dentry cache is not enabled.
+    zx_status_t GetDentryCacheStats(dentry_cache_stats_t* out) const;
 
 #ifdef __Fuchsia__
-    void TokenDiscard(zx::event ios_token) __TA_EXCLUDES(vfs_lock_);
+    void TokenDiscard(zx::event ios_token) __TA_EXCLUDES(rename_lock_);
     zx_status_t VnodeToToken(fbl::RefPtr<Vnode> vn, zx::event* ios_token,
-                             zx::event* out) __TA_EXCLUDES(vfs_lock_);
+                             zx::event* out) __TA_EXCLUDES(rename_lock_);
     zx_status_t Link(zx::event token, fbl::RefPtr<Vnode> oldparent,
                      fbl::StringPiece oldStr, fbl::StringPiece newStr) __TA_EXCLUDES(vfs_lock_);
     zx_status_t Rename(zx::event token, fbl::RefPtr<Vnode> oldparent,
                        fbl::StringPiece oldStr, fbl::StringPiece newStr) __TA_EXCLUDES(vfs_lock_);
-    // Calls readdir on the Vnode while holding the vfs_lock, preventing path
-    // modification operations for the duration of the operation.
+    // Calls readdir on the Vnode while holding the vfs_lock (unless
+    // fine-grained locking is enabled), preventing path modification
+    // operations for the duration of the operation.
     zx_status_t Readdir(Vnode* vn, vdircookie_t* cookie,
                         void* dirents, size_t len, size_t* out_actual) __TA_EXCLUDES(vfs_lock_);
 
@@ -178,9 +209,13 @@ public:
 
 protected:
     // Whether this file system is read-only.
-    bool ReadonlyLocked() const __TA_REQUIRES(vfs_lock_) { return readonly_; }
+    bool IsReadonly() const { return readonly_.load(); }
 
 private:
+    // Holds |vfs_lock_| for the duration of a namespace operation, unless
+    // fine-grained locking is enabled.
+    class NamespaceLock;
+
     // Starting at vnode |vn|, walk the tree described by the path string,
     // until either there is only one path segment remaining in the string
     // or we encounter a vnode that represents a remote filesystem
@@ -189,16 +224,26 @@ private:
     // |out| is the vnode at which we stopped searching
     // |pathout| is the reaminer of the path to search
     zx_status_t Walk(fbl::RefPtr<Vnode> vn, fbl::RefPtr<Vnode>* out,
-                     fbl::StringPiece path, fbl::StringPiece* pathout) __TA_REQUIRES(vfs_lock_);
+                     fbl::StringPiece path, fbl::StringPiece* pathout);
 
+    // Called with the NamespaceLock held.
     zx_status_t OpenLocked(fbl::RefPtr<Vnode> vn, fbl::RefPtr<Vnode>* out,
                            fbl::StringPiece path, fbl::StringPiece* pathout,
-                           uint32_t flags, uint32_t mode) __TA_REQUIRES(vfs_lock_);
+                           uint32_t flags, uint32_t mode);
+
+    // Looks up a single path segment |name| within |vn|, consulting the
+    // dentry cache if it is enabled.
+    zx_status_t LookupLocked(fbl::RefPtr<Vnode> vn, fbl::RefPtr<Vnode>* out,
+                             fbl::StringPiece name);
 
-    bool readonly_{};
+    fbl::atomic<bool> readonly_{};
+    bool fine_grained_locking_{};
+
+    // Set once by EnableDentryCache; the cache has its own lock.
+    fbl::unique_ptr<DentryCache> dentry_cache_;
 
 #ifdef __Fuchsia__
-    zx_status_t TokenToVnode(zx::event token, fbl::RefPtr<Vnode>* out) __TA_REQUIRES(vfs_lock_);
+    zx_status_t TokenToVnode(zx::event token, fbl::RefPtr<Vnode>* out) __TA_REQUIRES(rename_lock_);
     zx_status_t InstallRemoteLocked(fbl::RefPtr<Vnode> vn, MountChannel h) __TA_REQUIRES(vfs_lock_);
     zx_status_t UninstallRemoteLocked(fbl::RefPtr<Vnode> vn,
                                       zx::channel* h) __TA_REQUIRES(vfs_lock_);
@@ -226,8 +271,13 @@ private:
 
     async_t* async_{};
 
+    // Serializes Rename and Link against each other, and against the
+    // invalidation of the tokens they resolve.
+    fbl::Mutex rename_lock_;
+
 protected:
-    // A lock which should be used to protect lookup and walk operations
+    // A lock which protects the set of mount points, and (unless
+    // fine-grained locking is enabled) lookup and walk operations.
     mtx_t vfs_lock_{};
 
     // Starts tracking the lifetime of the connection.
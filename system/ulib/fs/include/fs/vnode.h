@@ -193,6 +193,10 @@ public:
     // Invoked by the VFS layer whenever files are added or removed.
     virtual void Notify(fbl::StringPiece name, unsigned event);
 
+    // Whether the results of looking up names within (or of looking up)
+    // this vnode may be held in the VFS's dentry cache, if one is enabled.
+    virtual bool IsDentryCacheable() const;
+
 #ifdef __Fuchsia__
     // Attaches a handle to the vnode, if possible. Otherwise, returns an error.
     virtual zx_status_t AttachRemote(MountChannel h);
@@ -213,6 +217,14 @@ public:
 protected:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Vnode);
     Vnode();
+
+private:
+    friend class DentryCache;
+
+    // The dentry cache which may hold entries referring to this vnode,
+    // without a reference. Set by the cache; the vnode drops those entries
+    // as it is destroyed.
+    DentryCache* dentry_cache_ = nullptr;
 };
 
 // Opens a vnode by reference.
@@ -56,13 +56,15 @@ zx_status_t Vfs::InstallRemote(fbl::RefPtr<Vnode> vn, MountChannel h) {
     if (!ac.check()) {
         return ZX_ERR_NO_MEMORY;
     }
+    // Remote handles are only attached and detached with |vfs_lock_| held,
+    // so that ForwardMessageRemote may use them under the same lock.
+    fbl::AutoLock lock(&vfs_lock_);
     zx_status_t status = vn->AttachRemote(fbl::move(h));
     if (status != ZX_OK) {
         return status;
     }
     // Save this node in the list of mounted vnodes
     mount_point->SetNode(fbl::move(vn));
-    fbl::AutoLock lock(&vfs_lock_);
     remote_list_.push_front(fbl::move(mount_point));
     return ZX_OK;
 }
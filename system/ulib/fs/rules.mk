@@ -10,6 +10,7 @@ MODULE_TYPE := userlib
 
 MODULE_SRCS += \
     $(LOCAL_DIR)/connection.cpp \
+    $(LOCAL_DIR)/dentry-cache.cpp \
     $(LOCAL_DIR)/fvm.cpp \
     $(LOCAL_DIR)/managed-vfs.cpp \
     $(LOCAL_DIR)/mapped-vmo.cpp \
@@ -2,6 +2,7 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <fbl/alloc_checker.h>
 #include <fbl/auto_call.h>
 #include <fdio/remoteio.h>
 #include <fdio/watcher.h>
@@ -59,17 +60,6 @@ zx_status_t vfs_name_trim(fbl::StringPiece name, fbl::StringPiece* name_out,
     return ZX_OK;
 }
 
-zx_status_t vfs_lookup(fbl::RefPtr<Vnode> vn, fbl::RefPtr<Vnode>* out,
-                       fbl::StringPiece name) {
-    if (name == "..") {
-        return ZX_ERR_INVALID_ARGS;
-    } else if (name == ".") {
-        *out = fbl::move(vn);
-        return ZX_OK;
-    }
-    return vn->Lookup(out, name);
-}
-
 // Validate open flags as much as they can be validated
 // independently of the target node.
 zx_status_t vfs_prevalidate_flags(uint32_t flags) {
@@ -90,24 +80,51 @@ zx_status_t vfs_prevalidate_flags(uint32_t flags) {
 #ifdef __Fuchsia__
 
 bool RemoteContainer::IsRemote() const {
+    fbl::AutoLock lock(&lock_);
     return remote_.is_valid();
 }
 
 zx::channel RemoteContainer::DetachRemote() {
+    fbl::AutoLock lock(&lock_);
     return fbl::move(remote_);
 }
 
 zx_handle_t RemoteContainer::GetRemote() const {
+    fbl::AutoLock lock(&lock_);
     return remote_.get();
 }
 
 void RemoteContainer::SetRemote(zx::channel remote) {
+    fbl::AutoLock lock(&lock_);
     ZX_DEBUG_ASSERT(!remote_.is_valid());
     remote_ = fbl::move(remote);
 }
 
 #endif
 
+class Vfs::NamespaceLock {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(NamespaceLock);
+#ifdef __Fuchsia__
+    explicit NamespaceLock(Vfs* vfs) __TA_NO_THREAD_SAFETY_ANALYSIS
+        : lock_(vfs->fine_grained_locking_ ? nullptr : &vfs->vfs_lock_) {
+        if (lock_ != nullptr) {
+            mtx_lock(lock_);
+        }
+    }
+    ~NamespaceLock() __TA_NO_THREAD_SAFETY_ANALYSIS {
+        if (lock_ != nullptr) {
+            mtx_unlock(lock_);
+        }
+    }
+
+private:
+    mtx_t* const lock_;
+#else
+    explicit NamespaceLock(Vfs* vfs) {}
+#endif
+};
+
 Vfs::Vfs() = default;
 Vfs::~Vfs() = default;
 
@@ -119,9 +136,7 @@ Vfs::Vfs(async_t* async)
 zx_status_t Vfs::Open(fbl::RefPtr<Vnode> vndir, fbl::RefPtr<Vnode>* out,
                       fbl::StringPiece path, fbl::StringPiece* pathout, uint32_t flags,
                       uint32_t mode) {
-#ifdef __Fuchsia__
-    fbl::AutoLock lock(&vfs_lock_);
-#endif
+    NamespaceLock lock(this);
     return OpenLocked(fbl::move(vndir), out, path, pathout, flags, mode);
 }
 
@@ -159,9 +174,10 @@ zx_status_t Vfs::OpenLocked(fbl::RefPtr<Vnode> vndir, fbl::RefPtr<Vnode>* out,
             return ZX_ERR_INVALID_ARGS;
         } else if (path == ".") {
             return ZX_ERR_INVALID_ARGS;
-        } else if (ReadonlyLocked()) {
+        } else if (IsReadonly()) {
             return ZX_ERR_ACCESS_DENIED;
         }
+        const uint64_t generation = dentry_cache_ ? dentry_cache_->Generation() : 0;
         if ((r = vndir->Create(&vn, path, mode)) < 0) {
             if ((r == ZX_ERR_ALREADY_EXISTS) && (!(flags & ZX_FS_FLAG_EXCLUSIVE))) {
                 goto try_open;
@@ -173,10 +189,13 @@ zx_status_t Vfs::OpenLocked(fbl::RefPtr<Vnode> vndir, fbl::RefPtr<Vnode>* out,
             }
             return r;
         }
+        if (dentry_cache_ != nullptr) {
+            dentry_cache_->Insert(vndir, path, vn, generation);
+        }
         vndir->Notify(path, VFS_WATCH_EVT_ADDED);
     } else {
     try_open:
-        r = vfs_lookup(fbl::move(vndir), &vn, path);
+        r = LookupLocked(fbl::move(vndir), &vn, path);
         if (r < 0) {
             return r;
         }
@@ -190,7 +209,7 @@ zx_status_t Vfs::OpenLocked(fbl::RefPtr<Vnode> vndir, fbl::RefPtr<Vnode>* out,
 
         flags |= (must_be_dir ? ZX_FS_FLAG_DIRECTORY : 0);
 #endif
-        if (ReadonlyLocked() && IsWritable(flags)) {
+        if (IsReadonly() && IsWritable(flags)) {
             return ZX_ERR_ACCESS_DENIED;
         }
         if ((r = vn->ValidateFlags(flags)) != ZX_OK) {
@@ -226,14 +245,15 @@ zx_status_t Vfs::Unlink(fbl::RefPtr<Vnode> vndir, fbl::StringPiece path) {
     }
 
     {
-#ifdef __Fuchsia__
-        fbl::AutoLock lock(&vfs_lock_);
-#endif
-        if (ReadonlyLocked()) {
+        NamespaceLock lock(this);
+        if (IsReadonly()) {
             r = ZX_ERR_ACCESS_DENIED;
         } else {
             r = vndir->Unlink(path, must_be_dir);
         }
+        if (r == ZX_OK && dentry_cache_ != nullptr) {
+            dentry_cache_->Invalidate(vndir.get(), path);
+        }
     }
     if (r != ZX_OK) {
         return r;
@@ -247,7 +267,7 @@ zx_status_t Vfs::Unlink(fbl::RefPtr<Vnode> vndir, fbl::StringPiece path) {
 #define TOKEN_RIGHTS (ZX_RIGHTS_BASIC)
 
 void Vfs::TokenDiscard(zx::event ios_token) {
-    fbl::AutoLock lock(&vfs_lock_);
+    fbl::AutoLock lock(&rename_lock_);
     if (ios_token) {
         // The token is cleared here to prevent the following race condition:
         // 1) Open
@@ -267,7 +287,7 @@ zx_status_t Vfs::VnodeToToken(fbl::RefPtr<Vnode> vn, zx::event* ios_token,
     uint64_t vnode_cookie = reinterpret_cast<uint64_t>(vn.get());
     zx_status_t r;
 
-    fbl::AutoLock lock(&vfs_lock_);
+    fbl::AutoLock lock(&rename_lock_);
     if (ios_token->is_valid()) {
         // Token has already been set for this iostate
         if ((r = ios_token->duplicate(TOKEN_RIGHTS, out) != ZX_OK)) {
@@ -329,8 +349,9 @@ zx_status_t Vfs::Rename(zx::event token, fbl::RefPtr<Vnode> oldparent,
 
     fbl::RefPtr<fs::Vnode> newparent;
     {
-        fbl::AutoLock lock(&vfs_lock_);
-        if (ReadonlyLocked()) {
+        fbl::AutoLock rename_lock(&rename_lock_);
+        NamespaceLock lock(this);
+        if (IsReadonly()) {
             return ZX_ERR_ACCESS_DENIED;
         }
         if ((r = TokenToVnode(fbl::move(token), &newparent)) != ZX_OK) {
@@ -339,6 +360,10 @@ zx_status_t Vfs::Rename(zx::event token, fbl::RefPtr<Vnode> oldparent,
 
         r = oldparent->Rename(newparent, oldStr, newStr, old_must_be_dir,
                               new_must_be_dir);
+        if (r == ZX_OK && dentry_cache_ != nullptr) {
+            dentry_cache_->Invalidate(oldparent.get(), oldStr);
+            dentry_cache_->Invalidate(newparent.get(), newStr);
+        }
     }
     if (r != ZX_OK) {
         return r;
@@ -350,13 +375,14 @@ zx_status_t Vfs::Rename(zx::event token, fbl::RefPtr<Vnode> oldparent,
 
 zx_status_t Vfs::Readdir(Vnode* vn, vdircookie_t* cookie,
                          void* dirents, size_t len, size_t* out_actual) {
-    fbl::AutoLock lock(&vfs_lock_);
+    NamespaceLock lock(this);
     return vn->Readdir(cookie, dirents, len, out_actual);
 }
 
 zx_status_t Vfs::Link(zx::event token, fbl::RefPtr<Vnode> oldparent,
                       fbl::StringPiece oldStr, fbl::StringPiece newStr) {
-    fbl::AutoLock lock(&vfs_lock_);
+    fbl::AutoLock rename_lock(&rename_lock_);
+    NamespaceLock lock(this);
     fbl::RefPtr<fs::Vnode> newparent;
     zx_status_t r;
     if ((r = TokenToVnode(fbl::move(token), &newparent)) != ZX_OK) {
@@ -365,7 +391,7 @@ zx_status_t Vfs::Link(zx::event token, fbl::RefPtr<Vnode> oldparent,
     // Local filesystem
     bool old_must_be_dir;
     bool new_must_be_dir;
-    if (ReadonlyLocked()) {
+    if (IsReadonly()) {
         return ZX_ERR_ACCESS_DENIED;
     } else if ((r = vfs_name_trim(oldStr, &oldStr, &old_must_be_dir)) != ZX_OK) {
         return r;
@@ -394,6 +420,9 @@ zx_status_t Vfs::Link(zx::event token, fbl::RefPtr<Vnode> oldparent,
     if (r != ZX_OK) {
         return r;
     }
+    if (dentry_cache_ != nullptr) {
+        dentry_cache_->Invalidate(newparent.get(), newStr);
+    }
     newparent->Notify(newStr, VFS_WATCH_EVT_ADDED);
     return ZX_OK;
 }
@@ -491,6 +520,11 @@ zx_status_t Vfs::Ioctl(fbl::RefPtr<Vnode> vn, uint32_t op, const void* in_buf, s
     }
     case IOCTL_VFS_UNMOUNT_FS: {
         Vfs::UninstallAll(ZX_TIME_INFINITE);
+        // Cached vnodes must not outlive the filesystem which is about to
+        // be torn down.
+        if (dentry_cache_ != nullptr) {
+            dentry_cache_->Clear();
+        }
         *out_actual = 0;
         vn->Ioctl(op, in_buf, in_len, out_buf, out_len, out_actual);
         return ZX_OK;
@@ -502,10 +536,66 @@ zx_status_t Vfs::Ioctl(fbl::RefPtr<Vnode> vn, uint32_t op, const void* in_buf, s
 }
 
 void Vfs::SetReadonly(bool value) {
-#ifdef __Fuchsia__
-    fbl::AutoLock lock(&vfs_lock_);
-#endif
-    readonly_ = value;
+    readonly_.store(value);
+}
+
+void Vfs::SetFineGrainedLocking(bool value) {
+    fine_grained_locking_ = value;
+}
+
+zx_status_t Vfs::EnableDentryCache(size_t max_entries) {
+    ZX_DEBUG_ASSERT(dentry_cache_ == nullptr);
+    fbl::AllocChecker ac;
+    dentry_cache_.reset(new (&ac) DentryCache(max_entries));
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    return ZX_OK;
+}
+
+void Vfs::InvalidateDentry(Vnode* parent, fbl::StringPiece name) {
+    if (dentry_cache_ != nullptr) {
+        dentry_cache_->Invalidate(parent, name);
+    }
+}
+
+zx_status_t Vfs::GetDentryCacheStats(dentry_cache_stats_t* out) const {
+    if (dentry_cache_ == nullptr) {
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+    dentry_cache_->GetStats(out);
+    return ZX_OK;
+}
+
+zx_status_t Vfs::LookupLocked(fbl::RefPtr<Vnode> vn, fbl::RefPtr<Vnode>* out,
+                              fbl::StringPiece name) {
+    if (name == "..") {
+        return ZX_ERR_INVALID_ARGS;
+    } else if (name == ".") {
+        *out = fbl::move(vn);
+        return ZX_OK;
+    }
+    if (dentry_cache_ == nullptr) {
+        return vn->Lookup(out, name);
+    }
+
+    fbl::RefPtr<Vnode> child;
+    if (dentry_cache_->Lookup(vn.get(), name, &child)) {
+        if (child == nullptr) {
+            return ZX_ERR_NOT_FOUND;
+        }
+        *out = fbl::move(child);
+        return ZX_OK;
+    }
+    const uint64_t generation = dentry_cache_->Generation();
+    zx_status_t status = vn->Lookup(&child, name);
+    if (status == ZX_OK) {
+        dentry_cache_->Insert(vn, name, child, generation);
+        *out = fbl::move(child);
+    } else if (status == ZX_ERR_NOT_FOUND) {
+        dentry_cache_->Insert(fbl::move(vn), name, nullptr, generation);
+    }
+    return status;
 }
 
 zx_status_t Vfs::Walk(fbl::RefPtr<Vnode> vn, fbl::RefPtr<Vnode>* out,
@@ -552,7 +642,7 @@ zx_status_t Vfs::Walk(fbl::RefPtr<Vnode> vn, fbl::RefPtr<Vnode>* out,
             // traverse to the next segment
             size_t len = nextpath - path;
             nextpath++;
-            if ((r = vfs_lookup(fbl::move(vn), &vn, fbl::StringPiece(path, len))) < 0) {
+            if ((r = LookupLocked(fbl::move(vn), &vn, fbl::StringPiece(path, len))) < 0) {
                 return r;
             }
             path = nextpath;
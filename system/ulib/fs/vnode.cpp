@@ -12,7 +12,11 @@ namespace fs {
 
 Vnode::Vnode() = default;
 
-Vnode::~Vnode() = default;
+Vnode::~Vnode() {
+    if (dentry_cache_ != nullptr) {
+        dentry_cache_->Forget(this);
+    }
+}
 
 #ifdef __Fuchsia__
 zx_status_t Vnode::Serve(fs::Vfs* vfs, zx::channel channel, uint32_t flags) {
@@ -33,6 +37,10 @@ zx_status_t Vnode::WatchDir(Vfs* vfs, const vfs_watch_dir_t* cmd) {
 
 void Vnode::Notify(fbl::StringPiece name, unsigned event) {}
 
+bool Vnode::IsDentryCacheable() const {
+    return true;
+}
+
 zx_status_t Vnode::ValidateFlags(uint32_t flags) {
     return ZX_OK;
 }
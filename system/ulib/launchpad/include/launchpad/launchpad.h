@@ -133,6 +133,48 @@ zx_status_t launchpad_load_from_fd(launchpad_t* lp, int fd);
 zx_status_t launchpad_load_from_vmo(launchpad_t* lp, zx_handle_t vmo);
 
 
+// PROCESS TEMPLATES
+// A template holds the parts of loading a program which are the same
+// every time it is launched: the executable, the dynamic linker named
+// by its PT_INTERP (looked up once via the default loader service),
+// the vDSO, and all of their parsed ELF headers.  Programs launched
+// many times can be loaded from a template, skipping the file lookups,
+// header reads, and loader service round trip that launchpad_load_*()
+// repeat for every launch.
+//
+// Each process still gets its own copy-on-write mappings, and its
+// dynamic linker still loads and relocates its shared libraries.
+// A template is not modified by loading from it, so it may be used
+// by several threads at once.
+// -------------------------------------------------------------------
+
+typedef struct launchpad_template launchpad_template_t;
+
+// Create a template for the ELF executable in vmo, which is consumed.
+// Scripts (files starting with "#!") are not supported.
+zx_status_t launchpad_template_create(zx_handle_t vmo,
+                                      launchpad_template_t** tmpl);
+
+// Create a template for the ELF executable at path.
+zx_status_t launchpad_template_create_from_file(const char* path,
+                                                launchpad_template_t** tmpl);
+
+// Free a template.  Processes loaded from it are not affected.
+void launchpad_template_destroy(launchpad_template_t* tmpl);
+
+// Load the program from tmpl, as launchpad_load_from_vmo would load
+// the template's executable: this loads the executable (or its dynamic
+// linker) and the vDSO, and adds the vDSO handle.
+//
+// The dynamic linker is always the one the default loader service found
+// for the executable's PT_INTERP when the template was created, even if
+// launchpad_use_loader_service() has given lp a loader service of its
+// own.  That loader service is still handed to the new process, so the
+// dynamic linker uses it to load the program's shared libraries.
+zx_status_t launchpad_load_from_template(launchpad_t* lp,
+                                         const launchpad_template_t* tmpl);
+
+
 // ADDING ARGUMENTS, ENVIRONMENT, AND HANDLES
 // These functions setup arguments, environment, or handles to be
 // passed to the new process via the processargs protocol.
@@ -74,6 +74,13 @@ zx_status_t loader_service_create(const char* name,
                                   const loader_service_ops_t* ops, void* ctx,
                                   loader_service_t** out);
 
+// Keep the VMOs of the objects loaded by |svc|, and hand out read-only
+// duplicates of them to later loads of the same name. Cached objects are
+// never reloaded, so this is only suitable for services whose load_object
+// op always resolves a name to the same unchanging file, such as one
+// backed by bootfs.
+zx_status_t loader_service_enable_cache(loader_service_t* svc);
+
 // the default publish_data_sink implementation, which publishes
 // into /tmp, provided the fs there supports such publishing
 zx_status_t loader_service_publish_data_sink_fs(const char* name, zx_handle_t vmo);
@@ -523,20 +523,30 @@ static zx_status_t reserve_low_address_space(launchpad_t* lp) {
     return ZX_OK;
 }
 
-// Consumes 'vmo' on success, not on failure.
-static zx_status_t handle_interp(launchpad_t* lp, zx_handle_t vmo,
-                                 const char* interp, size_t interp_len) {
-    zx_status_t status = setup_loader_svc(lp);
-    if (status != ZX_OK)
-        return status;
-
-    zx_handle_t interp_vmo;
-    status = loader_svc_rpc(
-        lp->special_handles[HND_LOADER_SVC], LOADER_SVC_OP_LOAD_OBJECT,
-        interp, interp_len, &interp_vmo);
-    if (status != ZX_OK)
-        return status;
+// Map in the ELF file in 'vmo', which has no PT_INTERP, to be started
+// directly.
+static zx_status_t load_elf_direct(launchpad_t* lp, elf_load_info_t* elf,
+                                   zx_handle_t vmo) {
+    zx_handle_t segments_vmar;
+    zx_status_t status = elf_load_finish(lp_vmar(lp), elf, vmo, &segments_vmar,
+                                         &lp->base, &lp->entry);
+    if (status == ZX_OK) {
+        // With no PT_INTERP, we obey PT_GNU_STACK.p_memsz for
+        // the stack size setting.  With PT_INTERP, the dynamic
+        // linker is responsible for that.
+        check_elf_stack_size(lp, elf);
+        lp->loader_message = false;
+        launchpad_add_handle(lp, segments_vmar, PA_HND(PA_VMAR_LOADED, 0));
+    }
+    return status;
+}
 
+// Map in the dynamic linker from 'interp_vmo', to be started with the
+// executable 'vmo' in its bootstrap message.
+// Consumes 'vmo' on success, not on failure.
+static zx_status_t load_interp(launchpad_t* lp, zx_handle_t vmo,
+                               elf_load_info_t* elf, zx_handle_t interp_vmo) {
+    zx_status_t status;
     if (lp->fresh_process) {
         // A fresh process using PT_INTERP might be loading a libc.so that
         // supports sanitizers, so in that case (the most common case)
@@ -546,16 +556,9 @@ static zx_status_t handle_interp(launchpad_t* lp, zx_handle_t vmo,
             return status;
     }
 
-    elf_load_info_t* elf;
     zx_handle_t segments_vmar;
-    status = elf_load_start(interp_vmo, NULL, 0, &elf);
-    if (status == ZX_OK) {
-        status = elf_load_finish(lp_vmar(lp), elf, interp_vmo,
-                                 &segments_vmar, &lp->base, &lp->entry);
-        elf_load_destroy(elf);
-    }
-    zx_handle_close(interp_vmo);
-
+    status = elf_load_finish(lp_vmar(lp), elf, interp_vmo,
+                             &segments_vmar, &lp->base, &lp->entry);
     if (status == ZX_OK) {
         if (lp->special_handles[HND_EXEC_VMO] != ZX_HANDLE_INVALID)
             zx_handle_close(lp->special_handles[HND_EXEC_VMO]);
@@ -569,6 +572,31 @@ static zx_status_t handle_interp(launchpad_t* lp, zx_handle_t vmo,
     return status;
 }
 
+// Consumes 'vmo' on success, not on failure.
+static zx_status_t handle_interp(launchpad_t* lp, zx_handle_t vmo,
+                                 const char* interp, size_t interp_len) {
+    zx_status_t status = setup_loader_svc(lp);
+    if (status != ZX_OK)
+        return status;
+
+    zx_handle_t interp_vmo;
+    status = loader_svc_rpc(
+        lp->special_handles[HND_LOADER_SVC], LOADER_SVC_OP_LOAD_OBJECT,
+        interp, interp_len, &interp_vmo);
+    if (status != ZX_OK)
+        return status;
+
+    elf_load_info_t* elf;
+    status = elf_load_start(interp_vmo, NULL, 0, &elf);
+    if (status == ZX_OK) {
+        status = load_interp(lp, vmo, elf, interp_vmo);
+        elf_load_destroy(elf);
+    }
+    zx_handle_close(interp_vmo);
+
+    return status;
+}
+
 static zx_status_t launchpad_elf_load_body(launchpad_t* lp, const char* hdr_buf,
                                            size_t buf_sz, zx_handle_t vmo) {
     elf_load_info_t* elf;
@@ -586,21 +614,8 @@ static zx_status_t launchpad_elf_load_body(launchpad_t* lp, const char* hdr_buf,
             lp_error(lp, status, "elf_load: get_interp() failed");
         } else {
             if (interp == NULL) {
-                zx_handle_t segments_vmar;
-                status = elf_load_finish(lp_vmar(lp), elf, vmo, &segments_vmar,
-                                         &lp->base, &lp->entry);
-                if (status != ZX_OK) {
+                if ((status = load_elf_direct(lp, elf, vmo)) != ZX_OK)
                     lp_error(lp, status, "elf_load: elf_load_finish() failed");
-                } else {
-                    // With no PT_INTERP, we obey PT_GNU_STACK.p_memsz for
-                    // the stack size setting.  With PT_INTERP, the dynamic
-                    // linker is responsible for that.
-                    check_elf_stack_size(lp, elf);
-                    lp->loader_message = false;
-                    launchpad_add_handle(
-                        lp, segments_vmar,
-                        PA_HND(PA_VMAR_LOADED, 0));
-                }
             } else {
                 if ((status = handle_interp(lp, vmo, interp, interp_len))) {
                     lp_error(lp, status, "elf_load: handle_interp failed");
@@ -1311,3 +1326,125 @@ zx_status_t launchpad_load_from_fd(launchpad_t* lp, int fd) {
 zx_status_t launchpad_load_from_vmo(launchpad_t* lp, zx_handle_t vmo) {
     return launchpad_file_load_with_vdso(lp, vmo);
 }
+
+struct launchpad_template {
+    zx_handle_t exec_vmo;
+    elf_load_info_t* exec_elf;
+
+    // Only set if the executable has a PT_INTERP.
+    zx_handle_t interp_vmo;
+    elf_load_info_t* interp_elf;
+
+    zx_handle_t vdso_vmo;
+    elf_load_info_t* vdso_elf;
+};
+
+void launchpad_template_destroy(launchpad_template_t* tmpl) {
+    close_handles(&tmpl->exec_vmo, 1);
+    close_handles(&tmpl->interp_vmo, 1);
+    close_handles(&tmpl->vdso_vmo, 1);
+    elf_load_destroy(tmpl->exec_elf);
+    elf_load_destroy(tmpl->interp_elf);
+    elf_load_destroy(tmpl->vdso_elf);
+    free(tmpl);
+}
+
+static zx_status_t template_load_interp(launchpad_template_t* tmpl,
+                                        const char* interp,
+                                        size_t interp_len) {
+    zx_handle_t loader_svc;
+    zx_status_t status = loader_service_get_default(&loader_svc);
+    if (status != ZX_OK)
+        return status;
+    status = loader_svc_rpc(loader_svc, LOADER_SVC_OP_LOAD_OBJECT,
+                            interp, interp_len, &tmpl->interp_vmo);
+    zx_handle_close(loader_svc);
+    if (status != ZX_OK)
+        return status;
+    return elf_load_start(tmpl->interp_vmo, NULL, 0, &tmpl->interp_elf);
+}
+
+zx_status_t launchpad_template_create(zx_handle_t vmo,
+                                      launchpad_template_t** out) {
+    if (vmo == ZX_HANDLE_INVALID)
+        return ZX_ERR_INVALID_ARGS;
+
+    launchpad_template_t* tmpl = calloc(1, sizeof(*tmpl));
+    if (tmpl == NULL) {
+        zx_handle_close(vmo);
+        return ZX_ERR_NO_MEMORY;
+    }
+    tmpl->exec_vmo = vmo;
+
+    char* interp = NULL;
+    size_t interp_len;
+    zx_status_t status = elf_load_start(vmo, NULL, 0, &tmpl->exec_elf);
+    if (status == ZX_OK)
+        status = elf_load_get_interp(tmpl->exec_elf, vmo,
+                                     &interp, &interp_len);
+    if (status == ZX_OK && interp != NULL)
+        status = template_load_interp(tmpl, interp, interp_len);
+    free(interp);
+
+    if (status == ZX_OK)
+        status = launchpad_get_vdso_vmo(&tmpl->vdso_vmo);
+    if (status == ZX_OK)
+        status = elf_load_start(tmpl->vdso_vmo, NULL, 0, &tmpl->vdso_elf);
+
+    if (status != ZX_OK) {
+        launchpad_template_destroy(tmpl);
+        return status;
+    }
+    *out = tmpl;
+    return ZX_OK;
+}
+
+zx_status_t launchpad_template_create_from_file(const char* path,
+                                                launchpad_template_t** out) {
+    zx_handle_t vmo;
+    zx_status_t status = launchpad_vmo_from_file(path, &vmo);
+    if (status != ZX_OK)
+        return status;
+    return launchpad_template_create(vmo, out);
+}
+
+zx_status_t launchpad_load_from_template(launchpad_t* lp,
+                                         const launchpad_template_t* tmpl) {
+    if (lp->error)
+        return lp->error;
+
+    zx_status_t status;
+    if (tmpl->interp_elf == NULL) {
+        if ((status = load_elf_direct(lp, tmpl->exec_elf,
+                                      tmpl->exec_vmo)) != ZX_OK)
+            return lp_error(lp, status,
+                            "load_from_template: elf_load_finish() failed");
+    } else {
+        if ((status = setup_loader_svc(lp)) != ZX_OK)
+            return lp_error(lp, status,
+                            "load_from_template: setup_loader_svc() failed");
+        zx_handle_t vmo;
+        if ((status = zx_handle_duplicate(tmpl->exec_vmo, ZX_RIGHT_SAME_RIGHTS,
+                                          &vmo)) != ZX_OK)
+            return lp_error(lp, status,
+                            "load_from_template: zx_handle_duplicate() failed");
+        if ((status = load_interp(lp, vmo, tmpl->interp_elf,
+                                  tmpl->interp_vmo)) != ZX_OK) {
+            zx_handle_close(vmo);
+            return lp_error(lp, status,
+                            "load_from_template: load_interp() failed");
+        }
+    }
+
+    if ((status = elf_load_finish(lp_vmar(lp), tmpl->vdso_elf, tmpl->vdso_vmo,
+                                  NULL, &lp->vdso_base, NULL)) != ZX_OK)
+        return lp_error(lp, status,
+                        "load_from_template: cannot load vDSO");
+    zx_handle_t vdso;
+    if ((status = zx_handle_duplicate(tmpl->vdso_vmo, ZX_RIGHT_SAME_RIGHTS,
+                                      &vdso)) != ZX_OK)
+        return lp_error(lp, status,
+                        "load_from_template: zx_handle_duplicate() failed");
+    // Takes ownership of 'vdso'.
+    return launchpad_add_handle(lp, vdso, PA_HND(PA_VMO_VDSO, 0));
+}
@@ -25,6 +25,7 @@
 #include <zircon/dlfcn.h>
 #include <zircon/device/dmctl.h>
 #include <zircon/device/vfs.h>
+#include <zircon/listnode.h>
 #include <zircon/processargs.h>
 #include <zircon/status.h>
 #include <zircon/syscalls.h>
@@ -50,6 +51,21 @@ static void __PRINTFLIKE(2, 3) log_printf(zx_handle_t log,
 
 #define PREFIX_MAX 32
 
+// The most objects a loader service keeps loaded for reuse.
+#define CACHE_MAX 128
+
+// Rights for the VMOs handed out from the cache, which are shared by
+// every process that loads the object.
+#define CACHE_RIGHTS (ZX_RIGHTS_BASIC | ZX_RIGHT_GET_PROPERTY | \
+                      ZX_RIGHT_READ | ZX_RIGHT_EXECUTE | ZX_RIGHT_MAP)
+
+typedef struct cache_entry {
+    list_node_t node;
+    zx_handle_t vmo;
+    zx_rights_t rights;
+    char name[];
+} cache_entry_t;
+
 struct loader_service {
     char name[ZX_MAX_NAME_LEN];
     mtx_t dispatcher_lock;
@@ -61,6 +77,13 @@ struct loader_service {
 
     char config_prefix[PREFIX_MAX];
     bool config_exclusive;
+
+    // Objects loaded by name, most recently used first. Only kept once
+    // loader_service_enable_cache() has been called.
+    mtx_t cache_lock;
+    bool cache_enabled;
+    list_node_t cache;
+    size_t cache_count;
 };
 
 static const char* const libpaths[] = {
@@ -179,6 +202,90 @@ static const loader_service_ops_t fs_ops = {
     .publish_data_sink = fs_publish_data_sink,
 };
 
+// Returns the cache entry for |name|, moving it to the front of the
+// cache, or NULL if there is none.
+static cache_entry_t* cache_find_locked(loader_service_t* svc, const char* name) {
+    cache_entry_t* entry;
+    list_for_every_entry (&svc->cache, entry, cache_entry_t, node) {
+        if (!strcmp(entry->name, name)) {
+            list_delete(&entry->node);
+            list_add_head(&svc->cache, &entry->node);
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+// Loads the object called |name|, reusing the VMO from an earlier load
+// of the same name if there is one and caching is enabled. The VMO is
+// never writable, so it can be shared between all the processes which
+// load the object.
+static zx_status_t load_object_cached(loader_service_t* svc,
+                                      const char* name, zx_handle_t* out) {
+    mtx_lock(&svc->cache_lock);
+    if (!svc->cache_enabled) {
+        mtx_unlock(&svc->cache_lock);
+        return svc->ops->load_object(svc->ctx, name, out);
+    }
+
+    cache_entry_t* entry = cache_find_locked(svc, name);
+    if (entry != NULL) {
+        zx_status_t status = zx_handle_duplicate(entry->vmo, entry->rights, out);
+        mtx_unlock(&svc->cache_lock);
+        return status;
+    }
+    mtx_unlock(&svc->cache_lock);
+
+    // The lock is not held while loading, so that requests for objects
+    // which are already cached aren't held up behind this one's I/O.
+    zx_handle_t vmo;
+    zx_status_t status = svc->ops->load_object(svc->ctx, name, &vmo);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    // If the VMO cannot be shared, hand it out without caching it.
+    zx_info_handle_basic_t info;
+    size_t len = strlen(name);
+    if (zx_object_get_info(vmo, ZX_INFO_HANDLE_BASIC,
+                           &info, sizeof(info), NULL, NULL) != ZX_OK ||
+        !(info.rights & ZX_RIGHT_DUPLICATE) ||
+        (entry = malloc(sizeof(*entry) + len + 1)) == NULL) {
+        *out = vmo;
+        return ZX_OK;
+    }
+    entry->vmo = vmo;
+    entry->rights = info.rights & CACHE_RIGHTS;
+    memcpy(entry->name, name, len + 1);
+    if ((status = zx_handle_duplicate(vmo, entry->rights, out)) != ZX_OK) {
+        free(entry);
+        *out = vmo;
+        return ZX_OK;
+    }
+
+    mtx_lock(&svc->cache_lock);
+    // Another request may have loaded the same object in the meantime.
+    // Its VMO stays cached, and this one is only handed out this once.
+    if (cache_find_locked(svc, name) != NULL) {
+        mtx_unlock(&svc->cache_lock);
+        zx_handle_close(entry->vmo);
+        free(entry);
+        return ZX_OK;
+    }
+    if (svc->cache_count == CACHE_MAX) {
+        cache_entry_t* oldest = list_remove_tail_type(&svc->cache,
+                                                      cache_entry_t, node);
+        zx_handle_close(oldest->vmo);
+        free(oldest);
+        --svc->cache_count;
+    }
+    list_add_head(&svc->cache, &entry->node);
+    ++svc->cache_count;
+
+    mtx_unlock(&svc->cache_lock);
+    return ZX_OK;
+}
+
 static zx_status_t default_load_fn(void* cookie, uint32_t load_op,
                                    zx_handle_t request_handle,
                                    const char* fn, zx_handle_t* out) {
@@ -210,7 +317,7 @@ static zx_status_t default_load_fn(void* cookie, uint32_t load_op,
             size_t maxlen = PREFIX_MAX + strlen(fn) + 1;
             char pfn[maxlen];
             snprintf(pfn, maxlen, "%s%s", svc->config_prefix, fn);
-            if (((status = svc->ops->load_object(svc->ctx, pfn, out)) == ZX_OK) ||
+            if (((status = load_object_cached(svc, pfn, out)) == ZX_OK) ||
                 svc->config_exclusive) {
                 // if loading with prefix succeeds, or loading
                 // with prefix is configured to be exclusive of
@@ -219,7 +326,7 @@ static zx_status_t default_load_fn(void* cookie, uint32_t load_op,
             }
             // otherwise, if non-exclusive, try loading without the prefix
         }
-        status = svc->ops->load_object(svc->ctx, fn, out);
+        status = load_object_cached(svc, fn, out);
         break;
     case LOADER_SVC_OP_LOAD_SCRIPT_INTERP:
     case LOADER_SVC_OP_LOAD_DEBUG_CONFIG:
@@ -290,7 +397,8 @@ static zx_status_t handle_loader_rpc(zx_handle_t h,
     // forcibly null-terminate the message data argument
     data[sz - 1] = 0;
 
-    zx_handle_t handle = ZX_HANDLE_INVALID;
+    zx_handle_t handles[ZX_CHANNEL_MAX_MSG_HANDLES];
+    uint32_t handle_count = 0;
     switch (msg->opcode) {
     case LOADER_SVC_OP_CONFIG:
     case LOADER_SVC_OP_LOAD_OBJECT:
@@ -300,15 +408,41 @@ static zx_status_t handle_loader_rpc(zx_handle_t h,
     case LOADER_SVC_OP_CLONE:
         // TODO(ZX-491): Use a threadpool for loading, and guard against
         // other starvation attacks.
+        handles[0] = ZX_HANDLE_INVALID;
         r = (*loader)(loader_arg, msg->opcode,
-                      request_handle, (const char*) msg->data, &handle);
+                      request_handle, (const char*) msg->data, &handles[0]);
         if (r == ZX_ERR_NOT_FOUND) {
             fprintf(stderr, "dlsvc: could not open '%s'\n",
                     (const char*) msg->data);
         }
+        if (handles[0] != ZX_HANDLE_INVALID)
+            handle_count = 1;
         request_handle = ZX_HANDLE_INVALID;
         msg->arg = r;
         break;
+    case LOADER_SVC_OP_LOAD_OBJECTS: {
+        // Load each object in turn, stopping at the first that fails.
+        const char* name = (const char*) msg->data;
+        const char* end = (const char*) data + sz;
+        r = ZX_OK;
+        while (name < end && *name != '\0') {
+            if (handle_count == countof(handles)) {
+                r = ZX_ERR_OUT_OF_RANGE;
+                break;
+            }
+            r = (*loader)(loader_arg, LOADER_SVC_OP_LOAD_OBJECT,
+                          ZX_HANDLE_INVALID, name, &handles[handle_count]);
+            if (r != ZX_OK) {
+                if (r == ZX_ERR_NOT_FOUND)
+                    fprintf(stderr, "dlsvc: could not open '%s'\n", name);
+                break;
+            }
+            ++handle_count;
+            name += strlen(name) + 1;
+        }
+        msg->arg = r;
+        break;
+    }
     case LOADER_SVC_OP_DEBUG_PRINT:
         log_printf(sys_log, "dlsvc: debug: %s\n", (const char*) msg->data);
         msg->arg = ZX_OK;
@@ -332,7 +466,7 @@ static zx_status_t handle_loader_rpc(zx_handle_t h,
     msg->reserved0 = 0;
     msg->reserved1 = 0;
     if ((r = zx_channel_write(h, 0, msg, sizeof(zx_loader_svc_msg_t),
-                              &handle, handle != ZX_HANDLE_INVALID ? 1 : 0)) < 0) {
+                              handles, handle_count)) < 0) {
         fprintf(stderr, "dlsvc: msg write error: %d: %s\n", r, zx_status_get_string(r));
         return r;
     }
@@ -381,6 +515,7 @@ zx_status_t loader_service_create(const char* name,
 
     svc->ops = ops;
     svc->ctx = ctx;
+    list_initialize(&svc->cache);
     strncpy(svc->name, name, sizeof(svc->name) - 1);
     *out = svc;
 
@@ -392,6 +527,16 @@ zx_status_t loader_service_create_fs(const char* name,
     return loader_service_create(name, &fs_ops, NULL, out);
 }
 
+zx_status_t loader_service_enable_cache(loader_service_t* svc) {
+    if (svc == NULL) {
+        return ZX_ERR_INVALID_ARGS;
+    }
+    mtx_lock(&svc->cache_lock);
+    svc->cache_enabled = true;
+    mtx_unlock(&svc->cache_lock);
+    return ZX_OK;
+}
+
 static zx_status_t multiloader_cb(zx_handle_t h, void* cb, void* cookie) {
     if (h == 0) {
         // close notification, which we can ignore
@@ -457,6 +602,7 @@ zx_status_t loader_service_connect(loader_service_t* svc, zx_handle_t* out) {
 static loader_service_t local_loader_svc = {
     .name = "local-loader-svc",
     .ops = &fs_ops,
+    .cache = LIST_INITIAL_VALUE(local_loader_svc.cache),
 };
 
 zx_status_t loader_service_get_default(zx_handle_t* out) {
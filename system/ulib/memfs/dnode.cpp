@@ -43,6 +43,7 @@ void Dnode::RemoveFromParent() {
 
     // Detach from parent
     if (parent_) {
+        parent_->children_by_name_.erase(*this);
         parent_->children_.erase(*this);
         if (IsDirectory()) {
             // '..' no longer references parent.
@@ -85,15 +86,14 @@ void Dnode::AddChild(fbl::RefPtr<Dnode> parent, fbl::RefPtr<Dnode> child) {
     } else {
         child->ordering_token_ = parent->children_.back().ordering_token_ + 1;
     }
+    parent->children_by_name_.insert(child);
     parent->children_.push_back(fbl::move(child));
     parent->vnode_->UpdateModified();
 }
 
 zx_status_t Dnode::Lookup(fbl::StringPiece name, fbl::RefPtr<Dnode>* out) const {
-    auto dn = children_.find_if([&name](const Dnode& elem) -> bool {
-        return elem.NameMatch(name);
-    });
-    if (dn == children_.end()) {
+    auto dn = children_by_name_.find(name);
+    if (dn == children_by_name_.end()) {
         return ZX_ERR_NOT_FOUND;
     }
 
@@ -196,8 +196,4 @@ size_t Dnode::NameLen() const {
     return flags_ & kDnodeNameMax;
 }
 
-bool Dnode::NameMatch(fbl::StringPiece name) const {
-    return name == fbl::StringPiece(name_.get(), NameLen());
-}
-
 } // namespace memfs
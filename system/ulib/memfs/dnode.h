@@ -11,6 +11,7 @@
 #include <fs/vnode.h>
 #include <fdio/vfs.h>
 #include <fbl/intrusive_double_list.h>
+#include <fbl/intrusive_wavl_tree.h>
 #include <fbl/ref_counted.h>
 #include <fbl/ref_ptr.h>
 #include <fbl/unique_ptr.h>
@@ -43,6 +44,20 @@ public:
     using ChildList = fbl::DoublyLinkedList<fbl::RefPtr<Dnode>, Dnode::TypeChildTraits>;
     using DeviceList = fbl::DoublyLinkedList<fbl::RefPtr<Dnode>, Dnode::TypeDeviceTraits>;
 
+    // ChildIndex is an index of the children of a dnode, by name. The
+    // ChildList above is still used to order the children for Readdir.
+    using IndexNodeState = fbl::WAVLTreeNodeState<fbl::RefPtr<Dnode>>;
+    struct TypeChildIndexTraits {
+        static IndexNodeState& node_state(Dnode& dn) { return dn.type_child_index_state_; }
+    };
+    struct ChildIndexKeyTraits {
+        static fbl::StringPiece GetKey(const Dnode& dn) { return dn.Name(); }
+        static bool LessThan(const fbl::StringPiece& a, const fbl::StringPiece& b) { return a < b; }
+        static bool EqualTo(const fbl::StringPiece& a, const fbl::StringPiece& b) { return a == b; }
+    };
+    using ChildIndex = fbl::WAVLTree<fbl::StringPiece, fbl::RefPtr<Dnode>, ChildIndexKeyTraits,
+                                     TypeChildIndexTraits>;
+
     // Allocates a dnode, attached to a vnode
     static fbl::RefPtr<Dnode> Create(fbl::StringPiece name, fbl::RefPtr<VnodeMemfs> vn);
 
@@ -97,19 +112,23 @@ public:
 private:
     friend struct TypeChildTraits;
     friend struct TypeDeviceTraits;
+    friend struct TypeChildIndexTraits;
+    friend struct ChildIndexKeyTraits;
 
     Dnode(fbl::RefPtr<VnodeMemfs> vn, fbl::unique_ptr<char[]> name, uint32_t flags);
 
     size_t NameLen() const;
-    bool NameMatch(fbl::StringPiece name) const;
+    fbl::StringPiece Name() const { return fbl::StringPiece(name_.get(), NameLen()); }
 
     NodeState type_child_state_;
     NodeState type_device_state_;
+    IndexNodeState type_child_index_state_;
     fbl::RefPtr<VnodeMemfs> vnode_;
     fbl::RefPtr<Dnode> parent_;
     // Used to impose an absolute order on dnodes within a directory.
     size_t ordering_token_;
     ChildList children_;
+    ChildIndex children_by_name_;
     uint32_t flags_;
     fbl::unique_ptr<char[]> name_;
 };
@@ -27,10 +27,10 @@ namespace memfs {
 constexpr size_t kMemfsMaxFileSize = 512 * 1024 * 1024;
 
 VnodeFile::VnodeFile(Vfs* vfs)
-    : VnodeMemfs(vfs), vmo_(ZX_HANDLE_INVALID), length_(0) {}
+    : VnodeMemfs(vfs), vmo_(ZX_HANDLE_INVALID), vmo_size_(0), length_(0) {}
 
 VnodeFile::VnodeFile(Vfs* vfs, zx_handle_t vmo, zx_off_t length)
-    : VnodeMemfs(vfs), vmo_(vmo), length_(length) {}
+    : VnodeMemfs(vfs), vmo_(vmo), vmo_size_(0), length_(length) {}
 
 VnodeFile::~VnodeFile() {
     if (vmo_ != ZX_HANDLE_INVALID) {
@@ -56,23 +56,76 @@ zx_status_t VnodeFile::Read(void* data, size_t len, size_t off, size_t* out_actu
     return zx_vmo_read(vmo_, data, off, len, out_actual);
 }
 
-zx_status_t VnodeFile::Write(const void* data, size_t len, size_t offset,
-                             size_t* out_actual) {
+// The VMO grows geometrically, so that appending to a file does not resize it on every page.
+// Pages are only committed once written, so neither the slack nor any holes use memory.
+zx_status_t VnodeFile::Reserve(size_t len) {
     zx_status_t status;
-    size_t newlen = offset + len;
-    newlen = newlen > kMemfsMaxFileSize ? kMemfsMaxFileSize : newlen;
-    size_t alignedLen = fbl::round_up(newlen, static_cast<size_t>(PAGE_SIZE));
+    size_t capacity = fbl::round_up(len, static_cast<size_t>(PAGE_SIZE));
 
     if (vmo_ == ZX_HANDLE_INVALID) {
         // First access to the file? Allocate it.
-        if ((status = zx_vmo_create(alignedLen, 0, &vmo_)) != ZX_OK) {
-            return status;
-        }
-    } else if (newlen > fbl::round_up(length_, static_cast<size_t>(PAGE_SIZE))) {
-        // Accessing beyond the end of the file? Extend it.
-        if ((status = zx_vmo_set_size(vmo_, alignedLen)) != ZX_OK) {
+        if ((status = zx_vmo_create(capacity, 0, &vmo_)) != ZX_OK) {
             return status;
         }
+        vmo_size_ = capacity;
+        return ZX_OK;
+    }
+    if (vmo_size_ == 0 && (status = zx_vmo_get_size(vmo_, &vmo_size_)) != ZX_OK) {
+        return status;
+    }
+    if (capacity <= vmo_size_) {
+        return ZX_OK;
+    }
+
+    // Accessing beyond the end of the VMO? Extend it.
+    capacity = fbl::min(fbl::max(capacity, vmo_size_ * 2), kMemfsMaxFileSize);
+    if ((status = zx_vmo_set_size(vmo_, capacity)) != ZX_OK) {
+        return status;
+    }
+    vmo_size_ = capacity;
+    return ZX_OK;
+}
+
+zx_status_t VnodeFile::ZeroTail(size_t end) {
+    static const char kZeroes[PAGE_SIZE] = {};
+    const size_t start = length_;
+    if (start >= end) {
+        return ZX_OK;
+    }
+
+    // Overwrite any partial page at either end of the range, and decommit the whole pages between
+    // them, which then read as zero.
+    zx_status_t status;
+    size_t actual;
+    const size_t head_end = fbl::min(fbl::round_up(start, static_cast<size_t>(PAGE_SIZE)), end);
+    if (head_end > start &&
+        (status = zx_vmo_write(vmo_, kZeroes, start, head_end - start, &actual)) != ZX_OK) {
+        return status;
+    }
+    const size_t tail_start = fbl::max(fbl::round_down(end, static_cast<size_t>(PAGE_SIZE)),
+                                       head_end);
+    if (tail_start > head_end &&
+        (status = zx_vmo_op_range(vmo_, ZX_VMO_OP_DECOMMIT, head_end, tail_start - head_end,
+                                  nullptr, 0)) != ZX_OK) {
+        return status;
+    }
+    if (end > tail_start &&
+        (status = zx_vmo_write(vmo_, kZeroes, tail_start, end - tail_start, &actual)) != ZX_OK) {
+        return status;
+    }
+    return ZX_OK;
+}
+
+zx_status_t VnodeFile::Write(const void* data, size_t len, size_t offset,
+                             size_t* out_actual) {
+    zx_status_t status;
+    size_t newlen = offset + len;
+    newlen = newlen > kMemfsMaxFileSize ? kMemfsMaxFileSize : newlen;
+
+    if ((status = Reserve(newlen)) != ZX_OK) {
+        return status;
+    } else if ((status = ZeroTail(fbl::min(offset, newlen))) != ZX_OK) {
+        return status;
     }
 
     if ((status = zx_vmo_write(vmo_, data, offset, len, out_actual)) != ZX_OK) {
@@ -98,12 +151,9 @@ zx_status_t VnodeFile::Append(const void* data, size_t len, size_t* out_end,
 }
 
 zx_status_t VnodeFile::Mmap(int flags, size_t len, size_t* off, zx_handle_t* out) {
-    if (vmo_ == ZX_HANDLE_INVALID) {
-        // First access to the file? Allocate it.
-        zx_status_t status;
-        if ((status = zx_vmo_create(0, 0, &vmo_)) != ZX_OK) {
-            return status;
-        }
+    zx_status_t status;
+    if ((status = Reserve(0)) != ZX_OK) {
+        return status;
     }
 
     zx_rights_t rights = ZX_RIGHT_TRANSFER | ZX_RIGHT_MAP;
@@ -111,7 +161,18 @@ zx_status_t VnodeFile::Mmap(int flags, size_t len, size_t* off, zx_handle_t* out
     rights |= (flags & FDIO_MMAP_FLAG_WRITE) ? ZX_RIGHT_WRITE : 0;
     rights |= (flags & FDIO_MMAP_FLAG_EXEC) ? ZX_RIGHT_EXECUTE : 0;
     if (flags & FDIO_MMAP_FLAG_PRIVATE) {
-        return zx_vmo_clone(vmo_, ZX_VMO_CLONE_COPY_ON_WRITE, 0, length_, out);
+        // The clone reads the file's pages until the clone itself is
+        // written, so it is not a snapshot: later writes to the file show
+        // through pages the client has not modified.  It belongs to the
+        // client alone, so the client may also duplicate and clone it
+        // again, as fdio_get_vmo does.
+        zx_handle_t clone;
+        size_t clone_len = fbl::round_up(length_, static_cast<size_t>(PAGE_SIZE));
+        if ((status = zx_vmo_clone(vmo_, ZX_VMO_CLONE_COPY_ON_WRITE, 0, clone_len,
+                                   &clone)) != ZX_OK) {
+            return status;
+        }
+        return zx_handle_replace(clone, rights | ZX_RIGHTS_BASIC, out);
     }
 
     return zx_handle_duplicate(vmo_, rights, out);
@@ -138,12 +199,14 @@ zx_status_t VnodeFile::Truncate(size_t len) {
 
     size_t alignedLen = fbl::round_up(len, static_cast<size_t>(PAGE_SIZE));
 
-    if (vmo_ == ZX_HANDLE_INVALID) {
-        // First access to the file? Allocate it.
-        if ((status = zx_vmo_create(alignedLen, 0, &vmo_)) != ZX_OK) {
+    if ((vmo_ == ZX_HANDLE_INVALID) || (len >= length_)) {
+        // Growing the file; the new range must read as zero.
+        if ((status = Reserve(len)) != ZX_OK) {
+            return status;
+        } else if ((status = ZeroTail(len)) != ZX_OK) {
             return status;
         }
-    } else if ((len < length_) && (len % PAGE_SIZE != 0)) {
+    } else if (len % PAGE_SIZE != 0) {
         // Currently, if the file is truncated to a 'partial page', an later re-expanded, then the
         // partial page is *not necessarily* filled with zeroes. As a consequence, we manually must
         // fill the portion between "len" and the next highest page (or vn->length, whichever
@@ -159,8 +222,11 @@ zx_status_t VnodeFile::Truncate(size_t len) {
         } else if ((status = zx_vmo_set_size(vmo_, alignedLen)) != ZX_OK) {
             return status;
         }
+        vmo_size_ = alignedLen;
     } else if ((status = zx_vmo_set_size(vmo_, alignedLen)) != ZX_OK) {
         return status;
+    } else {
+        vmo_size_ = alignedLen;
     }
 
     length_ = len;
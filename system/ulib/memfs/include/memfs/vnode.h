@@ -80,7 +80,15 @@ private:
     zx_status_t Getattr(vnattr_t* a) final;
     zx_status_t Mmap(int flags, size_t len, size_t* off, zx_handle_t* out) final;
 
+    // Ensures the VMO backing the file holds at least |len| bytes.
+    zx_status_t Reserve(size_t len);
+    // Zeroes the VMO from the end of the file up to |end|, before the file grows over it.
+    zx_status_t ZeroTail(size_t end);
+
     zx_handle_t vmo_;
+    // Size of |vmo_|, or zero if it is not yet known.  This may exceed |length_|.  A shared mapping
+    // may write to the VMO past the end of the file, so that range is zeroed as the file grows.
+    size_t vmo_size_;
     zx_off_t length_;
 };
 
@@ -149,6 +149,7 @@ zx_status_t Bcache::SetSparse(off_t offset, const fbl::Vector<size_t>& extent_le
     extent_lengths_[2] = extent_lengths[2];
     extent_lengths_[3] = extent_lengths[3];
     extent_lengths_[4] = extent_lengths[4];
+    extent_lengths_[5] = extent_lengths[5];
     offset_ = offset;
     return ZX_OK;
 }
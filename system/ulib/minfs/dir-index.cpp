@@ -0,0 +1,99 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fbl/alloc_checker.h>
+#include <zircon/misc/fnv1hash.h>
+
+#include "dir-index.h"
+
+namespace minfs {
+
+DirectoryIndex::~DirectoryIndex() {
+    by_name_.clear();
+    by_space_.clear();
+    by_offset_.clear();
+}
+
+uint32_t DirectoryIndex::Hash(fbl::StringPiece name) {
+    return fnv1a32(name.data(), name.length());
+}
+
+zx_status_t DirectoryIndex::Insert(const minfs_dirent_t* de, size_t off) {
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<Record> record(new (&ac) Record());
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    record->off = off;
+    record->reclen = MinfsReclen(const_cast<minfs_dirent_t*>(de), off);
+    record->used = de->ino != 0;
+    if (record->used) {
+        record->slack = record->reclen - DirentSize(de->namelen);
+        record->hash = Hash(fbl::StringPiece(de->name, de->namelen));
+        by_name_.insert(record.get());
+    } else {
+        record->slack = record->reclen;
+        record->hash = 0;
+    }
+    if (record->slack > 0) {
+        by_space_.insert(record.get());
+    }
+    by_offset_.insert(fbl::move(record));
+    return ZX_OK;
+}
+
+void DirectoryIndex::RemoveRange(size_t start, size_t end) {
+    auto iter = by_offset_.lower_bound(start);
+    while (iter.IsValid() && iter->off < end) {
+        Record* record = &*iter;
+        ++iter;
+        if (record->used) {
+            by_name_.erase(*record);
+        }
+        if (record->slack > 0) {
+            by_space_.erase(*record);
+        }
+        by_offset_.erase(*record);
+    }
+}
+
+bool DirectoryIndex::FindName(uint32_t hash, size_t off, size_t* out) const {
+    auto iter = by_name_.lower_bound((static_cast<uint64_t>(hash) << 32) | off);
+    if (!iter.IsValid() || iter->hash != hash) {
+        return false;
+    }
+    *out = iter->off;
+    return true;
+}
+
+bool DirectoryIndex::FindSpace(uint32_t reclen, size_t* out) const {
+    // Picks the smallest record which fits, leaving larger gaps (notably,
+    // the tail of the directory) for larger names.
+    auto iter = by_space_.lower_bound(static_cast<uint64_t>(reclen) << 32);
+    if (!iter.IsValid()) {
+        return false;
+    }
+    *out = iter->off;
+    return true;
+}
+
+size_t DirectoryIndex::Prev(size_t off) const {
+    auto iter = by_offset_.find(off);
+    ZX_DEBUG_ASSERT(iter.IsValid());
+    --iter;
+    return iter.IsValid() ? iter->off : off;
+}
+
+size_t DirectoryIndex::NextEnd(size_t off) const {
+    auto iter = by_offset_.find(off);
+    ZX_DEBUG_ASSERT(iter.IsValid());
+    size_t end = iter->off + iter->reclen;
+    ++iter;
+    if (iter.IsValid() && iter->off == end) {
+        end += iter->reclen;
+    }
+    return end;
+}
+
+} // namespace minfs
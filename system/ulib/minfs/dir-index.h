@@ -0,0 +1,111 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// This file describes the in-memory index used to avoid linear scans of
+// large MinFS directories.
+
+#pragma once
+
+#include <stdint.h>
+
+#include <fbl/intrusive_wavl_tree.h>
+#include <fbl/macros.h>
+#include <fbl/string_piece.h>
+#include <fbl/unique_ptr.h>
+#include <minfs/format.h>
+#include <zircon/types.h>
+
+namespace minfs {
+
+// Directories smaller than this are scanned linearly, rather than indexed.
+constexpr size_t kMinfsDirIndexMinSize = kMinfsBlockSize;
+
+// An index of every record (used or free) within a single directory,
+// keyed three ways:
+// - By offset, to locate the neighbors of a record when it is unlinked,
+// - By a hash of the name of used records, to find entries by name, and
+// - By the free space available within a record, to find space for new
+//   entries.
+//
+// The index is not persisted; it mirrors the on-disk directory and is
+// rebuilt the first time a large directory is accessed after being loaded.
+class DirectoryIndex {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(DirectoryIndex);
+    DirectoryIndex() = default;
+    ~DirectoryIndex();
+
+    static uint32_t Hash(fbl::StringPiece name);
+
+    // Adds the record |de|, located at offset |off|, to the index.
+    // Only the first MINFS_DIRENT_SIZE bytes of |de| are accessed for
+    // unused records.
+    zx_status_t Insert(const minfs_dirent_t* de, size_t off);
+
+    // Removes every record starting within [start, end) from the index.
+    void RemoveRange(size_t start, size_t end);
+
+    // Finds the first used record at or after offset |off| whose name hashes
+    // to |hash|. Since hashes may collide, the caller must compare names.
+    bool FindName(uint32_t hash, size_t off, size_t* out) const;
+
+    // Finds a record which has room for a new record of |reclen| bytes.
+    bool FindSpace(uint32_t reclen, size_t* out) const;
+
+    // Returns the offset of the record preceding the record at |off|, or |off|
+    // itself if it is the first record.
+    size_t Prev(size_t off) const;
+
+    // Returns the offset at which the record after the record at |off| ends,
+    // or at which the record at |off| ends if it is the last.
+    size_t NextEnd(size_t off) const;
+
+private:
+    struct Record;
+    using OffsetState = fbl::WAVLTreeNodeState<fbl::unique_ptr<Record>>;
+    using IndexState = fbl::WAVLTreeNodeState<Record*>;
+
+    struct Record {
+        uint64_t off;
+        // The length of the record, as returned by MinfsReclen.
+        uint32_t reclen;
+        // The number of bytes which could be used by a new record.
+        uint32_t slack;
+        uint32_t hash;
+        bool used;
+
+        uint64_t NameKey() const { return (static_cast<uint64_t>(hash) << 32) | off; }
+        uint64_t SpaceKey() const { return (static_cast<uint64_t>(slack) << 32) | off; }
+
+        OffsetState offset_state;
+        IndexState name_state;
+        IndexState space_state;
+    };
+
+    struct KeyCompare {
+        static bool LessThan(uint64_t a, uint64_t b) { return a < b; }
+        static bool EqualTo(uint64_t a, uint64_t b) { return a == b; }
+    };
+    struct OffsetTraits : public KeyCompare {
+        static uint64_t GetKey(const Record& r) { return r.off; }
+        static OffsetState& node_state(Record& r) { return r.offset_state; }
+    };
+    struct NameTraits : public KeyCompare {
+        static uint64_t GetKey(const Record& r) { return r.NameKey(); }
+        static IndexState& node_state(Record& r) { return r.name_state; }
+    };
+    struct SpaceTraits : public KeyCompare {
+        static uint64_t GetKey(const Record& r) { return r.SpaceKey(); }
+        static IndexState& node_state(Record& r) { return r.space_state; }
+    };
+
+    // Owns all records.
+    fbl::WAVLTree<uint64_t, fbl::unique_ptr<Record>, OffsetTraits, OffsetTraits> by_offset_;
+    // Holds only used records.
+    fbl::WAVLTree<uint64_t, Record*, NameTraits, NameTraits> by_name_;
+    // Holds only records with non-zero slack.
+    fbl::WAVLTree<uint64_t, Record*, SpaceTraits, SpaceTraits> by_space_;
+};
+
+} // namespace minfs
@@ -50,6 +50,12 @@ private:
                                ino_t parent, uint32_t flags);
     const char* CheckDataBlock(blk_t bno);
     zx_status_t CheckFile(minfs_inode_t* inode, ino_t ino);
+    // Checks that the extents of an extent-mapped inode are sorted,
+    // non-overlapping and packed.
+    zx_status_t CheckExtents(minfs_inode_t* inode, ino_t ino);
+    // Counts and checks the data blocks of an inode, given the number
+    // of indirect blocks already counted in |block_count|.
+    zx_status_t CheckDataBlocks(minfs_inode_t* inode, ino_t ino, uint32_t block_count);
 
     fbl::RefPtr<Minfs> fs_;
     RawBitmap checked_inodes_;
@@ -102,6 +108,21 @@ zx_status_t MinfsChecker::GetInodeNthBno(minfs_inode_t* inode, blk_t n,
     // The default value for the "next n". It's easier to set it here anyway,
     // since we proceed to modify n in the code below.
     *next_n = n + 1;
+    if (inode->flags & kMinfsInodeFlagExtents) {
+        const minfs_extent_t* extents = MinfsInodeExtents(inode);
+        for (uint32_t i = 0; (i < kMinfsInodeExtents) && (extents[i].length != 0); i++) {
+            if (n < extents[i].file_block) {
+                // Skip ahead to the next extent.
+                *bno_out = 0;
+                *next_n = extents[i].file_block;
+                return ZX_OK;
+            } else if (n - extents[i].file_block < extents[i].length) {
+                *bno_out = extents[i].start + (n - extents[i].file_block);
+                return ZX_OK;
+            }
+        }
+        return ZX_ERR_OUT_OF_RANGE;
+    }
     if (n < kMinfsDirect) {
         *bno_out = inode->dnum[n];
         return ZX_OK;
@@ -308,7 +329,39 @@ const char* MinfsChecker::CheckDataBlock(blk_t bno) {
     return nullptr;
 }
 
+zx_status_t MinfsChecker::CheckExtents(minfs_inode_t* inode, ino_t ino) {
+    const minfs_extent_t* extents = MinfsInodeExtents(inode);
+    uint32_t i = 0;
+    for (; (i < kMinfsInodeExtents) && (extents[i].length != 0); i++) {
+        if ((i > 0) &&
+            (extents[i].file_block < extents[i - 1].file_block + extents[i - 1].length)) {
+            FS_TRACE_WARN("check: ino#%u: extent %u overlaps or is out of order\n", ino, i);
+            conforming_ = false;
+        }
+        if (extents[i].file_block + extents[i].length < extents[i].file_block) {
+            FS_TRACE_WARN("check: ino#%u: extent %u is too long\n", ino, i);
+            return ZX_ERR_IO_DATA_INTEGRITY;
+        }
+    }
+    for (; i < kMinfsInodeExtents; i++) {
+        if (extents[i].length != 0) {
+            FS_TRACE_WARN("check: ino#%u: extent %u follows an empty extent\n", ino, i);
+            conforming_ = false;
+        }
+    }
+    return ZX_OK;
+}
+
 zx_status_t MinfsChecker::CheckFile(minfs_inode_t* inode, ino_t ino) {
+    if (inode->flags & kMinfsInodeFlagExtents) {
+        zx_status_t status;
+        if ((status = CheckExtents(inode, ino)) != ZX_OK) {
+            return status;
+        }
+        // Extent-mapped files have no indirect blocks.
+        return CheckDataBlocks(inode, ino, 0);
+    }
+
     xprintf("Direct blocks: \n");
     for (unsigned n = 0; n < kMinfsDirect; n++) {
         xprintf(" %d,", inode->dnum[n]);
@@ -361,6 +414,11 @@ zx_status_t MinfsChecker::CheckFile(minfs_inode_t* inode, ino_t ino) {
         }
     }
 
+    return CheckDataBlocks(inode, ino, block_count);
+}
+
+zx_status_t MinfsChecker::CheckDataBlocks(minfs_inode_t* inode, ino_t ino,
+                                          uint32_t block_count) {
     // count and sanity-check data blocks
 
     // The next block which would be allocated if we expand the file size
@@ -563,7 +621,11 @@ zx_status_t minfs_check(fbl::unique_ptr<Bcache> bc) {
         FS_TRACE_ERROR("minfs: could not read info block\n");
         return ZX_ERR_IO;
     }
-    const minfs_info_t* info = reinterpret_cast<const minfs_info_t*>(data);
+    minfs_info_t* info = reinterpret_cast<minfs_info_t*>(data);
+    if ((status = minfs_replay_journal(bc.get(), info)) != ZX_OK) {
+        FS_TRACE_ERROR("minfs_check: journal replay failure: %d\n", status);
+        return status;
+    }
     minfs_dump_info(info);
     if ((status = minfs_check_info(info, bc.get())) != ZX_OK) {
         FS_TRACE_ERROR("minfs_check: check_info failure: %d\n", status);
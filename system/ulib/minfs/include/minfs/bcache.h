@@ -56,6 +56,17 @@ public:
         return block_fifo_txn(fifo_client_, requests, count);
     }
 
+    // Sends a transaction without waiting for it to complete. The result
+    // may be collected with |TxnWait|.
+    zx_status_t TxnAsync(block_fifo_request_t* requests, size_t count) {
+        return block_fifo_txn_async(fifo_client_, requests, count, nullptr, nullptr);
+    }
+
+    // Waits for the transaction sent on |txnid| to complete.
+    zx_status_t TxnWait(txnid_t txnid) {
+        return block_fifo_wait(fifo_client_, txnid);
+    }
+
     zx_status_t FVMQuery(fvm_info_t* info) {
         ssize_t r = ioctl_block_fvm_query(fd_.get(), info);
         if (r < 0) {
@@ -116,6 +127,21 @@ public:
         ioctl_block_free_txn(fd_.get(), &tid);
     }
 
+    // Allocates a TxnId which is not bound to the calling thread, for callers
+    // which keep several transactions in flight at once.
+    zx_status_t AllocTxnId(txnid_t* out) {
+        ssize_t r = ioctl_block_alloc_txn(fd_.get(), out);
+        if (r < 0) {
+            return static_cast<zx_status_t>(r);
+        }
+        return ZX_OK;
+    }
+
+    // Frees a TxnId acquired from |AllocTxnId|.
+    void FreeTxnId(txnid_t txnid) {
+        ioctl_block_free_txn(fd_.get(), &txnid);
+    }
+
 #else
     // Lengths of each extent (in bytes)
     fbl::Array<size_t> extent_lengths_;
@@ -18,6 +18,7 @@
 
 #include <assert.h>
 #include <limits.h>
+#include <stddef.h>
 #include <stdbool.h>
 #include <stdint.h>
 
@@ -35,7 +36,7 @@ typedef uint32_t ino_t;
 
 constexpr uint64_t kMinfsMagic0         = (0x002153466e694d21ULL);
 constexpr uint64_t kMinfsMagic1         = (0x385000d3d3d3d304ULL);
-constexpr uint32_t kMinfsVersion        = 0x00000005;
+constexpr uint32_t kMinfsVersion        = 0x00000007;
 
 constexpr ino_t kMinfsRootIno           = 1;
 constexpr uint32_t kMinfsFlagClean      = 0x00000001; // Currently unused
@@ -50,6 +51,9 @@ constexpr uint32_t kMinfsIndirect       = 31;
 constexpr uint32_t kMinfsDoublyIndirect = 1;
 
 constexpr uint32_t kMinfsDirectPerIndirect = (kMinfsBlockSize / sizeof(blk_t));
+
+// Inode flags
+constexpr uint32_t kMinfsInodeFlagExtents = 0x00000001; // Data is mapped by extents
 // not possible to have a block at or past this one
 // due to the limitations of the inode and indirect blocks
 // constexpr uint64_t kMinfsMaxFileBlock = (kMinfsDirect + (kMinfsIndirect * kMinfsDirectPerIndirect)
@@ -72,7 +76,8 @@ constexpr uint32_t MinfsMagicType(uint32_t n) { return n & 0xFF; }
 constexpr size_t kFVMBlockInodeBmStart = 0x10000;
 constexpr size_t kFVMBlockDataBmStart  = 0x20000;
 constexpr size_t kFVMBlockInodeStart   = 0x30000;
-constexpr size_t kFVMBlockDataStart    = 0x40000;
+constexpr size_t kFVMBlockJournalStart = 0x40000;
+constexpr size_t kFVMBlockDataStart    = 0x50000;
 
 typedef struct {
     uint64_t magic0;
@@ -88,18 +93,21 @@ typedef struct {
     blk_t ibm_block;     // first blockno of inode allocation bitmap
     blk_t abm_block;     // first blockno of block allocation bitmap
     blk_t ino_block;     // first blockno of inode table
+    blk_t jnl_block;     // first blockno of metadata journal
     blk_t dat_block;     // first blockno available for file data
+    uint32_t jnl_block_count; // total number of journal blocks
     // The following flags are only valid with (flags & kMinfsFlagFVM):
     uint64_t slice_size;    // Underlying slice size
     uint64_t vslice_count;  // Number of allocated underlying slices
     uint32_t ibm_slices;    // Slices allocated to inode bitmap
     uint32_t abm_slices;    // Slices allocated to block bitmap
     uint32_t ino_slices;    // Slices allocated to inode table
+    uint32_t jnl_slices;    // Slices allocated to metadata journal
     uint32_t dat_slices;    // Slices allocated to file data section
 } minfs_info_t;
 
 // Notes:
-// - the ibm, abm, ino, and dat regions must be in that order
+// - the ibm, abm, ino, jnl, and dat regions must be in that order
 //   and may not overlap
 // - the abm has an entry for every block on the volume, including
 //   the info block (0), the bitmaps, etc
@@ -111,6 +119,10 @@ typedef struct {
 //     ino_block + ino / kMinfsInodesPerBlock
 //   at offset: ino % kMinfsInodesPerBlock
 // - inode 0 is never used, should be marked allocated but ignored
+// - extent-mapped inodes (flags & kMinfsInodeFlagExtents) hold up to
+//   kMinfsInodeExtents extents, sorted by file_block and packed at the
+//   start of the table; unused extents have a length of zero
+// - the jnl region is described below
 
 typedef struct {
     uint32_t magic;
@@ -122,7 +134,8 @@ typedef struct {
     uint32_t seq_num;               // bumped when modified
     uint32_t gen_num;               // bumped when deleted
     uint32_t dirent_count;          // for directories
-    uint32_t rsvd[5];
+    uint32_t flags;                 // kMinfsInodeFlag*
+    uint32_t rsvd[4];
     blk_t dnum[kMinfsDirect];    // direct blocks
     blk_t inum[kMinfsIndirect];  // indirect blocks
     blk_t dinum[kMinfsDoublyIndirect]; // doubly indirect blocks
@@ -131,6 +144,82 @@ typedef struct {
 static_assert(sizeof(minfs_inode_t) == kMinfsInodeSize,
               "minfs inode size is wrong");
 
+// A run of |length| data blocks, starting at |start|, which hold
+// the file blocks starting at |file_block|.
+typedef struct {
+    blk_t file_block;
+    blk_t start;
+    uint32_t length;
+} minfs_extent_t;
+
+// The number of extents held by an extent-mapped inode, in place
+// of the dnum, inum and dinum tables.
+constexpr uint32_t kMinfsInodeExtents =
+    (kMinfsDirect + kMinfsIndirect + kMinfsDoublyIndirect) * sizeof(blk_t) /
+    sizeof(minfs_extent_t);
+
+static_assert(kMinfsInodeExtents * sizeof(minfs_extent_t) <=
+              kMinfsInodeSize - offsetof(minfs_inode_t, dnum),
+              "minfs extents do not fit in the inode");
+
+inline minfs_extent_t* MinfsInodeExtents(minfs_inode_t* inode) {
+    return reinterpret_cast<minfs_extent_t*>(inode->dnum);
+}
+
+inline const minfs_extent_t* MinfsInodeExtents(const minfs_inode_t* inode) {
+    return reinterpret_cast<const minfs_extent_t*>(inode->dnum);
+}
+
+// Metadata journal
+
+constexpr uint64_t kMinfsJournalMagic       = (0x6c6e724a53466e4dULL);
+constexpr uint64_t kMinfsJournalEntryMagic  = (0x7972746e45464e4dULL);
+constexpr uint64_t kMinfsJournalCommitMagic = (0x74696d6d43464e4dULL);
+
+// The size of the journal created by Mkfs, including the journal info block.
+constexpr uint32_t kMinfsJournalBlocks      = 256;
+// The smallest usable journal: the info block, and an entry holding one block.
+constexpr uint32_t kMinfsJournalMinBlocks   = 4;
+
+typedef struct {
+    uint64_t magic;
+    uint64_t seq;                   // sequence number of the entry at |start|
+    uint32_t start;                 // first live block, relative to the log
+    uint32_t reserved;
+} minfs_journal_info_t;
+
+constexpr uint32_t kMinfsJournalEntryMaxBlocks = (kMinfsBlockSize - 24) / sizeof(blk_t);
+
+typedef struct {
+    uint64_t magic;
+    uint64_t seq;
+    uint32_t block_count;           // number of blocks following the header
+    uint32_t reserved;
+    blk_t target[kMinfsJournalEntryMaxBlocks]; // where each block is written
+} minfs_journal_entry_t;
+
+static_assert(sizeof(minfs_journal_entry_t) == kMinfsBlockSize,
+              "minfs journal entry header size is wrong");
+
+typedef struct {
+    uint64_t magic;
+    uint64_t seq;                   // matches the entry header
+    uint32_t checksum;              // crc32 of the header and its blocks
+    uint32_t reserved;
+} minfs_journal_commit_t;
+
+// Notes:
+// - the first block of the jnl region holds a minfs_journal_info_t; the
+//   remaining (jnl_block_count - 1) blocks form a circular log
+// - each log entry is a header block, |block_count| metadata blocks, and a
+//   commit block; an entry may wrap around the end of the log
+// - starting at |start|, entries are replayed in order while the sequence
+//   numbers of their header and commit blocks match the next expected
+//   sequence number, and their checksum is correct
+// - the info block is only updated once the blocks of the entries before
+//   |start| have been written in place
+// - file data is not journaled
+
 typedef struct {
     ino_t ino;                      // inode number
     uint32_t reclen;                // Low 28 bits: Length of record
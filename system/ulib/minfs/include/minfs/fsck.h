@@ -23,7 +23,8 @@ zx_status_t minfs_check_info(const minfs_info_t* info, Bcache* bc);
 
 // Run fsck on an unmounted filesystem backed by |bc|.
 //
-// Invokes minfs_check_info, but also verifies inode and block usage.
+// Replays the metadata journal and invokes minfs_check_info, but also
+// verifies inode and block usage.
 zx_status_t minfs_check(fbl::unique_ptr<Bcache> bc);
 
 #ifndef __Fuchsia__
@@ -31,7 +32,7 @@ zx_status_t minfs_check(fbl::unique_ptr<Bcache> bc);
 // |start| indicates where the minfs partition starts within the file (in bytes)
 // |end| indicates the end of the minfs partition (in bytes)
 // |extent_lengths| contains the length (in bytes) of each minfs extent: currently this includes
-// the superblock, inode bitmap, block bitmap, inode table, and data blocks.
+// the superblock, inode bitmap, block bitmap, inode table, journal, and data blocks.
 zx_status_t minfs_fsck(fbl::unique_fd fd, off_t start, off_t end,
                        const fbl::Vector<size_t>& extent_lengths);
 #endif
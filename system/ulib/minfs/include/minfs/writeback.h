@@ -43,6 +43,20 @@ typedef struct {
 
 class WritebackBuffer;
 
+// The maximum number of device transactions which may be in flight to the
+// block device at once.
+constexpr size_t kWritebackMaxInflight = 8;
+
+// By default, the writeback thread waits this long after work is enqueued
+// for more work to arrive, so that several units of work may be merged into
+// a single device transaction.
+constexpr zx_duration_t kWritebackCommitWindowDefault = ZX_MSEC(2);
+
+// Metadata which has been committed to the journal is written in place (and
+// its journal entries released) once it has waited this long, unless the
+// writeback buffer or the journal fill up first.
+constexpr zx_duration_t kWritebackCheckpointDelay = ZX_MSEC(500);
+
 // A transaction consisting of enqueued VMOs to be written
 // out to disk at specified locations.
 //
@@ -57,25 +71,44 @@ public:
         ZX_DEBUG_ASSERT_MSG(count_ == 0, "WriteTxn still has pending requests");
     }
 
-    // Identify that a block should be written to disk
-    // as a later point in time.
+    // Identify that a block of metadata should be written to disk
+    // as a later point in time. Metadata is committed through the journal.
     void Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset, uint64_t nblocks);
+
+    // Identify that a block of file data should be written to disk at a
+    // later point in time. File data is written in place, bypassing the
+    // journal.
+    void EnqueueData(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                     uint64_t nblocks);
+
     size_t Count() const { return count_; }
+    // Returns true if request |i| was enqueued with |EnqueueData|.
+    bool IsData(size_t i) const { return data_[i]; }
     write_request_t* Requests() { return &requests_[0]; }
+    const write_request_t* Requests() const { return &requests_[0]; }
 
-    // Activate the transaction, writing it out to disk.
+    // Activate the transaction, sending it to disk on |txnid| without waiting
+    // for it to complete. The requests remain enqueued (so they may be
+    // compared against later transactions) until |Clear| is called.
     //
     // Each transaction uses the |vmo| / |vmoid| pair supplied, since the
     // transactions should be all reading from a single in-memory buffer.
-    zx_status_t Flush(zx_handle_t vmo, vmoid_t vmoid);
+    zx_status_t Send(zx_handle_t vmo, vmoid_t vmoid, txnid_t txnid);
+
+    // Drops all enqueued requests.
+    void Clear() { count_ = 0; }
 
     size_t BlkCount() const;
 
 private:
     friend class WritebackBuffer;
+    void EnqueueInternal(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                         uint64_t nblocks, bool data);
+
     Bcache* bc_;
     size_t count_ = 0;
     write_request_t requests_[MAX_TXN_MESSAGES];
+    bool data_[MAX_TXN_MESSAGES];
 };
 
 #else
@@ -99,12 +132,14 @@ public:
     void Reset();
 
 #ifdef __Fuchsia__
-    // Actually transacts the enqueued work, and resets the WritebackWork to
-    // its initial state.
-    //
-    // Returns the number of blocks of the writeback buffer that have been
-    // consumed.
-    size_t Complete(zx_handle_t vmo, vmoid_t vmoid);
+    // Signals the closure (if any) with |status|, the result of the sent
+    // transaction. Called once the journal entry of the work, and any
+    // blocks it writes in place, have been written.
+    void Commit(zx_status_t status);
+
+    // Resets the WritebackWork to its initial state (releasing any pinned
+    // Vnodes), once its journaled blocks have also been written in place.
+    void Complete();
 
     // Adds a closure to the WritebackWork, such that it will be signalled
     // when the WritebackWork is flushed to disk.
@@ -113,6 +148,7 @@ public:
     // Only one closure may be set for each WritebackWork unit.
     using SyncCallback = fs::Vnode::SyncCallback;
     void SetClosure(SyncCallback closure);
+    bool HasClosure() const { return static_cast<bool>(closure_); }
 #else
     void Complete();
 #endif
@@ -124,7 +160,24 @@ public:
     WriteTxn* txn() { return &txn_; }
 private:
 #ifdef __Fuchsia__
+    friend class WritebackBuffer;
+
     SyncCallback closure_; // Optional.
+
+    // The following are set once the work is copied to the writeback
+    // buffer. At that point, the first |inplace_count_| requests of |txn_|
+    // write blocks in place, and the remainder write its journal entry.
+    size_t inplace_count_ = 0;
+    // Requests which write the journaled blocks in place, from the buffer.
+    write_request_t checkpoint_[MAX_TXN_MESSAGES];
+    size_t checkpoint_count_ = 0;
+    // Metadata which did not fit in a journal entry, and is written in place.
+    bool unjournaled_ = false;
+    // The journaled blocks could not be tracked until they are checkpointed.
+    bool untracked_ = false;
+    // The space consumed in the writeback buffer and in the journal.
+    size_t buffer_blocks_ = 0;
+    size_t journal_blocks_ = 0;
 #endif
     WriteTxn txn_;
     size_t node_count_;
@@ -141,8 +194,11 @@ private:
 class WritebackBuffer {
 public:
     // Calls constructor, return an error if anything goes wrong.
+    //
+    // Metadata is committed to the journal described by |info|, which must
+    // not hold any entries which have yet to be replayed.
     static zx_status_t Create(Bcache* bc, fbl::unique_ptr<MappedVmo> buffer,
-                              fbl::unique_ptr<WritebackBuffer>* out);
+                              const minfs_info_t* info, fbl::unique_ptr<WritebackBuffer>* out);
     ~WritebackBuffer();
 
     // Enqueues work into the writeback buffer.
@@ -150,30 +206,153 @@ public:
     // have been copied to the writeback buffer, but not necessarily written to
     // disk.
     //
+    // The metadata of |work| is written to the journal as a single entry,
+    // which is replayed in its entirety (or not at all) if the filesystem is
+    // not unmounted cleanly. Once the entry (and any file data enqueued with
+    // it) has been written, closures are signalled. The metadata is written
+    // in place later, in the background.
+    //
     // To avoid accessing a stale Vnode from disk before the writeback has
     // completed, |work| also contains references to any Vnodes which are
     // enqueued, preventing them from closing while the writeback is pending.
     void Enqueue(fbl::unique_ptr<WritebackWork> work) __TA_EXCLUDES(writeback_lock_);
 
-private:
-    WritebackBuffer(Bcache* bc, fbl::unique_ptr<MappedVmo> buffer);
+    // Sets how long enqueued work may wait for more work to be merged with
+    // it before it is sent to disk. Work is sent without waiting if a closure
+    // is waiting on it, if producers are waiting for space in the buffer, or
+    // if enough work is queued to fill a device transaction.
+    //
+    // A window of zero sends work as soon as the writeback thread is free.
+    void SetCommitWindow(zx_duration_t window) __TA_EXCLUDES(writeback_lock_);
 
-    // Blocks until |blocks| blocks of data are free for the caller.
+private:
+    // Units of work which are sent to disk as a single device transaction.
+    //
+    // The requests of the work are merged: adjacent requests are combined,
+    // and a request which is entirely rewritten by later work is dropped,
+    // since the device may reorder the requests of a transaction.
+    struct Batch {
+        // Adds |requests| to the batch. Returns false (leaving the batch
+        // unmodified) if they do not fit in a single transaction, or if
+        // they partially overwrite a request already in the batch.
+        bool Merge(const write_request_t* requests, size_t count);
+
+        // Returns true if any device block is written by both batches.
+        bool Overlaps(const Batch& other) const;
+
+        Queue<fbl::unique_ptr<WritebackWork>> works;
+        write_request_t requests[MAX_TXN_MESSAGES];
+        size_t count = 0;
+        // Set if the pending metadata must be written in place before the
+        // batch is sent.
+        bool checkpoint_first = false;
+    };
+
+    // A block of the data region which has been journaled, but not yet
+    // written in place. Only these blocks may be freed and reused for file
+    // data while their metadata is still pending.
+    struct PendingBlock : public fbl::SinglyLinkedListable<fbl::unique_ptr<PendingBlock>> {
+        blk_t GetKey() const { return bno; }
+        static size_t GetHash(blk_t key) { return key; }
+
+        blk_t bno;
+        // The number of pending units of work which journaled the block.
+        size_t refs;
+    };
+
+    WritebackBuffer(Bcache* bc, fbl::unique_ptr<MappedVmo> buffer, const minfs_info_t* info);
+
+    // Blocks until |blocks| blocks of data are free for the caller, and
+    // |journal_blocks| blocks of the journal.
     // Returns |ZX_OK| with the lock still held in this case.
     // Returns |ZX_ERR_NO_RESOURCES| if there will never be space for the
     // incoming request (i.e., too many blocks requested).
     //
     // Doesn't actually allocate any space.
-    zx_status_t EnsureSpaceLocked(size_t blocks) __TA_REQUIRES(writeback_lock_);
+    zx_status_t EnsureSpaceLocked(size_t blocks, size_t journal_blocks)
+        __TA_REQUIRES(writeback_lock_);
+
+    // Returns the size of the journal entry which holds the metadata of
+    // |txn|, including its header and commit blocks. Returns zero if |txn|
+    // holds no metadata, or too much to fit in a single entry; such
+    // metadata is written in place.
+    size_t JournalEntryBlocks(const WriteTxn& txn) const;
 
-    // Copies a write transaction to the writeback buffer.
+    // Copies the write transaction of |work| to the writeback buffer,
+    // followed by its journal entry (if |entry_blocks| is nonzero).
     // Also updates the in-memory offsets of the WriteTxn's requests so
     // they point to the correct offsets in the in-memory buffer, not their
     // original VMOs.
     //
     // |EnsureSpaceLocked| should be called before invoking this function to
     // safely guarantee that space exists within the buffer.
-    void CopyToBufferLocked(WriteTxn* txn) __TA_REQUIRES(writeback_lock_);
+    void CopyToBufferLocked(WritebackWork* work, size_t entry_blocks)
+        __TA_REQUIRES(writeback_lock_);
+
+    // Copies |request| to the end of the buffer, appending the requests
+    // which write it from the buffer to |out|.
+    void CopyRequestLocked(const write_request_t& request, write_request_t* out, size_t* count)
+        __TA_REQUIRES(writeback_lock_);
+
+    // Builds the journal entry of |work| contiguously at the end of the
+    // buffer, appending the requests which write it to the journal to |out|.
+    void CopyJournalEntryLocked(WritebackWork* work, size_t entry_blocks, write_request_t* out,
+                                size_t* count) __TA_REQUIRES(writeback_lock_);
+
+    // Returns true if the queued work should be sent to disk now, rather
+    // than waiting for more work to merge with it.
+    bool CommitReadyLocked() const __TA_REQUIRES(writeback_lock_);
+
+    // Returns true if the committed metadata should be written in place now.
+    bool CheckpointReadyLocked() const __TA_REQUIRES(writeback_lock_);
+
+    // Moves as much queued work as fits into |batch|, which must be empty.
+    void FillBatchLocked(Batch* batch) __TA_REQUIRES(writeback_lock_);
+
+    // Sends |batch| to disk asynchronously, waiting first for any in-flight
+    // batch which writes the same blocks (so that writes land in order), or
+    // for a free transaction slot.
+    //
+    // Only called from the writeback thread.
+    void Issue(Batch* batch) __TA_EXCLUDES(writeback_lock_);
+
+    // Waits for the oldest in-flight work to complete, and signals its
+    // closures. The work is then held until it is checkpointed.
+    //
+    // Only called from the writeback thread.
+    void RetireOldest() __TA_EXCLUDES(writeback_lock_);
+
+    // Writes the journaled blocks of all committed work in place, marks
+    // their journal entries as no longer needing to be replayed, and
+    // releases their space in the writeback buffer and the journal.
+    //
+    // If any write fails, the journal is left untouched and the work is
+    // kept to be checkpointed again later (or, when unmounting, for its
+    // entries to be replayed at the next mount).
+    //
+    // Only called from the writeback thread, with no work in flight.
+    zx_status_t Checkpoint() __TA_EXCLUDES(writeback_lock_);
+
+    // Writes |count| requests from the VMO attached as |vmoid|, and waits
+    // for them to complete.
+    //
+    // Only called from the writeback thread, with no work in flight.
+    zx_status_t WriteSync(const write_request_t* requests, size_t count, vmoid_t vmoid);
+
+    // Flushes every completed write to stable storage.
+    //
+    // Only called from the writeback thread, with no work in flight.
+    zx_status_t FlushSync();
+
+    // Returns true if |work| writes in place any block which has been
+    // journaled (by in-flight or committed work, or by work in |batch|),
+    // but not yet written in place.
+    bool PendingOverlaps(const WritebackWork& work, const Batch& batch) const;
+
+    // Tracks the journaled blocks of |work| until it is checkpointed. If
+    // they cannot be tracked, all blocks are treated as pending instead.
+    void AddPending(WritebackWork* work);
+    void RemovePending(const WritebackWork& work);
 
     static int WritebackThread(void* arg);
 
@@ -204,8 +383,67 @@ private:
     // writeback buffer and are ready to be sent to disk.
     WorkQueue work_queue_ __TA_GUARDED(writeback_lock_){};
     bool unmounting_ __TA_GUARDED(writeback_lock_){false};
+    // The number of queued units of work with a closure, and the number of
+    // requests queued in total.
+    size_t queued_closures_ __TA_GUARDED(writeback_lock_){};
+    size_t queued_requests_ __TA_GUARDED(writeback_lock_){};
+    // When the oldest queued work was enqueued.
+    zx_time_t queued_since_ __TA_GUARDED(writeback_lock_){};
+    zx_duration_t commit_window_ __TA_GUARDED(writeback_lock_){kWritebackCommitWindowDefault};
     fbl::unique_ptr<MappedVmo> buffer_{};
     vmoid_t buffer_vmoid_ = VMOID_INVALID;
+
+    // The journal info block, and the journal region which follows it. Live
+    // entries begin at |journal_start_| within the log; |journal_seq_| is
+    // the sequence number of the next entry.
+    fbl::unique_ptr<MappedVmo> journal_info_{};
+    vmoid_t journal_info_vmoid_ = VMOID_INVALID;
+    const blk_t journal_block_ = 0;
+    const size_t journal_cap_ = 0;
+    size_t journal_start_ __TA_GUARDED(writeback_lock_){};
+    size_t journal_len_ __TA_GUARDED(writeback_lock_){};
+    uint64_t journal_seq_ __TA_GUARDED(writeback_lock_){};
+    // The first block of the data region.
+    const blk_t data_block_ = 0;
+
+    // Work which has been committed, but whose journaled blocks have not yet
+    // been written in place; the sequence number of its oldest entry; when
+    // the oldest work was committed (or the last checkpoint failed); the
+    // buffer space it holds; and the result of the last checkpoint.
+    //
+    // Only accessed by the writeback thread.
+    Queue<fbl::unique_ptr<WritebackWork>> checkpoint_queue_;
+    uint64_t checkpoint_seq_ = 0;
+    zx_time_t checkpoint_since_ = 0;
+    size_t checkpoint_blocks_ = 0;
+    zx_status_t checkpoint_status_ = ZX_OK;
+
+    // Blocks of the data region journaled by in-flight or committed work,
+    // and the number of such units of work whose blocks could not be
+    // tracked.
+    //
+    // Only accessed by the writeback thread.
+    fbl::HashTable<blk_t, fbl::unique_ptr<PendingBlock>> pending_blocks_;
+    size_t pending_untracked_ = 0;
+
+    // Batches which have been sent to disk, but not yet completed, in the
+    // order they were sent. Slot |i| always uses |txnids_[i]|, so at most
+    // |txnid_count_| batches are in flight at once.
+    //
+    // Only accessed by the writeback thread (and during construction and
+    // destruction).
+    struct Inflight {
+        Batch batch;
+        // The result of sending |batch|; the transaction is only awaited if
+        // this is ZX_OK and the batch had any requests.
+        zx_status_t status;
+    };
+    Inflight inflight_[kWritebackMaxInflight];
+    txnid_t txnids_[kWritebackMaxInflight];
+    size_t txnid_count_ = 0;
+    size_t inflight_start_ = 0;
+    size_t inflight_count_ = 0;
+
     // The units of all the following are "MinFS blocks".
     size_t start_ __TA_GUARDED(writeback_lock_){};
     size_t len_ __TA_GUARDED(writeback_lock_){};
@@ -0,0 +1,164 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
+#include <fs/trace.h>
+#include <lib/cksum.h>
+
+#include <minfs/format.h>
+#include "minfs-private.h"
+
+namespace minfs {
+namespace {
+
+// The circular log which follows the journal info block.
+struct JournalLog {
+    // Returns the device block holding block |n| of the log.
+    blk_t Bno(uint64_t n) const { return start + static_cast<blk_t>(n % blocks); }
+
+    blk_t start;
+    uint32_t blocks;
+    // The journal region, as described by the info block.
+    blk_t region_start;
+    uint32_t region_blocks;
+};
+
+// Checks that the entry at block |pos| of the log is complete, and has the
+// sequence number |seq|. On success, |header| holds the header of the entry.
+//
+// |scratch| must hold at least one block.
+bool CheckEntry(Bcache* bc, const JournalLog& log, uint64_t pos, uint64_t seq,
+                minfs_journal_entry_t* header, uint8_t* scratch) {
+    if ((bc->Readblk(log.Bno(pos), header) != ZX_OK) ||
+        (header->magic != kMinfsJournalEntryMagic) || (header->seq != seq) ||
+        (header->block_count == 0) || (header->block_count > kMinfsJournalEntryMaxBlocks) ||
+        (header->block_count + 2 > log.blocks)) {
+        return false;
+    }
+    for (uint32_t i = 0; i < header->block_count; i++) {
+        if ((header->target[i] >= log.region_start) &&
+            (header->target[i] < log.region_start + log.region_blocks)) {
+            return false;
+        }
+    }
+
+    uint32_t checksum = crc32(0, reinterpret_cast<const uint8_t*>(header), kMinfsBlockSize);
+    for (uint32_t i = 0; i < header->block_count; i++) {
+        if (bc->Readblk(log.Bno(pos + 1 + i), scratch) != ZX_OK) {
+            return false;
+        }
+        checksum = crc32(checksum, scratch, kMinfsBlockSize);
+    }
+
+    if (bc->Readblk(log.Bno(pos + 1 + header->block_count), scratch) != ZX_OK) {
+        return false;
+    }
+    const minfs_journal_commit_t* commit = reinterpret_cast<const minfs_journal_commit_t*>(scratch);
+    return (commit->magic == kMinfsJournalCommitMagic) && (commit->seq == seq) &&
+           (commit->checksum == checksum);
+}
+
+} // namespace
+
+zx_status_t minfs_replay_journal(Bcache* bc, minfs_info_t* info) {
+    if ((info->magic0 != kMinfsMagic0) || (info->magic1 != kMinfsMagic1) ||
+        (info->version != kMinfsVersion) || (info->jnl_block_count < kMinfsJournalMinBlocks)) {
+        // Left for minfs_check_info to report.
+        return ZX_OK;
+    }
+
+    JournalLog log;
+    log.region_start = info->jnl_block;
+    log.region_blocks = info->jnl_block_count;
+    blk_t jnl_block = info->jnl_block;
+#ifndef __Fuchsia__
+    if (bc->extent_lengths_.size() > 0) {
+        // Each region of a sparse image is held in its own extent; the
+        // journal follows the superblock, bitmaps and inode table.
+        size_t offset = 0;
+        for (size_t i = 0; i < 4; i++) {
+            offset += bc->extent_lengths_[i];
+        }
+        jnl_block = static_cast<blk_t>(offset / kMinfsBlockSize);
+    }
+#endif
+    log.start = jnl_block + 1;
+    log.blocks = info->jnl_block_count - 1;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kMinfsBlockSize * 2]);
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    minfs_journal_entry_t* header = reinterpret_cast<minfs_journal_entry_t*>(&data[0]);
+    uint8_t* scratch = &data[kMinfsBlockSize];
+
+    zx_status_t status;
+    minfs_journal_info_t jinfo;
+    if ((status = bc->Readblk(jnl_block, scratch)) != ZX_OK) {
+        FS_TRACE_ERROR("minfs: could not read journal info\n");
+        return status;
+    }
+    memcpy(&jinfo, scratch, sizeof(jinfo));
+    if ((jinfo.magic != kMinfsJournalMagic) || (jinfo.start >= log.blocks)) {
+        FS_TRACE_ERROR("minfs: bad journal info\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+
+    uint64_t pos = jinfo.start;
+    uint64_t seq = jinfo.seq;
+    while (CheckEntry(bc, log, pos, seq, header, scratch)) {
+        if (pos + header->block_count + 2 > jinfo.start + log.blocks) {
+            // Live entries never hold more than the entire log.
+            break;
+        }
+#ifndef __Fuchsia__
+        if (bc->extent_lengths_.size() > 0) {
+            // The blocks of the entry cannot be located within the image.
+            FS_TRACE_ERROR("minfs: cannot replay the journal of a sparse image\n");
+            return ZX_ERR_NOT_SUPPORTED;
+        }
+#endif
+        for (uint32_t i = 0; i < header->block_count; i++) {
+            if (((status = bc->Readblk(log.Bno(pos + 1 + i), scratch)) != ZX_OK) ||
+                ((status = bc->Writeblk(header->target[i], scratch)) != ZX_OK)) {
+                FS_TRACE_ERROR("minfs: failed to replay journal entry %" PRIu64 "\n", seq);
+                return status;
+            }
+        }
+        pos += header->block_count + 2;
+        seq++;
+    }
+
+    if (seq == jinfo.seq) {
+        return ZX_OK;
+    }
+    FS_TRACE_WARN("minfs: replayed %" PRIu64 " journal entries\n", seq - jinfo.seq);
+
+    // The replayed blocks must reach the disk before the entries holding
+    // them may be overwritten.
+    bc->Sync();
+    jinfo.start = static_cast<uint32_t>(pos % log.blocks);
+    jinfo.seq = seq;
+    memset(scratch, 0, kMinfsBlockSize);
+    memcpy(scratch, &jinfo, sizeof(jinfo));
+    if ((status = bc->Writeblk(jnl_block, scratch)) != ZX_OK) {
+        FS_TRACE_ERROR("minfs: could not update journal info\n");
+        return status;
+    }
+    bc->Sync();
+
+    // The info block may have been rewritten.
+    if ((status = bc->Readblk(0, scratch)) != ZX_OK) {
+        return status;
+    }
+    memcpy(info, scratch, sizeof(minfs_info_t));
+    return ZX_OK;
+}
+
+} // namespace minfs
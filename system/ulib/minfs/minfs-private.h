@@ -10,14 +10,19 @@
 #include <inttypes.h>
 
 #ifdef __Fuchsia__
+#include <threads.h>
+#include <time.h>
+
 #include <fbl/auto_lock.h>
 #include <fs/remote.h>
 #include <fs/watcher.h>
 #include <sync/completion.h>
+#include <zircon/syscalls.h>
 #include <zx/vmo.h>
 #endif
 
 #include <fbl/algorithm.h>
+#include <fbl/intrusive_double_list.h>
 #include <fbl/intrusive_hash_table.h>
 #include <fbl/intrusive_single_list.h>
 #include <fbl/macros.h>
@@ -35,7 +40,9 @@
 #include <minfs/format.h>
 #include <minfs/writeback.h>
 
-#define EXTENT_COUNT 5
+#include "dir-index.h"
+
+#define EXTENT_COUNT 6
 
 #define panic(fmt...)         \
     do {                      \
@@ -52,9 +59,9 @@
 namespace minfs {
 
 #ifdef __Fuchsia__
-using RawBitmap = bitmap::RawBitmapGeneric<bitmap::VmoStorage>;
+using RawBitmap = bitmap::SummarizedRawBitmapGeneric<bitmap::VmoStorage>;
 #else
-using RawBitmap = bitmap::RawBitmapGeneric<bitmap::DefaultStorage>;
+using RawBitmap = bitmap::SummarizedRawBitmapGeneric<bitmap::DefaultStorage>;
 #endif
 
 #ifdef __Fuchsia__
@@ -69,6 +76,28 @@ inline void validate_vmo_size(zx_handle_t vmo, blk_t blk) {
                   size, blk);
 #endif // MINFS_PARANOID_MODE
 }
+
+// Waits on |cvar| until it is signalled, or until the monotonic clock
+// reaches |deadline|. |mtx| is held when this function is called and
+// returns.
+inline void cnd_wait_until(cnd_t* cvar, mtx_t* mtx, zx_time_t deadline) {
+    if (deadline == ZX_TIME_INFINITE) {
+        cnd_wait(cvar, mtx);
+        return;
+    }
+    // cnd_timedwait takes an absolute time on the realtime clock, which has
+    // a different origin than the monotonic clock (and may be set), so
+    // |deadline| cannot be passed to it directly. Instead, wait until the
+    // realtime clock has advanced by as much as the monotonic clock must.
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    const zx_time_t now = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    const zx_duration_t wait = (deadline > now) ? deadline - now : 0;
+    const zx_time_t realtime_deadline = ZX_SEC(ts.tv_sec) + ts.tv_nsec + wait;
+    ts.tv_sec = static_cast<time_t>(realtime_deadline / ZX_SEC(1));
+    ts.tv_nsec = static_cast<long>(realtime_deadline % ZX_SEC(1));
+    cnd_timedwait(cvar, mtx, &ts);
+}
 #endif // __Fuchsia__
 
 // minfs_sync_vnode flags
@@ -78,12 +107,38 @@ constexpr uint32_t kMxFsSyncCtime = (1 << 1);
 
 constexpr uint32_t kMinfsBlockCacheSize = 64;
 
+// The smallest free run in which an extent-mapped file begins a new extent,
+// when the extent it follows cannot be grown. Successive extents of a file
+// are given geometrically more room, so files written concurrently need
+// few extents.
+constexpr uint32_t kMinfsExtentRun = 32;
+
+#ifdef __Fuchsia__
+// Blocks written to files are not allocated on disk when they are written;
+// they are allocated (and written back) once this many bytes of them are
+// pending across the filesystem, once they have been pending for this long,
+// or when the file is closed or synced.
+constexpr size_t kMinfsDirtyBytesDefault = 8 * (1LU << 20);
+constexpr zx_duration_t kMinfsDirtyTimeoutDefault = ZX_SEC(1);
+
+// Delayed blocks are allocated in units of writeback work holding at most
+// this many requests before the allocation of another block, leaving room
+// for the bitmap, indirect and inode blocks which the allocation updates.
+constexpr size_t kMinfsDelallocMaxRequests = MAX_TXN_MESSAGES / 2;
+#endif
+
 // Used by fsck
 class MinfsChecker;
 class VnodeMinfs;
 
 using SyncCallback = fs::Vnode::SyncCallback;
 
+#ifdef __Fuchsia__
+struct DelallocTraits {
+    static fbl::DoublyLinkedListNodeState<VnodeMinfs*>& node_state(VnodeMinfs& vn);
+};
+#endif
+
 class Minfs : public fbl::RefCounted<Minfs> {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Minfs);
@@ -110,6 +165,14 @@ public:
     // Allocate a new data block.
     zx_status_t BlockNew(WriteTxn* txn, blk_t hint, blk_t* out_bno);
 
+    // Allocate a new data block for an extent-mapped file, where |hint| is
+    // the block following the extent being grown. Uses |hint| if it is free;
+    // otherwise starts a new extent within a free run of 2 * |run| blocks.
+    // If the run directly follows an allocated block (which may end another
+    // file's extent), the new extent begins |run| blocks into it, so both
+    // extents have room to grow.
+    zx_status_t BlockNewContiguous(WriteTxn* txn, blk_t hint, blk_t run, blk_t* out_bno);
+
     // free block in block bitmap
     zx_status_t BlockFree(WriteTxn* txn, blk_t bno);
 
@@ -138,9 +201,32 @@ public:
     uint64_t GetFsId() const { return fs_id_; }
 
     // Signals the completion object as soon as...
-    // (1) A sync probe has entered and exited the writeback queue, and
-    // (2) The block cache has sync'd with the underlying block device.
+    // (1) Blocks awaiting delayed allocation have been allocated,
+    // (2) A sync probe has entered and exited the writeback queue, and
+    // (3) The block cache has sync'd with the underlying block device.
     void Sync(SyncCallback closure);
+
+    // Sets how many bytes of file data may await delayed allocation, and for
+    // how long, before they are allocated and written back; and how long
+    // writeback work waits to be merged with later work into a single device
+    // transaction.
+    void SetWritebackLimits(size_t dirty_bytes, zx_duration_t dirty_timeout,
+                            zx_duration_t commit_window);
+
+    // The following are called with |txn_lock_| held.
+    //
+    // Returns true if |blocks| more blocks of |vn| may await delayed
+    // allocation without risking that they cannot be allocated.
+    bool DelallocReserveLocked(const VnodeMinfs* vn, blk_t blocks) const;
+
+    // Updates the accounting of delayed blocks after the number held by |vn|
+    // has changed from |old_blocks|. Called with |vn->lock_| held.
+    void DelallocChangedLocked(VnodeMinfs* vn, blk_t old_blocks);
+
+    // Allocates the delayed blocks of every file, if more than the dirty
+    // byte threshold are pending, or otherwise those of the files whose
+    // blocks have been pending longer than the dirty timeout.
+    void DelallocBalanceLocked();
 #endif
 
     // The following methods are used to read one block from the specified extent,
@@ -157,6 +243,13 @@ public:
     fbl::unique_ptr<Bcache> bc_;
     minfs_info_t info_{};
 #ifdef __Fuchsia__
+    // Held by every operation which modifies the filesystem, serializing
+    // updates to the allocation bitmaps, |info_| and the inode table, and
+    // the order in which WritebackWork is enqueued.
+    //
+    // Lock ordering: txn_lock_, then VnodeMinfs::lock_, then vnode_get_lock_,
+    // then hash_lock_.
+    fbl::Mutex txn_lock_;
     fbl::Mutex hash_lock_;
 #endif
 
@@ -171,9 +264,28 @@ private:
     zx_status_t InoNew(WriteTxn* txn, const minfs_inode_t* inode,
                        ino_t* ino_out);
 
+    // Ensures that a block may be allocated without taking one reserved for
+    // delayed allocation, growing the volume if necessary.
+    zx_status_t BlockReserve();
+
+    // Marks the block at |bitoff| allocated in the block bitmap, and enqueues
+    // the update.
+    zx_status_t BlockMarkAllocated(WriteTxn* txn, size_t bitoff, blk_t* out_bno);
+
     // Enqueues an update for allocated inode/block counts
     zx_status_t CountUpdate(WriteTxn* txn);
 
+#ifdef __Fuchsia__
+    // Allocates the delayed blocks of the files which first had blocks
+    // delayed at or before |before|. Called with |txn_lock_| held.
+    void DelallocFlushLocked(zx_time_t before);
+
+    // Stops the thread which allocates delayed blocks once they time out.
+    void DelallocStop();
+
+    static int DelallocThread(void* arg);
+#endif
+
     // If possible, attempt to resize the MinFS partition.
     zx_status_t AddInodes();
     zx_status_t AddBlocks();
@@ -197,6 +309,10 @@ private:
     HashTable vnode_hash_ __TA_GUARDED(hash_lock_){};
 
 #ifdef __Fuchsia__
+    // Held while a vnode is instantiated, so concurrent lookups of the same
+    // inode share a single vnode.
+    fbl::Mutex vnode_get_lock_;
+
     fbl::unique_ptr<MappedVmo> inode_table_{};
     fbl::unique_ptr<MappedVmo> info_vmo_{};
     vmoid_t inode_map_vmoid_{};
@@ -205,6 +321,25 @@ private:
     vmoid_t info_vmoid_{};
     fbl::unique_ptr<WritebackBuffer> writeback_;
     uint64_t fs_id_{};
+
+    // Delayed allocation state, protected by |txn_lock_|.
+    //
+    // Files with blocks awaiting delayed allocation, in the order in which
+    // they first had blocks delayed.
+    fbl::DoublyLinkedList<VnodeMinfs*, DelallocTraits> delalloc_list_{};
+    size_t delalloc_blocks_{};
+    // Blocks which no other allocation may take, so that the delayed blocks
+    // (and the indirect blocks which map them) can be allocated.
+    size_t delalloc_reserved_{};
+    size_t dirty_bytes_{kMinfsDirtyBytesDefault};
+    zx_duration_t dirty_timeout_{kMinfsDirtyTimeoutDefault};
+    bool delalloc_stop_{false};
+    // Signalled when |delalloc_list_| becomes non-empty, the limits change,
+    // or the thread should stop.
+    cnd_t delalloc_cvar_;
+    bool delalloc_cvar_valid_{false};
+    thrd_t delalloc_thrd_;
+    bool delalloc_thrd_running_{false};
 #else
     // Store start block + length for all extents. These may differ from info block for
     // sparse files.
@@ -257,6 +392,7 @@ public:
                                 fbl::RefPtr<VnodeMinfs>* out);
 
     bool IsDirectory() const { return inode_.magic == kMinfsMagicDir; }
+    bool IsExtentMapped() const { return (inode_.flags & kMinfsInodeFlagExtents) != 0; }
     bool IsUnlinked() const { return inode_.link_count == 0; }
     zx_status_t CanUnlink() const;
 
@@ -270,6 +406,21 @@ public:
     // fbl::Recyclable interface.
     void fbl_recycle() final;
 
+#ifdef __Fuchsia__
+    // The number of blocks of the file awaiting delayed allocation, and
+    // when the first of them was written.
+    blk_t DelallocBlocks() const { return delalloc_end_ - delalloc_start_; }
+    zx_time_t DelallocTime() const { return delalloc_time_; }
+
+    // Allocates the blocks of the file awaiting delayed allocation, and
+    // enqueues them (along with the inode) to be written back. Blocks which
+    // cannot be allocated are discarded, and the error is returned by the
+    // next Sync or Close of the file.
+    //
+    // Called with |fs_->txn_lock_| held; acquires |lock_|.
+    zx_status_t FlushDelayed();
+#endif
+
     // TODO(rvargas): Make private.
     fbl::RefPtr<Minfs> fs_;
 
@@ -277,6 +428,9 @@ private:
     // Fsck can introspect Minfs
     friend class MinfsChecker;
     friend zx_status_t Minfs::InoFree(VnodeMinfs* vn, WriteTxn* txn);
+#ifdef __Fuchsia__
+    friend struct DelallocTraits;
+#endif
 
     VnodeMinfs(Minfs* fs);
 
@@ -306,6 +460,10 @@ private:
                       size_t out_len, size_t* out_actual) final;
 
     // Internal functions
+    //
+    // Unless noted otherwise, these are called with |lock_| held and, if they
+    // modify the filesystem, with |fs_->txn_lock_| held.
+    zx_status_t WriteLocked(const void* data, size_t len, size_t offset, size_t* out_actual);
     zx_status_t ReadInternal(void* data, size_t len, size_t off, size_t* actual);
     zx_status_t ReadExactInternal(void* data, size_t len, size_t off);
     zx_status_t WriteInternal(WriteTxn* txn, const void* data, size_t len,
@@ -313,11 +471,17 @@ private:
     zx_status_t WriteExactInternal(WriteTxn* txn, const void* data, size_t len,
                                    size_t off);
     zx_status_t TruncateInternal(WriteTxn* txn, size_t len);
+    zx_status_t RenameLocked(fbl::RefPtr<VnodeMinfs> newdir, fbl::RefPtr<VnodeMinfs> oldvn,
+                             fbl::StringPiece oldname, fbl::StringPiece newname,
+                             bool src_must_be_dir, bool dst_must_be_dir);
     // Lookup which can traverse '..'
     zx_status_t LookupInternal(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece name);
 
     // Verify that the 'newdir' inode is not a subdirectory of this Vnode.
     // Traces the path from newdir back to the root inode.
+    //
+    // Acquires the lock of each directory traversed, so must be called with
+    // no vnode locked.
     zx_status_t CheckNotSubdirectory(fbl::RefPtr<VnodeMinfs> newdir);
 
     using DirentCallback = zx_status_t (*)(fbl::RefPtr<VnodeMinfs>,
@@ -327,6 +491,17 @@ private:
     // Enumerates directories.
     zx_status_t ForEachDirent(DirArgs* args, const DirentCallback func);
 
+    // Implementations of |ForEachDirent|: one visits every dirent in order,
+    // the other uses |dir_index_| to visit only the dirent |func| acts upon.
+    zx_status_t ForEachDirentLinear(DirArgs* args, const DirentCallback func);
+    zx_status_t ForEachDirentIndexed(DirArgs* args, const DirentCallback func);
+
+    // Builds |dir_index_| from the contents of the directory.
+    zx_status_t BuildDirIndex();
+    // Adds the dirents starting within [start, end) to |dir_index_|.
+    // |start| must be the offset of a dirent.
+    zx_status_t IndexDirents(size_t start, size_t end);
+
     // Directory callback functions.
     //
     // The following functions are passable to |ForEachDirent|, which reads the parent directory,
@@ -349,6 +524,8 @@ private:
                             minfs_dirent_t* de, DirectoryOffset* offs);
     // Remove the link to a vnode (referring to inodes exclusively).
     // Has no impact on direntries (or parent inode).
+    //
+    // Acquires |lock_|; called on a child while its parent is locked.
     void RemoveInodeLink(WriteTxn* txn);
 
     // Although file sizes don't need to be block-aligned, the underlying VMO is
@@ -381,12 +558,18 @@ private:
     // Allocate the block if requested with a non-null "txn".
     zx_status_t GetBno(WriteTxn* txn, blk_t n, blk_t* bno);
 
+    // GetBno for block-mapped files. If the block is not yet mapped and |map_bno| is nonzero,
+    // |map_bno| (which must already be allocated and counted by the inode) is mapped in place
+    // of a newly allocated block.
+    zx_status_t GetBnoBlockMap(WriteTxn* txn, blk_t n, blk_t map_bno, blk_t* bno);
+
     // Acquire (or allocate) a direct block |*bno|. If allocation occurs,
     // |*dirty| is set to true, and the inode block is written to disk.
+    // |map_bno| is as described by GetBnoBlockMap.
     //
     // Example call for accessing the 0th direct block in the inode:
-    // GetBnoDirect(txn, &inode_.dnum[0], &dirty);
-    zx_status_t GetBnoDirect(WriteTxn* txn, blk_t* bno, bool* dirty);
+    // GetBnoDirect(txn, 0, &inode_.dnum[0], &dirty);
+    zx_status_t GetBnoDirect(WriteTxn* txn, blk_t map_bno, blk_t* bno, bool* dirty);
 
     // Acquire (or allocate) a direct block |*bno| contained at index |bindex| within an indirect
     // block |*ibno|, which is allocated if necessary. If allocation of the indirect block occurs,
@@ -396,9 +579,9 @@ private:
     // indirect VMO. On other platforms, this argument may be ignored.
     //
     // Example call for accessing the 3rd direct block within the 2nd indirect block:
-    // GetBnoIndirect(txn, 3, 2, &inode_.inum[2], &bno, &dirty);
+    // GetBnoIndirect(txn, 3, 2, 0, &inode_.inum[2], &bno, &dirty);
     zx_status_t GetBnoIndirect(WriteTxn* txn, uint32_t bindex, uint32_t ib_vmo_offset,
-                               blk_t* ibno, blk_t* bno, bool* dirty);
+                               blk_t map_bno, blk_t* ibno, blk_t* bno, bool* dirty);
 
     // Acquire (or allocate) a direct block |*bno| contained at index |bindex| within a doubly
     // indirect block |*dibno|, at index |ibindex| within that indirect block. If allocation occurs,
@@ -409,15 +592,27 @@ private:
     // Example call for accessing the 3rd direct block in the 2nd indirect block
     // in the 0th doubly indirect block:
     // GetBnoDoublyIndirect(txn, 2, 3, GetVmoOffsetForDoublyIndirect(0), GetVmoOffsetForIndirect(0),
-    //                      &inode_.dinum[0], &bno, &dirty);
+    //                      0, &inode_.dinum[0], &bno, &dirty);
     zx_status_t GetBnoDoublyIndirect(WriteTxn* txn, uint32_t ibindex, uint32_t bindex,
                                      uint32_t dib_vmo_offset, uint32_t ib_vmo_offset,
-                                     blk_t* dibno, blk_t* bno, bool* dirty);
+                                     blk_t map_bno, blk_t* dibno, blk_t* bno, bool* dirty);
+
+    // GetBno for extent-mapped files. A block allocated past the end of an
+    // extent extends it where possible; if the file would need more than
+    // kMinfsInodeExtents extents, it is converted to the block map.
+    zx_status_t GetBnoExtent(WriteTxn* txn, blk_t n, blk_t* bno);
+
+    // Moves the data of an extent-mapped file into newly allocated blocks,
+    // mapped by the direct/indirect/doubly indirect block tables.
+    zx_status_t ExtentsToBlockMap(WriteTxn* txn);
 
     // Deletes all blocks (relative to a file) from "start" (inclusive) to the end
     // of the file. Does not update mtime/atime.
     zx_status_t BlocksShrink(WriteTxn* txn, blk_t start);
 
+    // BlocksShrink for extent-mapped files.
+    zx_status_t BlocksShrinkExtents(WriteTxn* txn, blk_t start);
+
     // Shrink |count| direct blocks from the |barray| array of direct blocks. Sets |*dirty| to
     // true if anything is deleted.
     zx_status_t BlocksShrinkDirect(WriteTxn *txn, size_t count, blk_t* barray, bool* dirty);
@@ -460,6 +655,21 @@ private:
     void Purge(WriteTxn* txn);
 
 #ifdef __Fuchsia__
+    // Called by WriteInternal for block |n| of a file, which has not been
+    // allocated on disk. Returns true if allocating the block may be delayed,
+    // in which case it is recorded as awaiting delayed allocation.
+    //
+    // Only a single run of blocks is delayed per file, so this may allocate
+    // the blocks already delayed first.
+    bool DelayAllocationLocked(blk_t n);
+
+    // FlushDelayed, called with |lock_| held.
+    zx_status_t FlushDelayedLocked();
+
+    // Discards the blocks awaiting delayed allocation from block |start|
+    // onwards, without allocating them.
+    void DropDelayedLocked(blk_t start);
+
     void Sync(SyncCallback closure) final;
     zx_status_t AttachRemote(fs::MountChannel h) final;
     zx_status_t InitVmo();
@@ -518,6 +728,18 @@ private:
     vmoid_t vmoid_{};
     vmoid_t vmoid_indirect_{};
 
+    // Blocks [delalloc_start_, delalloc_end_) of the file have been written
+    // to |vmo_|, but are not yet allocated on disk. Modified with both
+    // |lock_| and |fs_->txn_lock_| held.
+    blk_t delalloc_start_{};
+    blk_t delalloc_end_{};
+    zx_time_t delalloc_time_{};
+    // The first error allocating delayed blocks since the file was last
+    // synced or closed.
+    zx_status_t delalloc_status_{ZX_OK};
+    // Links the vnode into |fs_->delalloc_list_| while it has delayed blocks.
+    fbl::DoublyLinkedListNodeState<VnodeMinfs*> delalloc_node_{};
+
     fs::RemoteContainer remoter_{};
     fs::WatcherContainer watcher_{};
 #endif
@@ -525,13 +747,35 @@ private:
     ino_t ino_{};
     minfs_inode_t inode_{};
 
+    // Index of the dirents of large directories. Built on first use, and
+    // discarded if it cannot be kept consistent with the directory.
+    fbl::unique_ptr<DirectoryIndex> dir_index_{};
+
     // This field tracks the current number of file descriptors with
     // an open reference to this Vnode. Notably, this is distinct from the
     // VnodeMinfs's own refcount, since there may still be filesystem
     // work to do after the last file descriptor has been closed.
     uint32_t fd_count_{};
+
+#ifdef __Fuchsia__
+    // Protects the fields above. |inode_| is only modified with both this
+    // and |fs_->txn_lock_| held, so holding either is enough to read it; the
+    // VMOs and |dir_index_| are populated lazily, so require this lock.
+    //
+    // Operations which only read a vnode hold just its own lock, and never
+    // acquire another vnode's lock (or |fs_->txn_lock_|) while holding it.
+    // Locks of several vnodes may only be held at once under
+    // |fs_->txn_lock_|.
+    fbl::Mutex lock_;
+#endif
 };
 
+#ifdef __Fuchsia__
+inline fbl::DoublyLinkedListNodeState<VnodeMinfs*>& DelallocTraits::node_state(VnodeMinfs& vn) {
+    return vn.delalloc_node_;
+}
+#endif
+
 // Return the block offset in vmo_indirect_ of indirect blocks pointed to by the doubly indirect
 // block at dindex
 constexpr uint32_t GetVmoOffsetForIndirect(uint32_t dibindex) {
@@ -561,6 +805,13 @@ void minfs_dump_info(const minfs_info_t* info);
 void minfs_dump_inode(const minfs_inode_t* inode, ino_t ino);
 void minfs_dir_init(void* bdata, ino_t ino_self, ino_t ino_parent);
 
+// Writes the blocks of any committed entries in the metadata journal of the
+// filesystem described by |info| in place. Since the info block may be
+// among them, |info| is reloaded if anything was replayed.
+//
+// Must be called before the filesystem is checked or mounted.
+zx_status_t minfs_replay_journal(Bcache* bc, minfs_info_t* info);
+
 // Given an input bcache, initialize the filesystem and return a reference to the
 // root node.
 zx_status_t minfs_mount(fbl::unique_ptr<minfs::Bcache> bc, fbl::RefPtr<VnodeMinfs>* root_out);
@@ -60,6 +60,11 @@ void minfs_free_slices(Bcache* bc, const minfs_info_t* info) {
         request.offset = kFVMBlockInodeStart / kBlocksPerSlice;
         bc->FVMShrink(&request);
     }
+    if (info->jnl_slices) {
+        request.length = info->jnl_slices;
+        request.offset = kFVMBlockJournalStart / kBlocksPerSlice;
+        bc->FVMShrink(&request);
+    }
     if (info->dat_slices) {
         request.length = info->dat_slices;
         request.offset = kFVMBlockDataStart / kBlocksPerSlice;
@@ -68,6 +73,19 @@ void minfs_free_slices(Bcache* bc, const minfs_info_t* info) {
 #endif
 }
 
+#ifdef __Fuchsia__
+// Returns how many blocks allocating |blocks| delayed blocks of a single
+// file may take: the blocks themselves, the indirect blocks which map them
+// (the run may straddle an indirect block at either end), and a doubly
+// indirect block.
+size_t DelallocReservation(blk_t blocks) {
+    if (blocks == 0) {
+        return 0;
+    }
+    return blocks + blocks / kMinfsDirectPerIndirect + 3;
+}
+#endif
+
 }  // namespace
 
 void minfs_dump_info(const minfs_info_t* info) {
@@ -78,6 +96,7 @@ void minfs_dump_info(const minfs_info_t* info) {
     xprintf("minfs: inode bitmap @ %10u\n", info->ibm_block);
     xprintf("minfs: alloc bitmap @ %10u\n", info->abm_block);
     xprintf("minfs: inode table  @ %10u\n", info->ino_block);
+    xprintf("minfs: journal      @ %10u (%u blocks)\n", info->jnl_block, info->jnl_block_count);
     xprintf("minfs: data blocks  @ %10u\n", info->dat_block);
     xprintf("minfs: FVM-aware: %s\n", (info->flags & kMinfsFlagFVM) ? "YES" : "NO");
 }
@@ -108,6 +127,14 @@ zx_status_t minfs_check_info(const minfs_info_t* info, Bcache* bc) {
         FS_TRACE_ERROR("minfs: bsz/isz %u/%u unsupported\n", info->block_size, info->inode_size);
         return ZX_ERR_INVALID_ARGS;
     }
+    if (info->jnl_block_count < kMinfsJournalMinBlocks) {
+        FS_TRACE_ERROR("minfs: journal too small\n");
+        return ZX_ERR_INVALID_ARGS;
+    } else if ((info->jnl_block < info->ino_block) ||
+               (info->jnl_block + info->jnl_block_count > info->dat_block)) {
+        FS_TRACE_ERROR("minfs: journal outside of its region\n");
+        return ZX_ERR_INVALID_ARGS;
+    }
     if ((info->flags & kMinfsFlagFVM) == 0) {
         if (info->dat_block + info->block_count > max) {
             FS_TRACE_ERROR("minfs: too large for device\n");
@@ -127,18 +154,20 @@ zx_status_t minfs_check_info(const minfs_info_t* info, Bcache* bc) {
             return ZX_ERR_BAD_STATE;
         }
 
-        size_t expected_count[4];
+        size_t expected_count[5];
         expected_count[0] = info->ibm_slices;
         expected_count[1] = info->abm_slices;
         expected_count[2] = info->ino_slices;
-        expected_count[3] = info->dat_slices;
+        expected_count[3] = info->jnl_slices;
+        expected_count[4] = info->dat_slices;
 
         query_request_t request;
-        request.count = 4;
+        request.count = 5;
         request.vslice_start[0] = kFVMBlockInodeBmStart / kBlocksPerSlice;
         request.vslice_start[1] = kFVMBlockDataBmStart / kBlocksPerSlice;
         request.vslice_start[2] = kFVMBlockInodeStart / kBlocksPerSlice;
-        request.vslice_start[3] = kFVMBlockDataStart / kBlocksPerSlice;
+        request.vslice_start[3] = kFVMBlockJournalStart / kBlocksPerSlice;
+        request.vslice_start[4] = kFVMBlockDataStart / kBlocksPerSlice;
 
         query_response_t response;
 
@@ -214,8 +243,16 @@ zx_status_t minfs_check_info(const minfs_info_t* info, Bcache* bc) {
         if (ino_blocks_needed > ino_blocks_allocated) {
             FS_TRACE_ERROR("minfs: Not enough slices for inode table\n");
             return ZX_ERR_INVALID_ARGS;
-        } else if (ino_blocks_allocated + info->ino_block >= info->dat_block) {
-            FS_TRACE_ERROR("minfs: Inode table collides with data blocks\n");
+        } else if (ino_blocks_allocated + info->ino_block >= info->jnl_block) {
+            FS_TRACE_ERROR("minfs: Inode table collides with journal\n");
+            return ZX_ERR_INVALID_ARGS;
+        }
+        size_t jnl_blocks_allocated = info->jnl_slices * kBlocksPerSlice;
+        if (info->jnl_block_count > jnl_blocks_allocated) {
+            FS_TRACE_ERROR("minfs: Not enough slices for journal\n");
+            return ZX_ERR_INVALID_ARGS;
+        } else if (jnl_blocks_allocated + info->jnl_block >= info->dat_block) {
+            FS_TRACE_ERROR("minfs: Journal collides with data blocks\n");
             return ZX_ERR_INVALID_ARGS;
         }
         size_t dat_blocks_needed = info->block_count;
@@ -241,7 +278,7 @@ zx_status_t Minfs::InodeSync(WriteTxn* txn, ino_t ino, const minfs_inode_t* inod
     const uint32_t off_of_ino = (ino % kMinfsInodesPerBlock) * kMinfsInodeSize;
     const blk_t inoblock_rel = ino / kMinfsInodesPerBlock;
     const blk_t inoblock_abs = inoblock_rel + info_.ino_block;
-    assert(inoblock_abs < kFVMBlockDataStart);
+    assert(inoblock_abs < kFVMBlockJournalStart);
 #ifdef __Fuchsia__
     void* inodata = (void*)((uintptr_t)(inode_table_->GetData()) +
                             (uintptr_t)(inoblock_rel * kMinfsBlockSize));
@@ -260,10 +297,95 @@ zx_status_t Minfs::InodeSync(WriteTxn* txn, ino_t ino, const minfs_inode_t* inod
 
 #ifdef __Fuchsia__
 void Minfs::Sync(SyncCallback closure) {
+    fbl::AutoLock lock(&txn_lock_);
+    DelallocFlushLocked(ZX_TIME_INFINITE);
     fbl::unique_ptr<WritebackWork> wb(new WritebackWork(bc_.get()));
     wb->SetClosure(fbl::move(closure));
     EnqueueWork(fbl::move(wb));
 }
+
+void Minfs::SetWritebackLimits(size_t dirty_bytes, zx_duration_t dirty_timeout,
+                               zx_duration_t commit_window) {
+    writeback_->SetCommitWindow(commit_window);
+    fbl::AutoLock lock(&txn_lock_);
+    dirty_bytes_ = dirty_bytes;
+    dirty_timeout_ = dirty_timeout;
+    cnd_signal(&delalloc_cvar_);
+    DelallocBalanceLocked();
+}
+
+bool Minfs::DelallocReserveLocked(const VnodeMinfs* vn, blk_t blocks) const {
+    const blk_t old_blocks = vn->DelallocBlocks();
+    const size_t reserved = delalloc_reserved_ - DelallocReservation(old_blocks) +
+                            DelallocReservation(old_blocks + blocks);
+    return reserved <= info_.block_count - info_.alloc_block_count;
+}
+
+void Minfs::DelallocChangedLocked(VnodeMinfs* vn, blk_t old_blocks) {
+    const blk_t blocks = vn->DelallocBlocks();
+    delalloc_blocks_ = delalloc_blocks_ - old_blocks + blocks;
+    delalloc_reserved_ = delalloc_reserved_ - DelallocReservation(old_blocks) +
+                         DelallocReservation(blocks);
+    if (old_blocks == 0 && blocks != 0) {
+        if (delalloc_list_.is_empty()) {
+            cnd_signal(&delalloc_cvar_);
+        }
+        delalloc_list_.push_back(vn);
+    } else if (old_blocks != 0 && blocks == 0) {
+        delalloc_list_.erase(*vn);
+    }
+}
+
+void Minfs::DelallocBalanceLocked() {
+    if (delalloc_blocks_ * kMinfsBlockSize >= dirty_bytes_) {
+        DelallocFlushLocked(ZX_TIME_INFINITE);
+    } else {
+        DelallocFlushLocked(zx_clock_get(ZX_CLOCK_MONOTONIC) - dirty_timeout_);
+    }
+}
+
+void Minfs::DelallocFlushLocked(zx_time_t before) {
+    TRACE_DURATION("minfs", "Minfs::DelallocFlushLocked");
+    // Files are removed from the list as they are flushed, even if their
+    // blocks cannot be allocated; the failure is reported by the file's
+    // next Sync or Close.
+    while (!delalloc_list_.is_empty() && delalloc_list_.front().DelallocTime() <= before) {
+        delalloc_list_.front().FlushDelayed();
+    }
+}
+
+void Minfs::DelallocStop() {
+    if (!delalloc_thrd_running_) {
+        return;
+    }
+    {
+        fbl::AutoLock lock(&txn_lock_);
+        delalloc_stop_ = true;
+        cnd_signal(&delalloc_cvar_);
+    }
+    int r;
+    thrd_join(delalloc_thrd_, &r);
+    delalloc_thrd_running_ = false;
+}
+
+int Minfs::DelallocThread(void* arg) {
+    Minfs* fs = reinterpret_cast<Minfs*>(arg);
+
+    fbl::AutoLock lock(&fs->txn_lock_);
+    while (!fs->delalloc_stop_) {
+        if (fs->delalloc_list_.is_empty()) {
+            cnd_wait(&fs->delalloc_cvar_, fs->txn_lock_.GetInternal());
+            continue;
+        }
+        const zx_time_t deadline = fs->delalloc_list_.front().DelallocTime() + fs->dirty_timeout_;
+        if (zx_clock_get(ZX_CLOCK_MONOTONIC) < deadline) {
+            cnd_wait_until(&fs->delalloc_cvar_, fs->txn_lock_.GetInternal(), deadline);
+            continue;
+        }
+        fs->DelallocBalanceLocked();
+    }
+    return 0;
+}
 #endif
 
 Minfs::Minfs(fbl::unique_ptr<Bcache> bc, const minfs_info_t* info) : bc_(fbl::move(bc)) {
@@ -275,12 +397,13 @@ Minfs::Minfs(fbl::unique_ptr<Bcache> bc, const minfs_info_t* info) : bc_(fbl::mo
         ibm_block_count_ = bc_->extent_lengths_[1] / kMinfsBlockSize;
         abm_block_count_ = bc_->extent_lengths_[2] / kMinfsBlockSize;
         ino_block_count_ = bc_->extent_lengths_[3] / kMinfsBlockSize;
-        dat_block_count_ = bc_->extent_lengths_[4] / kMinfsBlockSize;
+        dat_block_count_ = bc_->extent_lengths_[5] / kMinfsBlockSize;
 
         ibm_start_block_ = bc_->extent_lengths_[0] / kMinfsBlockSize;
         abm_start_block_ = ibm_start_block_ + ibm_block_count_;
         ino_start_block_ = abm_start_block_ + abm_block_count_;
-        dat_start_block_ = ino_start_block_ + ino_block_count_;
+        dat_start_block_ = ino_start_block_ + ino_block_count_ +
+                           static_cast<blk_t>(bc_->extent_lengths_[4] / kMinfsBlockSize);
     } else {
         ibm_start_block_ = info_.ibm_block;
         abm_start_block_ = info_.abm_block;
@@ -289,13 +412,19 @@ Minfs::Minfs(fbl::unique_ptr<Bcache> bc, const minfs_info_t* info) : bc_(fbl::mo
 
         ibm_block_count_ = abm_start_block_ - ibm_start_block_;
         abm_block_count_ = ino_start_block_ - abm_start_block_;
-        ino_block_count_ = dat_start_block_ - ino_start_block_;
+        ino_block_count_ = info_.jnl_block - ino_start_block_;
         dat_block_count_ = info_.block_count;
     }
 #endif
 }
 
 Minfs::~Minfs() {
+#ifdef __Fuchsia__
+    DelallocStop();
+    if (delalloc_cvar_valid_) {
+        cnd_destroy(&delalloc_cvar_);
+    }
+#endif
     vnode_hash_.clear();
 }
 
@@ -315,6 +444,22 @@ zx_status_t Minfs::InoFree(VnodeMinfs* vn, WriteTxn* txn) {
     txn->Enqueue(ibm_id, bitbno, info_.ibm_block + bitbno, 1);
     uint32_t block_count = vn->inode_.block_count;
 
+    if (vn->IsExtentMapped()) {
+        // release all extents
+        const minfs_extent_t* extents = MinfsInodeExtents(&vn->inode_);
+        for (unsigned n = 0; (n < kMinfsInodeExtents) && (extents[n].length != 0); n++) {
+            for (blk_t b = 0; b < extents[n].length; b++) {
+                block_count--;
+                BlockFree(txn, extents[n].start + b);
+            }
+        }
+
+        CountUpdate(txn);
+        ZX_DEBUG_ASSERT(block_count == 0);
+        ZX_DEBUG_ASSERT(vn->IsUnlinked());
+        return ZX_OK;
+    }
+
     // release all direct blocks
     for (unsigned n = 0; n < kMinfsDirect; n++) {
         if (vn->inode_.dnum[n] == 0) {
@@ -693,6 +838,9 @@ zx_status_t Minfs::VnodeGet(fbl::RefPtr<VnodeMinfs>* out, ino_t ino) {
         return ZX_ERR_OUT_OF_RANGE;
     }
 
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&vnode_get_lock_);
+#endif
     fbl::RefPtr<VnodeMinfs> vn = VnodeLookup(ino);
     if (vn != nullptr) {
         *out = fbl::move(vn);
@@ -744,6 +892,9 @@ zx_status_t Minfs::BlockFree(WriteTxn* txn, blk_t bno) {
 zx_status_t Minfs::BlockNew(WriteTxn* txn, blk_t hint, blk_t* out_bno) {
     size_t bitoff_start;
     zx_status_t status;
+    if ((status = BlockReserve()) != ZX_OK) {
+        return status;
+    }
     if ((status = block_map_.Find(false, hint, block_map_.size(), 1, &bitoff_start)) != ZX_OK) {
         if ((status = block_map_.Find(false, 0, hint, 1, &bitoff_start)) != ZX_OK) {
             size_t old_size = block_map_.size();
@@ -755,8 +906,51 @@ zx_status_t Minfs::BlockNew(WriteTxn* txn, blk_t hint, blk_t* out_bno) {
             }
         }
     }
+    return BlockMarkAllocated(txn, bitoff_start, out_bno);
+}
+
+zx_status_t Minfs::BlockNewContiguous(WriteTxn* txn, blk_t hint, blk_t run, blk_t* out_bno) {
+    size_t bitoff_start;
+    zx_status_t status;
+    if ((status = BlockReserve()) != ZX_OK) {
+        return status;
+    }
+    if ((hint != 0) && (hint < block_map_.size()) && !block_map_.Get(hint, hint + 1)) {
+        return BlockMarkAllocated(txn, hint, out_bno);
+    }
+
+    if ((block_map_.Find(false, hint, block_map_.size(), 2 * run, &bitoff_start) == ZX_OK) ||
+        (block_map_.Find(false, 0, hint, 2 * run, &bitoff_start) == ZX_OK)) {
+        if ((bitoff_start > 0) && block_map_.Get(bitoff_start - 1, bitoff_start)) {
+            // Leave room for whatever precedes the run to grow.
+            bitoff_start += run;
+        }
+    } else if ((block_map_.Find(false, hint, block_map_.size(), kMinfsExtentRun,
+                                &bitoff_start) != ZX_OK) &&
+               (block_map_.Find(false, 0, hint, kMinfsExtentRun, &bitoff_start) != ZX_OK)) {
+        // Free space is fragmented; any block will do.
+        return BlockNew(txn, hint, out_bno);
+    }
+    return BlockMarkAllocated(txn, bitoff_start, out_bno);
+}
+
+zx_status_t Minfs::BlockReserve() {
+#ifdef __Fuchsia__
+    // The blocks reserved for delayed allocation may not be taken by
+    // anything else, or the delayed blocks could not be allocated later.
+    // A file flushing its delayed blocks releases its reservation first.
+    while (info_.alloc_block_count + delalloc_reserved_ >= info_.block_count) {
+        zx_status_t status;
+        if ((status = AddBlocks()) != ZX_OK) {
+            return status;
+        }
+    }
+#endif
+    return ZX_OK;
+}
 
-    status = block_map_.Set(bitoff_start, bitoff_start + 1);
+zx_status_t Minfs::BlockMarkAllocated(WriteTxn* txn, size_t bitoff_start, blk_t* out_bno) {
+    zx_status_t status = block_map_.Set(bitoff_start, bitoff_start + 1);
     assert(status == ZX_OK);
     info_.alloc_block_count++;
     blk_t bno = static_cast<blk_t>(bitoff_start);
@@ -916,11 +1110,21 @@ zx_status_t Minfs::Create(fbl::unique_ptr<Bcache> bc, const minfs_info_t* info,
         return status;
     }
 
-    if ((status = WritebackBuffer::Create(fs->bc_.get(), fbl::move(buffer),
+    if ((status = WritebackBuffer::Create(fs->bc_.get(), fbl::move(buffer), &fs->info_,
                                           &fs->writeback_)) != ZX_OK) {
         return status;
     }
 
+    if (cnd_init(&fs->delalloc_cvar_) != thrd_success) {
+        return ZX_ERR_NO_RESOURCES;
+    }
+    fs->delalloc_cvar_valid_ = true;
+    if (thrd_create_with_name(&fs->delalloc_thrd_, Minfs::DelallocThread, fs.get(),
+                              "minfs-delalloc") != thrd_success) {
+        return ZX_ERR_NO_RESOURCES;
+    }
+    fs->delalloc_thrd_running_ = true;
+
     status = fs->CreateFsId();
     if (status != ZX_OK) {
         FS_TRACE_ERROR("minfs: failed to create fs_id:%d\n", status);
@@ -941,6 +1145,9 @@ zx_status_t Minfs::Create(fbl::unique_ptr<Bcache> bc, const minfs_info_t* info,
         }
     }
 #endif
+    // The bitmaps were read directly into their storage.
+    fs->block_map_.RebuildSummary();
+    fs->inode_map_.RebuildSummary();
 
     *out = fs;
     return ZX_OK;
@@ -955,7 +1162,11 @@ zx_status_t minfs_mount(fbl::unique_ptr<minfs::Bcache> bc, fbl::RefPtr<VnodeMinf
         FS_TRACE_ERROR("minfs: could not read info block\n");
         return status;
     }
-    const minfs_info_t* info = reinterpret_cast<minfs_info_t*>(blk);
+    minfs_info_t* info = reinterpret_cast<minfs_info_t*>(blk);
+    if ((status = minfs_replay_journal(bc.get(), info)) != ZX_OK) {
+        FS_TRACE_ERROR("minfs: could not replay journal\n");
+        return status;
+    }
 
     fbl::RefPtr<Minfs> fs;
     if ((status = Minfs::Create(fbl::move(bc), info, &fs)) != ZX_OK) {
@@ -990,6 +1201,11 @@ zx_status_t MountAndServe(fs::Vfs *vfs, fbl::unique_ptr<Bcache> bc, zx::channel
 
 zx_status_t Minfs::Unmount() {
 #ifdef __Fuchsia__
+    {
+        fbl::AutoLock lock(&txn_lock_);
+        DelallocFlushLocked(ZX_TIME_INFINITE);
+    }
+    DelallocStop();
     // Ensure writeback buffer completes before auxilliary structures
     // are deleted.
     writeback_ = nullptr;
@@ -1058,6 +1274,15 @@ zx_status_t Mkfs(fbl::unique_ptr<Bcache> bc) {
             return status;
         }
         info.ino_slices = 1;
+        request.length = (kMinfsJournalBlocks + kBlocksPerSlice - 1) / kBlocksPerSlice;
+        request.offset = kFVMBlockJournalStart / kBlocksPerSlice;
+        if ((status = bc->FVMExtend(&request)) != ZX_OK) {
+            fprintf(stderr, "minfs mkfs: Failed to allocate journal: %d\n", status);
+            minfs_free_slices(bc.get(), &info);
+            return status;
+        }
+        info.jnl_slices = static_cast<uint32_t>(request.length);
+        request.length = 1;
         request.offset = kFVMBlockDataStart / kBlocksPerSlice;
         if ((status = bc->FVMExtend(&request)) != ZX_OK) {
             fprintf(stderr, "minfs mkfs: Failed to allocate data blocks\n");
@@ -1067,7 +1292,7 @@ zx_status_t Mkfs(fbl::unique_ptr<Bcache> bc) {
         info.dat_slices = 1;
 
         info.vslice_count = 1 + info.ibm_slices + info.abm_slices +
-                            info.ino_slices + info.dat_slices;
+                            info.ino_slices + info.jnl_slices + info.dat_slices;
 
         inodes = static_cast<uint32_t>(info.ino_slices * info.slice_size / kMinfsInodeSize);
         blocks = static_cast<uint32_t>(info.dat_slices * info.slice_size / kMinfsBlockSize);
@@ -1087,9 +1312,11 @@ zx_status_t Mkfs(fbl::unique_ptr<Bcache> bc) {
     info.inode_count = inodes;
     info.alloc_block_count = 0;
     info.alloc_inode_count = 0;
+    info.jnl_block_count = kMinfsJournalBlocks;
     if ((info.flags & kMinfsFlagFVM) == 0) {
         // Aligning distinct data areas to 8 block groups.
-        uint32_t non_dat_blocks = (8 + fbl::round_up(ibmblks, 8u) + inoblks);
+        uint32_t non_dat_blocks = (8 + fbl::round_up(ibmblks, 8u) + inoblks +
+                                   info.jnl_block_count);
         if (non_dat_blocks >= blocks) {
             fprintf(stderr, "mkfs: Partition size (%" PRIu64 " bytes) is too small\n",
                     static_cast<uint64_t>(blocks) * kMinfsBlockSize);
@@ -1102,13 +1329,15 @@ zx_status_t Mkfs(fbl::unique_ptr<Bcache> bc) {
         info.ibm_block = 8;
         info.abm_block = info.ibm_block + fbl::round_up(ibmblks, 8u);
         info.ino_block = info.abm_block + fbl::round_up(abmblks, 8u);
-        info.dat_block = info.ino_block + inoblks;
+        info.jnl_block = info.ino_block + inoblks;
+        info.dat_block = info.jnl_block + info.jnl_block_count;
     } else {
         info.block_count = blocks;
         abmblks = (info.block_count + kMinfsBlockBits - 1) / kMinfsBlockBits;
         info.ibm_block = kFVMBlockInodeBmStart;
         info.abm_block = kFVMBlockDataBmStart;
         info.ino_block = kFVMBlockInodeStart;
+        info.jnl_block = kFVMBlockJournalStart;
         info.dat_block = kFVMBlockDataStart;
     }
 
@@ -1188,6 +1417,18 @@ zx_status_t Mkfs(fbl::unique_ptr<Bcache> bc) {
     ino[kMinfsRootIno].dnum[0] = 1;
     bc->Writeblk(info.ino_block, blk);
 
+    // write an empty journal; the log is cleared so that no entries of a
+    // previous filesystem may be replayed
+    memset(blk, 0, sizeof(blk));
+    for (uint32_t n = 1; n < info.jnl_block_count; n++) {
+        bc->Writeblk(info.jnl_block + n, blk);
+    }
+    minfs_journal_info_t* jinfo = reinterpret_cast<minfs_journal_info_t*>(&blk[0]);
+    jinfo->magic = kMinfsJournalMagic;
+    jinfo->seq = 1;
+    jinfo->start = 0;
+    bc->Writeblk(info.jnl_block, blk);
+
     memset(blk, 0, sizeof(blk));
     memcpy(blk, &info, sizeof(info));
     bc->Writeblk(0, blk);
@@ -10,6 +10,8 @@ MODULE_TYPE := userlib
 
 COMMON_SRCS := \
     $(LOCAL_DIR)/bcache.cpp \
+    $(LOCAL_DIR)/dir-index.cpp \
+    $(LOCAL_DIR)/journal.cpp \
     $(LOCAL_DIR)/minfs.cpp \
     $(LOCAL_DIR)/vnode.cpp \
     $(LOCAL_DIR)/writeback.cpp \
@@ -31,6 +33,7 @@ MODULE_STATIC_LIBS := \
     system/ulib/zxcpp \
     system/ulib/fbl \
     system/ulib/sync \
+    third_party/ulib/cksum \
 
 MODULE_LIBS := \
     system/ulib/async.default \
@@ -46,8 +49,10 @@ MODULE_HOST_SRCS := \
     $(COMMON_SRCS) \
     $(LOCAL_DIR)/host.cpp \
     system/ulib/bitmap/raw-bitmap.cpp \
+    system/ulib/fs/dentry-cache.cpp \
     system/ulib/fs/vfs.cpp \
     system/ulib/fs/vnode.cpp \
+    third_party/ulib/cksum/crc32.c \
 
 MODULE_HOST_COMPILEFLAGS := \
     -Werror-implicit-function-declaration \
@@ -57,6 +62,7 @@ MODULE_HOST_COMPILEFLAGS := \
     -Isystem/ulib/fdio/include \
     -Isystem/ulib/fbl/include \
     -Isystem/ulib/fs/include \
+    -Ithird_party/ulib/cksum/include \
 
 # host minfs lib
 
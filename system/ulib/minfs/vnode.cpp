@@ -212,6 +212,10 @@ zx_status_t VnodeMinfs::BlocksShrinkDoublyIndirect(WriteTxn *txn, uint32_t ibind
 // Delete all blocks (relative to a file) from "start" (inclusive) to the end of
 // the file. Does not update mtime/atime.
 zx_status_t VnodeMinfs::BlocksShrink(WriteTxn *txn, blk_t start) {
+    if (IsExtentMapped()) {
+        return BlocksShrinkExtents(txn, start);
+    }
+
     bool dirty = false;
     zx_status_t status = ZX_OK;
     size_t size = (kMinfsIndirect + kMinfsDoublyIndirect) * kMinfsBlockSize;
@@ -278,6 +282,35 @@ zx_status_t VnodeMinfs::BlocksShrink(WriteTxn *txn, blk_t start) {
     return ZX_OK;
 }
 
+zx_status_t VnodeMinfs::BlocksShrinkExtents(WriteTxn* txn, blk_t start) {
+    minfs_extent_t* extents = MinfsInodeExtents(&inode_);
+    bool dirty = false;
+    for (uint32_t i = 0; (i < kMinfsInodeExtents) && (extents[i].length != 0); i++) {
+        minfs_extent_t* extent = &extents[i];
+        if (extent->file_block + extent->length <= start) {
+            continue;
+        }
+        // Extents are sorted, so the released extents remain packed at the
+        // start of the table.
+        uint32_t keep = (extent->file_block < start) ? start - extent->file_block : 0;
+        for (uint32_t b = keep; b < extent->length; b++) {
+            fs_->BlockFree(txn, extent->start + b);
+        }
+        inode_.block_count -= extent->length - keep;
+        if (keep == 0) {
+            memset(extent, 0, sizeof(*extent));
+        } else {
+            extent->length = keep;
+        }
+        dirty = true;
+    }
+
+    if (dirty) {
+        InodeSync(txn, kMxFsSyncDefault);
+    }
+    return ZX_OK;
+}
+
 #ifdef __Fuchsia__
 zx_status_t VnodeMinfs::LoadIndirectBlocks(blk_t* iarray, uint32_t count, uint32_t offset,
                                            uint64_t size) {
@@ -379,6 +412,19 @@ zx_status_t VnodeMinfs::InitVmo() {
     }
     ReadTxn txn(fs_->bc_.get());
 
+    if (IsExtentMapped()) {
+        // Each extent is read with a single request.
+        const minfs_extent_t* extents = MinfsInodeExtents(&inode_);
+        for (uint32_t i = 0; (i < kMinfsInodeExtents) && (extents[i].length != 0); i++) {
+            fs_->ValidateBno(extents[i].start);
+            txn.Enqueue(vmoid_, extents[i].file_block, extents[i].start + fs_->info_.dat_block,
+                        extents[i].length);
+        }
+        status = txn.Flush();
+        ValidateVmoTail();
+        return status;
+    }
+
     // Initialize all direct blocks
     blk_t bno;
     for (uint32_t d = 0; d < kMinfsDirect; d++) {
@@ -462,7 +508,7 @@ zx_status_t VnodeMinfs::InitVmo() {
 }
 #endif
 
-zx_status_t VnodeMinfs::GetBnoDirect(WriteTxn* txn, blk_t* bno, bool* dirty) {
+zx_status_t VnodeMinfs::GetBnoDirect(WriteTxn* txn, blk_t map_bno, blk_t* bno, bool* dirty) {
     // direct blocks are simple... is there an entry in dnum[]?
     blk_t hint = 0;
 
@@ -471,12 +517,17 @@ zx_status_t VnodeMinfs::GetBnoDirect(WriteTxn* txn, blk_t* bno, bool* dirty) {
             *bno = 0;
             return ZX_OK;
         }
-        // allocate a new block
-        zx_status_t status = fs_->BlockNew(txn, hint, bno);
-        if (status != ZX_OK) {
-            return status;
+        if (map_bno != 0) {
+            // The block is already allocated, and counted by the inode.
+            *bno = map_bno;
+        } else {
+            // allocate a new block
+            zx_status_t status = fs_->BlockNew(txn, hint, bno);
+            if (status != ZX_OK) {
+                return status;
+            }
+            inode_.block_count++;
         }
-        inode_.block_count++;
         *dirty = true;
     }
 
@@ -485,7 +536,7 @@ zx_status_t VnodeMinfs::GetBnoDirect(WriteTxn* txn, blk_t* bno, bool* dirty) {
 }
 
 zx_status_t VnodeMinfs::GetBnoIndirect(WriteTxn* txn, uint32_t bindex, uint32_t ib_vmo_offset,
-                                       blk_t* ibno, blk_t* bno, bool* dirty) {
+                                       blk_t map_bno, blk_t* ibno, blk_t* bno, bool* dirty) {
     // we should have initialized vmo before calling this method
     zx_status_t status;
 
@@ -525,7 +576,7 @@ zx_status_t VnodeMinfs::GetBnoIndirect(WriteTxn* txn, uint32_t bindex, uint32_t
 #endif
 
     bool direct_dirty = false;
-    if ((status = GetBnoDirect(txn, &ientry[bindex], &direct_dirty)) != ZX_OK) {
+    if ((status = GetBnoDirect(txn, map_bno, &ientry[bindex], &direct_dirty)) != ZX_OK) {
         return status;
     }
 
@@ -546,7 +597,8 @@ zx_status_t VnodeMinfs::GetBnoIndirect(WriteTxn* txn, uint32_t bindex, uint32_t
 
 zx_status_t VnodeMinfs::GetBnoDoublyIndirect(WriteTxn* txn, uint32_t ibindex, uint32_t bindex,
                                              uint32_t dib_vmo_offset, uint32_t ib_vmo_offset,
-                                             blk_t* dibno, blk_t* bno, bool* dirty) {
+                                             blk_t map_bno, blk_t* dibno, blk_t* bno,
+                                             bool* dirty) {
     zx_status_t status;
 
     // look up the doubly indirect bno, create if it doesn't already exist
@@ -583,8 +635,8 @@ zx_status_t VnodeMinfs::GetBnoDoublyIndirect(WriteTxn* txn, uint32_t ibindex, ui
 
     // get indirect block
     bool indirect_dirty = false;
-    if ((status = GetBnoIndirect(txn, bindex, ib_vmo_offset + ibindex, &dientry[ibindex], bno,
-                                 &indirect_dirty)) != ZX_OK) {
+    if ((status = GetBnoIndirect(txn, bindex, ib_vmo_offset + ibindex, map_bno,
+                                 &dientry[ibindex], bno, &indirect_dirty)) != ZX_OK) {
         return status;
     }
 
@@ -629,10 +681,17 @@ void VnodeMinfs::ClearIndirectBlock(blk_t bno) {
 
 // Get the bno corresponding to the nth logical block within the file.
 zx_status_t VnodeMinfs::GetBno(WriteTxn* txn, blk_t n, blk_t* bno) {
+    if (IsExtentMapped()) {
+        return GetBnoExtent(txn, n, bno);
+    }
+    return GetBnoBlockMap(txn, n, 0, bno);
+}
+
+zx_status_t VnodeMinfs::GetBnoBlockMap(WriteTxn* txn, blk_t n, blk_t map_bno, blk_t* bno) {
     bool dirty = false;
 
     if (n < kMinfsDirect) {
-        zx_status_t status = GetBnoDirect(txn, &inode_.dnum[n], &dirty);
+        zx_status_t status = GetBnoDirect(txn, map_bno, &inode_.dnum[n], &dirty);
         *bno = inode_.dnum[n];
         return status;
     }
@@ -645,7 +704,8 @@ zx_status_t VnodeMinfs::GetBno(WriteTxn* txn, blk_t n, blk_t* bno) {
         uint32_t ibindex = n / kMinfsDirectPerIndirect;
         // index of direct block within indirect block
         uint32_t bindex = n % kMinfsDirectPerIndirect;
-        return GetBnoIndirect(txn, bindex, ibindex, &inode_.inum[ibindex], bno, &dirty);
+        return GetBnoIndirect(txn, bindex, ibindex, map_bno, &inode_.inum[ibindex], bno,
+                              &dirty);
     }
 
     // for doubly indirect blocks, adjust past the indirect blocks
@@ -678,13 +738,139 @@ zx_status_t VnodeMinfs::GetBno(WriteTxn* txn, blk_t n, blk_t* bno) {
     #endif
 
         return GetBnoDoublyIndirect(txn, ibindex, bindex, GetVmoOffsetForDoublyIndirect(dibindex),
-                                    GetVmoOffsetForIndirect(dibindex), &inode_.dinum[dibindex], bno,
-                                    &dirty);
+                                    GetVmoOffsetForIndirect(dibindex), map_bno,
+                                    &inode_.dinum[dibindex], bno, &dirty);
     }
 
     return ZX_ERR_OUT_OF_RANGE;
 }
 
+zx_status_t VnodeMinfs::GetBnoExtent(WriteTxn* txn, blk_t n, blk_t* bno) {
+    minfs_extent_t* extents = MinfsInodeExtents(&inode_);
+    uint32_t count = 0;
+    while ((count < kMinfsInodeExtents) && (extents[count].length != 0)) {
+        count++;
+    }
+    // |next| is the first extent which starts after |n|.
+    uint32_t next = 0;
+    while ((next < count) && (extents[next].file_block <= n)) {
+        next++;
+    }
+
+    minfs_extent_t* prev = (next > 0) ? &extents[next - 1] : nullptr;
+    if ((prev != nullptr) && (n - prev->file_block < prev->length)) {
+        *bno = prev->start + (n - prev->file_block);
+        fs_->ValidateBno(*bno);
+        return ZX_OK;
+    }
+    if (txn == nullptr) {
+        *bno = 0;
+        return ZX_OK;
+    }
+
+    // Prefer the block which would grow the preceding extent, or (past a
+    // hole) would let the extent grow once the hole is filled.
+    zx_status_t status;
+    blk_t hint = 0;
+    blk_t run = kMinfsExtentRun;
+    if (prev != nullptr) {
+        hint = prev->start + (n - prev->file_block);
+        run = fbl::max(run, 2 * prev->length);
+    }
+    blk_t new_bno;
+    if ((status = fs_->BlockNewContiguous(txn, hint, run, &new_bno)) != ZX_OK) {
+        return status;
+    }
+
+    const bool joins_next = (next < count) && (extents[next].file_block == n + 1) &&
+                            (extents[next].start == new_bno + 1);
+    if ((prev != nullptr) && (prev->file_block + prev->length == n) && (new_bno == hint)) {
+        prev->length++;
+        if (joins_next) {
+            // The block filled the gap between two extents.
+            prev->length += extents[next].length;
+            memmove(&extents[next], &extents[next + 1],
+                    (count - next - 1) * sizeof(minfs_extent_t));
+            memset(&extents[count - 1], 0, sizeof(minfs_extent_t));
+        }
+    } else if (joins_next) {
+        extents[next].file_block--;
+        extents[next].start--;
+        extents[next].length++;
+    } else if (count < kMinfsInodeExtents) {
+        memmove(&extents[next + 1], &extents[next], (count - next) * sizeof(minfs_extent_t));
+        extents[next].file_block = n;
+        extents[next].start = new_bno;
+        extents[next].length = 1;
+    } else {
+        // The file is too fragmented to be described by extents.
+        fs_->BlockFree(txn, new_bno);
+        if ((status = ExtentsToBlockMap(txn)) != ZX_OK) {
+            return status;
+        }
+        return GetBnoBlockMap(txn, n, 0, bno);
+    }
+
+    inode_.block_count++;
+    *bno = new_bno;
+    return ZX_OK;
+}
+
+zx_status_t VnodeMinfs::ExtentsToBlockMap(WriteTxn* txn) {
+    minfs_extent_t extents[kMinfsInodeExtents];
+    memcpy(extents, MinfsInodeExtents(&inode_), sizeof(extents));
+    memset(MinfsInodeExtents(&inode_), 0, sizeof(extents));
+    inode_.flags &= ~kMinfsInodeFlagExtents;
+
+    // The data stays where it is; only the indirect blocks are allocated.
+    zx_status_t status = ZX_OK;
+    for (uint32_t i = 0; (i < kMinfsInodeExtents) && (extents[i].length != 0); i++) {
+        for (uint32_t b = 0; (status == ZX_OK) && (b < extents[i].length); b++) {
+            blk_t bno;
+            status = GetBnoBlockMap(txn, extents[i].file_block + b, extents[i].start + b, &bno);
+        }
+        if (status != ZX_OK) {
+            break;
+        }
+    }
+
+    if (status != ZX_OK) {
+        // Free the indirect blocks allocated so far (the data blocks are
+        // still described by the extents), and map the file by its extents
+        // again.
+        for (uint32_t i = 0; i < kMinfsIndirect; i++) {
+            if (inode_.inum[i] != 0) {
+                fs_->BlockFree(txn, inode_.inum[i]);
+                inode_.block_count--;
+            }
+        }
+        for (uint32_t i = 0; i < kMinfsDoublyIndirect; i++) {
+            if (inode_.dinum[i] == 0) {
+                continue;
+            }
+#ifdef __Fuchsia__
+            uint32_t* dientry;
+            ReadIndirectVmoBlock(GetVmoOffsetForDoublyIndirect(i), &dientry);
+#else
+            uint32_t dientry[kMinfsBlockSize];
+            ReadIndirectBlock(inode_.dinum[i], dientry);
+#endif
+            for (uint32_t j = 0; j < kMinfsDirectPerIndirect; j++) {
+                if (dientry[j] != 0) {
+                    fs_->BlockFree(txn, dientry[j]);
+                    inode_.block_count--;
+                }
+            }
+            fs_->BlockFree(txn, inode_.dinum[i]);
+            inode_.block_count--;
+        }
+        memcpy(MinfsInodeExtents(&inode_), extents, sizeof(extents));
+        inode_.flags |= kMinfsInodeFlagExtents;
+    }
+    InodeSync(txn, kMxFsSyncDefault);
+    return status;
+}
+
 // Immediately stop iterating over the directory.
 #define DIR_CB_DONE 0
 // Access the next direntry in the directory. Offsets updated.
@@ -845,6 +1031,9 @@ zx_status_t VnodeMinfs::UnlinkChild(WritebackWork* wb,
 }
 
 void VnodeMinfs::RemoveInodeLink(WriteTxn* txn) {
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&lock_);
+#endif
     // This effectively 'unlinks' the target node without deleting the direntry
     inode_.link_count--;
     if (MinfsMagicType(inode_.magic) == kMinfsTypeDir) {
@@ -1038,6 +1227,17 @@ zx_status_t VnodeMinfs::DirentCallbackAppend(fbl::RefPtr<VnodeMinfs> vndir, minf
 //          Since 'func' may create / remove surrounding dirents, it is responsible for
 //          updating the offset information to access the next dirent.
 zx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func) {
+    if (dir_index_ == nullptr && inode_.size >= kMinfsDirIndexMinSize) {
+        // If the index cannot be built, fall back to a linear scan.
+        BuildDirIndex();
+    }
+    if (dir_index_ != nullptr) {
+        return ForEachDirentIndexed(args, func);
+    }
+    return ForEachDirentLinear(args, func);
+}
+
+zx_status_t VnodeMinfs::ForEachDirentLinear(DirArgs* args, const DirentCallback func) {
     char data[kMinfsMaxDirentSize];
     minfs_dirent_t* de = (minfs_dirent_t*) data;
     DirectoryOffset offs = {
@@ -1070,6 +1270,113 @@ zx_status_t VnodeMinfs::ForEachDirent(DirArgs* args, const DirentCallback func)
     return ZX_ERR_NOT_FOUND;
 }
 
+zx_status_t VnodeMinfs::BuildDirIndex() {
+    fbl::AllocChecker ac;
+    dir_index_.reset(new (&ac) DirectoryIndex());
+    if (!ac.check()) {
+        return ZX_ERR_NO_MEMORY;
+    }
+    zx_status_t status = IndexDirents(0, kMinfsMaxDirectorySize);
+    if (status != ZX_OK) {
+        dir_index_.reset();
+    }
+    return status;
+}
+
+zx_status_t VnodeMinfs::IndexDirents(size_t start, size_t end) {
+    char data[kMinfsMaxDirentSize];
+    minfs_dirent_t* de = (minfs_dirent_t*) data;
+    size_t off = start;
+    while (off < end && off + MINFS_DIRENT_SIZE < kMinfsMaxDirectorySize) {
+        size_t r;
+        zx_status_t status = ReadInternal(data, kMinfsMaxDirentSize, off, &r);
+        if (status != ZX_OK) {
+            return status;
+        } else if ((status = validate_dirent(de, r, off)) != ZX_OK) {
+            return status;
+        } else if ((status = dir_index_->Insert(de, off)) != ZX_OK) {
+            return status;
+        }
+        off += MinfsReclen(de, off);
+    }
+    return ZX_OK;
+}
+
+// Equivalent to |ForEachDirentLinear|, but rather than passing every dirent
+// to 'func', only passes the one dirent it would act upon: the entry matching
+// 'args->name' or, for |DirentCallbackAppend|, an entry with enough space for
+// the new name.
+zx_status_t VnodeMinfs::ForEachDirentIndexed(DirArgs* args, const DirentCallback func) {
+    char data[kMinfsMaxDirentSize];
+    minfs_dirent_t* de = (minfs_dirent_t*) data;
+    zx_status_t status;
+    size_t off;
+    size_t r;
+
+    if (func == DirentCallbackAppend) {
+        if (!dir_index_->FindSpace(args->reclen, &off)) {
+            return ZX_ERR_NOT_FOUND;
+        }
+        if ((status = ReadInternal(data, kMinfsMaxDirentSize, off, &r)) != ZX_OK ||
+            (status = validate_dirent(de, r, off)) != ZX_OK) {
+            dir_index_.reset();
+            return status;
+        }
+    } else {
+        const uint32_t hash = DirectoryIndex::Hash(args->name);
+        size_t next = 0;
+        while (true) {
+            if (!dir_index_->FindName(hash, next, &off)) {
+                return ZX_ERR_NOT_FOUND;
+            }
+            if ((status = ReadInternal(data, kMinfsMaxDirentSize, off, &r)) != ZX_OK ||
+                (status = validate_dirent(de, r, off)) != ZX_OK) {
+                dir_index_.reset();
+                return status;
+            }
+            if ((de->ino != 0) && fbl::StringPiece(de->name, de->namelen) == args->name) {
+                break;
+            }
+            next = off + 1;
+        }
+    }
+
+    // 'func' may split the dirent, or coalesce it with its neighbors, but
+    // cannot modify any dirents outside of [start, end).
+    DirectoryOffset offs = {
+        .off = off,
+        .off_prev = dir_index_->Prev(off),
+    };
+    const size_t start = offs.off_prev;
+    const size_t end = dir_index_->NextEnd(off);
+
+    status = func(fbl::RefPtr<VnodeMinfs>(this), de, args, &offs);
+    switch (status) {
+    case DIR_CB_DONE:
+        return ZX_OK;
+    case DIR_CB_NEXT:
+        // The index disagrees with the contents of the directory.
+        FS_TRACE_ERROR("minfs: Directory index is inconsistent; discarding\n");
+        dir_index_.reset();
+        return ForEachDirentLinear(args, func);
+    case DIR_CB_SAVE_SYNC:
+        inode_.seq_num++;
+        InodeSync(args->wb->txn(), kMxFsSyncMtime);
+        args->wb->PinVnode(fbl::move(fbl::WrapRefPtr(this)));
+        status = ZX_OK;
+        break;
+    default:
+        // 'func' may have failed after partially modifying the directory.
+        break;
+    }
+
+    dir_index_->RemoveRange(start, end);
+    if (IndexDirents(start, end) != ZX_OK) {
+        dir_index_.reset();
+    }
+    return status;
+}
+
 void VnodeMinfs::fbl_recycle() {
     if (fd_count_ != 0 || !IsUnlinked()) {
         // If this node has not been purged already, remove it from the
@@ -1121,6 +1428,13 @@ zx_status_t VnodeMinfs::ValidateFlags(uint32_t flags) {
 }
 
 zx_status_t VnodeMinfs::Open(uint32_t flags, fbl::RefPtr<Vnode>* out_redirect) {
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&lock_);
+#endif
+    if (fd_count_ == 0 && IsUnlinked()) {
+        // The vnode was unlinked (and purged) after it was looked up.
+        return ZX_ERR_NOT_FOUND;
+    }
     fd_count_++;
     return ZX_OK;
 }
@@ -1129,12 +1443,14 @@ void VnodeMinfs::Purge(WriteTxn* txn) {
     ZX_DEBUG_ASSERT(fd_count_ == 0);
     ZX_DEBUG_ASSERT(IsUnlinked());
 #ifdef __Fuchsia__
+    DropDelayedLocked(0);
     {
         fbl::AutoLock lock(&fs_->hash_lock_);
         fs_->VnodeReleaseLocked(this);
     }
-    // TODO(smklein): Only init indirect vmo if it's needed
-    if (InitIndirectVmo() == ZX_OK) {
+    // Extent-mapped inodes overlay their extents on the indirect block
+    // numbers, and InoFree frees the extents directly.
+    if (IsExtentMapped() || InitIndirectVmo() == ZX_OK) {
         fs_->InoFree(this, txn);
     } else {
         fprintf(stderr, "minfs: Failed to Init Indirect VMO while purging %u\n", ino_);
@@ -1145,7 +1461,119 @@ void VnodeMinfs::Purge(WriteTxn* txn) {
 #endif
 }
 
+#ifdef __Fuchsia__
+bool VnodeMinfs::DelayAllocationLocked(blk_t n) {
+    if (IsDirectory()) {
+        return false;
+    } else if ((delalloc_start_ <= n) && (n < delalloc_end_)) {
+        return true;
+    }
+
+    const blk_t old_blocks = DelallocBlocks();
+    if ((old_blocks != 0) && (n != delalloc_end_) && (n + 1 != delalloc_start_)) {
+        // The block does not adjoin the delayed run.
+        if (FlushDelayedLocked() != ZX_OK) {
+            return false;
+        }
+        return DelayAllocationLocked(n);
+    } else if (!fs_->DelallocReserveLocked(this, 1)) {
+        return false;
+    }
+
+    if (old_blocks == 0) {
+        delalloc_start_ = n;
+        delalloc_end_ = n + 1;
+        delalloc_time_ = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    } else if (n == delalloc_end_) {
+        delalloc_end_++;
+    } else {
+        delalloc_start_--;
+    }
+    fs_->DelallocChangedLocked(this, old_blocks);
+    return true;
+}
+
+zx_status_t VnodeMinfs::FlushDelayed() {
+    fbl::AutoLock lock(&lock_);
+    return FlushDelayedLocked();
+}
+
+zx_status_t VnodeMinfs::FlushDelayedLocked() {
+    TRACE_DURATION("minfs", "VnodeMinfs::FlushDelayedLocked", "ino", ino_);
+    // Release the file's reservation first; its blocks are allocated from
+    // the space which was reserved for them.
+    blk_t start = delalloc_start_;
+    const blk_t end = delalloc_end_;
+    const blk_t old_blocks = DelallocBlocks();
+    delalloc_start_ = 0;
+    delalloc_end_ = 0;
+    fs_->DelallocChangedLocked(this, old_blocks);
+
+    zx_status_t status = ZX_OK;
+    while ((status == ZX_OK) && (start < end)) {
+        fbl::AllocChecker ac;
+        fbl::unique_ptr<WritebackWork> wb(new (&ac) WritebackWork(fs_->bc_.get()));
+        if (!ac.check()) {
+            status = ZX_ERR_NO_MEMORY;
+            break;
+        }
+        // Blocks allocated in order are usually contiguous, so they share a
+        // single request.
+        while ((start < end) && (wb->txn()->Count() < kMinfsDelallocMaxRequests)) {
+            blk_t bno;
+            if ((status = GetBno(wb->txn(), start, &bno)) != ZX_OK) {
+                break;
+            }
+            wb->txn()->EnqueueData(vmo_.get(), start, bno + fs_->info_.dat_block, 1);
+            start++;
+        }
+        InodeSync(wb->txn(), kMxFsSyncDefault);
+        wb->PinVnode(fbl::WrapRefPtr(this));
+        fs_->EnqueueWork(fbl::move(wb));
+    }
+    if (status != ZX_OK) {
+        // The data has already been accepted by Write, so the loss must be
+        // reported to whoever next syncs or closes the file.
+        FS_TRACE_ERROR("minfs: Failed to allocate %u delayed blocks of ino %u: %d\n",
+                       end - start, ino_, status);
+        if (delalloc_status_ == ZX_OK) {
+            delalloc_status_ = status;
+        }
+    }
+    return status;
+}
+
+void VnodeMinfs::DropDelayedLocked(blk_t start) {
+    const blk_t old_blocks = DelallocBlocks();
+    if (start < delalloc_end_) {
+        delalloc_end_ = start;
+    }
+    if (delalloc_end_ <= delalloc_start_) {
+        delalloc_start_ = 0;
+        delalloc_end_ = 0;
+    }
+    fs_->DelallocChangedLocked(this, old_blocks);
+}
+#endif
+
 zx_status_t VnodeMinfs::Close() {
+#ifdef __Fuchsia__
+    {
+        fbl::AutoLock lock(&lock_);
+        ZX_DEBUG_ASSERT_MSG(fd_count_ > 0, "Closing ino with no fds open");
+        if (fd_count_ > 1 ||
+            (!IsUnlinked() && DelallocBlocks() == 0 && delalloc_status_ == ZX_OK)) {
+            fd_count_--;
+            return ZX_OK;
+        }
+    }
+    // Closing the last file descriptor of a vnode purges it (if it is
+    // unlinked) or allocates its delayed blocks and reports whether they
+    // could be allocated, which must be done under the filesystem's
+    // transaction lock.
+    fbl::AutoLock txn_lock(&fs_->txn_lock_);
+    fbl::AutoLock lock(&lock_);
+#endif
     ZX_DEBUG_ASSERT_MSG(fd_count_ > 0, "Closing ino with no fds open");
     fd_count_--;
 
@@ -1154,6 +1582,14 @@ zx_status_t VnodeMinfs::Close() {
         Purge(wb->txn());
         fs_->EnqueueWork(fbl::move(wb));
     }
+#ifdef __Fuchsia__
+    else if (fd_count_ == 0) {
+        FlushDelayedLocked();
+        zx_status_t status = delalloc_status_;
+        delalloc_status_ = ZX_OK;
+        return status;
+    }
+#endif
     return ZX_OK;
 }
 
@@ -1161,6 +1597,9 @@ zx_status_t VnodeMinfs::Read(void* data, size_t len, size_t off, size_t* out_act
     TRACE_DURATION("minfs", "VnodeMinfs::Read", "ino", ino_, "len", len, "off", off);
     ZX_DEBUG_ASSERT_MSG(fd_count_ > 0, "Reading from ino with no fds open");
     xprintf("minfs_read() vn=%p(#%u) len=%zd off=%zd\n", this, ino_, len, off);
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&lock_);
+#endif
     if (IsDirectory()) {
         return ZX_ERR_NOT_FILE;
     }
@@ -1230,6 +1669,22 @@ zx_status_t VnodeMinfs::ReadInternal(void* data, size_t len, size_t off, size_t*
 zx_status_t VnodeMinfs::Write(const void* data, size_t len, size_t offset,
                               size_t* out_actual) {
     TRACE_DURATION("minfs", "VnodeMinfs::Write", "ino", ino_, "len", len, "off", offset);
+#ifdef __Fuchsia__
+    fbl::AutoLock txn_lock(&fs_->txn_lock_);
+    zx_status_t status;
+    {
+        fbl::AutoLock lock(&lock_);
+        status = WriteLocked(data, len, offset, out_actual);
+    }
+    fs_->DelallocBalanceLocked();
+    return status;
+#else
+    return WriteLocked(data, len, offset, out_actual);
+#endif
+}
+
+zx_status_t VnodeMinfs::WriteLocked(const void* data, size_t len, size_t offset,
+                                    size_t* out_actual) {
     ZX_DEBUG_ASSERT_MSG(fd_count_ > 0, "Writing to ino with no fds open");
     xprintf("minfs_write() vn=%p(#%u) len=%zd off=%zd\n", this, ino_, len, offset);
     if (IsDirectory()) {
@@ -1255,9 +1710,22 @@ zx_status_t VnodeMinfs::Write(const void* data, size_t len, size_t offset,
 
 zx_status_t VnodeMinfs::Append(const void* data, size_t len, size_t* out_end,
                                size_t* out_actual) {
-    zx_status_t status = Write(data, len, inode_.size, out_actual);
+    TRACE_DURATION("minfs", "VnodeMinfs::Append", "ino", ino_, "len", len);
+#ifdef __Fuchsia__
+    fbl::AutoLock txn_lock(&fs_->txn_lock_);
+    zx_status_t status;
+    {
+        fbl::AutoLock lock(&lock_);
+        status = WriteLocked(data, len, inode_.size, out_actual);
+        *out_end = inode_.size;
+    }
+    fs_->DelallocBalanceLocked();
+    return status;
+#else
+    zx_status_t status = WriteLocked(data, len, inode_.size, out_actual);
     *out_end = inode_.size;
     return status;
+#endif
 }
 
 // Internal write. Usable on directories.
@@ -1303,13 +1771,24 @@ zx_status_t VnodeMinfs::WriteInternal(WriteTxn* txn, const void* data,
             goto done;
         }
 
-        // Update this block on-disk
-        blk_t bno;
-        if ((status = GetBno(txn, n, &bno)) != ZX_OK) {
+        // Update this block on-disk, unless allocating it may be delayed
+        // (in which case it is written back once it is allocated).
+        blk_t bno = 0;
+        if (!IsDirectory() && (status = GetBno(nullptr, n, &bno)) != ZX_OK) {
             goto done;
         }
-        ZX_DEBUG_ASSERT(bno != 0);
-        txn->Enqueue(vmo_.get(), n, bno + fs_->info_.dat_block, 1);
+        if ((bno != 0) || !DelayAllocationLocked(n)) {
+            if ((bno == 0) && (status = GetBno(txn, n, &bno)) != ZX_OK) {
+                goto done;
+            }
+            ZX_DEBUG_ASSERT(bno != 0);
+            // Directory contents are metadata, and are journaled.
+            if (IsDirectory()) {
+                txn->Enqueue(vmo_.get(), n, bno + fs_->info_.dat_block, 1);
+            } else {
+                txn->EnqueueData(vmo_.get(), n, bno + fs_->info_.dat_block, 1);
+            }
+        }
 #else
         blk_t bno;
         if ((status = GetBno(txn, n, &bno)) != ZX_OK) {
@@ -1364,6 +1843,13 @@ zx_status_t VnodeMinfs::Lookup(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece nam
         return ZX_ERR_NOT_SUPPORTED;
     }
 
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&lock_);
+#endif
+    if (IsUnlinked()) {
+        // The directory may have been purged.
+        return ZX_ERR_NOT_FOUND;
+    }
     return LookupInternal(out, name);
 }
 
@@ -1384,12 +1870,19 @@ zx_status_t VnodeMinfs::LookupInternal(fbl::RefPtr<fs::Vnode>* out, fbl::StringP
 
 zx_status_t VnodeMinfs::Getattr(vnattr_t* a) {
     xprintf("minfs_getattr() vn=%p(#%u)\n", this, ino_);
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&lock_);
+#endif
     a->mode = DTYPE_TO_VTYPE(MinfsMagicType(inode_.magic)) |
             V_IRUSR | V_IWUSR | V_IRGRP | V_IROTH;
     a->inode = ino_;
     a->size = inode_.size;
     a->blksize = kMinfsBlockSize;
+#ifdef __Fuchsia__
+    a->blkcount = (inode_.block_count + DelallocBlocks()) * (kMinfsBlockSize / VNATTR_BLKSIZE);
+#else
     a->blkcount = inode_.block_count * (kMinfsBlockSize / VNATTR_BLKSIZE);
+#endif
     a->nlink = inode_.link_count;
     a->create_time = inode_.create_time;
     a->modify_time = inode_.modify_time;
@@ -1402,6 +1895,10 @@ zx_status_t VnodeMinfs::Setattr(const vnattr_t* a) {
     if ((a->valid & ~(ATTR_CTIME|ATTR_MTIME)) != 0) {
         return ZX_ERR_NOT_SUPPORTED;
     }
+#ifdef __Fuchsia__
+    fbl::AutoLock txn_lock(&fs_->txn_lock_);
+    fbl::AutoLock lock(&lock_);
+#endif
     if ((a->valid & ATTR_CTIME) != 0) {
         inode_.create_time = a->create_time;
         dirty = 1;
@@ -1436,6 +1933,9 @@ static_assert(sizeof(dircookie_t) <= sizeof(fs::vdircookie_t),
 zx_status_t VnodeMinfs::Readdir(fs::vdircookie_t* cookie, void* dirents, size_t len,
                                 size_t* out_actual) {
     TRACE_DURATION("minfs", "VnodeMinfs::Readdir");
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&lock_);
+#endif
     xprintf("minfs_readdir() vn=%p(#%u) cookie=%p len=%zd\n", this, ino_, cookie, len);
     dircookie_t* dc = reinterpret_cast<dircookie_t*>(cookie);
     fs::DirentFiller df(dirents, len);
@@ -1528,6 +2028,9 @@ zx_status_t VnodeMinfs::Allocate(Minfs* fs, uint32_t type, fbl::RefPtr<VnodeMinf
     }
     memset(&(*out)->inode_, 0, sizeof((*out)->inode_));
     (*out)->inode_.magic = MinfsMagic(type);
+    if (type == kMinfsTypeFile) {
+        (*out)->inode_.flags = kMinfsInodeFlagExtents;
+    }
     (*out)->inode_.create_time = (*out)->inode_.modify_time = minfs_gettime_utc();
     (*out)->inode_.link_count = (type == kMinfsTypeDir ? 2 : 1);
     return ZX_OK;
@@ -1552,6 +2055,10 @@ zx_status_t VnodeMinfs::Create(fbl::RefPtr<fs::Vnode>* out, fbl::StringPiece nam
     if (!IsDirectory()) {
         return ZX_ERR_NOT_SUPPORTED;
     }
+#ifdef __Fuchsia__
+    fbl::AutoLock txn_lock(&fs_->txn_lock_);
+    fbl::AutoLock lock(&lock_);
+#endif
     if (IsUnlinked()) {
         return ZX_ERR_BAD_STATE;
     }
@@ -1619,6 +2126,9 @@ zx_status_t VnodeMinfs::Ioctl(uint32_t op, const void* in_buf, size_t in_len, vo
                 return ZX_ERR_INVALID_ARGS;
             }
 
+#ifdef __Fuchsia__
+            fbl::AutoLock txn_lock(&fs_->txn_lock_);
+#endif
             vfs_query_info_t* info = static_cast<vfs_query_info_t*>(out_buf);
             memset(info, 0, sizeof(*info));
             info->block_size = kMinfsBlockSize;
@@ -1681,6 +2191,10 @@ zx_status_t VnodeMinfs::Unlink(fbl::StringPiece name, bool must_be_dir) {
     if (!IsDirectory()) {
         return ZX_ERR_NOT_SUPPORTED;
     }
+#ifdef __Fuchsia__
+    fbl::AutoLock txn_lock(&fs_->txn_lock_);
+    fbl::AutoLock lock(&lock_);
+#endif
     fbl::AllocChecker ac;
     fbl::unique_ptr<WritebackWork> wb(new (&ac) WritebackWork(fs_->bc_.get()));
     if (!ac.check()) {
@@ -1703,6 +2217,10 @@ zx_status_t VnodeMinfs::Truncate(size_t len) {
     if (IsDirectory()) {
         return ZX_ERR_NOT_FILE;
     }
+#ifdef __Fuchsia__
+    fbl::AutoLock txn_lock(&fs_->txn_lock_);
+    fbl::AutoLock lock(&lock_);
+#endif
 
     fbl::AllocChecker ac;
     fbl::unique_ptr<WritebackWork> wb(new (&ac) WritebackWork(fs_->bc_.get()));
@@ -1741,6 +2259,9 @@ zx_status_t VnodeMinfs::TruncateInternal(WriteTxn* txn, size_t len) {
             if ((r = BlocksShrink(txn, start_bno)) < 0) {
                 return r;
             }
+#ifdef __Fuchsia__
+            DropDelayedLocked(start_bno);
+#endif
 
             if (start_bno * kMinfsBlockSize < inode_.size) {
                 inode_.size = start_bno * kMinfsBlockSize;
@@ -1754,7 +2275,12 @@ zx_status_t VnodeMinfs::TruncateInternal(WriteTxn* txn, size_t len) {
             if (GetBno(nullptr, rel_bno, &bno) != ZX_OK) {
                 return ZX_ERR_IO;
             }
-            if (bno != 0) {
+#ifdef __Fuchsia__
+            const bool delayed = (delalloc_start_ <= rel_bno) && (rel_bno < delalloc_end_);
+#else
+            const bool delayed = false;
+#endif
+            if (bno != 0 || delayed) {
                 size_t adjust = len % kMinfsBlockSize;
 #ifdef __Fuchsia__
                 if ((r = VmoReadExact(bdata, len - adjust, adjust)) != ZX_OK) {
@@ -1765,7 +2291,11 @@ zx_status_t VnodeMinfs::TruncateInternal(WriteTxn* txn, size_t len) {
                 if ((r = VmoWriteExact(bdata, len - adjust, kMinfsBlockSize)) != ZX_OK) {
                     return ZX_ERR_IO;
                 }
-                txn->Enqueue(vmo_.get(), rel_bno, bno + fs_->info_.dat_block, 1);
+                if (bno != 0 && IsDirectory()) {
+                    txn->Enqueue(vmo_.get(), rel_bno, bno + fs_->info_.dat_block, 1);
+                } else if (bno != 0) {
+                    txn->EnqueueData(vmo_.get(), rel_bno, bno + fs_->info_.dat_block, 1);
+                }
 #else
                 if (fs_->bc_->Readblk(bno + fs_->info_.dat_block, bdata)) {
                     return ZX_ERR_IO;
@@ -1808,7 +2338,13 @@ zx_status_t VnodeMinfs::CheckNotSubdirectory(fbl::RefPtr<VnodeMinfs> newdir) {
         }
 
         fbl::RefPtr<fs::Vnode> out = nullptr;
-        if ((status = vn->LookupInternal(&out, "..")) < 0) {
+        {
+#ifdef __Fuchsia__
+            fbl::AutoLock lock(&vn->lock_);
+#endif
+            status = vn->LookupInternal(&out, "..");
+        }
+        if (status < 0) {
             break;
         }
         vn = fbl::RefPtr<VnodeMinfs>::Downcast(out);
@@ -1828,12 +2364,21 @@ zx_status_t VnodeMinfs::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece
     if (!(IsDirectory() && newdir->IsDirectory()))
         return ZX_ERR_NOT_SUPPORTED;
 
+#ifdef __Fuchsia__
+    fbl::AutoLock txn_lock(&fs_->txn_lock_);
+#endif
     zx_status_t status;
     fbl::RefPtr<VnodeMinfs> oldvn = nullptr;
     // acquire the 'oldname' node (it must exist)
     DirArgs args = DirArgs();
     args.name = oldname;
-    if ((status = ForEachDirent(&args, DirentCallbackFind)) < 0) {
+    {
+#ifdef __Fuchsia__
+        fbl::AutoLock lock(&lock_);
+#endif
+        status = ForEachDirent(&args, DirentCallbackFind);
+    }
+    if (status < 0) {
         return status;
     } else if ((status = fs_->VnodeGet(&oldvn, args.ino)) < 0) {
         return status;
@@ -1841,6 +2386,26 @@ zx_status_t VnodeMinfs::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece
         return status;
     }
 
+    // Neither directory can be modified by anything else while txn_lock_ is
+    // held, but both must be locked against concurrent readers.
+#ifdef __Fuchsia__
+    fbl::AutoLock lock(&lock_);
+    if (newdir.get() != this) {
+        fbl::AutoLock newdir_lock(&newdir->lock_);
+        return RenameLocked(fbl::move(newdir), fbl::move(oldvn), oldname, newname,
+                            src_must_be_dir, dst_must_be_dir);
+    }
+#endif
+    return RenameLocked(fbl::move(newdir), fbl::move(oldvn), oldname, newname,
+                        src_must_be_dir, dst_must_be_dir);
+}
+
+zx_status_t VnodeMinfs::RenameLocked(fbl::RefPtr<VnodeMinfs> newdir,
+                                     fbl::RefPtr<VnodeMinfs> oldvn, fbl::StringPiece oldname,
+                                     fbl::StringPiece newname, bool src_must_be_dir,
+                                     bool dst_must_be_dir) {
+    zx_status_t status;
+
     // If either the 'src' or 'dst' must be directories, BOTH of them must be directories.
     if (!oldvn->IsDirectory() && (src_must_be_dir || dst_must_be_dir)) {
         return ZX_ERR_NOT_DIR;
@@ -1853,6 +2418,7 @@ zx_status_t VnodeMinfs::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece
     if (!ac.check()) {
         return ZX_ERR_NO_MEMORY;
     }
+    DirArgs args = DirArgs();
     args.wb = wb.get();
     args.name = newname;
     args.ino = oldvn->ino_;
@@ -1871,21 +2437,24 @@ zx_status_t VnodeMinfs::Rename(fbl::RefPtr<fs::Vnode> _newdir, fbl::StringPiece
     // update the oldvn's entry for '..' if (1) it was a directory, and (2) it
     // moved to a new directory
     if ((args.type == kMinfsTypeDir) && (ino_ != newdir->ino_)) {
-        fbl::RefPtr<fs::Vnode> vn_fs;
-        if ((status = newdir->Lookup(&vn_fs, newname)) < 0) {
-            return status;
-        }
-        auto vn = fbl::RefPtr<VnodeMinfs>::Downcast(vn_fs);
+#ifdef __Fuchsia__
+        fbl::AutoLock lock(&oldvn->lock_);
+#endif
         args.name = "..";
         args.ino = newdir->ino_;
-        if ((status = vn->ForEachDirent(&args, DirentCallbackUpdateInode)) < 0) {
+        if ((status = oldvn->ForEachDirent(&args, DirentCallbackUpdateInode)) < 0) {
             return status;
         }
     }
 
     // at this point, the oldvn exists with multiple names (or the same name in
     // different directories)
-    oldvn->inode_.link_count++;
+    {
+#ifdef __Fuchsia__
+        fbl::AutoLock lock(&oldvn->lock_);
+#endif
+        oldvn->inode_.link_count++;
+    }
 
     // finally, remove oldname from its original position
     args.name = oldname;
@@ -1902,7 +2471,12 @@ zx_status_t VnodeMinfs::Link(fbl::StringPiece name, fbl::RefPtr<fs::Vnode> _targ
 
     if (!IsDirectory()) {
         return ZX_ERR_NOT_SUPPORTED;
-    } else if (IsUnlinked()) {
+    }
+#ifdef __Fuchsia__
+    fbl::AutoLock txn_lock(&fs_->txn_lock_);
+    fbl::AutoLock lock(&lock_);
+#endif
+    if (IsUnlinked()) {
         return ZX_ERR_BAD_STATE;
     }
 
@@ -1912,6 +2486,11 @@ zx_status_t VnodeMinfs::Link(fbl::StringPiece name, fbl::RefPtr<fs::Vnode> _targ
         return ZX_ERR_NOT_FILE;
     }
 
+    if (target->IsUnlinked()) {
+        // The target was unlinked after it was looked up.
+        return ZX_ERR_NOT_FOUND;
+    }
+
     // The destination should not exist
     DirArgs args = DirArgs();
     args.name = name;
@@ -1934,8 +2513,13 @@ zx_status_t VnodeMinfs::Link(fbl::StringPiece name, fbl::RefPtr<fs::Vnode> _targ
     }
 
     // We have successfully added the vn to a new location. Increment the link count.
-    target->inode_.link_count++;
-    target->InodeSync(wb->txn(), kMxFsSyncDefault);
+    {
+#ifdef __Fuchsia__
+        fbl::AutoLock target_lock(&target->lock_);
+#endif
+        target->inode_.link_count++;
+        target->InodeSync(wb->txn(), kMxFsSyncDefault);
+    }
     wb->PinVnode(fbl::move(fbl::WrapRefPtr(this)));
     wb->PinVnode(target);
     fs_->EnqueueWork(fbl::move(wb));
@@ -1945,7 +2529,20 @@ zx_status_t VnodeMinfs::Link(fbl::StringPiece name, fbl::RefPtr<fs::Vnode> _targ
 #ifdef __Fuchsia__
 void VnodeMinfs::Sync(SyncCallback closure) {
     TRACE_DURATION("minfs", "VnodeMinfs::Sync");
-    fs_->Sync([this, cb = fbl::move(closure)](zx_status_t status) {
+    // Allocate the file's delayed blocks now, so that a failure to allocate
+    // them (now or earlier) is reported by this sync.
+    zx_status_t delalloc_status;
+    {
+        fbl::AutoLock txn_lock(&fs_->txn_lock_);
+        fbl::AutoLock lock(&lock_);
+        FlushDelayedLocked();
+        delalloc_status = delalloc_status_;
+        delalloc_status_ = ZX_OK;
+    }
+    fs_->Sync([this, delalloc_status, cb = fbl::move(closure)](zx_status_t status) {
+        if (status == ZX_OK) {
+            status = delalloc_status;
+        }
         if (status != ZX_OK) {
             cb(status);
             return;
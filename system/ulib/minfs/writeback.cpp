@@ -19,6 +19,7 @@
 #include <fs/block-txn.h>
 #include <fs/mapped-vmo.h>
 #include <fs/vfs.h>
+#include <lib/cksum.h>
 
 #include "minfs-private.h"
 #include <minfs/writeback.h>
@@ -29,9 +30,19 @@ namespace minfs {
 
 void WriteTxn::Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
                        uint64_t nblocks) {
+    EnqueueInternal(vmo, vmo_offset, dev_offset, nblocks, false);
+}
+
+void WriteTxn::EnqueueData(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                           uint64_t nblocks) {
+    EnqueueInternal(vmo, vmo_offset, dev_offset, nblocks, true);
+}
+
+void WriteTxn::EnqueueInternal(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset,
+                               uint64_t nblocks, bool data) {
     validate_vmo_size(vmo, static_cast<blk_t>(vmo_offset));
     for (size_t i = 0; i < count_; i++) {
-        if (requests_[i].vmo != vmo) {
+        if (requests_[i].vmo != vmo || data_[i] != data) {
             continue;
         }
 
@@ -55,6 +66,7 @@ void WriteTxn::Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset
     requests_[count_].vmo_offset = vmo_offset;
     requests_[count_].dev_offset = dev_offset;
     requests_[count_].length = nblocks;
+    data_[count_] = data;
     count_++;
 
     // "-1" so we can split a txn into two if we need to wrap around the log.
@@ -62,28 +74,40 @@ void WriteTxn::Enqueue(zx_handle_t vmo, uint64_t vmo_offset, uint64_t dev_offset
                   "Enqueueing too many messages for one operation");
 }
 
-zx_status_t WriteTxn::Flush(zx_handle_t vmo, vmoid_t vmoid) {
-    ZX_DEBUG_ASSERT(vmo != ZX_HANDLE_INVALID);
+namespace {
+
+// Sends |requests|, which are described in Minfs blocks relative to the
+// buffer |vmoid|, to disk on |txnid|.
+zx_status_t SendRequests(Bcache* bc, const write_request_t* requests, size_t count,
+                         vmoid_t vmoid, txnid_t txnid) {
     ZX_DEBUG_ASSERT(vmoid != VMOID_INVALID);
 
     // Update all the outgoing transactions to be in "disk blocks",
     // not "Minfs blocks".
     block_fifo_request_t blk_reqs[MAX_TXN_MESSAGES];
-    const uint32_t kDiskBlocksPerMinfsBlock = kMinfsBlockSize / bc_->BlockSize();
-    for (size_t i = 0; i < count_; i++) {
-        blk_reqs[i].txnid = bc_->TxnId();
+    const uint32_t kDiskBlocksPerMinfsBlock = kMinfsBlockSize / bc->BlockSize();
+    for (size_t i = 0; i < count; i++) {
+        blk_reqs[i].txnid = txnid;
         blk_reqs[i].vmoid = vmoid;
         blk_reqs[i].opcode = BLOCKIO_WRITE;
-        blk_reqs[i].vmo_offset = requests_[i].vmo_offset * kDiskBlocksPerMinfsBlock;
-        blk_reqs[i].dev_offset = requests_[i].dev_offset * kDiskBlocksPerMinfsBlock;
-        blk_reqs[i].length = requests_[i].length * kDiskBlocksPerMinfsBlock;
+        blk_reqs[i].vmo_offset = requests[i].vmo_offset * kDiskBlocksPerMinfsBlock;
+        blk_reqs[i].dev_offset = requests[i].dev_offset * kDiskBlocksPerMinfsBlock;
+        blk_reqs[i].length = requests[i].length * kDiskBlocksPerMinfsBlock;
     }
 
     // Actually send the operations to the underlying block device.
-    zx_status_t status = bc_->Txn(blk_reqs, count_);
+    return bc->TxnAsync(blk_reqs, count);
+}
+
+bool RequestsOverlap(const write_request_t& a, const write_request_t& b) {
+    return a.dev_offset < b.dev_offset + b.length && b.dev_offset < a.dev_offset + a.length;
+}
+
+} // namespace
 
-    count_ = 0;
-    return status;
+zx_status_t WriteTxn::Send(zx_handle_t vmo, vmoid_t vmoid, txnid_t txnid) {
+    ZX_DEBUG_ASSERT(vmo != ZX_HANDLE_INVALID);
+    return SendRequests(bc_, requests_, count_, vmoid, txnid);
 }
 
 size_t WriteTxn::BlkCount() const {
@@ -113,16 +137,22 @@ void WritebackWork::Reset() {
 }
 
 #ifdef __Fuchsia__
-// Returns the number of blocks of the writeback buffer that have been
-// consumed
-size_t WritebackWork::Complete(zx_handle_t vmo, vmoid_t vmoid) {
-    size_t blk_count = txn_.BlkCount();
-    zx_status_t status = txn_.Flush(vmo, vmoid);
+void WritebackWork::Commit(zx_status_t status) {
     if (closure_) {
         closure_(status);
+        closure_ = nullptr;
     }
+}
+
+void WritebackWork::Complete() {
+    txn_.Clear();
+    inplace_count_ = 0;
+    checkpoint_count_ = 0;
+    unjournaled_ = false;
+    untracked_ = false;
+    buffer_blocks_ = 0;
+    journal_blocks_ = 0;
     Reset();
-    return blk_count;
 }
 
 void WritebackWork::SetClosure(SyncCallback closure) {
@@ -152,8 +182,9 @@ void WritebackWork::PinVnode(fbl::RefPtr<VnodeMinfs> vn) {
 #ifdef __Fuchsia__
 
 zx_status_t WritebackBuffer::Create(Bcache* bc, fbl::unique_ptr<MappedVmo> buffer,
+                                    const minfs_info_t* info,
                                     fbl::unique_ptr<WritebackBuffer>* out) {
-    fbl::unique_ptr<WritebackBuffer> wb(new WritebackBuffer(bc, fbl::move(buffer)));
+    fbl::unique_ptr<WritebackBuffer> wb(new WritebackBuffer(bc, fbl::move(buffer), info));
     if (wb->buffer_->GetSize() % kMinfsBlockSize != 0) {
         return ZX_ERR_INVALID_ARGS;
     } else if (cnd_init(&wb->consumer_cvar_) != thrd_success) {
@@ -170,13 +201,52 @@ zx_status_t WritebackBuffer::Create(Bcache* bc, fbl::unique_ptr<MappedVmo> buffe
         return status;
     }
 
+    // Since the journal has been replayed, new entries are written from its
+    // recorded start.
+    if ((status = MappedVmo::Create(kMinfsBlockSize, "minfs-journal-info",
+                                    &wb->journal_info_)) != ZX_OK) {
+        return status;
+    } else if ((status = wb->bc_->Readblk(wb->journal_block_,
+                                          wb->journal_info_->GetData())) != ZX_OK) {
+        FS_TRACE_ERROR("minfs: could not read journal info\n");
+        return status;
+    }
+    const minfs_journal_info_t* jinfo =
+        static_cast<const minfs_journal_info_t*>(wb->journal_info_->GetData());
+    if ((jinfo->magic != kMinfsJournalMagic) || (jinfo->start >= wb->journal_cap_)) {
+        FS_TRACE_ERROR("minfs: bad journal info\n");
+        return ZX_ERR_IO_DATA_INTEGRITY;
+    }
+    wb->checkpoint_seq_ = jinfo->seq;
+    {
+        fbl::AutoLock lock(&wb->writeback_lock_);
+        wb->journal_start_ = jinfo->start;
+        wb->journal_seq_ = jinfo->seq;
+    }
+    status = wb->bc_->AttachVmo(wb->journal_info_->GetVmo(), &wb->journal_info_vmoid_);
+    if (status != ZX_OK) {
+        return status;
+    }
+
+    // Allocate a txnid for each unit of work we may keep in flight. Fewer are
+    // acceptable (at the cost of concurrency), but at least one is required.
+    while (wb->txnid_count_ < kWritebackMaxInflight &&
+           wb->bc_->AllocTxnId(&wb->txnids_[wb->txnid_count_]) == ZX_OK) {
+        wb->txnid_count_++;
+    }
+    if (wb->txnid_count_ == 0) {
+        return ZX_ERR_NO_RESOURCES;
+    }
+
     *out = fbl::move(wb);
     return ZX_OK;
 }
 
-WritebackBuffer::WritebackBuffer(Bcache* bc, fbl::unique_ptr<MappedVmo> buffer) :
+WritebackBuffer::WritebackBuffer(Bcache* bc, fbl::unique_ptr<MappedVmo> buffer,
+                                 const minfs_info_t* info) :
     bc_(bc), unmounting_(false), buffer_(fbl::move(buffer)),
-    cap_(buffer_->GetSize() / kMinfsBlockSize) {}
+    journal_block_(info->jnl_block), journal_cap_(info->jnl_block_count - 1),
+    data_block_(info->dat_block), cap_(buffer_->GetSize() / kMinfsBlockSize) {}
 
 WritebackBuffer::~WritebackBuffer() {
     // Block until the background thread completes itself.
@@ -187,108 +257,220 @@ WritebackBuffer::~WritebackBuffer() {
     }
     int r;
     thrd_join(writeback_thrd_, &r);
+    ZX_DEBUG_ASSERT(inflight_count_ == 0);
+    ZX_DEBUG_ASSERT(checkpoint_queue_.is_empty());
+    for (size_t i = 0; i < txnid_count_; i++) {
+        bc_->FreeTxnId(txnids_[i]);
+    }
 
-    if (buffer_vmoid_ != VMOID_INVALID) {
-        block_fifo_request_t request;
-        request.txnid = bc_->TxnId();
-        request.vmoid = buffer_vmoid_;
-        request.opcode = BLOCKIO_CLOSE_VMO;
-        bc_->Txn(&request, 1);
+    const vmoid_t vmoids[] = {buffer_vmoid_, journal_info_vmoid_};
+    for (vmoid_t vmoid : vmoids) {
+        if (vmoid != VMOID_INVALID) {
+            block_fifo_request_t request;
+            request.txnid = bc_->TxnId();
+            request.vmoid = vmoid;
+            request.opcode = BLOCKIO_CLOSE_VMO;
+            bc_->Txn(&request, 1);
+        }
     }
 }
 
-zx_status_t WritebackBuffer::EnsureSpaceLocked(size_t blocks) {
-    if (blocks > cap_) {
+zx_status_t WritebackBuffer::EnsureSpaceLocked(size_t blocks, size_t journal_blocks) {
+    if (blocks > cap_ || journal_blocks > journal_cap_) {
         // There will never be enough room in the writeback buffer
         // for this request.
         return ZX_ERR_NO_RESOURCES;
     }
-    while (len_ + blocks > cap_) {
+    while (len_ + blocks > cap_ || journal_len_ + journal_blocks > journal_cap_) {
         // Not enough room to write back work, yet. Wait until
         // room is available.
         Waiter w;
         producer_queue_.push(&w);
+        // Space is only released by checkpoints, which are hurried along by
+        // waiting producers.
+        cnd_signal(&consumer_cvar_);
 
         do {
             cnd_wait(&producer_cvar_, writeback_lock_.GetInternal());
         } while ((&producer_queue_.front() != &w) && // We are first in line to enqueue...
-                 (len_ + blocks > cap_)); // ... and there is enough space for us.
+                 (len_ + blocks > cap_ || // ... and there is enough space for us.
+                  journal_len_ + journal_blocks > journal_cap_));
 
         producer_queue_.pop();
     }
     return ZX_OK;
 }
 
-void WritebackBuffer::CopyToBufferLocked(WriteTxn* txn) {
-    size_t req_count = txn->Count();
-    write_request_t* reqs = txn->Requests();
-    // Write back to the buffer
-    for (size_t i = 0; i < req_count; i++) {
-        size_t vmo_offset = reqs[i].vmo_offset;
-        size_t dev_offset = reqs[i].dev_offset;
-        const size_t vmo_len = reqs[i].length;
-        ZX_DEBUG_ASSERT(vmo_len > 0);
-        size_t wb_offset = (start_ + len_) % cap_;
-        size_t wb_len = (wb_offset + vmo_len > cap_) ? cap_ - wb_offset : vmo_len;
-        ZX_DEBUG_ASSERT(wb_len <= vmo_len);
-        ZX_DEBUG_ASSERT(wb_offset < cap_);
-        zx_handle_t vmo = reqs[i].vmo;
+size_t WritebackBuffer::JournalEntryBlocks(const WriteTxn& txn) const {
+    size_t blocks = 0;
+    for (size_t i = 0; i < txn.Count(); i++) {
+        if (!txn.IsData(i)) {
+            blocks += txn.Requests()[i].length;
+        }
+    }
+    // Entries must fit within the log, and leave room for others in the
+    // writeback buffer.
+    const size_t max_blocks = fbl::min(fbl::min(static_cast<size_t>(kMinfsJournalEntryMaxBlocks),
+                                                journal_cap_ - 2), cap_ / 4);
+    if (blocks == 0 || blocks > max_blocks) {
+        return 0;
+    }
+    return blocks + 2;
+}
+
+void WritebackBuffer::CopyRequestLocked(const write_request_t& request, write_request_t* out,
+                                        size_t* count) {
+    size_t vmo_offset = request.vmo_offset;
+    size_t dev_offset = request.dev_offset;
+    size_t remaining = request.length;
+    ZX_DEBUG_ASSERT(remaining > 0);
+    while (remaining > 0) {
+        // If the request wraps around the end of the buffer, it is written
+        // as two requests.
+        const size_t wb_offset = (start_ + len_) % cap_;
+        const size_t wb_len = fbl::min(remaining, cap_ - wb_offset);
+        ZX_DEBUG_ASSERT(len_ + wb_len <= cap_);
+        ZX_DEBUG_ASSERT(*count < MAX_TXN_MESSAGES);
 
         void* ptr = (void*)((uintptr_t)(buffer_->GetData()) +
                             (uintptr_t)(wb_offset * kMinfsBlockSize));
         size_t actual;
         zx_status_t status;
-        ZX_DEBUG_ASSERT((start_ <= wb_offset) ?
-                        (start_ < wb_offset + wb_len) :
-                        (wb_offset + wb_len <= start_)); // Wraparound
-        ZX_ASSERT_MSG((status = zx_vmo_read(vmo, ptr, vmo_offset * kMinfsBlockSize,
+        ZX_ASSERT_MSG((status = zx_vmo_read(request.vmo, ptr, vmo_offset * kMinfsBlockSize,
                       wb_len * kMinfsBlockSize, &actual)) == ZX_OK, "VMO Read Fail: %d", status);
         ZX_ASSERT_MSG(actual == wb_len * kMinfsBlockSize, "Only read %" PRIu64 " of %" PRIu64,
                       actual, wb_len * kMinfsBlockSize);
         len_ += wb_len;
 
-        // Update the write_request to transfer from the writeback buffer
-        // out to disk, rather than the supplied VMO
-        reqs[i].vmo_offset = wb_offset;
-        reqs[i].length = wb_len;
+        // Transfer from the writeback buffer out to disk, rather than the
+        // supplied VMO.
+        out[*count].vmo = buffer_->GetVmo();
+        out[*count].vmo_offset = wb_offset;
+        out[*count].dev_offset = dev_offset;
+        out[*count].length = wb_len;
+        (*count)++;
+
+        vmo_offset += wb_len;
+        dev_offset += wb_len;
+        remaining -= wb_len;
+    }
+}
+
+void WritebackBuffer::CopyJournalEntryLocked(WritebackWork* work, size_t entry_blocks,
+                                             write_request_t* out, size_t* count) {
+    const WriteTxn& txn = work->txn_;
 
-        if (wb_len != vmo_len) {
-            // We wrapped around; write what remains from this request
-            vmo_offset += wb_len;
-            dev_offset += wb_len;
-            wb_len = vmo_len - wb_len;
-            ptr = buffer_->GetData();
-            ZX_DEBUG_ASSERT((start_ == 0) ?  (start_ < wb_len) : (wb_len <= start_)); // Wraparound
-            ZX_ASSERT(zx_vmo_read(vmo, ptr, vmo_offset * kMinfsBlockSize,
-                                  wb_len * kMinfsBlockSize, &actual) == ZX_OK);
-            ZX_ASSERT_MSG(actual == wb_len * kMinfsBlockSize, "Only read %"
-                          PRIu64 " of %" PRIu64, actual, wb_len * kMinfsBlockSize);
-            len_ += wb_len;
+    // The entry is kept contiguous within the buffer, so each run of
+    // journaled blocks may later be written in place with a single request.
+    size_t wb_offset = (start_ + len_) % cap_;
+    if (wb_offset + entry_blocks > cap_) {
+        len_ += cap_ - wb_offset;
+        wb_offset = 0;
+    }
+    ZX_DEBUG_ASSERT(len_ + entry_blocks <= cap_);
+    uint8_t* entry = static_cast<uint8_t*>(buffer_->GetData()) + wb_offset * kMinfsBlockSize;
+
+    minfs_journal_entry_t* header = reinterpret_cast<minfs_journal_entry_t*>(entry);
+    memset(header, 0, kMinfsBlockSize);
+    header->magic = kMinfsJournalEntryMagic;
+    header->seq = journal_seq_;
+    header->block_count = static_cast<uint32_t>(entry_blocks - 2);
+
+    size_t blocks = 0;
+    work->checkpoint_count_ = 0;
+    for (size_t i = 0; i < txn.Count(); i++) {
+        if (txn.IsData(i)) {
+            continue;
+        }
+        const write_request_t& request = txn.Requests()[i];
+        size_t actual;
+        zx_status_t status;
+        ZX_ASSERT_MSG((status = zx_vmo_read(request.vmo, entry + (1 + blocks) * kMinfsBlockSize,
+                                            request.vmo_offset * kMinfsBlockSize,
+                                            request.length * kMinfsBlockSize,
+                                            &actual)) == ZX_OK, "VMO Read Fail: %d", status);
+        ZX_ASSERT_MSG(actual == request.length * kMinfsBlockSize,
+                      "Only read %" PRIu64 " of %" PRIu64, actual,
+                      request.length * kMinfsBlockSize);
+        for (size_t j = 0; j < request.length; j++) {
+            header->target[blocks + j] = static_cast<blk_t>(request.dev_offset + j);
+        }
 
-            // Shift down all following write requests
-            static_assert(fbl::is_pod<write_request_t>::value, "Can't memmove non-POD");
-            req_count++;
-            i++;
-            memmove(&reqs[i + 1], &reqs[i], sizeof(write_request_t) * (req_count - i));
+        write_request_t* checkpoint = &work->checkpoint_[work->checkpoint_count_++];
+        checkpoint->vmo = buffer_->GetVmo();
+        checkpoint->vmo_offset = wb_offset + 1 + blocks;
+        checkpoint->dev_offset = request.dev_offset;
+        checkpoint->length = request.length;
+        blocks += request.length;
+    }
+    ZX_DEBUG_ASSERT(blocks + 2 == entry_blocks);
+
+    minfs_journal_commit_t* commit =
+        reinterpret_cast<minfs_journal_commit_t*>(entry + (1 + blocks) * kMinfsBlockSize);
+    memset(commit, 0, kMinfsBlockSize);
+    commit->magic = kMinfsJournalCommitMagic;
+    commit->seq = journal_seq_;
+    commit->checksum = crc32(0, entry, (1 + blocks) * kMinfsBlockSize);
+    len_ += entry_blocks;
+
+    // Write the entry to the log, wrapping around its end if necessary.
+    const size_t log_offset = (journal_start_ + journal_len_) % journal_cap_;
+    const size_t log_len = fbl::min(entry_blocks, journal_cap_ - log_offset);
+    ZX_DEBUG_ASSERT(*count + 2 <= MAX_TXN_MESSAGES);
+    out[*count].vmo = buffer_->GetVmo();
+    out[*count].vmo_offset = wb_offset;
+    out[*count].dev_offset = journal_block_ + 1 + log_offset;
+    out[*count].length = log_len;
+    (*count)++;
+    if (log_len < entry_blocks) {
+        out[*count].vmo = buffer_->GetVmo();
+        out[*count].vmo_offset = wb_offset + log_len;
+        out[*count].dev_offset = journal_block_ + 1;
+        out[*count].length = entry_blocks - log_len;
+        (*count)++;
+    }
+    journal_len_ += entry_blocks;
+    journal_seq_++;
+}
 
-            // Insert the "new" request, which is the latter half of
-            // the request we wrote out earlier
-            reqs[i].dev_offset = dev_offset;
-            reqs[i].vmo_offset = 0;
-            reqs[i].length = wb_len;
-            txn->count_++;
+void WritebackBuffer::CopyToBufferLocked(WritebackWork* work, size_t entry_blocks) {
+    WriteTxn* txn = &work->txn_;
+    write_request_t requests[MAX_TXN_MESSAGES];
+    size_t count = 0;
+    const size_t len = len_;
+
+    // Blocks written in place come first, followed by the journal entry.
+    bool metadata = false;
+    for (size_t i = 0; i < txn->Count(); i++) {
+        metadata |= !txn->IsData(i);
+        if (txn->IsData(i) || entry_blocks == 0) {
+            CopyRequestLocked(txn->Requests()[i], requests, &count);
         }
     }
+    work->inplace_count_ = count;
+    work->unjournaled_ = metadata && (entry_blocks == 0);
+    if (entry_blocks > 0) {
+        CopyJournalEntryLocked(work, entry_blocks, requests, &count);
+    }
+
+    static_assert(fbl::is_pod<write_request_t>::value, "Can't memcpy non-POD");
+    memcpy(txn->requests_, requests, count * sizeof(write_request_t));
+    txn->count_ = count;
+    work->buffer_blocks_ = len_ - len;
+    work->journal_blocks_ = entry_blocks;
 }
 
 void WritebackBuffer::Enqueue(fbl::unique_ptr<WritebackWork> work) {
     TRACE_DURATION("minfs", "WritebackBuffer::Enqueue");
     TRACE_FLOW_BEGIN("minfs", "writeback", reinterpret_cast<trace_flow_id_t>(work.get()));
     fbl::AutoLock lock(&writeback_lock_);
+    const size_t entry_blocks = JournalEntryBlocks(*work->txn());
 
     {
         TRACE_DURATION("minfs", "Allocating Writeback space");
-        size_t blocks = work->txn()->BlkCount();
+        // The journal entry is kept contiguous, so up to an entry's worth of
+        // blocks may be skipped at the end of the buffer.
+        size_t blocks = work->txn()->BlkCount() + 2 * entry_blocks;
         // TODO(smklein): Experimentally, all filesystem operations cause between
         // 0 and 10 blocks to be updated, though the writeback buffer has space
         // for thousands of blocks.
@@ -302,49 +484,495 @@ void WritebackBuffer::Enqueue(fbl::unique_ptr<WritebackWork> work) {
         // extremely large operations, or (2) the worst-case operation should be
         // calculated, and it should be proven that it will always fit within
         // the allocated writeback buffer.
-        ZX_ASSERT_MSG(EnsureSpaceLocked(blocks) == ZX_OK,
+        ZX_ASSERT_MSG(EnsureSpaceLocked(blocks, entry_blocks) == ZX_OK,
                       "Requested txn (%zu blocks) larger than writeback buffer", blocks);
     }
 
     {
         TRACE_DURATION("minfs", "Copying to Writeback buffer");
-        CopyToBufferLocked(work->txn());
+        CopyToBufferLocked(work.get(), entry_blocks);
     }
 
+    if (work_queue_.is_empty()) {
+        queued_since_ = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    }
+    if (work->HasClosure()) {
+        queued_closures_++;
+    }
+    queued_requests_ += work->txn()->Count();
     work_queue_.push(fbl::move(work));
     cnd_signal(&consumer_cvar_);
 }
 
+void WritebackBuffer::SetCommitWindow(zx_duration_t window) {
+    fbl::AutoLock lock(&writeback_lock_);
+    commit_window_ = window;
+    cnd_signal(&consumer_cvar_);
+}
+
+bool WritebackBuffer::Batch::Merge(const write_request_t* reqs, size_t req_count) {
+    write_request_t merged[MAX_TXN_MESSAGES];
+    memcpy(merged, requests, count * sizeof(write_request_t));
+    size_t merged_count = count;
+
+    for (size_t i = 0; i < req_count; i++) {
+        const write_request_t& req = reqs[i];
+        size_t j = 0;
+        while (j < merged_count) {
+            if (!RequestsOverlap(merged[j], req)) {
+                j++;
+            } else if (req.dev_offset <= merged[j].dev_offset &&
+                       merged[j].dev_offset + merged[j].length <= req.dev_offset + req.length) {
+                // Every block of the earlier request is rewritten.
+                merged[j] = merged[--merged_count];
+            } else {
+                return false;
+            }
+        }
+
+        bool combined = false;
+        for (j = 0; j < merged_count; j++) {
+            if ((merged[j].vmo_offset + merged[j].length == req.vmo_offset) &&
+                (merged[j].dev_offset + merged[j].length == req.dev_offset)) {
+                merged[j].length += req.length;
+                combined = true;
+                break;
+            }
+        }
+        if (!combined) {
+            if (merged_count == MAX_TXN_MESSAGES) {
+                return false;
+            }
+            merged[merged_count++] = req;
+        }
+    }
+
+    memcpy(requests, merged, merged_count * sizeof(write_request_t));
+    count = merged_count;
+    return true;
+}
+
+bool WritebackBuffer::Batch::Overlaps(const Batch& other) const {
+    for (size_t i = 0; i < count; i++) {
+        for (size_t j = 0; j < other.count; j++) {
+            if (RequestsOverlap(requests[i], other.requests[j])) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+bool WritebackBuffer::CommitReadyLocked() const {
+    if (unmounting_ || queued_closures_ > 0 || !producer_queue_.is_empty()) {
+        return true;
+    } else if (queued_requests_ >= MAX_TXN_MESSAGES) {
+        // More work cannot be merged into a single transaction.
+        return true;
+    }
+    return zx_clock_get(ZX_CLOCK_MONOTONIC) >= queued_since_ + commit_window_;
+}
+
+bool WritebackBuffer::CheckpointReadyLocked() const {
+    if (unmounting_) {
+        return true;
+    } else if (checkpoint_status_ != ZX_OK) {
+        // The last checkpoint failed; wait before trying again, even if
+        // producers are waiting for space.
+        return zx_clock_get(ZX_CLOCK_MONOTONIC) >= checkpoint_since_ + kWritebackCheckpointDelay;
+    } else if (!producer_queue_.is_empty()) {
+        return true;
+    } else if (checkpoint_blocks_ >= cap_ / 2 || journal_len_ >= journal_cap_ / 2) {
+        // Checkpoint before the buffer or the journal fills, so producers
+        // rarely need to wait for space.
+        return true;
+    }
+    return zx_clock_get(ZX_CLOCK_MONOTONIC) >= checkpoint_since_ + kWritebackCheckpointDelay;
+}
+
+bool WritebackBuffer::PendingOverlaps(const WritebackWork& work, const Batch& batch) const {
+    if (work.unjournaled_) {
+        // Metadata written in place must not be overwritten later by an older
+        // journaled copy.
+        return !batch.works.is_empty() || inflight_count_ > 0 || !checkpoint_queue_.is_empty();
+    }
+    const write_request_t* requests = work.txn_.Requests();
+    for (size_t i = 0; i < work.inplace_count_; i++) {
+        if (pending_untracked_ > 0) {
+            return true;
+        }
+        const write_request_t& request = requests[i];
+        for (size_t bno = request.dev_offset; bno < request.dev_offset + request.length; bno++) {
+            if (pending_blocks_.is_empty()) {
+                return false;
+            } else if ((bno >= data_block_) &&
+                       pending_blocks_.find(static_cast<blk_t>(bno)).IsValid()) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void WritebackBuffer::AddPending(WritebackWork* work) {
+    // Allocate every block up front, so the blocks of |work| are either all
+    // tracked, or not at all.
+    fbl::SinglyLinkedList<fbl::unique_ptr<PendingBlock>> spare;
+    for (size_t i = 0; i < work->checkpoint_count_; i++) {
+        const write_request_t& request = work->checkpoint_[i];
+        for (size_t bno = request.dev_offset; bno < request.dev_offset + request.length; bno++) {
+            if ((bno < data_block_) || pending_blocks_.find(static_cast<blk_t>(bno)).IsValid()) {
+                continue;
+            }
+            fbl::AllocChecker ac;
+            fbl::unique_ptr<PendingBlock> block(new (&ac) PendingBlock());
+            if (!ac.check()) {
+                work->untracked_ = true;
+                pending_untracked_++;
+                return;
+            }
+            spare.push_front(fbl::move(block));
+        }
+    }
+
+    for (size_t i = 0; i < work->checkpoint_count_; i++) {
+        const write_request_t& request = work->checkpoint_[i];
+        for (size_t bno = request.dev_offset; bno < request.dev_offset + request.length; bno++) {
+            if (bno < data_block_) {
+                continue;
+            }
+            auto iter = pending_blocks_.find(static_cast<blk_t>(bno));
+            if (iter.IsValid()) {
+                iter->refs++;
+                continue;
+            }
+            fbl::unique_ptr<PendingBlock> block = spare.pop_front();
+            block->bno = static_cast<blk_t>(bno);
+            block->refs = 1;
+            pending_blocks_.insert(fbl::move(block));
+        }
+    }
+}
+
+void WritebackBuffer::RemovePending(const WritebackWork& work) {
+    if (work.untracked_) {
+        pending_untracked_--;
+        return;
+    }
+    for (size_t i = 0; i < work.checkpoint_count_; i++) {
+        const write_request_t& request = work.checkpoint_[i];
+        for (size_t bno = request.dev_offset; bno < request.dev_offset + request.length; bno++) {
+            if (bno < data_block_) {
+                continue;
+            }
+            auto iter = pending_blocks_.find(static_cast<blk_t>(bno));
+            ZX_DEBUG_ASSERT(iter.IsValid());
+            if (--iter->refs == 0) {
+                pending_blocks_.erase(iter);
+            }
+        }
+    }
+}
+
+void WritebackBuffer::FillBatchLocked(Batch* batch) {
+    ZX_DEBUG_ASSERT(batch->works.is_empty());
+    while (!work_queue_.is_empty()) {
+        WritebackWork* work = &work_queue_.front();
+        const bool conflict = PendingOverlaps(*work, *batch);
+        if (conflict && !batch->works.is_empty()) {
+            // The pending blocks must be written in place before |work| may
+            // write them itself.
+            break;
+        }
+        if (!batch->Merge(work->txn()->Requests(), work->txn()->Count())) {
+            if (!batch->works.is_empty()) {
+                break;
+            }
+            // The first unit of work is sent as it was enqueued.
+            batch->count = work->txn()->Count();
+            memcpy(batch->requests, work->txn()->Requests(),
+                   batch->count * sizeof(write_request_t));
+        }
+        if (conflict) {
+            batch->checkpoint_first = true;
+        }
+        AddPending(work);
+        if (work->HasClosure()) {
+            queued_closures_--;
+        }
+        queued_requests_ -= work->txn()->Count();
+        batch->works.push(work_queue_.pop());
+    }
+}
+
+void WritebackBuffer::Issue(Batch* batch) {
+    zx_status_t status = ZX_OK;
+    if (batch->checkpoint_first) {
+        // |batch| writes blocks in place which older work has journaled, but
+        // not yet written in place. If they cannot be, |batch| is not sent,
+        // since replaying the older entries would overwrite it.
+        while (inflight_count_ > 0) {
+            RetireOldest();
+        }
+        status = Checkpoint();
+        batch->checkpoint_first = false;
+    }
+
+    // Writes to the same blocks must reach the disk in the order they were
+    // enqueued, but the device may complete concurrent requests in any order.
+    // Retire everything up to (and including) the newest in-flight batch
+    // which overlaps with |batch|.
+    size_t retire = 0;
+    for (size_t i = 0; i < inflight_count_; i++) {
+        const Inflight& pending = inflight_[(inflight_start_ + i) % txnid_count_];
+        if (pending.batch.Overlaps(*batch)) {
+            retire = i + 1;
+        }
+    }
+    while (retire-- > 0) {
+        RetireOldest();
+    }
+    if (inflight_count_ == txnid_count_) {
+        RetireOldest();
+    }
+
+    size_t slot = (inflight_start_ + inflight_count_) % txnid_count_;
+    Inflight* inflight = &inflight_[slot];
+    inflight->status = status;
+    if (status == ZX_OK && batch->count > 0) {
+        inflight->status = SendRequests(bc_, batch->requests, batch->count, buffer_vmoid_,
+                                        txnids_[slot]);
+    }
+    ZX_DEBUG_ASSERT(inflight->batch.works.is_empty());
+    while (!batch->works.is_empty()) {
+        inflight->batch.works.push(batch->works.pop());
+    }
+    memcpy(inflight->batch.requests, batch->requests, batch->count * sizeof(write_request_t));
+    inflight->batch.count = batch->count;
+    batch->count = 0;
+    inflight_count_++;
+}
+
+void WritebackBuffer::RetireOldest() {
+    ZX_DEBUG_ASSERT(inflight_count_ > 0);
+    Inflight* oldest = &inflight_[inflight_start_];
+    zx_status_t status = oldest->status;
+    if (status == ZX_OK && oldest->batch.count > 0) {
+        status = bc_->TxnWait(txnids_[inflight_start_]);
+    }
+    while (!oldest->batch.works.is_empty()) {
+        fbl::unique_ptr<WritebackWork> work = oldest->batch.works.pop();
+        work->Commit(status);
+        TRACE_FLOW_END("minfs", "writeback", reinterpret_cast<trace_flow_id_t>(work.get()));
+
+        // The work keeps its space in the writeback buffer until its
+        // journaled blocks have been written in place.
+        if (checkpoint_queue_.is_empty()) {
+            checkpoint_since_ = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        }
+        checkpoint_blocks_ += work->buffer_blocks_;
+        checkpoint_queue_.push(fbl::move(work));
+    }
+    oldest->batch.count = 0;
+    inflight_start_ = (inflight_start_ + 1) % txnid_count_;
+    inflight_count_--;
+}
+
+zx_status_t WritebackBuffer::WriteSync(const write_request_t* requests, size_t count,
+                                       vmoid_t vmoid) {
+    ZX_DEBUG_ASSERT(inflight_count_ == 0);
+    if (count == 0) {
+        return ZX_OK;
+    }
+    const txnid_t txnid = txnids_[inflight_start_];
+    zx_status_t status = SendRequests(bc_, requests, count, vmoid, txnid);
+    if (status != ZX_OK) {
+        return status;
+    }
+    return bc_->TxnWait(txnid);
+}
+
+zx_status_t WritebackBuffer::FlushSync() {
+    ZX_DEBUG_ASSERT(inflight_count_ == 0);
+    block_fifo_request_t request;
+    request.txnid = txnids_[inflight_start_];
+    request.vmoid = VMOID_INVALID;
+    request.opcode = BLOCKIO_SYNC;
+    request.length = 0;
+    request.vmo_offset = 0;
+    request.dev_offset = 0;
+    zx_status_t status = bc_->TxnAsync(&request, 1);
+    if (status != ZX_OK) {
+        return status;
+    }
+    return bc_->TxnWait(request.txnid);
+}
+
+zx_status_t WritebackBuffer::Checkpoint() {
+    TRACE_DURATION("minfs", "WritebackBuffer::Checkpoint");
+    ZX_DEBUG_ASSERT(inflight_count_ == 0);
+
+    Queue<fbl::unique_ptr<WritebackWork>> pending;
+    size_t entries = 0;
+    size_t journal_blocks = 0;
+    while (!checkpoint_queue_.is_empty()) {
+        fbl::unique_ptr<WritebackWork> work = checkpoint_queue_.pop();
+        if (work->journal_blocks_ > 0) {
+            entries++;
+        }
+        journal_blocks += work->journal_blocks_;
+        pending.push(fbl::move(work));
+    }
+
+    // The journal entries must be durable before any of their blocks are
+    // written in place, or a crash could leave metadata half updated with
+    // no entry to replay.
+    zx_status_t status = (entries > 0) ? FlushSync() : ZX_OK;
+
+    // Write the journaled blocks in place, in the order they were committed.
+    // Blocks which were rewritten by later work are only written once.
+    Queue<fbl::unique_ptr<WritebackWork>> done;
+    Batch batch;
+    while (!pending.is_empty()) {
+        fbl::unique_ptr<WritebackWork> work = pending.pop();
+        if (status == ZX_OK && !batch.Merge(work->checkpoint_, work->checkpoint_count_)) {
+            status = WriteSync(batch.requests, batch.count, buffer_vmoid_);
+            batch.count = 0;
+            if (!batch.Merge(work->checkpoint_, work->checkpoint_count_)) {
+                batch.count = work->checkpoint_count_;
+                memcpy(batch.requests, work->checkpoint_,
+                       batch.count * sizeof(write_request_t));
+            }
+        }
+        done.push(fbl::move(work));
+    }
+    if (status == ZX_OK) {
+        status = WriteSync(batch.requests, batch.count, buffer_vmoid_);
+    }
+
+    // Once their blocks are durably in place, the entries need not be
+    // replayed.
+    if (status == ZX_OK && entries > 0) {
+        status = FlushSync();
+    }
+    if (status == ZX_OK && entries > 0) {
+        size_t journal_start;
+        {
+            fbl::AutoLock lock(&writeback_lock_);
+            journal_start = journal_start_;
+        }
+        minfs_journal_info_t* jinfo = static_cast<minfs_journal_info_t*>(journal_info_->GetData());
+        jinfo->start = static_cast<uint32_t>((journal_start + journal_blocks) % journal_cap_);
+        jinfo->seq = checkpoint_seq_ + entries;
+        write_request_t request;
+        request.vmo = journal_info_->GetVmo();
+        request.vmo_offset = 0;
+        request.dev_offset = journal_block_;
+        request.length = 1;
+        status = WriteSync(&request, 1, journal_info_vmoid_);
+    }
+
+    checkpoint_status_ = status;
+    if (status != ZX_OK) {
+        FS_TRACE_ERROR("minfs: failed to checkpoint journal: %d\n", status);
+        checkpoint_since_ = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        bool unmounting;
+        {
+            fbl::AutoLock lock(&writeback_lock_);
+            unmounting = unmounting_;
+        }
+        if (!unmounting) {
+            // The entries may still be replayed, so they keep their space in
+            // the buffer and the journal until a later checkpoint succeeds.
+            while (!done.is_empty()) {
+                checkpoint_queue_.push(done.pop());
+            }
+            return status;
+        }
+        // The journal info still points at the entries, so they are replayed
+        // when the filesystem is next mounted.
+        checkpoint_blocks_ = 0;
+        while (!done.is_empty()) {
+            fbl::unique_ptr<WritebackWork> work = done.pop();
+            RemovePending(*work);
+            work->Complete();
+        }
+        return status;
+    }
+    checkpoint_seq_ += entries;
+
+    // Work is checkpointed in the order it was enqueued, so the space it
+    // consumed is always at the start of the buffer and of the journal.
+    {
+        fbl::AutoLock lock(&writeback_lock_);
+        start_ = (start_ + checkpoint_blocks_) % cap_;
+        len_ -= checkpoint_blocks_;
+        journal_start_ = (journal_start_ + journal_blocks) % journal_cap_;
+        journal_len_ -= journal_blocks;
+        cnd_broadcast(&producer_cvar_);
+    }
+    checkpoint_blocks_ = 0;
+
+    while (!done.is_empty()) {
+        fbl::unique_ptr<WritebackWork> work = done.pop();
+        RemovePending(*work);
+        work->Complete();
+    }
+    return ZX_OK;
+}
+
 int WritebackBuffer::WritebackThread(void* arg) {
     WritebackBuffer* b = reinterpret_cast<WritebackBuffer*>(arg);
 
     b->writeback_lock_.Acquire();
     while (true) {
-        while (!b->work_queue_.is_empty()) {
-            auto work = b->work_queue_.pop();
+        if (!b->work_queue_.is_empty() && b->CommitReadyLocked()) {
             TRACE_DURATION("minfs", "WritebackBuffer::WritebackThread");
+            Batch batch;
+            b->FillBatchLocked(&batch);
 
-            // Stay unlocked while processing a unit of work
+            // Stay unlocked while sending the batch
             b->writeback_lock_.Release();
-
-            // TODO(smklein): We could add additional validation that the blocks
-            // in "work" are contiguous and in the range of [start_, len_) (including
-            // wraparound).
-            size_t blks_consumed = work->Complete(b->buffer_->GetVmo(), b->buffer_vmoid_);
-            TRACE_FLOW_END("minfs", "writeback", reinterpret_cast<trace_flow_id_t>(work.get()));
-            work = nullptr;
+            b->Issue(&batch);
 
             // Relock before checking the state of the queue
             b->writeback_lock_.Acquire();
-            b->start_ = (b->start_ + blks_consumed) % b->cap_;
-            b->len_ -= blks_consumed;
-            cnd_signal(&b->producer_cvar_);
+            continue;
+        }
+
+        if (b->inflight_count_ > 0) {
+            // Nothing else is ready to be sent; wait for the oldest work to
+            // complete, then check the queue again.
+            b->writeback_lock_.Release();
+            b->RetireOldest();
+            b->writeback_lock_.Acquire();
+            continue;
+        }
+
+        if (!b->checkpoint_queue_.is_empty() && b->CheckpointReadyLocked()) {
+            b->writeback_lock_.Release();
+            b->Checkpoint();
+            b->writeback_lock_.Acquire();
+            continue;
+        }
+
+        if (!b->work_queue_.is_empty() || !b->checkpoint_queue_.is_empty()) {
+            // Wait for more work to merge with what is queued, or until
+            // committed work is due to be checkpointed.
+            zx_time_t deadline = ZX_TIME_INFINITE;
+            if (!b->work_queue_.is_empty()) {
+                deadline = b->queued_since_ + b->commit_window_;
+            }
+            if (!b->checkpoint_queue_.is_empty()) {
+                deadline = fbl::min(deadline, b->checkpoint_since_ + kWritebackCheckpointDelay);
+            }
+            cnd_wait_until(&b->consumer_cvar_, b->writeback_lock_.GetInternal(), deadline);
+            continue;
         }
 
         // Before waiting, we should check if we're unmounting.
         if (b->unmounting_) {
             b->writeback_lock_.Release();
-            b->bc_->FreeTxnId();
             return 0;
         }
         cnd_wait(&b->consumer_cvar_, b->writeback_lock_.GetInternal());
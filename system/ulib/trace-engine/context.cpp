@@ -4,11 +4,15 @@
 
 #include "context_impl.h"
 
+#include <threads.h>
+
 #include <zircon/compiler.h>
 #include <zircon/syscalls.h>
 
 #include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
 #include <fbl/atomic.h>
+#include <fbl/auto_lock.h>
 #include <fbl/intrusive_hash_table.h>
 #include <fbl/unique_ptr.h>
 #include <zx/process.h>
@@ -103,16 +107,30 @@ struct ContextCache {
     // Thread reference created when this thread was registered.
     trace_thread_ref_t thread_ref{};
 
-    // Maximum number of strings to cache per thread.
-    static constexpr size_t kMaxStringEntries = 256;
+    // This thread's chunk of the trace buffer.  Records are allocated from
+    // |chunk_current| up to |chunk_end|; the rest of the chunk holds zeroes,
+    // which readers skip, so the buffer can be read back at any time.
+    uint64_t* chunk_current{nullptr};
+    uint64_t* chunk_end{nullptr};
+
+    // The rolling buffer wrapped count at which the chunk was allocated.
+    uint32_t chunk_wrapped_count{0u};
+
+    // Strings are cached in blocks which are allocated as this thread
+    // registers more of them, up to a limit.
+    static constexpr size_t kStringEntriesPerBlock = 256;
+    static constexpr size_t kMaxStringEntries = 4096;
+    static constexpr size_t kStringTableBuckets = 509;
 
     // String table.
     // Provides a limited amount of storage for rapidly looking up string literals
     // registered by this thread.
-    fbl::HashTable<const char*, StringEntry*> string_table;
+    fbl::HashTable<const char*, StringEntry*, fbl::SinglyLinkedList<StringEntry*>,
+                   size_t, kStringTableBuckets> string_table;
 
     // Storage for the string entries.
-    StringEntry string_entries[kMaxStringEntries];
+    // Blocks are kept when the context changes and reused by later traces.
+    fbl::unique_ptr<StringEntry[]> string_blocks[kMaxStringEntries / kStringEntriesPerBlock];
 };
 thread_local fbl::unique_ptr<ContextCache> tls_cache{};
 
@@ -129,6 +147,8 @@ ContextCache* GetCurrentContextCache(uint32_t generation) {
     }
     cache->generation = generation;
     cache->thread_ref = trace_make_unknown_thread_ref();
+    cache->chunk_current = nullptr;
+    cache->chunk_end = nullptr;
     cache->string_table.clear();
     return cache;
 }
@@ -147,7 +167,15 @@ StringEntry* CacheStringEntry(uint32_t generation,
     if (unlikely(count == ContextCache::kMaxStringEntries))
         return nullptr;
 
-    StringEntry* entry = &cache->string_entries[count];
+    auto& block = cache->string_blocks[count / ContextCache::kStringEntriesPerBlock];
+    if (unlikely(!block)) {
+        fbl::AllocChecker ac;
+        block.reset(new (&ac) StringEntry[ContextCache::kStringEntriesPerBlock]);
+        if (!ac.check())
+            return nullptr;
+    }
+
+    StringEntry* entry = &block[count % ContextCache::kStringEntriesPerBlock];
     entry->string_literal = string_literal;
     entry->flags = 0u;
     entry->index = 0u;
@@ -167,6 +195,16 @@ inline constexpr uint64_t MakeArgumentHeader(ArgumentType type, size_t size,
            ArgumentFields::NameRef::Make(name_ref->encoded_value);
 }
 
+// Fills |num_bytes| of otherwise unused buffer space at |ptr|.
+inline void WritePadding(uint64_t* ptr, size_t num_bytes) {
+    ZX_DEBUG_ASSERT(num_bytes <= TRACE_ENCODED_RECORD_MAX_LENGTH);
+    if (num_bytes) {
+        *ptr = MakeRecordHeader(RecordType::kMetadata, num_bytes) |
+               MetadataRecordFields::MetadataType::Make(
+                   ToUnderlyingType(MetadataType::kPadding));
+    }
+}
+
 size_t SizeOfEncodedStringRef(const trace_string_ref_t* string_ref) {
     return trace_is_inline_string_ref(string_ref)
                ? Pad(trace_inline_string_ref_length(string_ref))
@@ -328,6 +366,10 @@ public:
         return *this;
     }
 
+protected:
+    explicit Payload(uint64_t* ptr)
+        : ptr_(ptr) {}
+
 private:
     void WriteArgumentHeaderAndName(ArgumentType type,
                                     const trace_string_ref_t* name_ref,
@@ -343,6 +385,54 @@ private:
     uint64_t* ptr_;
 };
 
+// A payload for records which other records refer to.
+class DurablePayload : public Payload {
+public:
+    explicit DurablePayload(trace_context_t* context, size_t num_bytes)
+        : Payload(context->AllocDurableRecord(num_bytes)) {}
+};
+
+// Returns false if the record could not be written, in which case the
+// index must not be referred to.
+bool WriteStringRecord(trace_context_t* context,
+                       trace_string_index_t index, const char* string, size_t length) {
+    ZX_DEBUG_ASSERT(index != TRACE_ENCODED_STRING_REF_EMPTY);
+    ZX_DEBUG_ASSERT(index <= TRACE_ENCODED_STRING_REF_MAX_INDEX);
+
+    if (length > TRACE_ENCODED_STRING_REF_MAX_LENGTH)
+        length = TRACE_ENCODED_STRING_REF_MAX_LENGTH;
+
+    const size_t record_size = sizeof(RecordHeader) + Pad(length);
+    DurablePayload payload(context, record_size);
+    if (!payload)
+        return false;
+    payload
+        .WriteUint64(MakeRecordHeader(RecordType::kString, record_size) |
+                     StringRecordFields::StringIndex::Make(index) |
+                     StringRecordFields::StringLength::Make(length))
+        .WriteBytes(string, length);
+    return true;
+}
+
+// Returns false if the record could not be written, in which case the
+// index must not be referred to.
+bool WriteThreadRecord(trace_context_t* context, trace_thread_index_t index,
+                       zx_koid_t process_koid, zx_koid_t thread_koid) {
+    ZX_DEBUG_ASSERT(index != TRACE_ENCODED_THREAD_REF_INLINE);
+    ZX_DEBUG_ASSERT(index <= TRACE_ENCODED_THREAD_REF_MAX_INDEX);
+
+    const size_t record_size = sizeof(RecordHeader) + WordsToBytes(2);
+    DurablePayload payload(context, record_size);
+    if (!payload)
+        return false;
+    payload
+        .WriteUint64(MakeRecordHeader(RecordType::kThread, record_size) |
+                     ThreadRecordFields::ThreadIndex::Make(index))
+        .WriteUint64(process_koid)
+        .WriteUint64(thread_koid);
+    return true;
+}
+
 Payload WriteEventRecordBase(
     trace_context_t* context,
     EventType event_type,
@@ -412,11 +502,11 @@ bool RegisterString(trace_context_t* context,
 
         if (out_ref_optional) {
             if (unlikely(!(entry->flags & StringEntry::kAllocIndexAttempted))) {
-                if (context->AllocStringIndex(&entry->index)) {
+                if (context->AllocStringIndex(&entry->index) &&
+                    WriteStringRecord(context, entry->index,
+                                      string_literal, strlen(string_literal))) {
                     entry->flags |= StringEntry::kAllocIndexAttempted |
                                     StringEntry::kAllocIndexSucceeded;
-                    trace_context_write_string_record(context, entry->index,
-                                                      string_literal, strlen(string_literal));
                 } else {
                     entry->flags |= StringEntry::kAllocIndexAttempted;
                 }
@@ -459,8 +549,8 @@ void trace_context_register_string_copy(
     // TODO(ZX-1035): Cache the registered strings on the trace context structure,
     // guarded by a mutex.
     trace_string_index_t index;
-    if (likely(context->AllocStringIndex(&index))) {
-        trace_context_write_string_record(context, index, string, length);
+    if (likely(context->AllocStringIndex(&index) &&
+               trace::WriteStringRecord(context, index, string, length))) {
         *out_ref = trace_make_indexed_string_ref(index);
     } else {
         *out_ref = trace_make_inline_string_ref(string, length);
@@ -502,9 +592,9 @@ void trace_context_register_current_thread(
 
     if (likely(cache)) {
         trace_thread_index_t index;
-        if (likely(context->AllocThreadIndex(&index))) {
+        if (likely(context->AllocThreadIndex(&index) &&
+                   trace::WriteThreadRecord(context, index, process_koid, thread_koid))) {
             cache->thread_ref = trace_make_indexed_thread_ref(index);
-            trace_context_write_thread_record(context, index, process_koid, thread_koid);
         } else {
             cache->thread_ref = trace_make_inline_thread_ref(
                 process_koid, thread_koid);
@@ -528,8 +618,8 @@ void trace_context_register_thread(
     // TODO(ZX-1035): Since we can't use the thread-local cache here, cache
     // this registered thread on the trace context structure, guarded by a mutex.
     trace_thread_index_t index;
-    if (likely(context->AllocThreadIndex(&index))) {
-        trace_context_write_thread_record(context, index, process_koid, thread_koid);
+    if (likely(context->AllocThreadIndex(&index) &&
+               trace::WriteThreadRecord(context, index, process_koid, thread_koid))) {
         *out_ref = trace_make_indexed_thread_ref(index);
     } else {
         *out_ref = trace_make_inline_thread_ref(process_koid, thread_koid);
@@ -862,7 +952,7 @@ void trace_context_write_initialization_record(
     uint64_t ticks_per_second) {
     const size_t record_size = sizeof(trace::RecordHeader) +
                                trace::WordsToBytes(1);
-    trace::Payload payload(context, record_size);
+    trace::DurablePayload payload(context, record_size);
     if (payload) {
         payload
             .WriteUint64(trace::MakeRecordHeader(trace::RecordType::kInitialization, record_size))
@@ -873,22 +963,7 @@ void trace_context_write_initialization_record(
 void trace_context_write_string_record(
     trace_context_t* context,
     trace_string_index_t index, const char* string, size_t length) {
-    ZX_DEBUG_ASSERT(index != TRACE_ENCODED_STRING_REF_EMPTY);
-    ZX_DEBUG_ASSERT(index <= TRACE_ENCODED_STRING_REF_MAX_INDEX);
-
-    if (length > TRACE_ENCODED_STRING_REF_MAX_LENGTH)
-        length = TRACE_ENCODED_STRING_REF_MAX_LENGTH;
-
-    const size_t record_size = sizeof(trace::RecordHeader) +
-                               trace::Pad(length);
-    trace::Payload payload(context, record_size);
-    if (payload) {
-        payload
-            .WriteUint64(trace::MakeRecordHeader(trace::RecordType::kString, record_size) |
-                         trace::StringRecordFields::StringIndex::Make(index) |
-                         trace::StringRecordFields::StringLength::Make(length))
-            .WriteBytes(string, length);
-    }
+    trace::WriteStringRecord(context, index, string, length);
 }
 
 void trace_context_write_thread_record(
@@ -896,19 +971,7 @@ void trace_context_write_thread_record(
     trace_thread_index_t index,
     zx_koid_t process_koid,
     zx_koid_t thread_koid) {
-    ZX_DEBUG_ASSERT(index != TRACE_ENCODED_THREAD_REF_INLINE);
-    ZX_DEBUG_ASSERT(index <= TRACE_ENCODED_THREAD_REF_MAX_INDEX);
-
-    const size_t record_size = sizeof(trace::RecordHeader) +
-                               trace::WordsToBytes(2);
-    trace::Payload payload(context, record_size);
-    if (payload) {
-        payload
-            .WriteUint64(trace::MakeRecordHeader(trace::RecordType::kThread, record_size) |
-                         trace::ThreadRecordFields::ThreadIndex::Make(index))
-            .WriteUint64(process_koid)
-            .WriteUint64(thread_koid);
-    }
+    trace::WriteThreadRecord(context, index, process_koid, thread_koid);
 }
 
 void* trace_context_alloc_record(trace_context_t* context, size_t num_bytes) {
@@ -917,51 +980,378 @@ void* trace_context_alloc_record(trace_context_t* context, size_t num_bytes) {
 
 /* struct trace_context */
 
+namespace trace {
+namespace {
+
+static_assert(sizeof(trace_buffer_header_t) == 128u, "trace_buffer_header_t changed size");
+
+// Size of the durable buffer relative to the whole trace buffer, and its bounds.
+constexpr size_t kDurableBufferFraction = 8u;
+constexpr size_t kMinDurableBufferSize = 16u * 1024u;
+constexpr size_t kMaxDurableBufferSize = 1024u * 1024u;
+
+// Each rolling buffer must be able to hold the largest possible record.
+constexpr size_t kMinRollingBufferSize = Pad(TRACE_ENCODED_RECORD_MAX_LENGTH);
+
+// Threads allocate their records from chunks of the rolling buffer so they
+// don't all contend on its allocation offset.  Chunks are small enough that
+// the space left over in each one when tracing stops doesn't matter much.
+constexpr size_t kMaxChunkSize = 4096u;
+constexpr size_t kMinChunkSize = 256u;
+constexpr size_t kMinChunksPerBuffer = 16u;
+
+// Once failed allocations have pushed the offset this far beyond the end of a
+// buffer, it is pulled back so that it cannot overflow into the wrapped count.
+constexpr uint64_t kMaxOffsetOverrun = 1ull << 32;
+
+inline size_t RoundDown8(size_t size) {
+    return size & ~static_cast<size_t>(7u);
+}
+
+// Splits a buffer into its durable and rolling buffers.
+void ComputeBufferLayout(size_t buffer_num_bytes,
+                         size_t* out_durable_size, size_t* out_rolling_size) {
+    size_t available = buffer_num_bytes > sizeof(trace_buffer_header_t)
+                           ? RoundDown8(buffer_num_bytes - sizeof(trace_buffer_header_t))
+                           : 0u;
+    size_t durable_size = fbl::clamp(RoundDown8(available / kDurableBufferFraction),
+                                     kMinDurableBufferSize, kMaxDurableBufferSize);
+    *out_durable_size = durable_size;
+    *out_rolling_size = available > durable_size
+                            ? RoundDown8((available - durable_size) / TRACE_NUM_ROLLING_BUFFERS)
+                            : 0u;
+}
+
+// Picks the size of the chunks which threads allocate their records from,
+// or returns 0 if the buffer is too small to be split up this way.
+size_t ComputeChunkSize(size_t rolling_buffer_size) {
+    size_t chunk_size = fbl::min(kMaxChunkSize,
+                                 RoundDown8(rolling_buffer_size / kMinChunksPerBuffer));
+    return chunk_size >= kMinChunkSize ? chunk_size : 0u;
+}
+
+} // namespace
+} // namespace trace
+
 trace_context::trace_context(void* buffer, size_t buffer_num_bytes,
+                             trace_buffering_mode_t buffering_mode,
                              trace_handler_t* handler)
     : generation_(trace::g_next_generation.fetch_add(1u, fbl::memory_order_relaxed) + 1u),
+      buffering_mode_(buffering_mode),
       buffer_start_(static_cast<uint8_t*>(buffer)),
       buffer_end_(buffer_start_ + buffer_num_bytes),
-      buffer_current_(reinterpret_cast<uintptr_t>(buffer_start_)),
-      buffer_full_mark_(0u),
+      header_(buffering_mode == TRACE_BUFFERING_MODE_ONESHOT
+                  ? nullptr
+                  : reinterpret_cast<trace_buffer_header_t*>(buffer)),
       handler_(handler) {
     ZX_DEBUG_ASSERT(generation_ != 0u);
+    ZX_DEBUG_ASSERT(IsBufferSizeValid(buffering_mode, buffer_num_bytes));
+
+    if (!header_) {
+        rolling_buffer_start_[0] = buffer_start_;
+        rolling_buffer_size_ = trace::RoundDown8(buffer_num_bytes);
+        chunk_size_ = trace::ComputeChunkSize(rolling_buffer_size_);
+        ClearRollingBuffers();
+        return;
+    }
+
+    trace::ComputeBufferLayout(buffer_num_bytes, &durable_buffer_size_, &rolling_buffer_size_);
+    chunk_size_ = trace::ComputeChunkSize(rolling_buffer_size_);
+    durable_buffer_start_ = buffer_start_ + sizeof(trace_buffer_header_t);
+    rolling_buffer_start_[0] = durable_buffer_start_ + durable_buffer_size_;
+    rolling_buffer_start_[1] = rolling_buffer_start_[0] + rolling_buffer_size_;
+
+    memset(header_, 0, sizeof(*header_));
+    header_->magic = TRACE_BUFFER_HEADER_MAGIC;
+    header_->version = TRACE_BUFFER_HEADER_V0;
+    header_->buffering_mode = static_cast<uint8_t>(buffering_mode);
+    header_->total_size = buffer_num_bytes;
+    header_->durable_buffer_size = durable_buffer_size_;
+    header_->rolling_buffer_size = rolling_buffer_size_;
+    ClearRollingBuffers();
+}
+
+void trace_context::ClearRollingBuffers() {
+    // Threads don't write padding after each record in their chunk, so
+    // whatever part of the chunk they haven't reached yet must read back as
+    // zeroes, which readers skip.
+    if (!chunk_size_)
+        return;
+    for (size_t i = 0; i < (header_ ? TRACE_NUM_ROLLING_BUFFERS : 1u); i++)
+        memset(rolling_buffer_start_[i], 0, rolling_buffer_size_);
 }
 
 trace_context::~trace_context() = default;
 
-uint64_t* trace_context::AllocRecord(size_t num_bytes) {
+bool trace_context::IsBufferSizeValid(trace_buffering_mode_t buffering_mode,
+                                      size_t buffer_num_bytes) {
+    switch (buffering_mode) {
+    case TRACE_BUFFERING_MODE_ONESHOT:
+        return true;
+    case TRACE_BUFFERING_MODE_CIRCULAR:
+    case TRACE_BUFFERING_MODE_STREAMING: {
+        size_t durable_size, rolling_size;
+        trace::ComputeBufferLayout(buffer_num_bytes, &durable_size, &rolling_size);
+        return rolling_size >= trace::kMinRollingBufferSize;
+    }
+    default:
+        return false;
+    }
+}
+
+size_t trace_context::bytes_allocated() const {
+    if (!header_) {
+        if (is_buffer_full())
+            return oneshot_full_mark_;
+        return fbl::min(GetOffset(rolling_buffer_current_.load(fbl::memory_order_relaxed)),
+                        static_cast<uint64_t>(rolling_buffer_size_));
+    }
+
+    // The extent of the buffer which holds records.
+    size_t end = sizeof(trace_buffer_header_t) + header_->durable_data_end;
+    for (size_t i = 0; i < TRACE_NUM_ROLLING_BUFFERS; i++) {
+        if (header_->rolling_data_end[i]) {
+            end = fbl::max(end, static_cast<size_t>(rolling_buffer_start_[i] - buffer_start_) +
+                                    static_cast<size_t>(header_->rolling_data_end[i]));
+        }
+    }
+    return end;
+}
+
+uint64_t trace_context::durable_data_end() const {
+    if (durable_buffer_full_.load(fbl::memory_order_acquire))
+        return durable_buffer_full_mark_;
+    return fbl::min(durable_buffer_current_.load(fbl::memory_order_relaxed),
+                    static_cast<uint64_t>(durable_buffer_size_));
+}
+
+void trace_context::RecordDropped() {
+    // Notify the trace manager the first time so it can notify the user
+    // that records (likely) got dropped.
+    if (num_records_dropped_.fetch_add(1u, fbl::memory_order_relaxed) == 0u)
+        handler_->ops->buffer_overflow(handler_);
+}
+
+uint64_t* trace_context::AllocDurableRecord(size_t num_bytes) {
+    if (!header_)
+        return AllocRecord(num_bytes);
+
     ZX_DEBUG_ASSERT((num_bytes & 7) == 0);
     if (unlikely(num_bytes > TRACE_ENCODED_RECORD_MAX_LENGTH))
         return nullptr;
 
-    uint8_t* ptr = reinterpret_cast<uint8_t*>(
-        buffer_current_.fetch_add(num_bytes,
-                                  fbl::memory_order_relaxed));
-    if (likely(ptr + num_bytes <= buffer_end_)) {
-        ZX_DEBUG_ASSERT(ptr + num_bytes >= buffer_start_);
-        return reinterpret_cast<uint64_t*>(ptr); // success!
-    }
-
-    // Buffer is full!
-    // Snap to the endpoint to reduce likelihood of pointer wrap-around.
-    buffer_current_.store(reinterpret_cast<uintptr_t>(buffer_end_),
-                          fbl::memory_order_relaxed);
-
-    // Mark the end point if not already marked.
-    uintptr_t expected_mark = 0u;
-    if (buffer_full_mark_.compare_exchange_strong(&expected_mark,
-                                                  reinterpret_cast<uintptr_t>(ptr),
-                                                  fbl::memory_order_relaxed,
-                                                  fbl::memory_order_relaxed)) {
-        // Notify the trace manager so it can notify the user that a record
-        // (likely) got dropped.
-        handler_->ops->buffer_overflow(handler_);
+    uint64_t offset = durable_buffer_current_.fetch_add(num_bytes, fbl::memory_order_relaxed);
+    if (likely(offset + num_bytes <= durable_buffer_size_))
+        return reinterpret_cast<uint64_t*>(durable_buffer_start_ + offset); // success!
+
+    // Durable buffer is full!
+    // Exactly one allocation starts at or before the end and runs past it;
+    // it marks where the records end.
+    if (offset <= durable_buffer_size_) {
+        durable_buffer_full_mark_ = offset;
+        durable_buffer_full_.store(true, fbl::memory_order_release);
     }
+    // Snap to the endpoint to reduce likelihood of overflow.
+    durable_buffer_current_.store(durable_buffer_size_ + 8u, fbl::memory_order_relaxed);
 
+    RecordDropped();
     return nullptr;
 }
 
+uint64_t* trace_context::AllocRecord(size_t num_bytes) {
+    ZX_DEBUG_ASSERT((num_bytes & 7) == 0);
+    if (unlikely(num_bytes > TRACE_ENCODED_RECORD_MAX_LENGTH))
+        return nullptr;
+
+    uint32_t wrapped_count;
+    trace::ContextCache* cache;
+    if (unlikely(!chunk_size_ || !(cache = trace::GetCurrentContextCache(generation_))))
+        return AllocFromRollingBuffer(num_bytes, &wrapped_count);
+
+    // Allocate from this thread's chunk, so long as the engine hasn't moved
+    // on to another rolling buffer since it was allocated, and isn't stalled
+    // on it.  A stalled buffer has already been handed to the handler to be
+    // saved, so records written to it would be lost without being counted.
+    uint64_t* ptr = cache->chunk_current;
+    if (likely(ptr && (!header_ || (cache->chunk_wrapped_count ==
+                                        GetWrappedCount(rolling_buffer_current_.load(
+                                            fbl::memory_order_relaxed)) &&
+                                    !rolling_buffer_stalled_.load(
+                                        fbl::memory_order_acquire))))) {
+        size_t available = (cache->chunk_end - ptr) * sizeof(uint64_t);
+        if (likely(num_bytes <= available)) {
+            cache->chunk_current = ptr + num_bytes / sizeof(uint64_t);
+            return ptr; // success!
+        }
+        // Cover the rest of the chunk with a single padding record, so
+        // readers needn't skip its zeroes a word at a time.
+        trace::WritePadding(ptr, available);
+    }
+
+    // Move on to a new chunk.
+    // Records which are too large for a chunk are allocated on their own;
+    // doing so once the old chunk is given up keeps this thread's records
+    // in the order in which they were written.
+    cache->chunk_current = nullptr;
+    cache->chunk_end = nullptr;
+    if (unlikely(num_bytes >= chunk_size_))
+        return AllocFromRollingBuffer(num_bytes, &wrapped_count);
+
+    ptr = AllocFromRollingBuffer(chunk_size_, &wrapped_count);
+    if (unlikely(!ptr))
+        return nullptr;
+    cache->chunk_current = ptr + num_bytes / sizeof(uint64_t);
+    cache->chunk_end = ptr + chunk_size_ / sizeof(uint64_t);
+    cache->chunk_wrapped_count = wrapped_count;
+    // In circular mode the buffer still holds the records from before it
+    // last wrapped, so the unused part of the chunk must be cleared here.
+    if (buffering_mode_ == TRACE_BUFFERING_MODE_CIRCULAR &&
+        wrapped_count >= TRACE_NUM_ROLLING_BUFFERS) {
+        memset(cache->chunk_current, 0, chunk_size_ - num_bytes);
+    }
+    return ptr;
+}
+
+uint64_t* trace_context::AllocFromRollingBuffer(size_t num_bytes,
+                                                uint32_t* out_wrapped_count) {
+    for (;;) {
+        uint64_t state = rolling_buffer_current_.fetch_add(num_bytes,
+                                                           fbl::memory_order_relaxed);
+        uint32_t wrapped_count = GetWrappedCount(state);
+        uint64_t offset = GetOffset(state);
+        if (likely(offset + num_bytes <= rolling_buffer_size_)) {
+            uint8_t* ptr = rolling_buffer_start_[wrapped_count & 1u] + offset;
+            *out_wrapped_count = wrapped_count;
+            return reinterpret_cast<uint64_t*>(ptr); // success!
+        }
+
+        // Buffer is full!
+        // Exactly one allocation starts at or before the end and runs past
+        // it.  That one is responsible for marking where the records end,
+        // and for moving on to the other rolling buffer if we can.  Other
+        // allocations which fail wait for it to do so and try again.
+        if (!header_) {
+            if (offset <= rolling_buffer_size_)
+                oneshot_full_mark_ = offset;
+            // Snap to the endpoint to reduce likelihood of overflow.
+            rolling_buffer_current_.store(MakeRollingState(0u, rolling_buffer_size_ + 8u),
+                                          fbl::memory_order_relaxed);
+            RecordDropped();
+            return nullptr;
+        }
+        if (offset <= rolling_buffer_size_) {
+            if (SwitchRollingBuffer(wrapped_count, offset))
+                continue;
+        } else if (WaitForRollingBufferSwitch(wrapped_count)) {
+            continue;
+        }
+
+        // Streaming mode and the other buffer hasn't been saved yet.
+        if (offset > rolling_buffer_size_ + trace::kMaxOffsetOverrun) {
+            rolling_buffer_current_.compare_exchange_strong(
+                &state, MakeRollingState(wrapped_count, rolling_buffer_size_ + 8u),
+                fbl::memory_order_relaxed, fbl::memory_order_relaxed);
+        }
+        RecordDropped();
+        return nullptr;
+    }
+}
+
+bool trace_context::SwitchRollingBuffer(uint32_t wrapped_count, uint64_t offset) {
+    uint32_t full_wrapped_count = 0u;
+    bool notify = false;
+    bool switched = false;
+    {
+        fbl::AutoLock lock(&buffer_switch_mutex_);
+        ZX_DEBUG_ASSERT(GetWrappedCount(MakeRollingState(wrapped_count_, 0u)) == wrapped_count);
+
+        uint32_t index = wrapped_count_ & 1u;
+        header_->rolling_data_end[index] = offset;
+        if (buffering_mode_ == TRACE_BUFFERING_MODE_STREAMING) {
+            rolling_buffer_needs_save_[index] = true;
+            rolling_buffer_filled_at_[index] = wrapped_count_;
+            full_wrapped_count = wrapped_count_;
+            notify = true;
+        }
+
+        if (rolling_buffer_needs_save_[index ^ 1u]) {
+            rolling_buffer_stalled_.store(true, fbl::memory_order_release);
+        } else {
+            SwitchRollingBufferLocked();
+            switched = true;
+        }
+    }
+
+    if (notify) {
+        handler_->ops->notify_buffer_full(handler_, full_wrapped_count, durable_data_end());
+    }
+    return switched;
+}
+
+void trace_context::SwitchRollingBufferLocked() {
+    wrapped_count_++;
+    header_->wrapped_count = wrapped_count_;
+    header_->rolling_data_end[wrapped_count_ & 1u] = 0u;
+    rolling_buffer_current_.store(MakeRollingState(wrapped_count_, 0u),
+                                  fbl::memory_order_relaxed);
+    rolling_buffer_stalled_.store(false, fbl::memory_order_release);
+}
+
+bool trace_context::WaitForRollingBufferSwitch(uint32_t wrapped_count) {
+    // The allocation which ran past the end of the buffer holds no locks
+    // while it is on its way to the switch, so waiting here cannot take long.
+    for (;;) {
+        uint64_t state = rolling_buffer_current_.load(fbl::memory_order_relaxed);
+        if (GetWrappedCount(state) != wrapped_count)
+            return true;
+        if (rolling_buffer_stalled_.load(fbl::memory_order_acquire))
+            return false;
+        thrd_yield();
+    }
+}
+
+zx_status_t trace_context::MarkRollingBufferSaved(uint32_t wrapped_count,
+                                                  uint64_t durable_data_end) {
+    if (buffering_mode_ != TRACE_BUFFERING_MODE_STREAMING)
+        return ZX_ERR_BAD_STATE;
+    if (durable_data_end > durable_buffer_size_)
+        return ZX_ERR_INVALID_ARGS;
+
+    fbl::AutoLock lock(&buffer_switch_mutex_);
+
+    uint32_t index = wrapped_count & 1u;
+    if (!rolling_buffer_needs_save_[index] ||
+        rolling_buffer_filled_at_[index] != wrapped_count)
+        return ZX_ERR_INVALID_ARGS;
+    // Nothing writes to the buffer until it is marked saved, so it can be
+    // cleared for reuse here rather than by the threads which write to it.
+    if (chunk_size_)
+        memset(rolling_buffer_start_[index], 0, rolling_buffer_size_);
+    rolling_buffer_needs_save_[index] = false;
+
+    // Resume writing if we were waiting for this buffer.
+    if (rolling_buffer_stalled_.load(fbl::memory_order_relaxed) &&
+        index != (wrapped_count_ & 1u)) {
+        SwitchRollingBufferLocked();
+    }
+    return ZX_OK;
+}
+
+void trace_context::UpdateBufferHeaderAfterStopped() {
+    if (!header_)
+        return;
+
+    fbl::AutoLock lock(&buffer_switch_mutex_);
+
+    header_->durable_data_end = durable_data_end();
+    if (!rolling_buffer_stalled_.load(fbl::memory_order_relaxed)) {
+        uint64_t offset = GetOffset(rolling_buffer_current_.load(fbl::memory_order_relaxed));
+        header_->rolling_data_end[wrapped_count_ & 1u] =
+            fbl::min(offset, static_cast<uint64_t>(rolling_buffer_size_));
+    }
+    header_->num_records_dropped = num_records_dropped_.load(fbl::memory_order_relaxed);
+}
+
 bool trace_context::AllocThreadIndex(trace_thread_index_t* out_index) {
     trace_thread_index_t index = next_thread_index_.fetch_add(1u, fbl::memory_order_relaxed);
     if (unlikely(index > TRACE_ENCODED_THREAD_REF_MAX_INDEX)) {
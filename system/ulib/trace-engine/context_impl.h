@@ -7,7 +7,9 @@
 #include <zircon/assert.h>
 
 #include <fbl/atomic.h>
+#include <fbl/mutex.h>
 
+#include <trace-engine/buffer_internal.h>
 #include <trace-engine/context.h>
 #include <trace-engine/handler.h>
 
@@ -16,46 +18,136 @@
 // context references.
 // Implements the opaque type declared in <trace-engine/context.h>.
 struct trace_context {
-    trace_context(void* buffer, size_t buffer_num_bytes, trace_handler_t* handler);
+    trace_context(void* buffer, size_t buffer_num_bytes,
+                  trace_buffering_mode_t buffering_mode, trace_handler_t* handler);
 
     ~trace_context();
 
+    // Returns true if a buffer of |buffer_num_bytes| can be used in |buffering_mode|.
+    static bool IsBufferSizeValid(trace_buffering_mode_t buffering_mode,
+                                  size_t buffer_num_bytes);
+
     uint32_t generation() const { return generation_; }
 
+    trace_buffering_mode_t buffering_mode() const { return buffering_mode_; }
+
     trace_handler_t* handler() const { return handler_; }
 
     bool is_buffer_full() const {
-        return buffer_full_mark_.load(fbl::memory_order_relaxed) != 0u;
+        return num_records_dropped_.load(fbl::memory_order_relaxed) != 0u;
     }
 
-    size_t bytes_allocated() const {
-        uintptr_t tail = buffer_full_mark_.load(fbl::memory_order_relaxed);
-        if (!tail)
-            tail = buffer_current_.load(fbl::memory_order_relaxed);
-        return reinterpret_cast<uint8_t*>(tail) - buffer_start_;
-    }
+    // Returns the number of bytes at the start of the buffer which hold records,
+    // or, in circular and streaming modes, which hold the header and records.
+    // Only valid once the trace has stopped and |UpdateBufferHeaderAfterStopped()|
+    // has been called.
+    size_t bytes_allocated() const;
 
+    // Allocates space for a record which other records may refer to, such as
+    // string and thread records.  In circular and streaming modes these are
+    // kept apart from the rolling buffers so they are never overwritten.
+    uint64_t* AllocDurableRecord(size_t num_bytes);
+
+    // Allocates space for a record from the calling thread's chunk of the
+    // buffer, allocating a new chunk as needed.
     uint64_t* AllocRecord(size_t num_bytes);
     bool AllocThreadIndex(trace_thread_index_t* out_index);
     bool AllocStringIndex(trace_string_index_t* out_index);
 
+    // Reports that the rolling buffer which filled at |wrapped_count| has been
+    // saved.  Only valid in streaming mode.
+    zx_status_t MarkRollingBufferSaved(uint32_t wrapped_count, uint64_t durable_data_end);
+
+    // Writes the final data offsets into the buffer header.
+    void UpdateBufferHeaderAfterStopped();
+
 private:
+    // The rolling buffer allocation state packs the low bits of the wrapped
+    // count above the allocation offset so both can be updated with a single
+    // atomic operation.  Only the low bit of the wrapped count selects the
+    // buffer; the rest only serves to detect that a switch took place.
+    static constexpr int kWrappedCountShift = 40;
+    static constexpr uint64_t kOffsetMask = (1ull << kWrappedCountShift) - 1u;
+
+    static uint64_t MakeRollingState(uint32_t wrapped_count, uint64_t offset) {
+        return (static_cast<uint64_t>(wrapped_count) << kWrappedCountShift) | offset;
+    }
+    static uint32_t GetWrappedCount(uint64_t state) {
+        return static_cast<uint32_t>(state >> kWrappedCountShift);
+    }
+    static uint64_t GetOffset(uint64_t state) { return state & kOffsetMask; }
+
+    uint64_t durable_data_end() const;
+    uint64_t* AllocFromRollingBuffer(size_t num_bytes, uint32_t* out_wrapped_count);
+    bool SwitchRollingBuffer(uint32_t wrapped_count, uint64_t offset);
+    bool WaitForRollingBufferSwitch(uint32_t wrapped_count);
+    void SwitchRollingBufferLocked() __TA_REQUIRES(buffer_switch_mutex_);
+    void RecordDropped();
+    void ClearRollingBuffers();
+
     // The generation counter associated with this context to distinguish
     // it from previously created contexts.
     uint32_t const generation_;
 
+    trace_buffering_mode_t const buffering_mode_;
+
     // Buffer start and end pointers.
     uint8_t* const buffer_start_;
     uint8_t* const buffer_end_;
 
-    // Current allocation pointer.
-    // Starts at |buffer_start| and grows from there.
-    // May exceed |buffer_end| when the buffer is full.
-    fbl::atomic<uintptr_t> buffer_current_;
+    // The buffer header, or null in oneshot mode.
+    trace_buffer_header_t* const header_;
+
+    // The durable buffer, which is empty in oneshot mode.
+    uint8_t* durable_buffer_start_ = nullptr;
+    size_t durable_buffer_size_ = 0u;
+
+    // Offset of the next durable allocation.
+    // May exceed |durable_buffer_size_| when the durable buffer is full.
+    fbl::atomic<uint64_t> durable_buffer_current_{0u};
+
+    // Offset beyond the last successful durable allocation.
+    // Only valid once |durable_buffer_full_| is set.
+    uint64_t durable_buffer_full_mark_ = 0u;
+    fbl::atomic<bool> durable_buffer_full_{false};
+
+    // The rolling buffers.  In oneshot mode there is a single rolling buffer
+    // covering the whole trace buffer.
+    uint8_t* rolling_buffer_start_[TRACE_NUM_ROLLING_BUFFERS] = {};
+    size_t rolling_buffer_size_ = 0u;
+
+    // Size of the chunks which threads allocate records from, or 0 if
+    // records are allocated from the rolling buffer one at a time.
+    size_t chunk_size_ = 0u;
+
+    // Current allocation state, see |MakeRollingState()|.
+    // The offset starts at 0 for each rolling buffer and grows from there.
+    // May exceed |rolling_buffer_size_| when the buffer is full.
+    fbl::atomic<uint64_t> rolling_buffer_current_{0u};
+
+    // Offset beyond the last successful allocation in oneshot mode.
+    // Only valid once records have been dropped.
+    uint64_t oneshot_full_mark_ = 0u;
+
+    // Set in streaming mode while the current rolling buffer is full and the
+    // other one has not been saved yet.  Records are dropped in the meantime.
+    fbl::atomic<bool> rolling_buffer_stalled_{false};
+
+    // Number of records which could not be written.
+    fbl::atomic<uint64_t> num_records_dropped_{0u};
+
+    // Guards switching between rolling buffers.
+    fbl::Mutex buffer_switch_mutex_;
+
+    // Authoritative count of rolling buffer switches.
+    uint32_t wrapped_count_ __TA_GUARDED(buffer_switch_mutex_) = 0u;
 
-    // Pointer beyond the last successful allocation, or null if not full.
-    // Only ever set to non-null once in the lifetime of the trace context.
-    fbl::atomic<uintptr_t> buffer_full_mark_;
+    // In streaming mode, whether each rolling buffer is full and waiting to
+    // be saved, and the wrapped count at which it filled.
+    bool rolling_buffer_needs_save_[TRACE_NUM_ROLLING_BUFFERS]
+        __TA_GUARDED(buffer_switch_mutex_) = {};
+    uint32_t rolling_buffer_filled_at_[TRACE_NUM_ROLLING_BUFFERS]
+        __TA_GUARDED(buffer_switch_mutex_) = {};
 
     // Handler associated with the trace session.
     trace_handler_t* const handler_;
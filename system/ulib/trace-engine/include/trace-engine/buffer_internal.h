@@ -0,0 +1,73 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+//
+// Layout of trace buffers written in circular or streaming mode.
+//
+// This is shared between the trace engine, which writes the buffer, and
+// the trace manager and trace reader, which consume it.  Instrumentation
+// should not depend on it.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+#include <zircon/compiler.h>
+
+__BEGIN_CDECLS
+
+// "TraceBuf" in little-endian ASCII.
+#define TRACE_BUFFER_HEADER_MAGIC ((uint64_t)0x6675427265636154ull)
+#define TRACE_BUFFER_HEADER_V0 ((uint16_t)0u)
+
+// Number of rolling buffers.
+#define TRACE_NUM_ROLLING_BUFFERS 2u
+
+// In circular and streaming modes the trace buffer is laid out as:
+//
+//   [header][durable buffer][rolling buffer 0][rolling buffer 1]
+//
+// The durable buffer holds records which the rest of the trace refers to,
+// such as the initialization record and the string and thread tables, so
+// that they are never overwritten.  All other records are written into the
+// rolling buffers, one at a time: rolling buffer |wrapped_count % 2| is the
+// one currently being written.
+//
+// In circular mode, when the current rolling buffer fills the engine moves
+// on to the other one, discarding its contents.  In streaming mode the
+// engine notifies the trace handler that the full buffer is ready to be
+// saved and only moves on once the handler reports that the other buffer
+// has been saved; records are dropped in the meantime.
+//
+// All sizes and offsets are in bytes and are multiples of 8.  The data end
+// offsets are relative to the start of the buffer they describe.
+typedef struct trace_buffer_header {
+    uint64_t magic;
+    uint16_t version;
+    // One of |trace_buffering_mode_t|.
+    uint8_t buffering_mode;
+    uint8_t reserved1;
+    // Number of times the engine has moved from one rolling buffer to the next.
+    uint32_t wrapped_count;
+
+    // Size of the whole trace buffer, including this header.
+    uint64_t total_size;
+    uint64_t durable_buffer_size;
+    uint64_t rolling_buffer_size;
+
+    // Offset beyond the last record written into the durable buffer.
+    uint64_t durable_data_end;
+    // Offset beyond the last record written into each rolling buffer.
+    // Only valid for a buffer once the engine has moved off of it, or once
+    // the trace has stopped.
+    uint64_t rolling_data_end[TRACE_NUM_ROLLING_BUFFERS];
+
+    // Number of records which could not be written.
+    uint64_t num_records_dropped;
+
+    uint64_t reserved[7];
+} trace_buffer_header_t;
+
+__END_CDECLS
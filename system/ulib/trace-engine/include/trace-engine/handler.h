@@ -27,6 +27,21 @@
 
 __BEGIN_CDECLS
 
+// Specifies how the trace engine uses the trace buffer.
+// See <trace-engine/buffer_internal.h> for the layout of the buffer in the
+// circular and streaming modes.
+typedef enum {
+    // Records are written until the buffer fills, then further records
+    // are dropped.
+    TRACE_BUFFERING_MODE_ONESHOT = 0,
+    // Once the buffer fills, the oldest records are overwritten.
+    TRACE_BUFFERING_MODE_CIRCULAR = 1,
+    // The buffer is split in two halves; the trace handler is notified
+    // whenever one fills so the trace manager can save it while the other
+    // one is being written.
+    TRACE_BUFFERING_MODE_STREAMING = 2,
+} trace_buffering_mode_t;
+
 // Trace handler interface.
 //
 // Implementations must supply valid function pointers for each function
@@ -63,6 +78,8 @@ struct trace_handler_ops {
     // |disposition| is |ZX_OK| if tracing stopped normally, otherwise indicates
     // that tracing was aborted due to an error.
     // |buffer_bytes_written| is number of bytes which were written to the trace buffer.
+    // In circular and streaming modes the records are not contiguous; consult
+    // the buffer header to find them.
     //
     // Called on an asynchronous dispatch thread.
     void (*trace_stopped)(trace_handler_t* handler, async_t* async,
@@ -73,6 +90,27 @@ struct trace_handler_ops {
     //
     // Called by instrumentation on any thread.  Must be thread-safe.
     void (*buffer_overflow)(trace_handler_t* handler);
+
+    // Called by the trace engine in streaming mode when one of the rolling
+    // buffers is full and ready to be saved.
+    //
+    // |handler| is the trace handler object itself.
+    // |wrapped_count| is the value of the buffer header's |wrapped_count|
+    // field when the buffer filled; the full buffer is |wrapped_count % 2|.
+    // |durable_data_end| is the offset beyond the last record written into
+    // the durable buffer so far.
+    //
+    // Once the buffer has been saved, the trace manager must arrange for
+    // |trace_engine_mark_buffer_saved()| to be called.
+    //
+    // This is called by the thread whose record did not fit.  Other threads
+    // may still be finishing records which they allocated just before then,
+    // so unless all instrumentation runs on one thread, the buffer should be
+    // saved later from another thread rather than from within this call.
+    //
+    // Called by instrumentation on any thread.  Must be thread-safe.
+    void (*notify_buffer_full)(trace_handler_t* handler, uint32_t wrapped_count,
+                               uint64_t durable_data_end);
 };
 
 // Asynchronously starts the trace engine.
@@ -109,6 +147,20 @@ zx_status_t trace_start_engine(async_t* async,
                                void* buffer,
                                size_t buffer_num_bytes);
 
+// Asynchronously starts the trace engine using the specified buffering mode.
+//
+// Behaves like |trace_start_engine()|, which uses |TRACE_BUFFERING_MODE_ONESHOT|.
+// In the circular and streaming modes the buffer begins with a
+// |trace_buffer_header_t| describing where the records are.
+//
+// Returns |ZX_ERR_INVALID_ARGS| if |buffering_mode| is unknown or if
+// |buffer_num_bytes| is too small for the requested mode.
+zx_status_t trace_start_engine_with_mode(async_t* async,
+                                         trace_handler_t* handler,
+                                         trace_buffering_mode_t buffering_mode,
+                                         void* buffer,
+                                         size_t buffer_num_bytes);
+
 // Asynchronously stops the trace engine.
 //
 // The trace handler's |trace_stopped()| method will be invoked asynchronously
@@ -123,4 +175,20 @@ zx_status_t trace_start_engine(async_t* async,
 // This function is thread-safe.
 zx_status_t trace_stop_engine(zx_status_t disposition);
 
+// Reports that the rolling buffer which filled when the header's wrapped
+// count was |wrapped_count| has been saved, so the trace engine may write
+// into it again.  Only meaningful in streaming mode.
+//
+// |durable_data_end| is the offset up to which the durable buffer has been
+// saved.  It is used for bookkeeping only; the durable buffer is never reused.
+//
+// Returns |ZX_OK| on success.
+// Returns |ZX_ERR_BAD_STATE| if the engine is not running in streaming mode.
+// Returns |ZX_ERR_INVALID_ARGS| if no buffer is waiting to be saved for
+// |wrapped_count|.
+//
+// This function is thread-safe.
+zx_status_t trace_engine_mark_buffer_saved(uint32_t wrapped_count,
+                                           uint64_t durable_data_end);
+
 __END_CDECLS
@@ -339,6 +339,8 @@ enum class MetadataType {
     kProviderInfo = 1,
     kProviderSection = 2,
     kProviderEvent = 3,
+    // Fills space which holds no records.  Readers skip it.
+    kPadding = 4,
 };
 
 // Enumerates all provider events.
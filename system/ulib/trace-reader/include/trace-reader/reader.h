@@ -40,6 +40,13 @@ public:
     // chunks as they become available to resume decoding.
     bool ReadRecords(Chunk& chunk);
 
+    // Reads all records from a complete trace buffer, invoking the record
+    // consumer for each one.  Buffers written in circular or streaming mode
+    // start with a |trace_buffer_header_t| describing where the records are;
+    // others hold a plain sequence of records.  Returns false if the buffer
+    // is corrupt.
+    bool ReadBuffer(const void* buffer, size_t num_bytes);
+
     // Gets the current trace provider id.
     // Returns 0 if no providers have been registered yet.
     ProviderId current_provider_id() const { return current_provider_->id; }
@@ -55,6 +62,7 @@ public:
     fbl::String GetProviderName(ProviderId id) const;
 
 private:
+    bool ReadBufferChunk(const uint8_t* data, size_t num_bytes);
     bool ReadMetadataRecord(Chunk& record,
                             RecordHeader header);
     bool ReadInitializationRecord(Chunk& record,
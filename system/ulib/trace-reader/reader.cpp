@@ -5,6 +5,7 @@
 #include <trace-reader/reader.h>
 
 #include <fbl/string_printf.h>
+#include <trace-engine/buffer_internal.h>
 #include <trace-engine/fields.h>
 
 namespace trace {
@@ -21,6 +22,10 @@ bool TraceReader::ReadRecords(Chunk& chunk) {
         if (!pending_header_ && !chunk.ReadUint64(&pending_header_))
             return true; // need more data
 
+        // A zero word is a word of padding.
+        if (!pending_header_)
+            continue;
+
         auto size = RecordFields::RecordSize::Get<size_t>(pending_header_);
         if (size == 0) {
             ReportError("Unexpected record of size 0");
@@ -93,6 +98,71 @@ bool TraceReader::ReadRecords(Chunk& chunk) {
     }
 }
 
+bool TraceReader::ReadBuffer(const void* buffer, size_t num_bytes) {
+    auto data = static_cast<const uint8_t*>(buffer);
+    auto header = static_cast<const trace_buffer_header_t*>(buffer);
+    if (num_bytes < sizeof(trace_buffer_header_t) ||
+        header->magic != TRACE_BUFFER_HEADER_MAGIC)
+        return ReadBufferChunk(data, num_bytes);
+
+    if (header->version != TRACE_BUFFER_HEADER_V0) {
+        ReportError(fbl::StringPrintf("Unsupported buffer header version %u",
+                                      header->version));
+        return false;
+    }
+
+    // Validate the layout before touching any of the records.  The buffer
+    // may have been truncated to just the part which holds records.
+    const uint64_t max_size = header->total_size - sizeof(trace_buffer_header_t);
+    const uint64_t durable_size = header->durable_buffer_size;
+    const uint64_t rolling_size = header->rolling_buffer_size;
+    if (header->total_size < sizeof(trace_buffer_header_t) ||
+        durable_size > max_size ||
+        rolling_size > (max_size - durable_size) / TRACE_NUM_ROLLING_BUFFERS ||
+        header->durable_data_end > durable_size ||
+        header->rolling_data_end[0] > rolling_size ||
+        header->rolling_data_end[1] > rolling_size) {
+        ReportError("Corrupt buffer header");
+        return false;
+    }
+
+    const size_t durable_offset = sizeof(trace_buffer_header_t);
+    const size_t rolling_offsets[TRACE_NUM_ROLLING_BUFFERS] = {
+        durable_offset + durable_size,
+        durable_offset + durable_size + rolling_size};
+    auto read_chunk = [this, data, num_bytes](size_t offset, uint64_t data_end) {
+        if (offset + data_end > num_bytes) {
+            ReportError("Buffer is shorter than its header describes");
+            return false;
+        }
+        return ReadBufferChunk(data + offset, data_end);
+    };
+
+    // String and thread records come first, then the older rolling buffer,
+    // if the engine has moved on from it, and finally the current one.
+    if (!read_chunk(durable_offset, header->durable_data_end))
+        return false;
+    const uint32_t current = header->wrapped_count & 1u;
+    if (header->wrapped_count > 0u) {
+        const uint32_t older = current ^ 1u;
+        if (!read_chunk(rolling_offsets[older], header->rolling_data_end[older]))
+            return false;
+    }
+    return read_chunk(rolling_offsets[current], header->rolling_data_end[current]);
+}
+
+bool TraceReader::ReadBufferChunk(const uint8_t* data, size_t num_bytes) {
+    Chunk chunk(reinterpret_cast<const uint64_t*>(data), BytesToWords(num_bytes));
+    pending_header_ = 0u;
+    if (!ReadRecords(chunk))
+        return false;
+    if (pending_header_) {
+        ReportError("Buffer ends with a truncated record");
+        pending_header_ = 0u;
+    }
+    return true;
+}
+
 bool TraceReader::ReadMetadataRecord(Chunk& record, RecordHeader header) {
     auto type = MetadataRecordFields::MetadataType::Get<MetadataType>(header);
 
@@ -139,6 +209,8 @@ bool TraceReader::ReadMetadataRecord(Chunk& record, RecordHeader header) {
         }
         break;
     }
+    case MetadataType::kPadding:
+        break;
     default: {
         // Ignore unknown metadata types for forward compatibility.
         ReportError(fbl::StringPrintf(
@@ -199,6 +199,9 @@ void MetadataContent::Destroy() {
     case MetadataType::kProviderEvent:
         provider_event_.~ProviderEvent();
         break;
+    case MetadataType::kPadding:
+        // Padding is never surfaced as a record.
+        break;
     }
 }
 
@@ -214,6 +217,8 @@ void MetadataContent::MoveFrom(MetadataContent&& other) {
     case MetadataType::kProviderEvent:
         new (&provider_event_) ProviderEvent(fbl::move(other.provider_event_));
         break;
+    case MetadataType::kPadding:
+        break;
     }
 }
 
@@ -240,6 +245,8 @@ fbl::String MetadataContent::ToString() const {
         return fbl::StringPrintf("ProviderEvent(id: %" PRId32 ", %s)",
                                  provider_event_.id, name.c_str());
     }
+    case MetadataType::kPadding:
+        break;
     }
     ZX_ASSERT(false);
 }
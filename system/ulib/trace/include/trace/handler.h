@@ -56,12 +56,22 @@ public:
     // the buffer was full.
     virtual void BufferOverflow() {}
 
+    // Called by the trace engine in streaming mode when the rolling buffer
+    // which filled at |wrapped_count| is ready to be saved.
+    //
+    // Once saved, report it with |trace_engine_mark_buffer_saved()|.
+    //
+    // Called by instrumentation on any thread.  Must be thread-safe.
+    virtual void NotifyBufferFull(uint32_t wrapped_count, uint64_t durable_data_end) {}
+
 private:
     static bool CallIsCategoryEnabled(trace_handler_t* handler, const char* category);
     static void CallTraceStarted(trace_handler_t* handler);
     static void CallTraceStopped(trace_handler_t* handler, async_t* async,
                                  zx_status_t disposition, size_t buffer_bytes_written);
     static void CallBufferOverflow(trace_handler_t* handler);
+    static void CallNotifyBufferFull(trace_handler_t* handler, uint32_t wrapped_count,
+                                     uint64_t durable_data_end);
 
     static const trace_handler_ops_t kOps;
 };
@@ -0,0 +1,20 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <zircon/features.h>
+#include <zircon/syscalls.h>
+
+#include "private.h"
+
+zx_status_t _zx_system_get_features(uint32_t kind, uint32_t* features) {
+    switch (kind) {
+    case ZX_FEATURE_KIND_CPU:
+        *features = DATA_CONSTANTS.cpu_features;
+        return ZX_OK;
+    default:
+        return ZX_ERR_NOT_SUPPORTED;
+    }
+}
+
+VDSO_INTERFACE_FUNCTION(zx_system_get_features);
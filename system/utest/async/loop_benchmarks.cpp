@@ -0,0 +1,164 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <zircon/syscalls.h>
+
+#include <async/cpp/loop.h>
+#include <async/receiver.h>
+#include <async/task.h>
+
+#include <fbl/alloc_checker.h>
+#include <fbl/atomic.h>
+#include <fbl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+constexpr uint32_t kNumTasks = 50000u;
+
+inline zx_time_t now() {
+    return zx_clock_get(ZX_CLOCK_MONOTONIC);
+}
+
+fbl::atomic_uint32_t g_count;
+
+async_task_result_t count_task(async_t* async, async_task_t* task, zx_status_t status) {
+    g_count.fetch_add(1u);
+    return ASYNC_TASK_FINISHED;
+}
+
+// Posts and cancels many timeouts with scattered deadlines, as a server
+// with many outstanding requests would.
+bool task_post_cancel_benchmark() {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<async_task_t[]> tasks(new (&ac) async_task_t[kNumTasks]);
+    ASSERT_TRUE(ac.check());
+
+    async::Loop loop;
+    unsigned int seed = static_cast<unsigned int>(zx_ticks_get());
+    zx_time_t deadline = zx_deadline_after(ZX_SEC(3600));
+    for (uint32_t i = 0; i < kNumTasks; i++) {
+        tasks[i] = async_task_t{ASYNC_STATE_INIT, count_task,
+                                deadline + ZX_MSEC(rand_r(&seed) % 100000), 0u, 0u};
+    }
+
+    zx_time_t start = now();
+    for (uint32_t i = 0; i < kNumTasks; i++) {
+        ASSERT_EQ(ZX_OK, async_post_task(loop.async(), &tasks[i]), "post");
+    }
+    zx_time_t post_time = now() - start;
+
+    start = now();
+    for (uint32_t i = 0; i < kNumTasks; i++) {
+        // Cancel in an order unrelated to the deadlines.
+        uint32_t index = static_cast<uint32_t>((i * 7919ull) % kNumTasks);
+        ASSERT_EQ(ZX_OK, async_cancel_task(loop.async(), &tasks[index]), "cancel");
+    }
+    zx_time_t cancel_time = now() - start;
+
+    unittest_printf("%u tasks: %" PRIu64 " ns per post, %" PRIu64 " ns per cancel\n",
+                    kNumTasks, post_time / kNumTasks, cancel_time / kNumTasks);
+
+    END_TEST;
+}
+
+bool task_dispatch_benchmark() {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<async_task_t[]> tasks(new (&ac) async_task_t[kNumTasks]);
+    ASSERT_TRUE(ac.check());
+
+    async::Loop loop;
+    unsigned int seed = static_cast<unsigned int>(zx_ticks_get());
+    zx_time_t deadline = now() - ZX_SEC(1);
+    for (uint32_t i = 0; i < kNumTasks; i++) {
+        tasks[i] = async_task_t{ASYNC_STATE_INIT, count_task,
+                                deadline + ZX_USEC(rand_r(&seed) % 1000), 0u, 0u};
+        ASSERT_EQ(ZX_OK, async_post_task(loop.async(), &tasks[i]), "post");
+    }
+
+    g_count.store(0u);
+    zx_time_t start = now();
+    ASSERT_EQ(ZX_OK, loop.RunUntilIdle(), "run loop");
+    zx_time_t elapsed = now() - start;
+    EXPECT_EQ(kNumTasks, g_count.load(), "run count");
+
+    unittest_printf("%u tasks: %" PRIu64 " ns per dispatch\n", kNumTasks, elapsed / kNumTasks);
+
+    END_TEST;
+}
+
+constexpr uint32_t kMaxThreads = 8u;
+constexpr uint32_t kNumPackets = 20000u;
+constexpr uint32_t kNumTimerTasks = 2000u;
+
+fbl::atomic_uint32_t g_remaining;
+
+void finish_one(async_t* async) {
+    if (g_remaining.fetch_sub(1u) == 1u)
+        async_loop_quit(async);
+}
+
+void count_packet(async_t* async, async_receiver_t* receiver, zx_status_t status,
+                  const zx_packet_user_t* data) {
+    finish_one(async);
+}
+
+async_task_result_t count_timer_task(async_t* async, async_task_t* task, zx_status_t status) {
+    finish_one(async);
+    return ASYNC_TASK_FINISHED;
+}
+
+// Mixes packets, which any thread may handle, with a stream of tasks
+// coming due, which are dispatched one thread at a time.  Threads which
+// are woken by the timer while another is dispatching tasks should go
+// straight back to handling packets.
+bool threads_dispatch_benchmark() {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<async_task_t[]> tasks(new (&ac) async_task_t[kNumTimerTasks]);
+    ASSERT_TRUE(ac.check());
+    async_receiver_t receiver{ASYNC_STATE_INIT, count_packet, 0u, 0u};
+
+    for (uint32_t threads = 1u; threads <= kMaxThreads; threads *= 2u) {
+        async::Loop loop;
+        g_remaining.store(kNumPackets + kNumTimerTasks);
+
+        zx_time_t start = now();
+        for (uint32_t i = 0; i < kNumTimerTasks; i++) {
+            tasks[i] = async_task_t{ASYNC_STATE_INIT, count_timer_task,
+                                    start + ZX_USEC(i * 5u), 0u, 0u};
+            ASSERT_EQ(ZX_OK, async_post_task(loop.async(), &tasks[i]), "post");
+        }
+        for (uint32_t i = 0; i < kNumPackets; i++) {
+            ASSERT_EQ(ZX_OK, async_queue_packet(loop.async(), &receiver, nullptr), "queue");
+        }
+        for (uint32_t i = 0; i < threads; i++) {
+            ASSERT_EQ(ZX_OK, loop.StartThread(), "start thread");
+        }
+        loop.JoinThreads();
+        zx_time_t elapsed = now() - start;
+        EXPECT_EQ(0u, g_remaining.load(), "all work handled");
+
+        unittest_printf("%u threads: %" PRIu64 " ns per item\n", threads,
+                        elapsed / (kNumPackets + kNumTimerTasks));
+    }
+
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(loop_benchmarks)
+RUN_TEST_PERFORMANCE(task_post_cancel_benchmark)
+RUN_TEST_PERFORMANCE(task_dispatch_benchmark)
+RUN_TEST_PERFORMANCE(threads_dispatch_benchmark)
+END_TEST_CASE(loop_benchmarks)
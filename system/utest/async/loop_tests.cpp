@@ -172,6 +172,23 @@ protected:
     }
 };
 
+class OrderedTask : public TestTask {
+public:
+    OrderedTask(zx_time_t deadline, uint32_t id, uint32_t* order, uint32_t* count)
+        : TestTask(deadline), id_(id), order_(order), count_(count) {}
+
+protected:
+    uint32_t id_;
+    uint32_t* order_;
+    uint32_t* count_;
+
+    async_task_result_t Handle(async_t* async, zx_status_t status) override {
+        TestTask::Handle(async, status);
+        order_[(*count_)++] = id_;
+        return ASYNC_TASK_FINISHED;
+    }
+};
+
 class TestReceiver {
 public:
     TestReceiver() {
@@ -615,6 +632,48 @@ bool task_shutdown_test() {
     END_TEST;
 }
 
+bool task_ordering_test() {
+    const uint32_t num_tasks = 1000u;
+
+    BEGIN_TEST;
+
+    async::Loop loop;
+
+    // Post tasks out of deadline order with many ties, then cancel some.
+    // The rest must run earliest deadline first, ties in the order posted.
+    zx_time_t start_time = now() - ZX_SEC(1);
+    uint32_t order[num_tasks];
+    uint32_t count = 0u;
+    OrderedTask* tasks[num_tasks];
+    for (uint32_t i = 0; i < num_tasks; i++) {
+        tasks[i] = new OrderedTask(start_time + ZX_USEC((i * 7919u) % 100u), i, order, &count);
+        EXPECT_EQ(ZX_OK, tasks[i]->op.Post(loop.async()), "post");
+    }
+    for (uint32_t i = 0; i < num_tasks; i += 5u) {
+        EXPECT_EQ(ZX_OK, tasks[i]->op.Cancel(loop.async()), "cancel");
+    }
+    EXPECT_EQ(ZX_ERR_NOT_FOUND, tasks[0]->op.Cancel(loop.async()), "cancel again");
+
+    EXPECT_EQ(ZX_OK, loop.RunUntilIdle(), "run loop");
+    EXPECT_EQ(num_tasks - num_tasks / 5u, count, "run count");
+    for (uint32_t i = 0; i < count; i++) {
+        EXPECT_NE(0u, order[i] % 5u, "canceled task ran");
+        if (i > 0) {
+            const OrderedTask* prev = tasks[order[i - 1]];
+            const OrderedTask* cur = tasks[order[i]];
+            EXPECT_TRUE(prev->op.deadline() < cur->op.deadline() ||
+                            (prev->op.deadline() == cur->op.deadline() && order[i - 1] < order[i]),
+                        "tasks ran in order");
+        }
+    }
+
+    for (uint32_t i = 0; i < num_tasks; i++) {
+        delete tasks[i];
+    }
+
+    END_TEST;
+}
+
 bool receiver_test() {
     const zx_packet_user_t data1{.u64 = {11, 12, 13, 14}};
     const zx_packet_user_t data2{.u64 = {21, 22, 23, 24}};
@@ -954,6 +1013,7 @@ RUN_TEST(wait_shutdown_test)
 RUN_TEST(wait_method_test)
 RUN_TEST(task_test)
 RUN_TEST(task_shutdown_test)
+RUN_TEST(task_ordering_test)
 RUN_TEST(receiver_test)
 RUN_TEST(receiver_shutdown_test)
 RUN_TEST(threads_have_default_dispatcher)
@@ -11,6 +11,7 @@ MODULE_TYPE := usertest
 MODULE_SRCS += \
     $(LOCAL_DIR)/async_stub.cpp \
     $(LOCAL_DIR)/default_tests.cpp \
+    $(LOCAL_DIR)/loop_benchmarks.cpp \
     $(LOCAL_DIR)/loop_tests.cpp \
     $(LOCAL_DIR)/main.c \
     $(LOCAL_DIR)/receiver_tests.cpp \
@@ -5,9 +5,13 @@
 #include <bitmap/raw-bitmap.h>
 #include <bitmap/storage.h>
 
+#include <inttypes.h>
+#include <stdlib.h>
+
 #include <fbl/algorithm.h>
 #include <fbl/alloc_checker.h>
 #include <unittest/unittest.h>
+#include <zircon/syscalls.h>
 
 namespace bitmap {
 namespace tests {
@@ -441,6 +445,109 @@ static bool GrowFailure(void) {
     END_TEST;
 }
 
+// Checks that a summarized bitmap agrees with a plain bitmap across a series
+// of random operations.
+template <typename Storage>
+static bool SummaryMatchesPlain(void) {
+    BEGIN_TEST;
+
+    unsigned int seed = 0x12345678;
+    for (size_t iter = 0; iter < 16; ++iter) {
+        const size_t bitmap_size = 1 + rand_r(&seed) % (1 << 18);
+        RawBitmapGeneric<Storage> plain;
+        SummarizedRawBitmapGeneric<Storage> summarized;
+        ASSERT_EQ(plain.Reset(bitmap_size), ZX_OK);
+        ASSERT_EQ(summarized.Reset(bitmap_size), ZX_OK);
+
+        for (size_t op = 0; op < 64; ++op) {
+            size_t bitoff = rand_r(&seed) % bitmap_size;
+            size_t bitmax = bitoff + rand_r(&seed) % (bitmap_size - bitoff + 1);
+            if (rand_r(&seed) % 3) {
+                ASSERT_EQ(plain.Set(bitoff, bitmax), ZX_OK);
+                ASSERT_EQ(summarized.Set(bitoff, bitmax), ZX_OK);
+            } else {
+                ASSERT_EQ(plain.Clear(bitoff, bitmax), ZX_OK);
+                ASSERT_EQ(summarized.Clear(bitoff, bitmax), ZX_OK);
+            }
+
+            for (size_t query = 0; query < 8; ++query) {
+                bool is_set = rand_r(&seed) % 2;
+                bitoff = rand_r(&seed) % bitmap_size;
+                bitmax = bitoff + 1 + rand_r(&seed) % (bitmap_size - bitoff);
+                size_t run_len = 1 + rand_r(&seed) % 4096;
+                ASSERT_EQ(plain.Scan(bitoff, bitmax, is_set),
+                          summarized.Scan(bitoff, bitmax, is_set));
+                size_t plain_out, summarized_out;
+                ASSERT_EQ(plain.Find(is_set, bitoff, bitmax, run_len, &plain_out),
+                          summarized.Find(is_set, bitoff, bitmax, run_len, &summarized_out));
+                ASSERT_EQ(plain_out, summarized_out);
+            }
+        }
+    }
+
+    END_TEST;
+}
+
+// Checks that the summary can be rebuilt after modifying the storage
+// directly.
+template <typename Storage>
+static bool SummaryRebuild(void) {
+    BEGIN_TEST;
+
+    const size_t bitmap_size = 1 << 16;
+    SummarizedRawBitmapGeneric<Storage> bitmap;
+    ASSERT_EQ(bitmap.Reset(bitmap_size), ZX_OK);
+    ASSERT_EQ(bitmap.Set(0, bitmap_size), ZX_OK);
+
+    size_t* data = static_cast<size_t*>(const_cast<void*>(bitmap.StorageUnsafe()->GetData()));
+    data[bitmap_size / kBits / 2] = 0;
+    bitmap.RebuildSummary();
+
+    size_t out;
+    EXPECT_EQ(bitmap.Find(false, 0, bitmap_size, kBits, &out), ZX_OK);
+    EXPECT_EQ(out, bitmap_size / 2);
+    EXPECT_EQ(bitmap.Find(false, 0, bitmap_size, kBits + 1, &out), ZX_ERR_NO_RESOURCES);
+
+    END_TEST;
+}
+
+// Measures the time taken by |Find| to locate the only free bits at the end
+// of a nearly full bitmap, and by |Find| to locate a long free run.
+template <typename RawBitmap>
+static bool FindBenchmark(void) {
+    BEGIN_TEST;
+
+    const size_t kIterations = 100;
+    for (size_t bitmap_size = 1 << 16; bitmap_size <= 1 << 28; bitmap_size <<= 4) {
+        RawBitmap bitmap;
+        ASSERT_EQ(bitmap.Reset(bitmap_size), ZX_OK);
+        ASSERT_EQ(bitmap.Set(0, bitmap_size - 1), ZX_OK);
+
+        size_t out;
+        zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        for (size_t i = 0; i < kIterations; ++i) {
+            ASSERT_EQ(bitmap.Find(false, 0, bitmap_size, 1, &out), ZX_OK);
+        }
+        zx_time_t single = (zx_clock_get(ZX_CLOCK_MONOTONIC) - start) / kIterations;
+        ASSERT_EQ(out, bitmap_size - 1);
+
+        // Leave a free run of 1/16th of the bitmap at the end.
+        ASSERT_EQ(bitmap.Clear(bitmap_size - bitmap_size / 16, bitmap_size), ZX_OK);
+        start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        for (size_t i = 0; i < kIterations; ++i) {
+            ASSERT_EQ(bitmap.Find(false, 0, bitmap_size, bitmap_size / 16, &out), ZX_OK);
+        }
+        zx_time_t run = (zx_clock_get(ZX_CLOCK_MONOTONIC) - start) / kIterations;
+        ASSERT_EQ(out, bitmap_size - bitmap_size / 16);
+
+        unittest_printf_critical("\n    %zu bits: single %" PRIu64 " ns, run %" PRIu64 " ns",
+                                 bitmap_size, single, run);
+    }
+    unittest_printf_critical("\n");
+
+    END_TEST;
+}
+
 #define RUN_TEMPLATIZED_TEST(test, specialization) RUN_TEST(test<specialization>)
 #define ALL_TESTS(specialization)                           \
     RUN_TEMPLATIZED_TEST(InitializedEmpty, specialization)  \
@@ -458,10 +565,22 @@ static bool GrowFailure(void) {
 BEGIN_TEST_CASE(raw_bitmap_tests)
 ALL_TESTS(RawBitmapGeneric<DefaultStorage>)
 ALL_TESTS(RawBitmapGeneric<VmoStorage>)
+ALL_TESTS(SummarizedRawBitmapGeneric<DefaultStorage>)
+ALL_TESTS(SummarizedRawBitmapGeneric<VmoStorage>)
 RUN_TEST(GrowAcrossPage<RawBitmapGeneric<VmoStorage>>)
 RUN_TEST(GrowShrink<RawBitmapGeneric<VmoStorage>>)
 RUN_TEST(GrowFailure<RawBitmapGeneric<DefaultStorage>>)
+RUN_TEST(GrowAcrossPage<SummarizedRawBitmapGeneric<VmoStorage>>)
+RUN_TEST(GrowShrink<SummarizedRawBitmapGeneric<VmoStorage>>)
+RUN_TEST(SummaryMatchesPlain<DefaultStorage>)
+RUN_TEST(SummaryRebuild<DefaultStorage>)
+RUN_TEST(SummaryRebuild<VmoStorage>)
 END_TEST_CASE(raw_bitmap_tests);
 
+BEGIN_TEST_CASE(raw_bitmap_benchmarks)
+RUN_TEST_PERFORMANCE(FindBenchmark<RawBitmapGeneric<DefaultStorage>>)
+RUN_TEST_PERFORMANCE(FindBenchmark<SummarizedRawBitmapGeneric<DefaultStorage>>)
+END_TEST_CASE(raw_bitmap_benchmarks);
+
 } // namespace tests
 } // namespace bitmap
@@ -153,7 +153,8 @@ static int EndBlobstoreTest(test_info_t* test_info) {
     return 0;
 }
 
-static int MountBlobstore(const char* ramdisk_path) {
+static int MountBlobstore(const char* ramdisk_path,
+                          const mount_options_t* options = &default_mount_options) {
     int fd = open(ramdisk_path, O_RDWR);
     if (fd < 0) {
         fprintf(stderr, "Could not open ramdisk\n");
@@ -163,7 +164,7 @@ static int MountBlobstore(const char* ramdisk_path) {
     // fd consumed by mount. By default, mount waits until the filesystem is
     // ready to accept commands.
     zx_status_t status;
-    if ((status = mount(fd, MOUNT_PATH, DISK_FORMAT_BLOBFS, &default_mount_options,
+    if ((status = mount(fd, MOUNT_PATH, DISK_FORMAT_BLOBFS, options,
                         launch_stdio_async)) != ZX_OK) {
         fprintf(stderr, "Could not mount blobstore: %d\n", status);
         destroy_ramdisk(ramdisk_path);
@@ -347,21 +348,10 @@ typedef struct blob_info {
     size_t size_data;
 } blob_info_t;
 
-// Creates, writes, reads (to verify) and operates on a blob.
-// Returns the result of the post-processing 'func' (true == success).
-static bool GenerateBlob(size_t size_data, fbl::unique_ptr<blob_info_t>* out) {
-    // Generate a Blob of random data
+// Generates the Merkle tree and path of a blob whose data has been filled in.
+static bool FinishBlob(blob_info_t* info) {
     fbl::AllocChecker ac;
-    fbl::unique_ptr<blob_info_t> info(new (&ac) blob_info_t);
-    EXPECT_EQ(ac.check(), true);
-    info->data.reset(new (&ac) char[size_data]);
-    EXPECT_EQ(ac.check(), true);
-    static unsigned int seed = static_cast<unsigned int>(zx_ticks_get());
-
-    for (size_t i = 0; i < size_data; i++) {
-        info->data[i] = (char)rand_r(&seed);
-    }
-    info->size_data = size_data;
+    size_t size_data = info->size_data;
 
     // Generate the Merkle Tree
     info->size_merkle = MerkleTree::GetTreeLength(size_data);
@@ -383,6 +373,49 @@ static bool GenerateBlob(size_t size_data, fbl::unique_ptr<blob_info_t>* out) {
     ASSERT_EQ(MerkleTree::Verify(&info->data[0], info->size_data, &info->merkle[0],
                                  info->size_merkle, 0, info->size_data, digest),
               ZX_OK, "Failed to validate Merkle Tree");
+    return true;
+}
+
+// Creates, writes, reads (to verify) and operates on a blob.
+// Returns the result of the post-processing 'func' (true == success).
+static bool GenerateBlob(size_t size_data, fbl::unique_ptr<blob_info_t>* out) {
+    // Generate a Blob of random data
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<blob_info_t> info(new (&ac) blob_info_t);
+    EXPECT_EQ(ac.check(), true);
+    info->data.reset(new (&ac) char[size_data]);
+    EXPECT_EQ(ac.check(), true);
+    static unsigned int seed = static_cast<unsigned int>(zx_ticks_get());
+
+    for (size_t i = 0; i < size_data; i++) {
+        info->data[i] = (char)rand_r(&seed);
+    }
+    info->size_data = size_data;
+    ASSERT_TRUE(FinishBlob(info.get()));
+
+    *out = fbl::move(info);
+    return true;
+}
+
+// Generates a blob of easily compressible (but not uniform) data.
+static bool GenerateCompressibleBlob(size_t size_data, fbl::unique_ptr<blob_info_t>* out) {
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<blob_info_t> info(new (&ac) blob_info_t);
+    EXPECT_EQ(ac.check(), true);
+    info->data.reset(new (&ac) char[size_data]);
+    EXPECT_EQ(ac.check(), true);
+    static unsigned int seed = static_cast<unsigned int>(zx_ticks_get());
+
+    // Runs of a random byte, of random length.
+    size_t i = 0;
+    while (i < size_data) {
+        char c = (char)rand_r(&seed);
+        size_t run = fbl::min(size_data - i, static_cast<size_t>(rand_r(&seed) % 64 + 1));
+        memset(&info->data[i], c, run);
+        i += run;
+    }
+    info->size_data = size_data;
+    ASSERT_TRUE(FinishBlob(info.get()));
 
     *out = fbl::move(info);
     return true;
@@ -1510,6 +1543,73 @@ static bool TestReadOnly(void) {
     END_TEST;
 }
 
+template <fs_test_type_t TestType>
+static bool TestCompressed(void) {
+    BEGIN_TEST;
+    test_info_t test_info;
+    ASSERT_EQ(StartBlobstoreTest<TestType>(&test_info), 0, "Mounting Blobstore");
+
+    // Remount with compression enabled.
+    mount_options_t options;
+    memcpy(&options, &default_mount_options, sizeof(options));
+    options.enable_compression = true;
+    ASSERT_EQ(umount(MOUNT_PATH), ZX_OK, "Could not unmount blobstore");
+    ASSERT_EQ(MountBlobstore(test_info.ramdisk_path, &options), 0, "Could not mount blobstore");
+
+    // Both compressible and incompressible blobs must round-trip.
+    fbl::unique_ptr<blob_info_t> compressible;
+    fbl::unique_ptr<blob_info_t> incompressible;
+    ASSERT_TRUE(GenerateCompressibleBlob(1 << 20, &compressible));
+    ASSERT_TRUE(GenerateBlob(1 << 17, &incompressible));
+
+    int fd;
+    ASSERT_TRUE(MakeBlob(compressible->path, compressible->merkle.get(),
+                         compressible->size_merkle, compressible->data.get(),
+                         compressible->size_data, &fd));
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_TRUE(MakeBlob(incompressible->path, incompressible->merkle.get(),
+                         incompressible->size_merkle, incompressible->data.get(),
+                         incompressible->size_data, &fd));
+    ASSERT_EQ(close(fd), 0);
+
+    // The compressible blob should occupy less space than its raw size.
+    fd = open(compressible->path, O_RDONLY);
+    ASSERT_GT(fd, 0);
+    struct stat s;
+    ASSERT_EQ(fstat(fd, &s), 0);
+    ASSERT_EQ(s.st_size, (off_t) compressible->size_data);
+    ASSERT_LT(s.st_blocks * 512, (blkcnt_t) compressible->size_data);
+    ASSERT_EQ(close(fd), 0);
+
+    // Remount, so that blobs are read back from disk.
+    ASSERT_EQ(umount(MOUNT_PATH), ZX_OK, "Could not unmount blobstore");
+    ASSERT_EQ(MountBlobstore(test_info.ramdisk_path, &options), 0, "Could not mount blobstore");
+
+    // Partial reads only need to decompress the chunks they touch.
+    fd = open(compressible->path, O_RDONLY);
+    ASSERT_GT(fd, 0);
+    char buf[4096];
+    size_t off = compressible->size_data / 2 + 123;
+    ASSERT_EQ(pread(fd, buf, sizeof(buf), off), (ssize_t) sizeof(buf));
+    ASSERT_EQ(memcmp(buf, &compressible->data[off], sizeof(buf)), 0);
+    ASSERT_TRUE(VerifyContents(fd, compressible->data.get(), compressible->size_data));
+    void* addr = mmap(NULL, compressible->size_data, PROT_READ, MAP_SHARED, fd, 0);
+    ASSERT_NE(addr, MAP_FAILED, "Could not mmap blob");
+    ASSERT_EQ(memcmp(addr, compressible->data.get(), compressible->size_data), 0);
+    ASSERT_EQ(munmap(addr, compressible->size_data), 0, "Could not unmap blob");
+    ASSERT_EQ(close(fd), 0);
+
+    fd = open(incompressible->path, O_RDONLY);
+    ASSERT_GT(fd, 0);
+    ASSERT_TRUE(VerifyContents(fd, incompressible->data.get(), incompressible->size_data));
+    ASSERT_EQ(close(fd), 0);
+
+    ASSERT_EQ(unlink(compressible->path), 0);
+    ASSERT_EQ(unlink(incompressible->path), 0);
+    ASSERT_EQ(EndBlobstoreTest<TestType>(&test_info), 0, "unmounting blobstore");
+    END_TEST;
+}
+
 // This tests growing both additional inodes and blocks
 template <fs_test_type_t TestType>
 static bool ResizePartition(void) {
@@ -1619,6 +1719,7 @@ RUN_TEST_FOR_ALL_TYPES(LARGE, CreateUmountRemountLarge)
 RUN_TEST_FOR_ALL_TYPES(LARGE, NoSpace)
 RUN_TEST_FOR_ALL_TYPES(MEDIUM, QueryDevicePath)
 RUN_TEST_FOR_ALL_TYPES(MEDIUM, TestReadOnly)
+RUN_TEST_FOR_ALL_TYPES(MEDIUM, TestCompressed)
 RUN_TEST_MEDIUM(ResizePartition<FS_TEST_FVM>)
 RUN_TEST_MEDIUM(CorruptAtMount<FS_TEST_FVM>)
 END_TEST_CASE(blobstore_tests)
@@ -0,0 +1,86 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <crypto/bytes.h>
+#include <crypto/cipher.h>
+#include <digest/digest.h>
+#include <unittest/unittest.h>
+#include <zircon/syscalls.h>
+#include <zircon/types.h>
+
+#include "utils.h"
+
+namespace crypto {
+namespace testing {
+namespace {
+
+// See utils.h; the following macros allow reusing tests for each of the supported Ciphers.
+#define EACH_PARAM(OP, Test) OP(Test, Cipher, AES256_XTS)
+
+// Amount of data transformed or hashed by each benchmark.
+const size_t kBenchmarkLen = 16 * 1024 * 1024;
+
+// Amount of data handed to the cipher per call, matching the size of a zxcrypt block.
+const size_t kBenchmarkChunk = 4096;
+
+// Prints the throughput, in MiB/s, of processing |kBenchmarkLen| bytes in |ticks|.
+void PrintThroughput(const char* what, uint64_t ticks) {
+    uint64_t us = (ticks * 1000000) / zx_ticks_per_second();
+    uint64_t rate = us == 0 ? 0 : (kBenchmarkLen * 1000000) / (us * 1024 * 1024);
+    unittest_printf("\n    %s: %" PRIu64 " MiB/s", what, rate);
+}
+
+bool BenchmarkCipher(Cipher::Algorithm cipher) {
+    BEGIN_TEST;
+    Bytes key, iv, buf;
+    ASSERT_OK(GenerateKeyMaterial(cipher, &key, &iv));
+    ASSERT_OK(buf.Resize(kBenchmarkLen));
+    ASSERT_OK(buf.Randomize());
+
+    Cipher encrypt, decrypt;
+    ASSERT_OK(encrypt.InitEncrypt(cipher, key, iv, kBenchmarkChunk));
+    ASSERT_OK(decrypt.InitDecrypt(cipher, key, iv, kBenchmarkChunk));
+
+    uint64_t start = zx_ticks_get();
+    for (size_t off = 0; off < kBenchmarkLen; off += kBenchmarkChunk) {
+        ASSERT_OK(encrypt.Encrypt(buf.get() + off, off, kBenchmarkChunk, buf.get() + off));
+    }
+    PrintThroughput("encrypt", zx_ticks_get() - start);
+
+    start = zx_ticks_get();
+    for (size_t off = 0; off < kBenchmarkLen; off += kBenchmarkChunk) {
+        ASSERT_OK(decrypt.Decrypt(buf.get() + off, off, kBenchmarkChunk, buf.get() + off));
+    }
+    PrintThroughput("decrypt", zx_ticks_get() - start);
+    unittest_printf("\n");
+    END_TEST;
+}
+DEFINE_EACH(BenchmarkCipher);
+
+bool BenchmarkDigest(void) {
+    BEGIN_TEST;
+    Bytes buf;
+    ASSERT_OK(buf.Resize(kBenchmarkLen));
+    ASSERT_OK(buf.Randomize());
+
+    ::digest::Digest digest;
+    uint64_t start = zx_ticks_get();
+    digest.Hash(buf.get(), buf.len());
+    PrintThroughput("SHA-256", zx_ticks_get() - start);
+    unittest_printf("\n");
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(CryptoBenchmark)
+RUN_TEST_PERFORMANCE(BenchmarkCipher_AES256_XTS)
+RUN_TEST_PERFORMANCE(BenchmarkDigest)
+END_TEST_CASE(CryptoBenchmark)
+
+} // namespace
+} // namespace testing
+} // namespace crypto
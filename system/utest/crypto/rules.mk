@@ -10,6 +10,7 @@ MODULE_TYPE := usertest
 
 MODULE_SRCS += \
     $(LOCAL_DIR)/aead.cpp \
+    $(LOCAL_DIR)/benchmark.cpp \
     $(LOCAL_DIR)/bytes.cpp \
     $(LOCAL_DIR)/cipher.cpp \
     $(LOCAL_DIR)/hkdf.cpp \
@@ -24,6 +25,7 @@ MODULE_LIBS := \
     system/ulib/zircon \
     system/ulib/fdio \
     system/ulib/crypto \
+    system/ulib/digest \
     system/ulib/unittest \
 
 MODULE_STATIC_LIBS := \
@@ -4,11 +4,17 @@
 
 #include <digest/merkle-tree.h>
 
+#include <inttypes.h>
+#include <pthread.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <digest/digest.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
 #include <zircon/assert.h>
 #include <zircon/status.h>
+#include <zircon/syscalls.h>
 #include <unittest/unittest.h>
 
 namespace {
@@ -378,6 +384,115 @@ bool CreateByteByByte(void) {
     END_TEST;
 }
 
+bool CreateParallelAll(void) {
+    BEGIN_TEST_WITH_RC;
+    for (size_t i = 0; i < kNumCases; ++i) {
+        size_t data_len = kCases[i].data_len;
+        size_t tree_len = MerkleTree::GetTreeLength(data_len);
+        Digest actual;
+        ASSERT_OK(MerkleTree::CreateParallel(gData, data_len, gTree, tree_len, &actual, 4));
+        Digest expected;
+        ASSERT_OK(expected.Parse(kCases[i].digest, strlen(kCases[i].digest)));
+        ASSERT_TRUE(actual == expected, "Incorrect root digest");
+    }
+    END_TEST;
+}
+
+bool CreateParallelMatchesSerial(void) {
+    BEGIN_TEST_WITH_RC;
+    // Enough data for several nodes in the first level above the data, with a
+    // partial node at the end of each level.
+    const size_t data_len = (3 * (kNodeSize / Digest::kLength) + 1) * kNodeSize + 123;
+    const size_t tree_len = MerkleTree::GetTreeLength(data_len);
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[data_len]);
+    ASSERT_TRUE(ac.check());
+    fbl::unique_ptr<uint8_t[]> expected_tree(new (&ac) uint8_t[tree_len]);
+    ASSERT_TRUE(ac.check());
+    fbl::unique_ptr<uint8_t[]> actual_tree(new (&ac) uint8_t[tree_len]);
+    ASSERT_TRUE(ac.check());
+    for (size_t i = 0; i < data_len; ++i) {
+        data[i] = static_cast<uint8_t>(rand());
+    }
+    Digest expected;
+    ASSERT_OK(MerkleTree::Create(data.get(), data_len, expected_tree.get(), tree_len, &expected));
+    for (size_t num_threads = 1; num_threads <= 8; ++num_threads) {
+        Digest actual;
+        memset(actual_tree.get(), 0xff, tree_len);
+        ASSERT_OK(MerkleTree::CreateParallel(data.get(), data_len, actual_tree.get(), tree_len,
+                                             &actual, num_threads));
+        ASSERT_TRUE(actual == expected, "Incorrect root digest");
+        ASSERT_EQ(memcmp(actual_tree.get(), expected_tree.get(), tree_len), 0,
+                  "Incorrect tree");
+    }
+    END_TEST;
+}
+
+// Used by CreateParallelConcurrent below.
+struct ConcurrentCreate {
+    const uint8_t* data;
+    size_t data_len;
+    fbl::unique_ptr<uint8_t[]> tree;
+    size_t tree_len;
+    Digest digest;
+    zx_status_t rc;
+};
+
+void* ConcurrentCreateThread(void* arg) {
+    ConcurrentCreate* cc = static_cast<ConcurrentCreate*>(arg);
+    cc->rc = MerkleTree::CreateParallel(cc->data, cc->data_len, cc->tree.get(), cc->tree_len,
+                                        &cc->digest, 4);
+    return nullptr;
+}
+
+bool CreateParallelConcurrent(void) {
+    BEGIN_TEST_WITH_RC;
+    // Several callers share the helper threads at once, and each must still
+    // get its own, complete tree.
+    const size_t data_len = (5 * (kNodeSize / Digest::kLength) + 3) * kNodeSize + 17;
+    const size_t tree_len = MerkleTree::GetTreeLength(data_len);
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[data_len]);
+    ASSERT_TRUE(ac.check());
+    fbl::unique_ptr<uint8_t[]> expected_tree(new (&ac) uint8_t[tree_len]);
+    ASSERT_TRUE(ac.check());
+    for (size_t i = 0; i < data_len; ++i) {
+        data[i] = static_cast<uint8_t>(rand());
+    }
+    Digest expected;
+    ASSERT_OK(MerkleTree::Create(data.get(), data_len, expected_tree.get(), tree_len, &expected));
+
+    constexpr size_t kNumCallers = 6;
+    ConcurrentCreate ccs[kNumCallers];
+    pthread_t threads[kNumCallers];
+    for (size_t i = 0; i < kNumCallers; ++i) {
+        ccs[i].data = data.get();
+        ccs[i].data_len = data_len;
+        ccs[i].tree.reset(new (&ac) uint8_t[tree_len]);
+        ASSERT_TRUE(ac.check());
+        ccs[i].tree_len = tree_len;
+        ASSERT_EQ(pthread_create(&threads[i], nullptr, ConcurrentCreateThread, &ccs[i]), 0);
+    }
+    for (size_t i = 0; i < kNumCallers; ++i) {
+        ASSERT_EQ(pthread_join(threads[i], nullptr), 0);
+        ASSERT_OK(ccs[i].rc);
+        ASSERT_TRUE(ccs[i].digest == expected, "Incorrect root digest");
+        ASSERT_EQ(memcmp(ccs[i].tree.get(), expected_tree.get(), tree_len), 0,
+                  "Incorrect tree");
+    }
+    END_TEST;
+}
+
+bool CreateParallelTreeTooSmall(void) {
+    BEGIN_TEST_WITH_RC;
+    Digest digest;
+    size_t tree_len = MerkleTree::GetTreeLength(kUnalignedLarge);
+    ASSERT_ERR(ZX_ERR_BUFFER_TOO_SMALL,
+               MerkleTree::CreateParallel(gData, kUnalignedLarge, gTree, tree_len - 1,
+                                          &digest, 4));
+    END_TEST;
+}
+
 bool CreateMissingData(void) {
     BEGIN_TEST_WITH_RC;
     size_t tree_len = MerkleTree::GetTreeLength(kSmall);
@@ -692,6 +807,44 @@ bool CreateAndVerifyHugePRNGData(void) {
     END_TEST;
 }
 
+// Measures the throughput of |CreateParallel| on 1 GiB of data as the number
+// of threads increases.
+bool CreateParallelBenchmark(void) {
+    BEGIN_TEST_WITH_RC;
+    const size_t data_len = 1 << 30;
+    const size_t tree_len = MerkleTree::GetTreeLength(data_len);
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[data_len]);
+    ASSERT_TRUE(ac.check());
+    fbl::unique_ptr<uint8_t[]> tree(new (&ac) uint8_t[tree_len]);
+    ASSERT_TRUE(ac.check());
+    for (size_t i = 0; i < data_len; ++i) {
+        data[i] = static_cast<uint8_t>(rand());
+    }
+
+    Digest expected;
+    zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    ASSERT_OK(MerkleTree::Create(data.get(), data_len, tree.get(), tree_len, &expected));
+    zx_time_t serial = zx_clock_get(ZX_CLOCK_MONOTONIC) - start;
+    unittest_printf_critical("\n    Create: %" PRIu64 " ms", serial / ZX_MSEC(1));
+
+    const size_t max_threads = 2 * zx_system_get_num_cpus();
+    for (size_t num_threads = 1; num_threads <= max_threads; num_threads <<= 1) {
+        Digest actual;
+        start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        ASSERT_OK(MerkleTree::CreateParallel(data.get(), data_len, tree.get(), tree_len,
+                                             &actual, num_threads));
+        zx_time_t elapsed = zx_clock_get(ZX_CLOCK_MONOTONIC) - start;
+        ASSERT_TRUE(actual == expected, "Incorrect root digest");
+        unittest_printf_critical("\n    CreateParallel(%zu threads): %" PRIu64 " ms (%zu.%02zux)",
+                                 num_threads, elapsed / ZX_MSEC(1),
+                                 static_cast<size_t>(serial / elapsed),
+                                 static_cast<size_t>((serial * 100 / elapsed) % 100));
+    }
+    unittest_printf_critical("\n");
+    END_TEST;
+}
+
 } // namespace
 
 BEGIN_TEST_CASE(MerkleTreeTests)
@@ -719,6 +872,10 @@ RUN_TEST(CreateAll)
 RUN_TEST(CreateFinalCAll)
 RUN_TEST(CreateCAll)
 RUN_TEST(CreateByteByByte)
+RUN_TEST(CreateParallelAll)
+RUN_TEST(CreateParallelMatchesSerial)
+RUN_TEST(CreateParallelConcurrent)
+RUN_TEST(CreateParallelTreeTooSmall)
 RUN_TEST(CreateMissingData)
 RUN_TEST(CreateMissingTree)
 RUN_TEST(CreateTreeTooSmall)
@@ -740,4 +897,5 @@ RUN_TEST(VerifyBadTree)
 RUN_TEST(VerifyGoodPartOfBadLeaves)
 RUN_TEST(VerifyBadLeaves)
 RUN_TEST(CreateAndVerifyHugePRNGData)
+RUN_TEST_PERFORMANCE(CreateParallelBenchmark)
 END_TEST_CASE(MerkleTreeTests)
@@ -10,6 +10,7 @@
 #include <zircon/processargs.h>
 #include <zircon/syscalls.h>
 
+#include <limits.h>
 #include <stdatomic.h>
 #include <stdio.h>
 #include <string.h>
@@ -160,6 +161,164 @@ bool clone_test(void) {
     END_TEST;
 }
 
+static atomic_int counting_load_calls = 0;
+
+static zx_status_t counting_load_object(void* ctx, const char* name,
+                                        zx_handle_t* vmo) {
+    ++counting_load_calls;
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s%s", LIBPREFIX, name);
+    return launchpad_vmo_from_file(path, vmo);
+}
+
+static zx_status_t counting_load_abspath(void* ctx, const char* path,
+                                         zx_handle_t* vmo) {
+    return ZX_ERR_NOT_SUPPORTED;
+}
+
+static zx_status_t counting_publish_data_sink(void* ctx, const char* name,
+                                              zx_handle_t vmo) {
+    zx_handle_close(vmo);
+    return ZX_ERR_NOT_SUPPORTED;
+}
+
+static const loader_service_ops_t counting_ops = {
+    .load_object = counting_load_object,
+    .load_abspath = counting_load_abspath,
+    .publish_data_sink = counting_publish_data_sink,
+};
+
+// Sends a request with |len| bytes of |data| to the loader service |svc|
+// and returns the status from the reply.
+static zx_status_t loader_call(zx_handle_t svc, uint32_t opcode,
+                               const char* data, size_t len,
+                               zx_handle_t* handles, uint32_t max_handles,
+                               uint32_t* actual_handles) {
+    struct {
+        zx_loader_svc_msg_t header;
+        uint8_t data[1024 - sizeof(zx_loader_svc_msg_t)];
+    } msg;
+    memset(&msg.header, 0, sizeof(msg.header));
+    msg.header.opcode = opcode;
+    memcpy(msg.data, data, len);
+    msg.data[len] = 0;
+
+    zx_channel_call_args_t call = {
+        .wr_bytes = &msg,
+        .wr_num_bytes = sizeof(msg.header) + len + 1,
+        .rd_bytes = &msg,
+        .rd_num_bytes = sizeof(msg),
+        .rd_handles = handles,
+        .rd_num_handles = max_handles,
+    };
+    uint32_t actual_bytes;
+    zx_status_t read_status;
+    zx_status_t status = zx_channel_call(svc, 0, ZX_TIME_INFINITE, &call,
+                                         &actual_bytes, actual_handles,
+                                         &read_status);
+    if (status != ZX_OK)
+        return status == ZX_ERR_CALL_FAILED ? read_status : status;
+    return msg.header.arg;
+}
+
+static bool get_basic_info(zx_handle_t handle, zx_info_handle_basic_t* info) {
+    BEGIN_HELPER;
+    ASSERT_EQ(zx_object_get_info(handle, ZX_INFO_HANDLE_BASIC, info,
+                                 sizeof(*info), NULL, NULL), ZX_OK, "");
+    END_HELPER;
+}
+
+bool loader_service_cache_test(void) {
+    BEGIN_TEST;
+
+    loader_service_t* svc;
+    ASSERT_EQ(loader_service_create("cache-test", &counting_ops, NULL, &svc),
+              ZX_OK, "loader_service_create");
+    zx_handle_t h;
+    ASSERT_EQ(loader_service_connect(svc, &h), ZX_OK,
+              "loader_service_connect");
+    counting_load_calls = 0;
+
+    // Objects are loaded afresh each time until caching is enabled.
+    zx_handle_t vmo1 = ZX_HANDLE_INVALID;
+    zx_handle_t vmo2 = ZX_HANDLE_INVALID;
+    uint32_t count = 0;
+    EXPECT_EQ(loader_call(h, LOADER_SVC_OP_LOAD_OBJECT, TEST_SONAME,
+                          strlen(TEST_SONAME), &vmo1, 1, &count), ZX_OK, "");
+    EXPECT_EQ(count, 1u, "");
+    zx_handle_close(vmo1);
+    EXPECT_EQ(loader_call(h, LOADER_SVC_OP_LOAD_OBJECT, TEST_SONAME,
+                          strlen(TEST_SONAME), &vmo2, 1, &count), ZX_OK, "");
+    EXPECT_EQ(count, 1u, "");
+    zx_handle_close(vmo2);
+    EXPECT_EQ(counting_load_calls, 2, "object cached without being enabled");
+
+    ASSERT_EQ(loader_service_enable_cache(svc), ZX_OK,
+              "loader_service_enable_cache");
+    counting_load_calls = 0;
+    EXPECT_EQ(loader_call(h, LOADER_SVC_OP_LOAD_OBJECT, TEST_SONAME,
+                          strlen(TEST_SONAME), &vmo1, 1, &count), ZX_OK, "");
+    EXPECT_EQ(count, 1u, "");
+    EXPECT_EQ(loader_call(h, LOADER_SVC_OP_LOAD_OBJECT, TEST_SONAME,
+                          strlen(TEST_SONAME), &vmo2, 1, &count), ZX_OK, "");
+    EXPECT_EQ(count, 1u, "");
+
+    // The file was only opened once, and both loads share the same VMO,
+    // which neither can write.
+    EXPECT_EQ(counting_load_calls, 1, "object not cached");
+    zx_info_handle_basic_t info1, info2;
+    ASSERT_TRUE(get_basic_info(vmo1, &info1), "");
+    ASSERT_TRUE(get_basic_info(vmo2, &info2), "");
+    EXPECT_EQ(info1.koid, info2.koid, "cached VMO not reused");
+    EXPECT_EQ(info1.rights & ZX_RIGHT_WRITE, 0u, "cached VMO is writable");
+    EXPECT_EQ(info2.rights & ZX_RIGHT_WRITE, 0u, "cached VMO is writable");
+
+    zx_handle_close(vmo1);
+    zx_handle_close(vmo2);
+    zx_handle_close(h);
+
+    END_TEST;
+}
+
+bool loader_service_batch_test(void) {
+    BEGIN_TEST;
+
+    loader_service_t* svc;
+    ASSERT_EQ(loader_service_create("batch-test", &counting_ops, NULL, &svc),
+              ZX_OK, "loader_service_create");
+    zx_handle_t h;
+    ASSERT_EQ(loader_service_connect(svc, &h), ZX_OK,
+              "loader_service_connect");
+
+    zx_handle_t vmos[3];
+    uint32_t count = 0;
+    static const char kNames[] = TEST_SONAME "\0liblaunchpad.so";
+    EXPECT_EQ(loader_call(h, LOADER_SVC_OP_LOAD_OBJECTS, kNames,
+                          sizeof(kNames), vmos, 3, &count), ZX_OK, "");
+    ASSERT_EQ(count, 2u, "wrong number of objects loaded");
+    zx_info_handle_basic_t info;
+    ASSERT_TRUE(get_basic_info(vmos[0], &info), "");
+    EXPECT_EQ(info.type, (uint32_t)ZX_OBJ_TYPE_VMO, "");
+    ASSERT_TRUE(get_basic_info(vmos[1], &info), "");
+    EXPECT_EQ(info.type, (uint32_t)ZX_OBJ_TYPE_VMO, "");
+    for (uint32_t i = 0; i < count; ++i)
+        zx_handle_close(vmos[i]);
+
+    // Loading stops at the first object that cannot be loaded.
+    static const char kMissing[] =
+        TEST_SONAME "\0libdoesnotexist.so\0liblaunchpad.so";
+    EXPECT_EQ(loader_call(h, LOADER_SVC_OP_LOAD_OBJECTS, kMissing,
+                          sizeof(kMissing), vmos, 3, &count),
+              ZX_ERR_NOT_FOUND, "");
+    EXPECT_EQ(count, 1u, "wrong number of objects loaded");
+    for (uint32_t i = 0; i < count; ++i)
+        zx_handle_close(vmos[i]);
+
+    zx_handle_close(h);
+
+    END_TEST;
+}
+
 int main(int argc, char** argv);
 static bool dladdr_main_test(void) {
     BEGIN_TEST;
@@ -180,6 +339,8 @@ BEGIN_TEST_CASE(dlfcn_tests)
 RUN_TEST(dlopen_vmo_test);
 RUN_TEST(loader_service_test);
 RUN_TEST(clone_test);
+RUN_TEST(loader_service_cache_test);
+RUN_TEST(loader_service_batch_test);
 RUN_TEST(dladdr_main_test);
 END_TEST_CASE(dlfcn_tests)
 
@@ -0,0 +1,163 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <threads.h>
+#include <unistd.h>
+
+#include <zircon/syscalls.h>
+#include <fdio/limits.h>
+#include <unittest/unittest.h>
+
+#define MAX_THREADS 8
+#define READS_PER_THREAD 20000
+
+typedef struct {
+    int fd;
+    atomic_bool* stop;
+    int reads;
+    int failures;
+} reader_args_t;
+
+// Reads from an empty non-blocking pipe, which exercises the fd table
+// lookup on every call without waiting on the pipe. The read either
+// fails with EAGAIN or, once the write end is closed, returns 0.
+static int reader(void* arg) {
+    reader_args_t* args = arg;
+    char c;
+    while ((args->stop == NULL && args->reads < READS_PER_THREAD) ||
+           (args->stop != NULL && !atomic_load(args->stop))) {
+        ssize_t r = read(args->fd, &c, 1);
+        if ((r > 0) || ((r < 0) && (errno != EAGAIN))) {
+            args->failures++;
+        }
+        args->reads++;
+    }
+    return 0;
+}
+
+static bool make_pipe(int* rd, int* wr) {
+    int fds[2];
+    ASSERT_EQ(pipe2(fds, O_NONBLOCK), 0, "");
+    *rd = fds[0];
+    *wr = fds[1];
+    return true;
+}
+
+bool fdtab_read_scaling_test(void) {
+    BEGIN_TEST;
+
+    int rd[MAX_THREADS];
+    int wr[MAX_THREADS];
+    for (int i = 0; i < MAX_THREADS; i++) {
+        ASSERT_TRUE(make_pipe(&rd[i], &wr[i]), "");
+    }
+
+    for (int threads = 1; threads <= MAX_THREADS; threads *= 2) {
+        thrd_t t[MAX_THREADS];
+        reader_args_t args[MAX_THREADS];
+        zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+        for (int i = 0; i < threads; i++) {
+            args[i] = (reader_args_t){ .fd = rd[i] };
+            ASSERT_EQ(thrd_create(&t[i], reader, &args[i]), thrd_success, "");
+        }
+        for (int i = 0; i < threads; i++) {
+            ASSERT_EQ(thrd_join(t[i], NULL), thrd_success, "");
+            EXPECT_EQ(args[i].failures, 0, "read() did not fail with EAGAIN");
+        }
+        zx_time_t elapsed = zx_clock_get(ZX_CLOCK_MONOTONIC) - start;
+        unittest_printf("%d threads: %" PRIu64 " ns per read()\n", threads,
+                        elapsed / READS_PER_THREAD);
+    }
+
+    for (int i = 0; i < MAX_THREADS; i++) {
+        EXPECT_EQ(close(rd[i]), 0, "");
+        EXPECT_EQ(close(wr[i]), 0, "");
+    }
+
+    END_TEST;
+}
+
+// Replaces the fd being read from, as fast as possible, while readers look
+// it up concurrently.
+bool fdtab_concurrent_replace_test(void) {
+    BEGIN_TEST;
+
+    int rd, wr;
+    ASSERT_TRUE(make_pipe(&rd, &wr), "");
+
+    atomic_bool stop = ATOMIC_VAR_INIT(false);
+    thrd_t t[4];
+    reader_args_t args[4];
+    for (int i = 0; i < 4; i++) {
+        args[i] = (reader_args_t){ .fd = rd, .stop = &stop };
+        ASSERT_EQ(thrd_create(&t[i], reader, &args[i]), thrd_success, "");
+    }
+
+    for (int i = 0; i < 2000; i++) {
+        int rd2, wr2;
+        ASSERT_TRUE(make_pipe(&rd2, &wr2), "");
+        ASSERT_EQ(dup2(rd2, rd), rd, "");
+        ASSERT_EQ(close(rd2), 0, "");
+        ASSERT_EQ(close(wr2), 0, "");
+    }
+
+    atomic_store(&stop, true);
+    for (int i = 0; i < 4; i++) {
+        ASSERT_EQ(thrd_join(t[i], NULL), thrd_success, "");
+        // A read racing with the dup2() which closes its pipe may fail, but
+        // must never see a freed fdio_t.
+        EXPECT_GT(args[i].reads, 0, "");
+    }
+    EXPECT_EQ(close(rd), 0, "");
+    EXPECT_EQ(close(wr), 0, "");
+
+    END_TEST;
+}
+
+bool fdtab_lowest_free_test(void) {
+    BEGIN_TEST;
+
+    // Fill the table, spanning several words of the allocation bitmap.
+    int fds[FDIO_MAX_FD];
+    int count = 0;
+    int fd;
+    while ((fd = dup(0)) >= 0) {
+        fds[count++] = fd;
+    }
+    EXPECT_EQ(errno, EMFILE, "");
+    ASSERT_GT(count, 128, "");
+
+    // The lowest free descriptor is always the one handed out.
+    int holes[] = { fds[count - 1], fds[100], fds[63], fds[64], fds[3] };
+    for (size_t i = 0; i < countof(holes); i++) {
+        EXPECT_EQ(close(holes[i]), 0, "");
+    }
+    int expected[] = { fds[3], fds[63], fds[64], fds[100], fds[count - 1] };
+    for (size_t i = 0; i < countof(expected); i++) {
+        EXPECT_EQ(dup(0), expected[i], "");
+    }
+    EXPECT_EQ(dup(0), -1, "");
+
+    EXPECT_EQ(fcntl(0, F_DUPFD, fds[100]), -1, "");
+    EXPECT_EQ(close(fds[count - 2]), 0, "");
+    EXPECT_EQ(fcntl(0, F_DUPFD, fds[100]), fds[count - 2], "");
+
+    for (int i = 0; i < count; i++) {
+        EXPECT_EQ(close(fds[i]), 0, "");
+    }
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(fdio_fdtab_test)
+RUN_TEST(fdtab_concurrent_replace_test);
+RUN_TEST(fdtab_lowest_free_test);
+RUN_TEST_PERFORMANCE(fdtab_read_scaling_test);
+END_TEST_CASE(fdio_fdtab_test)
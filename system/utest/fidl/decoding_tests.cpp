@@ -188,6 +188,47 @@ bool decode_single_present_handle_unaligned_error() {
     END_TEST;
 }
 
+bool decode_single_present_handle_surplus_handle_error() {
+    BEGIN_TEST;
+
+    nonnullable_handle_message_layout message = {};
+    message.inline_struct.handle = FIDL_HANDLE_PRESENT;
+
+    // One more handle than the message claims.
+    zx_handle_t handles[] = {
+        dummy_handle_0,
+        dummy_handle_1,
+    };
+
+    const char* error = nullptr;
+    auto status = fidl_decode(&nonnullable_handle_message_type, &message, sizeof(message), handles,
+                              ArrayCount(handles), &error);
+
+    EXPECT_EQ(status, ZX_ERR_INVALID_ARGS);
+    EXPECT_NONNULL(error);
+
+    END_TEST;
+}
+
+bool decode_absent_handle_too_many_handles_error() {
+    BEGIN_TEST;
+
+    nullable_handle_message_layout message = {};
+    message.inline_struct.handle = FIDL_HANDLE_ABSENT;
+
+    // More handles than could fit in the message at all.
+    zx_handle_t handles[sizeof(message) / sizeof(zx_handle_t) + 1] = {};
+
+    const char* error = nullptr;
+    auto status = fidl_decode(&nullable_handle_message_type, &message, sizeof(message), handles,
+                              ArrayCount(handles), &error);
+
+    EXPECT_EQ(status, ZX_ERR_INVALID_ARGS);
+    EXPECT_NONNULL(error);
+
+    END_TEST;
+}
+
 bool decode_multiple_present_handles() {
     BEGIN_TEST;
 
@@ -1472,6 +1513,8 @@ END_TEST_CASE(null_parameters)
 BEGIN_TEST_CASE(handles)
 RUN_TEST(decode_single_present_handle)
 RUN_TEST(decode_single_present_handle_unaligned_error)
+RUN_TEST(decode_single_present_handle_surplus_handle_error)
+RUN_TEST(decode_absent_handle_too_many_handles_error)
 RUN_TEST(decode_multiple_present_handles)
 RUN_TEST(decode_single_absent_handle)
 RUN_TEST(decode_multiple_absent_handles)
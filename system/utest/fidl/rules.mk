@@ -15,7 +15,9 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/encoding_tests.cpp \
     $(LOCAL_DIR)/fidl_coded_types.cpp \
     $(LOCAL_DIR)/main.c \
+    $(LOCAL_DIR)/message_arena_tests.cpp \
     $(LOCAL_DIR)/message_tests.cpp \
+    $(LOCAL_DIR)/static_coding_tests.cpp \
 
 MODULE_NAME := fidl-test
 
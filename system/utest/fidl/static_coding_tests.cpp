@@ -0,0 +1,386 @@
+// Copyright 2018 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <fidl/coding.h>
+#include <fidl/cpp/static_coding.h>
+#include <fidl/internal.h>
+#include <zircon/syscalls.h>
+
+#include <unittest/unittest.h>
+
+#include "fidl_coded_types.h"
+#include "fidl_structs.h"
+
+namespace fidl {
+namespace {
+
+constexpr uint32_t kMaxHandles = 16u;
+
+// Static descriptions of some of the messages in fidl_coded_types.cpp.
+using NonnullableHandle = coding::Handle<kNonnullable>;
+using NullableHandle = coding::Handle<kNullable>;
+
+using MultipleNullableHandlesMessage = coding::Struct<
+    sizeof(multiple_nullable_handles_inline_data),
+    coding::Field<offsetof(multiple_nullable_handles_inline_data, handle_0), NullableHandle>,
+    coding::Field<offsetof(multiple_nullable_handles_inline_data, handle_1), NullableHandle>,
+    coding::Field<offsetof(multiple_nullable_handles_inline_data, handle_2), NullableHandle>>;
+
+using MultipleNullableStringsMessage = coding::Struct<
+    sizeof(multiple_nullable_strings_inline_data),
+    coding::Field<offsetof(multiple_nullable_strings_inline_data, string),
+                  coding::String<32, kNullable>>,
+    coding::Field<offsetof(multiple_nullable_strings_inline_data, string2),
+                  coding::String<32, kNullable>>>;
+
+using VectorOfHandlesMessage = coding::Struct<
+    sizeof(unbounded_nonnullable_vector_of_handles_inline_data),
+    coding::Field<offsetof(unbounded_nonnullable_vector_of_handles_inline_data, vector),
+                  coding::Vector<NonnullableHandle>>>;
+
+using OutOfLineArrayMessage = coding::Struct<
+    sizeof(out_of_line_array_of_nonnullable_handles_inline_data),
+    coding::Field<offsetof(out_of_line_array_of_nonnullable_handles_inline_data, maybe_array),
+                  coding::Pointer<coding::Struct<
+                      sizeof(array_of_nonnullable_handles),
+                      coding::Field<offsetof(array_of_nonnullable_handles, handles),
+                                    coding::Array<NonnullableHandle, 4>>>>>>;
+
+using ArrayOfNonnullableHandlesUnion = coding::Union<
+    sizeof(array_of_nonnullable_handles_union),
+    NonnullableHandle,
+    coding::Array<NonnullableHandle, 2>,
+    coding::Array<coding::Array<NonnullableHandle, 2>, 2>>;
+
+using UnionPointerMessage = coding::Struct<
+    sizeof(array_of_nonnullable_handles_union_ptr_inline_data),
+    coding::Field<offsetof(array_of_nonnullable_handles_union_ptr_inline_data, data),
+                  coding::Pointer<ArrayOfNonnullableHandlesUnion>>>;
+
+// Encodes and decodes two copies of a message, one with the table-driven
+// coders and one with the static ones, and checks that both produce the
+// same bytes and handles.
+template <typename Type, typename Layout>
+bool CodesLikeTable(const fidl_type_t* table, void (*init)(Layout*)) {
+    BEGIN_HELPER;
+
+    Layout expected;
+    Layout actual;
+    memset(&expected, 0, sizeof(expected));
+    memset(&actual, 0, sizeof(actual));
+    init(&expected);
+    init(&actual);
+
+    zx_handle_t expected_handles[kMaxHandles] = {};
+    zx_handle_t actual_handles[kMaxHandles] = {};
+    uint32_t expected_count = 0u;
+    uint32_t actual_count = 0u;
+    const char* error = nullptr;
+    ASSERT_EQ(fidl_encode(table, &expected, sizeof(Layout), expected_handles, kMaxHandles,
+                          &expected_count, &error), ZX_OK, error);
+    ASSERT_EQ(StaticEncode<Type>(&actual, sizeof(Layout), actual_handles, kMaxHandles,
+                                 &actual_count, &error), ZX_OK, error);
+    ASSERT_EQ(expected_count, actual_count);
+    EXPECT_BYTES_EQ(reinterpret_cast<uint8_t*>(&expected), reinterpret_cast<uint8_t*>(&actual),
+                    sizeof(Layout), "encoded bytes");
+    EXPECT_BYTES_EQ(reinterpret_cast<uint8_t*>(expected_handles),
+                    reinterpret_cast<uint8_t*>(actual_handles),
+                    sizeof(zx_handle_t) * expected_count, "encoded handles");
+
+    // The decoded messages point into different buffers, so check them by
+    // encoding them once more.
+    ASSERT_EQ(fidl_decode(table, &expected, sizeof(Layout), expected_handles, expected_count,
+                          &error), ZX_OK, error);
+    ASSERT_EQ(StaticDecode<Type>(&actual, sizeof(Layout), actual_handles, actual_count, &error),
+              ZX_OK, error);
+    ASSERT_EQ(fidl_encode(table, &expected, sizeof(Layout), expected_handles, kMaxHandles,
+                          &expected_count, &error), ZX_OK, error);
+    ASSERT_EQ(fidl_encode(table, &actual, sizeof(Layout), actual_handles, kMaxHandles,
+                          &actual_count, &error), ZX_OK, error);
+    EXPECT_BYTES_EQ(reinterpret_cast<uint8_t*>(&expected), reinterpret_cast<uint8_t*>(&actual),
+                    sizeof(Layout), "re-encoded bytes");
+
+    END_HELPER;
+}
+
+bool static_coding_handles() {
+    BEGIN_TEST;
+
+    EXPECT_TRUE((CodesLikeTable<MultipleNullableHandlesMessage>(
+        &multiple_nullable_handles_message_type,
+        +[](multiple_nullable_handles_message_layout* message) {
+            message->inline_struct.data_0 = 0xff;
+            message->inline_struct.handle_0 = static_cast<zx_handle_t>(23);
+            message->inline_struct.handle_1 = ZX_HANDLE_INVALID;
+            message->inline_struct.handle_2 = static_cast<zx_handle_t>(24);
+            message->inline_struct.data_2 = 0xffffffffffffffffull;
+        })));
+
+    END_TEST;
+}
+
+bool static_coding_strings() {
+    BEGIN_TEST;
+
+    EXPECT_TRUE((CodesLikeTable<MultipleNullableStringsMessage>(
+        &multiple_nullable_strings_message_type,
+        +[](multiple_nullable_strings_message_layout* message) {
+            memcpy(message->data, "hello ", 6);
+            memcpy(message->data2, "world!!!", 8);
+            message->inline_struct.string = fidl_string_t{6, &message->data[0]};
+            message->inline_struct.string2 = fidl_string_t{8, &message->data2[0]};
+        })));
+
+    END_TEST;
+}
+
+bool static_coding_vectors() {
+    BEGIN_TEST;
+
+    EXPECT_TRUE((CodesLikeTable<VectorOfHandlesMessage>(
+        &unbounded_nonnullable_vector_of_handles_message_type,
+        +[](unbounded_nonnullable_vector_of_handles_message_layout* message) {
+            for (uint32_t i = 0u; i < 4u; i++)
+                message->handles[i] = static_cast<zx_handle_t>(23 + i);
+            message->inline_struct.vector = fidl_vector_t{4, &message->handles[0]};
+        })));
+
+    END_TEST;
+}
+
+bool static_coding_struct_pointers() {
+    BEGIN_TEST;
+
+    EXPECT_TRUE((CodesLikeTable<OutOfLineArrayMessage>(
+        &out_of_line_array_of_nonnullable_handles_message_type,
+        +[](out_of_line_array_of_nonnullable_handles_message_layout* message) {
+            for (uint32_t i = 0u; i < 4u; i++)
+                message->data.handles[i] = static_cast<zx_handle_t>(23 + i);
+            message->inline_struct.maybe_array = &message->data;
+        })));
+
+    END_TEST;
+}
+
+bool static_coding_unions() {
+    BEGIN_TEST;
+
+    EXPECT_TRUE((CodesLikeTable<UnionPointerMessage>(
+        &array_of_nonnullable_handles_union_ptr_message_type,
+        +[](array_of_nonnullable_handles_union_ptr_message_layout* message) {
+            message->data.tag = array_of_nonnullable_handles_union_kArrayOfArrayOfHandles;
+            message->data.array_of_array_of_handles[0][0] = static_cast<zx_handle_t>(23);
+            message->data.array_of_array_of_handles[0][1] = static_cast<zx_handle_t>(24);
+            message->data.array_of_array_of_handles[1][0] = static_cast<zx_handle_t>(25);
+            message->data.array_of_array_of_handles[1][1] = static_cast<zx_handle_t>(26);
+            message->inline_struct.data = &message->data;
+        })));
+
+    END_TEST;
+}
+
+bool static_coding_errors() {
+    BEGIN_TEST;
+
+    // Too few handles to encode into.
+    {
+        multiple_nullable_handles_message_layout message = {};
+        message.inline_struct.handle_0 = static_cast<zx_handle_t>(23);
+        message.inline_struct.handle_2 = static_cast<zx_handle_t>(24);
+        zx_handle_t handles[1] = {};
+        uint32_t actual_handles = 0u;
+        const char* error = nullptr;
+        EXPECT_EQ(StaticEncode<MultipleNullableHandlesMessage>(
+                      &message, sizeof(message), handles, 1u, &actual_handles, &error),
+                  ZX_ERR_INVALID_ARGS);
+        EXPECT_NONNULL(error);
+    }
+
+    // A string longer than its bound.
+    {
+        multiple_nullable_strings_message_layout message = {};
+        message.inline_struct.string =
+            fidl_string_t{33, reinterpret_cast<char*>(FIDL_ALLOC_PRESENT)};
+        const char* error = nullptr;
+        EXPECT_EQ(StaticDecode<MultipleNullableStringsMessage>(
+                      &message, sizeof(message), nullptr, 0u, &error),
+                  ZX_ERR_INVALID_ARGS);
+        EXPECT_NONNULL(error);
+    }
+
+    // Trailing bytes which the message does not account for.
+    {
+        uint8_t bytes[sizeof(multiple_nullable_handles_inline_data) + FIDL_ALIGNMENT] = {};
+        const char* error = nullptr;
+        EXPECT_EQ(StaticDecode<MultipleNullableHandlesMessage>(
+                      bytes, sizeof(bytes), nullptr, 0u, &error),
+                  ZX_ERR_INVALID_ARGS);
+        EXPECT_NONNULL(error);
+    }
+
+    // A bad union tag.
+    {
+        array_of_nonnullable_handles_union_ptr_message_layout message = {};
+        message.inline_struct.data = reinterpret_cast<array_of_nonnullable_handles_union*>(
+            FIDL_ALLOC_PRESENT);
+        message.data.tag = 3u;
+        const char* error = nullptr;
+        EXPECT_EQ(StaticDecode<UnionPointerMessage>(&message, sizeof(message), nullptr, 0u,
+                                                    &error),
+                  ZX_ERR_INVALID_ARGS);
+        EXPECT_NONNULL(error);
+    }
+
+    END_TEST;
+}
+
+// A small message with a fixed layout, such as a request to set a value.
+struct alignas(FIDL_ALIGNMENT) fixed_layout_message {
+    fidl_message_header_t header;
+    uint64_t id;
+    uint32_t flags;
+    uint32_t value;
+    int64_t deadline;
+};
+
+using FixedLayoutMessage = coding::Struct<sizeof(fixed_layout_message)>;
+
+const fidl_type_t fixed_layout_message_type =
+    fidl_type_t(FidlCodedStruct(nullptr, 0u, sizeof(fixed_layout_message)));
+
+bool static_coding_copy() {
+    BEGIN_TEST;
+
+    static_assert(!FixedLayoutMessage::kNeedsCoding, "");
+
+    fixed_layout_message message = {};
+    message.header.ordinal = 1u;
+    message.id = 42u;
+    message.value = 7u;
+
+    uint8_t buffer[2 * sizeof(fixed_layout_message)];
+    BytePart bytes(buffer, sizeof(buffer));
+    const char* error = nullptr;
+    ASSERT_EQ(StaticEncodeCopy<FixedLayoutMessage>(message, &bytes, &error), ZX_OK, error);
+    EXPECT_EQ(bytes.actual(), sizeof(fixed_layout_message));
+
+    fixed_layout_message decoded = {};
+    ASSERT_EQ(StaticDecodeCopy<FixedLayoutMessage>(bytes, &decoded, &error), ZX_OK, error);
+    EXPECT_EQ(decoded.id, 42u);
+    EXPECT_EQ(decoded.value, 7u);
+
+    BytePart small_bytes(buffer, sizeof(fixed_layout_message) - 1u);
+    EXPECT_EQ(StaticEncodeCopy<FixedLayoutMessage>(message, &small_bytes, &error),
+              ZX_ERR_INVALID_ARGS);
+
+    bytes.set_actual(sizeof(fixed_layout_message) + FIDL_ALIGNMENT);
+    EXPECT_EQ(StaticDecodeCopy<FixedLayoutMessage>(bytes, &decoded, &error),
+              ZX_ERR_INVALID_ARGS);
+
+    END_TEST;
+}
+
+constexpr uint32_t kNumIterations = 100000u;
+
+inline zx_time_t now() {
+    return zx_clock_get(ZX_CLOCK_MONOTONIC);
+}
+
+// Encodes and decodes |message| in place |kNumIterations| times, with both
+// the table-driven and the static coders, and reports the time taken per
+// round trip.
+template <typename Type, typename Layout>
+bool BenchmarkCoding(const char* name, const fidl_type_t* table, Layout* message) {
+    BEGIN_HELPER;
+
+    zx_handle_t handles[kMaxHandles];
+    uint32_t actual_handles = 0u;
+    const char* error = nullptr;
+
+    zx_time_t start = now();
+    for (uint32_t i = 0u; i < kNumIterations; i++) {
+        ASSERT_EQ(fidl_encode(table, message, sizeof(Layout), handles, kMaxHandles,
+                              &actual_handles, &error), ZX_OK, error);
+        ASSERT_EQ(fidl_decode(table, message, sizeof(Layout), handles, actual_handles, &error),
+                  ZX_OK, error);
+    }
+    zx_time_t table_time = now() - start;
+
+    start = now();
+    for (uint32_t i = 0u; i < kNumIterations; i++) {
+        ASSERT_EQ(StaticEncode<Type>(message, sizeof(Layout), handles, kMaxHandles,
+                                     &actual_handles, &error), ZX_OK, error);
+        ASSERT_EQ(StaticDecode<Type>(message, sizeof(Layout), handles, actual_handles, &error),
+                  ZX_OK, error);
+    }
+    zx_time_t static_time = now() - start;
+
+    unittest_printf("%s: %" PRIu64 " ns per table-driven round trip, %" PRIu64
+                    " ns per static round trip\n",
+                    name, table_time / kNumIterations, static_time / kNumIterations);
+
+    END_HELPER;
+}
+
+bool static_coding_benchmark() {
+    BEGIN_TEST;
+
+    fixed_layout_message fixed = {};
+    EXPECT_TRUE((BenchmarkCoding<FixedLayoutMessage>("fixed layout", &fixed_layout_message_type,
+                                                     &fixed)));
+
+    multiple_nullable_handles_message_layout handles = {};
+    handles.inline_struct.handle_0 = static_cast<zx_handle_t>(23);
+    handles.inline_struct.handle_2 = static_cast<zx_handle_t>(24);
+    EXPECT_TRUE((BenchmarkCoding<MultipleNullableHandlesMessage>(
+        "handles", &multiple_nullable_handles_message_type, &handles)));
+
+    multiple_nullable_strings_message_layout strings = {};
+    strings.inline_struct.string = fidl_string_t{6, &strings.data[0]};
+    strings.inline_struct.string2 = fidl_string_t{8, &strings.data2[0]};
+    EXPECT_TRUE((BenchmarkCoding<MultipleNullableStringsMessage>(
+        "strings", &multiple_nullable_strings_message_type, &strings)));
+
+    array_of_nonnullable_handles_union_ptr_message_layout unions = {};
+    unions.data.tag = array_of_nonnullable_handles_union_kArrayOfArrayOfHandles;
+    unions.data.array_of_array_of_handles[0][0] = static_cast<zx_handle_t>(23);
+    unions.data.array_of_array_of_handles[0][1] = static_cast<zx_handle_t>(24);
+    unions.data.array_of_array_of_handles[1][0] = static_cast<zx_handle_t>(25);
+    unions.data.array_of_array_of_handles[1][1] = static_cast<zx_handle_t>(26);
+    unions.inline_struct.data = &unions.data;
+    EXPECT_TRUE((BenchmarkCoding<UnionPointerMessage>(
+        "union pointer", &array_of_nonnullable_handles_union_ptr_message_type, &unions)));
+
+    // The copy path for fixed layout messages, for comparison.
+    uint8_t buffer[sizeof(fixed_layout_message)];
+    BytePart bytes(buffer, sizeof(buffer));
+    const char* error = nullptr;
+    zx_time_t start = now();
+    for (uint32_t i = 0u; i < kNumIterations; i++) {
+        ASSERT_EQ(StaticEncodeCopy<FixedLayoutMessage>(fixed, &bytes, &error), ZX_OK, error);
+        ASSERT_EQ(StaticDecodeCopy<FixedLayoutMessage>(bytes, &fixed, &error), ZX_OK, error);
+    }
+    unittest_printf("fixed layout: %" PRIu64 " ns per static copy round trip\n",
+                    (now() - start) / kNumIterations);
+
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(static_coding)
+RUN_TEST(static_coding_handles)
+RUN_TEST(static_coding_strings)
+RUN_TEST(static_coding_vectors)
+RUN_TEST(static_coding_struct_pointers)
+RUN_TEST(static_coding_unions)
+RUN_TEST(static_coding_errors)
+RUN_TEST(static_coding_copy)
+RUN_TEST_PERFORMANCE(static_coding_benchmark)
+END_TEST_CASE(static_coding)
+
+} // namespace
+} // namespace fidl
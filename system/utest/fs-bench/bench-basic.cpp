@@ -11,6 +11,7 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#include <threads.h>
 #include <unistd.h>
 
 #include <zircon/device/vfs.h>
@@ -106,6 +107,53 @@ bool benchmark_write_read(void) {
     END_TEST;
 }
 
+// Measures reading a file which is not cached by the filesystem, such as
+// one written before the filesystem was mounted. On filesystems which load
+// a file's contents when it is opened, this is dominated by the number of
+// requests needed to load the file.
+template <size_t DataSize, size_t NumOps>
+bool benchmark_cold_read(void) {
+    BEGIN_TEST;
+    int fd = open(MOUNT_POINT "/bigfile", O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "Cannot create file (FS benchmarks assume mounted FS exists at '/benchmark')");
+    const size_t size_mb = (DataSize * NumOps) / MB;
+    if (size_mb > 64 && benchmark_banned(fd, "memfs")) {
+        return true;
+    }
+    printf("\nBenchmarking Cold Read (%lu MB)\n", size_mb);
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[DataSize]);
+    ASSERT_EQ(ac.check(), true);
+    memset(data.get(), kMagicByte, DataSize);
+
+    for (size_t i = 0; i < NumOps; i++) {
+        ASSERT_EQ(write(fd, data.get(), DataSize), DataSize);
+    }
+    ASSERT_EQ(syncfs(fd), 0);
+    ASSERT_EQ(close(fd), 0);
+
+    for (int i = 0; i < kWriteReadCycles; i++) {
+        char str[100];
+        snprintf(str, sizeof(str), "read %d", i);
+
+        // Once the last connection to the file is closed, its cached
+        // contents are released.
+        fd = open(MOUNT_POINT "/bigfile", O_RDONLY);
+        ASSERT_GT(fd, 0);
+        uint64_t start = zx_ticks_get();
+        for (size_t count = 0; count < NumOps; count++) {
+            ASSERT_EQ(read(fd, data.get(), DataSize), DataSize);
+            ASSERT_EQ(data[0], kMagicByte);
+        }
+        time_end(str, start);
+        ASSERT_EQ(close(fd), 0);
+    }
+
+    ASSERT_EQ(unlink(MOUNT_POINT "/bigfile"), 0);
+    END_TEST;
+}
+
 #define START_STRING "/aaa"
 
 size_t constexpr kComponentLength = fbl::constexpr_strlen(START_STRING);
@@ -202,14 +250,107 @@ bool benchmark_path_walk(void) {
     END_TEST;
 }
 
+constexpr size_t kClientFileSize = 256 * KB;
+constexpr size_t kClientReadSize = 4 * KB;
+constexpr size_t kClientOps = 2048;
+
+struct ClientArgs {
+    int index;
+    bool success;
+};
+
+// Each client reads and stats its own file, so any contention between
+// clients is within the filesystem server, rather than on shared files.
+int concurrent_client(void* arg) {
+    ClientArgs* args = static_cast<ClientArgs*>(arg);
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), MOUNT_POINT "/client-%d", args->index);
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    uint8_t buf[kClientReadSize];
+    for (size_t i = 0; i < kClientOps; i++) {
+        off_t off = static_cast<off_t>((i * kClientReadSize) % kClientFileSize);
+        struct stat st;
+        if (pread(fd, buf, sizeof(buf), off) != static_cast<ssize_t>(sizeof(buf)) ||
+            buf[0] != kMagicByte || stat(path, &st) != 0) {
+            close(fd);
+            return -1;
+        }
+    }
+    args->success = close(fd) == 0;
+    return 0;
+}
+
+// Every client performs the same amount of work, so if the filesystem scales
+// with the number of clients, the elapsed time should not grow with them.
+template <int NumClients>
+bool benchmark_concurrent_clients(void) {
+    BEGIN_TEST;
+    printf("\nBenchmarking Concurrent read + stat (%d clients)\n", NumClients);
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kClientFileSize]);
+    ASSERT_EQ(ac.check(), true);
+    memset(data.get(), kMagicByte, kClientFileSize);
+
+    char path[PATH_MAX];
+    for (int i = 0; i < NumClients; i++) {
+        snprintf(path, sizeof(path), MOUNT_POINT "/client-%d", i);
+        int fd = open(path, O_CREAT | O_RDWR, 0644);
+        ASSERT_GT(fd, 0, "Cannot create file");
+        ASSERT_EQ(write(fd, data.get(), kClientFileSize), kClientFileSize);
+        ASSERT_EQ(close(fd), 0);
+    }
+
+    ClientArgs args[NumClients];
+    thrd_t threads[NumClients];
+    int created = 0;
+    uint64_t start = zx_ticks_get();
+    for (; created < NumClients; created++) {
+        args[created].index = created;
+        args[created].success = false;
+        if (thrd_create(&threads[created], concurrent_client, &args[created]) != thrd_success) {
+            break;
+        }
+    }
+    // Clients which were started must be joined before anything is asserted.
+    for (int i = 0; i < created; i++) {
+        thrd_join(threads[i], nullptr);
+    }
+    time_end("read + stat", start);
+    ASSERT_EQ(created, NumClients, "Cannot create client thread");
+    for (int i = 0; i < NumClients; i++) {
+        ASSERT_TRUE(args[i].success, "Client failed");
+    }
+
+    for (int i = 0; i < NumClients; i++) {
+        snprintf(path, sizeof(path), MOUNT_POINT "/client-%d", i);
+        ASSERT_EQ(unlink(path), 0);
+    }
+    int fd = open(MOUNT_POINT, O_DIRECTORY | O_RDONLY);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(syncfs(fd), 0);
+    ASSERT_EQ(close(fd), 0);
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(basic_benchmarks)
 RUN_TEST_PERFORMANCE((benchmark_write_read<16 * KB, 1024>))
 RUN_TEST_PERFORMANCE((benchmark_write_read<16 * KB, 2048>))
 RUN_TEST_PERFORMANCE((benchmark_write_read<16 * KB, 4096>))
 RUN_TEST_PERFORMANCE((benchmark_write_read<16 * KB, 8192>))
 RUN_TEST_PERFORMANCE((benchmark_write_read<16 * KB, 16384>))
+RUN_TEST_PERFORMANCE((benchmark_write_read<64 * KB, 16384>))
+RUN_TEST_PERFORMANCE((benchmark_cold_read<64 * KB, 4096>))
+RUN_TEST_PERFORMANCE((benchmark_cold_read<64 * KB, 16384>))
 RUN_TEST_PERFORMANCE((benchmark_path_walk<125>))
 RUN_TEST_PERFORMANCE((benchmark_path_walk<250>))
 RUN_TEST_PERFORMANCE((benchmark_path_walk<500>))
 RUN_TEST_PERFORMANCE((benchmark_path_walk<1000>))
+RUN_TEST_PERFORMANCE((benchmark_concurrent_clients<1>))
+RUN_TEST_PERFORMANCE((benchmark_concurrent_clients<2>))
+RUN_TEST_PERFORMANCE((benchmark_concurrent_clients<4>))
+RUN_TEST_PERFORMANCE((benchmark_concurrent_clients<8>))
 END_TEST_CASE(basic_benchmarks)
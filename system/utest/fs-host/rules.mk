@@ -15,11 +15,13 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/util.cpp \
     $(LOCAL_DIR)/test-basic.cpp \
     $(LOCAL_DIR)/test-directory.cpp \
+    $(LOCAL_DIR)/test-journal.cpp \
     $(LOCAL_DIR)/test-maxfile.cpp \
     $(LOCAL_DIR)/test-rw-workers.cpp \
     $(LOCAL_DIR)/test-sparse.cpp \
     $(LOCAL_DIR)/test-truncate.cpp \
     system/ulib/bitmap/raw-bitmap.cpp \
+    system/ulib/fs/dentry-cache.cpp \
     system/ulib/fs/vfs.cpp \
     system/ulib/fs/vnode.cpp \
 
@@ -37,6 +39,7 @@ MODULE_COMPILEFLAGS := \
     -Isystem/ulib/fbl/include \
     -Isystem/ulib/fdio/include \
     -Isystem/ulib/zircon/include \
+    -Ithird_party/ulib/cksum/include \
 
 MODULE_HOST_LIBS := \
     system/ulib/unittest.hostlib \
@@ -0,0 +1,320 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_fd.h>
+#include <fbl/unique_ptr.h>
+#include <fbl/vector.h>
+#include <lib/cksum.h>
+#include <minfs/bcache.h>
+#include <minfs/format.h>
+#include <minfs/fsck.h>
+
+#include "util.h"
+
+// The journal tests use an image of their own, which is modified behind the
+// back of the filesystem to simulate a crash before the journal was
+// checkpointed. Mounting the image again replays the journal.
+#define JOURNAL_PATH "/tmp/zircon-fs-test-journal"
+
+namespace {
+
+constexpr size_t kBlockSize = minfs::kMinfsBlockSize;
+constexpr uint32_t kImageBlocks = 4096;
+
+// The contents of the image before and after a directory and a file were
+// created, and the blocks which differ between the two.
+struct journal_image_t {
+    fbl::unique_ptr<uint8_t[]> before;
+    fbl::unique_ptr<uint8_t[]> after;
+    fbl::Vector<minfs::blk_t> changed;
+    minfs::minfs_info_t info;
+};
+
+bool read_image(fbl::unique_ptr<uint8_t[]>* out) {
+    BEGIN_HELPER;
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> image(new (&ac) uint8_t[kImageBlocks * kBlockSize]);
+    ASSERT_TRUE(ac.check());
+    fbl::unique_fd fd(open(JOURNAL_PATH, O_RDONLY));
+    ASSERT_TRUE(fd);
+    ASSERT_EQ(pread(fd.get(), image.get(), kImageBlocks * kBlockSize, 0),
+              static_cast<ssize_t>(kImageBlocks * kBlockSize));
+    *out = fbl::move(image);
+    END_HELPER;
+}
+
+bool write_block(minfs::blk_t bno, const void* data) {
+    BEGIN_HELPER;
+    fbl::unique_fd fd(open(JOURNAL_PATH, O_RDWR));
+    ASSERT_TRUE(fd);
+    ASSERT_EQ(pwrite(fd.get(), data, kBlockSize, bno * kBlockSize),
+              static_cast<ssize_t>(kBlockSize));
+    END_HELPER;
+}
+
+// Creates a filesystem, and records the blocks modified by creating
+// "::dir/file". The image is then restored to its state before the file
+// was created, as if the modified blocks never reached the disk.
+bool setup_journal_image(journal_image_t* image) {
+    BEGIN_HELPER;
+    int fd = open(JOURNAL_PATH, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    ASSERT_GE(fd, 0);
+    ASSERT_EQ(ftruncate(fd, kImageBlocks * kBlockSize), 0);
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(emu_mkfs(JOURNAL_PATH), 0);
+    ASSERT_TRUE(read_image(&image->before));
+
+    ASSERT_EQ(emu_mount(JOURNAL_PATH), 0);
+    ASSERT_EQ(emu_mkdir("::dir", 0755), 0);
+    fd = emu_open("::dir/file", O_RDWR | O_CREAT, 0644);
+    ASSERT_GT(fd, 0);
+    const char data[] = "journaled";
+    ASSERT_EQ(emu_write(fd, data, sizeof(data)), static_cast<ssize_t>(sizeof(data)));
+    ASSERT_EQ(emu_close(fd), 0);
+    ASSERT_TRUE(read_image(&image->after));
+
+    memcpy(&image->info, &image->before[0], sizeof(image->info));
+    for (minfs::blk_t bno = 0; bno < kImageBlocks; bno++) {
+        if (memcmp(&image->before[bno * kBlockSize], &image->after[bno * kBlockSize],
+                   kBlockSize)) {
+            ASSERT_TRUE((bno < image->info.jnl_block) ||
+                        (bno >= image->info.jnl_block + image->info.jnl_block_count),
+                        "Host writes should bypass the journal");
+            image->changed.push_back(bno);
+        }
+    }
+    ASSERT_GE(image->changed.size(), 2u, "Creating a file should modify several blocks");
+
+    for (size_t i = 0; i < image->changed.size(); i++) {
+        minfs::blk_t bno = image->changed[i];
+        ASSERT_TRUE(write_block(bno, &image->before[bno * kBlockSize]));
+    }
+    END_HELPER;
+}
+
+// Returns the number of blocks in the circular log.
+uint32_t log_blocks(const journal_image_t& image) {
+    return image.info.jnl_block_count - 1;
+}
+
+// Returns the device block holding block |n| of the log.
+minfs::blk_t log_bno(const journal_image_t& image, uint64_t n) {
+    return image.info.jnl_block + 1 + static_cast<minfs::blk_t>(n % log_blocks(image));
+}
+
+bool write_journal_info(const journal_image_t& image, uint32_t start, uint64_t seq) {
+    BEGIN_HELPER;
+    uint8_t blk[kBlockSize];
+    memset(blk, 0, sizeof(blk));
+    minfs::minfs_journal_info_t* jinfo = reinterpret_cast<minfs::minfs_journal_info_t*>(blk);
+    jinfo->magic = minfs::kMinfsJournalMagic;
+    jinfo->seq = seq;
+    jinfo->start = start;
+    ASSERT_TRUE(write_block(image.info.jnl_block, blk));
+    END_HELPER;
+}
+
+bool check_journal_info(const journal_image_t& image, uint32_t start, uint64_t seq) {
+    BEGIN_HELPER;
+    fbl::unique_fd fd(open(JOURNAL_PATH, O_RDONLY));
+    ASSERT_TRUE(fd);
+    minfs::minfs_journal_info_t jinfo;
+    ASSERT_EQ(pread(fd.get(), &jinfo, sizeof(jinfo), image.info.jnl_block * kBlockSize),
+              static_cast<ssize_t>(sizeof(jinfo)));
+    ASSERT_EQ(jinfo.magic, minfs::kMinfsJournalMagic);
+    ASSERT_EQ(jinfo.start, start, "Unexpected journal start");
+    ASSERT_EQ(jinfo.seq, seq, "Unexpected journal sequence number");
+    END_HELPER;
+}
+
+// Writes an entry with sequence number |seq| at block |pos| of the log,
+// holding |count| blocks of |data| which target |targets|. Returns the
+// position following the entry in |pos|.
+bool write_journal_entry(const journal_image_t& image, uint64_t* pos, uint64_t seq,
+                         const minfs::blk_t* targets, size_t count, const uint8_t* data) {
+    BEGIN_HELPER;
+    ASSERT_LE(count, minfs::kMinfsJournalEntryMaxBlocks);
+    uint8_t blk[kBlockSize];
+    memset(blk, 0, sizeof(blk));
+    minfs::minfs_journal_entry_t* header = reinterpret_cast<minfs::minfs_journal_entry_t*>(blk);
+    header->magic = minfs::kMinfsJournalEntryMagic;
+    header->seq = seq;
+    header->block_count = static_cast<uint32_t>(count);
+    for (size_t i = 0; i < count; i++) {
+        header->target[i] = targets[i];
+    }
+    uint32_t checksum = crc32(0, blk, kBlockSize);
+    ASSERT_TRUE(write_block(log_bno(image, (*pos)++), blk));
+
+    for (size_t i = 0; i < count; i++) {
+        const uint8_t* payload = &data[targets[i] * kBlockSize];
+        checksum = crc32(checksum, payload, kBlockSize);
+        ASSERT_TRUE(write_block(log_bno(image, (*pos)++), payload));
+    }
+
+    memset(blk, 0, sizeof(blk));
+    minfs::minfs_journal_commit_t* commit = reinterpret_cast<minfs::minfs_journal_commit_t*>(blk);
+    commit->magic = minfs::kMinfsJournalCommitMagic;
+    commit->seq = seq;
+    commit->checksum = checksum;
+    ASSERT_TRUE(write_block(log_bno(image, (*pos)++), blk));
+    END_HELPER;
+}
+
+// Verifies that every modified block holds its contents from |expected|.
+bool check_changed_blocks(const journal_image_t& image, const uint8_t* expected) {
+    BEGIN_HELPER;
+    fbl::unique_ptr<uint8_t[]> current;
+    ASSERT_TRUE(read_image(&current));
+    for (size_t i = 0; i < image.changed.size(); i++) {
+        minfs::blk_t bno = image.changed[i];
+        ASSERT_EQ(memcmp(&current[bno * kBlockSize], &expected[bno * kBlockSize], kBlockSize), 0,
+                  "Unexpected block contents after replay");
+    }
+    END_HELPER;
+}
+
+bool check_fsck(void) {
+    BEGIN_HELPER;
+    fbl::unique_fd fd(open(JOURNAL_PATH, O_RDWR));
+    ASSERT_TRUE(fd);
+    fbl::unique_ptr<minfs::Bcache> bc;
+    ASSERT_EQ(minfs::Bcache::Create(&bc, fbl::move(fd), kImageBlocks), ZX_OK);
+    ASSERT_EQ(minfs::minfs_check(fbl::move(bc)), ZX_OK);
+    END_HELPER;
+}
+
+bool check_file_exists(bool exists) {
+    BEGIN_HELPER;
+    struct stat s;
+    if (exists) {
+        ASSERT_EQ(emu_stat("::dir/file", &s), 0);
+        ASSERT_EQ(s.st_size, static_cast<off_t>(sizeof("journaled")));
+    } else {
+        ASSERT_NE(emu_stat("::dir", &s), 0);
+    }
+    END_HELPER;
+}
+
+} // namespace
+
+// An entry which was committed but never checkpointed is replayed on mount.
+bool test_journal_replay(void) {
+    BEGIN_TEST;
+    journal_image_t image;
+    ASSERT_TRUE(setup_journal_image(&image));
+
+    uint64_t pos = 0;
+    ASSERT_TRUE(write_journal_entry(image, &pos, 1, image.changed.get(), image.changed.size(),
+                                    image.after.get()));
+    ASSERT_EQ(emu_mount(JOURNAL_PATH), 0);
+    ASSERT_TRUE(check_changed_blocks(image, image.after.get()));
+    ASSERT_TRUE(check_journal_info(image, static_cast<uint32_t>(pos), 2));
+    ASSERT_TRUE(check_file_exists(true));
+    ASSERT_TRUE(check_fsck());
+
+    // The replayed entry is now behind the start of the journal.
+    ASSERT_EQ(emu_mount(JOURNAL_PATH), 0);
+    ASSERT_TRUE(check_journal_info(image, static_cast<uint32_t>(pos), 2));
+
+    ASSERT_EQ(unlink(JOURNAL_PATH), 0);
+    END_TEST;
+}
+
+// An entry whose commit block never reached the disk is ignored.
+bool test_journal_torn_commit(void) {
+    BEGIN_TEST;
+    journal_image_t image;
+    ASSERT_TRUE(setup_journal_image(&image));
+
+    uint64_t pos = 0;
+    ASSERT_TRUE(write_journal_entry(image, &pos, 1, image.changed.get(), image.changed.size(),
+                                    image.after.get()));
+    uint8_t blk[kBlockSize];
+    memset(blk, 0, sizeof(blk));
+    ASSERT_TRUE(write_block(log_bno(image, pos - 1), blk));
+
+    ASSERT_EQ(emu_mount(JOURNAL_PATH), 0);
+    ASSERT_TRUE(check_changed_blocks(image, image.before.get()));
+    ASSERT_TRUE(check_journal_info(image, 0, 1));
+    ASSERT_TRUE(check_file_exists(false));
+    ASSERT_TRUE(check_fsck());
+
+    ASSERT_EQ(unlink(JOURNAL_PATH), 0);
+    END_TEST;
+}
+
+// Replay stops at the first entry whose checksum does not match its blocks.
+bool test_journal_bad_checksum(void) {
+    BEGIN_TEST;
+    journal_image_t image;
+    ASSERT_TRUE(setup_journal_image(&image));
+
+    uint64_t pos = 0;
+    ASSERT_TRUE(write_journal_entry(image, &pos, 1, image.changed.get(), image.changed.size(),
+                                    image.after.get()));
+    const uint64_t end = pos;
+
+    // The second entry would clobber the superblock, but one of its blocks
+    // was altered after the commit block was written.
+    const minfs::blk_t target = 0;
+    ASSERT_TRUE(write_journal_entry(image, &pos, 2, &target, 1, image.before.get()));
+    uint8_t blk[kBlockSize];
+    memcpy(blk, &image.before[0], kBlockSize);
+    blk[kBlockSize - 1] ^= 0xFF;
+    ASSERT_TRUE(write_block(log_bno(image, end + 1), blk));
+
+    ASSERT_EQ(emu_mount(JOURNAL_PATH), 0);
+    ASSERT_TRUE(check_changed_blocks(image, image.after.get()));
+    ASSERT_TRUE(check_journal_info(image, static_cast<uint32_t>(end), 2));
+    ASSERT_TRUE(check_file_exists(true));
+    ASSERT_TRUE(check_fsck());
+
+    ASSERT_EQ(unlink(JOURNAL_PATH), 0);
+    END_TEST;
+}
+
+// Entries may wrap around the end of the circular log.
+bool test_journal_wraparound(void) {
+    BEGIN_TEST;
+    journal_image_t image;
+    ASSERT_TRUE(setup_journal_image(&image));
+
+    // Start the journal close enough to the end of the log that the first
+    // entry wraps around, and the second entry follows it at the start.
+    const uint32_t start = log_blocks(image) - 2;
+    const uint64_t seq = 7;
+    ASSERT_TRUE(write_journal_info(image, start, seq));
+
+    const size_t half = image.changed.size() / 2;
+    uint64_t pos = start;
+    ASSERT_TRUE(write_journal_entry(image, &pos, seq, image.changed.get(), half,
+                                    image.after.get()));
+    ASSERT_GT(pos, log_blocks(image), "The first entry should wrap around the log");
+    ASSERT_TRUE(write_journal_entry(image, &pos, seq + 1, image.changed.get() + half,
+                                    image.changed.size() - half, image.after.get()));
+
+    ASSERT_EQ(emu_mount(JOURNAL_PATH), 0);
+    ASSERT_TRUE(check_changed_blocks(image, image.after.get()));
+    ASSERT_TRUE(check_journal_info(image, static_cast<uint32_t>(pos % log_blocks(image)),
+                                   seq + 2));
+    ASSERT_TRUE(check_file_exists(true));
+    ASSERT_TRUE(check_fsck());
+
+    ASSERT_EQ(unlink(JOURNAL_PATH), 0);
+    END_TEST;
+}
+
+BEGIN_TEST_CASE(minfs_journal_tests)
+RUN_TEST_MEDIUM(test_journal_replay)
+RUN_TEST_MEDIUM(test_journal_torn_commit)
+RUN_TEST_MEDIUM(test_journal_bad_checksum)
+RUN_TEST_MEDIUM(test_journal_wraparound)
+END_TEST_CASE(minfs_journal_tests)
@@ -2,10 +2,14 @@
 // Use of this source code is governed by a BSD-style license that can be
 // found in the LICENSE file.
 
+#include <fcntl.h>
+#include <string.h>
 #include <time.h>
 
 #include <fbl/alloc_checker.h>
+#include <fbl/unique_fd.h>
 #include <fbl/unique_ptr.h>
+#include <minfs/fsck.h>
 
 #include "util.h"
 
@@ -72,6 +76,117 @@ bool test_sparse(void) {
 constexpr size_t kBlockSize = 8192;
 constexpr size_t kDirectBlocks = 16;
 
+// Writes every |Stride|th block of a file, then fills in the gaps. With
+// enough writes, a file is too fragmented to be mapped by extents alone.
+template <size_t Blocks, size_t Stride>
+bool test_sparse_fragmented(void) {
+    BEGIN_TEST;
+
+    char filename[20];
+    sprintf(filename, "::my_file_%u", count++);
+    int fd = emu_open(filename, O_RDWR | O_CREAT, 0644);
+    ASSERT_GT(fd, 0);
+
+    constexpr size_t kFileSize = Blocks * kBlockSize;
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> wbuf(new (&ac) uint8_t[kFileSize]);
+    ASSERT_EQ(ac.check(), true);
+    fbl::unique_ptr<uint8_t[]> rbuf(new (&ac) uint8_t[kFileSize]);
+    ASSERT_EQ(ac.check(), true);
+    unsigned int seed = static_cast<unsigned int>(time(NULL));
+    unittest_printf("Fragmented sparse test using seed: %u\n", seed);
+    for (size_t i = 0; i < kFileSize; i++) {
+        wbuf[i] = (uint8_t) rand_r(&seed);
+    }
+
+    for (size_t b = 0; b < Blocks; b += Stride) {
+        ASSERT_EQ(emu_pwrite(fd, &wbuf[b * kBlockSize], kBlockSize, b * kBlockSize), kBlockSize);
+    }
+    // The file ends with the last block written.
+    constexpr size_t kSparseSize = (Blocks - Stride + 1) * kBlockSize;
+    ASSERT_EQ(emu_pread(fd, &rbuf[0], kFileSize, 0), kSparseSize);
+    for (size_t i = 0; i < kSparseSize; i++) {
+        if ((i / kBlockSize) % Stride == 0) {
+            ASSERT_EQ(rbuf[i], wbuf[i]);
+        } else {
+            ASSERT_EQ(rbuf[i], 0, "This portion of file should be sparse; but isn't");
+        }
+    }
+
+    for (size_t b = 0; b < Blocks; b++) {
+        if (b % Stride != 0) {
+            ASSERT_EQ(emu_pwrite(fd, &wbuf[b * kBlockSize], kBlockSize, b * kBlockSize),
+                      kBlockSize);
+        }
+    }
+    ASSERT_EQ(emu_close(fd), 0);
+    fd = emu_open(filename, O_RDWR, 0644);
+    ASSERT_GT(fd, 0);
+    ASSERT_EQ(emu_pread(fd, &rbuf[0], kFileSize, 0), kFileSize);
+    ASSERT_EQ(memcmp(&rbuf[0], &wbuf[0], kFileSize), 0);
+
+    ASSERT_EQ(emu_close(fd), 0);
+    END_TEST;
+}
+
+constexpr size_t kSmallDiskSize = 64 * 1024 * 1024;
+
+// Fills the disk, so that converting a fragmented file from extents to a
+// block map runs out of space part way through. The file must be left
+// mapped by its extents, with its data and the filesystem intact.
+bool test_sparse_fragmented_no_space(void) {
+    BEGIN_TEST;
+
+    // Each block is its own extent, and together they are mapped by two
+    // indirect blocks once the file is converted.
+    constexpr size_t kStride = 256;
+    constexpr size_t kExtents = 16;
+    int fd = emu_open("::fragmented", O_RDWR | O_CREAT, 0644);
+    ASSERT_GT(fd, 0);
+    uint8_t wbuf[kBlockSize];
+    for (size_t i = 0; i < kExtents; i++) {
+        memset(wbuf, static_cast<int>(i + 1), sizeof(wbuf));
+        ASSERT_EQ(emu_pwrite(fd, wbuf, kBlockSize, i * kStride * kBlockSize), kBlockSize);
+    }
+
+    int fill = emu_open("::fill", O_RDWR | O_CREAT, 0644);
+    ASSERT_GT(fill, 0);
+    memset(wbuf, 0, sizeof(wbuf));
+    off_t fill_size = 0;
+    while (emu_write(fill, wbuf, kBlockSize) == kBlockSize) {
+        fill_size += kBlockSize;
+    }
+    // Leave room for the new data block and one of the indirect blocks.
+    ASSERT_EQ(emu_ftruncate(fill, fill_size - kBlockSize), 0);
+
+    constexpr off_t kNewOffset = kExtents * kStride * kBlockSize;
+    ASSERT_NE(emu_pwrite(fd, wbuf, kBlockSize, kNewOffset), kBlockSize);
+
+    uint8_t rbuf[kBlockSize];
+    for (size_t i = 0; i < kExtents; i++) {
+        memset(wbuf, static_cast<int>(i + 1), sizeof(wbuf));
+        ASSERT_EQ(emu_pread(fd, rbuf, kBlockSize, i * kStride * kBlockSize), kBlockSize);
+        ASSERT_EQ(memcmp(rbuf, wbuf, kBlockSize), 0);
+    }
+
+    // Once there is room, the conversion succeeds.
+    ASSERT_EQ(emu_ftruncate(fill, 0), 0);
+    memset(wbuf, 0xff, sizeof(wbuf));
+    ASSERT_EQ(emu_pwrite(fd, wbuf, kBlockSize, kNewOffset), kBlockSize);
+    ASSERT_EQ(emu_pread(fd, rbuf, kBlockSize, kNewOffset), kBlockSize);
+    ASSERT_EQ(memcmp(rbuf, wbuf, kBlockSize), 0);
+    ASSERT_EQ(emu_close(fill), 0);
+    ASSERT_EQ(emu_close(fd), 0);
+
+    fbl::unique_fd disk(open(MOUNT_PATH, O_RDWR));
+    ASSERT_TRUE(disk);
+    fbl::unique_ptr<minfs::Bcache> bc;
+    ASSERT_EQ(minfs::Bcache::Create(&bc, fbl::move(disk),
+                                    static_cast<uint32_t>(kSmallDiskSize / kBlockSize)), ZX_OK);
+    ASSERT_EQ(minfs::minfs_check(fbl::move(bc)), ZX_OK);
+    END_TEST;
+}
+
 RUN_MINFS_TESTS(sparse_tests,
     RUN_TEST_MEDIUM((test_sparse<0, 0, kBlockSize>))
     RUN_TEST_MEDIUM((test_sparse<kBlockSize / 2, 0, kBlockSize>))
@@ -91,4 +206,10 @@ RUN_MINFS_TESTS(sparse_tests,
     RUN_TEST_MEDIUM((test_sparse<kBlockSize * kDirectBlocks + kBlockSize,
                                  kBlockSize * kDirectBlocks + 2 * kBlockSize,
                                  kBlockSize * 32>))
+    RUN_TEST_MEDIUM((test_sparse_fragmented<8, 2>))
+    RUN_TEST_MEDIUM((test_sparse_fragmented<256, 4>))
+)
+
+RUN_MINFS_TESTS_SIZE(sparse_no_space_tests, kSmallDiskSize,
+    RUN_TEST_MEDIUM(test_sparse_fragmented_no_space)
 )
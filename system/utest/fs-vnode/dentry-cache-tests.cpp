@@ -0,0 +1,271 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fs/dentry-cache.h>
+
+#include <fs/pseudo-dir.h>
+#include <fs/pseudo-file.h>
+#include <fs/vfs.h>
+#include <unittest/unittest.h>
+
+namespace {
+
+class UncacheableFile : public fs::UnbufferedPseudoFile {
+public:
+    bool IsDentryCacheable() const final { return false; }
+};
+
+class TrackedDir : public fs::PseudoDir {
+public:
+    explicit TrackedDir(bool* destroyed)
+        : destroyed_(destroyed) {}
+    ~TrackedDir() override { *destroyed_ = true; }
+
+private:
+    bool* destroyed_;
+};
+
+bool test_dentry_cache_lookup() {
+    BEGIN_TEST;
+
+    fs::DentryCache cache(16);
+    auto dir = fbl::AdoptRef<fs::Vnode>(new fs::PseudoDir());
+    auto file = fbl::AdoptRef<fs::Vnode>(new fs::UnbufferedPseudoFile());
+    fbl::RefPtr<fs::Vnode> out;
+
+    EXPECT_FALSE(cache.Lookup(dir.get(), "file", &out));
+
+    // Positive entry
+    cache.Insert(dir, "file", file, cache.Generation());
+    ASSERT_TRUE(cache.Lookup(dir.get(), "file", &out));
+    EXPECT_EQ(file.get(), out.get());
+    EXPECT_FALSE(cache.Lookup(dir.get(), "fil", &out));
+    EXPECT_FALSE(cache.Lookup(file.get(), "file", &out));
+
+    // Negative entry
+    cache.Insert(dir, "missing", nullptr, cache.Generation());
+    ASSERT_TRUE(cache.Lookup(dir.get(), "missing", &out));
+    EXPECT_NULL(out);
+
+    // Replacing an entry
+    cache.Insert(dir, "missing", file, cache.Generation());
+    ASSERT_TRUE(cache.Lookup(dir.get(), "missing", &out));
+    EXPECT_EQ(file.get(), out.get());
+
+    // Invalidation
+    cache.Invalidate(dir.get(), "missing");
+    EXPECT_FALSE(cache.Lookup(dir.get(), "missing", &out));
+    EXPECT_TRUE(cache.Lookup(dir.get(), "file", &out));
+
+    fs::dentry_cache_stats_t stats;
+    cache.GetStats(&stats);
+    EXPECT_EQ(3u, stats.hits);
+    EXPECT_EQ(1u, stats.negative_hits);
+    EXPECT_EQ(4u, stats.misses);
+    EXPECT_EQ(0u, stats.evictions);
+
+    cache.Clear();
+    EXPECT_FALSE(cache.Lookup(dir.get(), "file", &out));
+
+    END_TEST;
+}
+
+bool test_dentry_cache_uncacheable() {
+    BEGIN_TEST;
+
+    fs::DentryCache cache(16);
+    auto dir = fbl::AdoptRef<fs::Vnode>(new fs::PseudoDir());
+    auto file = fbl::AdoptRef<fs::Vnode>(new UncacheableFile());
+    fbl::RefPtr<fs::Vnode> out;
+
+    cache.Insert(dir, "file", file, cache.Generation());
+    EXPECT_FALSE(cache.Lookup(dir.get(), "file", &out));
+
+    // Inserting an uncacheable vnode drops a stale negative entry.
+    cache.Insert(dir, "file", nullptr, cache.Generation());
+    EXPECT_TRUE(cache.Lookup(dir.get(), "file", &out));
+    cache.Insert(dir, "file", file, cache.Generation());
+    EXPECT_FALSE(cache.Lookup(dir.get(), "file", &out));
+
+    END_TEST;
+}
+
+bool test_dentry_cache_stale_insert() {
+    BEGIN_TEST;
+
+    fs::DentryCache cache(16);
+    auto dir = fbl::AdoptRef<fs::Vnode>(new fs::PseudoDir());
+    auto file = fbl::AdoptRef<fs::Vnode>(new fs::UnbufferedPseudoFile());
+    fbl::RefPtr<fs::Vnode> out;
+
+    // A lookup which raced with an invalidation must not be cached.
+    uint64_t generation = cache.Generation();
+    cache.Invalidate(dir.get(), "file");
+    cache.Insert(dir, "file", nullptr, generation);
+    EXPECT_FALSE(cache.Lookup(dir.get(), "file", &out));
+
+    generation = cache.Generation();
+    cache.Purge(dir.get());
+    cache.Insert(dir, "file", file, generation);
+    EXPECT_FALSE(cache.Lookup(dir.get(), "file", &out));
+
+    generation = cache.Generation();
+    cache.Insert(dir, "file", file, generation);
+    EXPECT_TRUE(cache.Lookup(dir.get(), "file", &out));
+
+    END_TEST;
+}
+
+bool test_dentry_cache_eviction() {
+    BEGIN_TEST;
+
+    fs::DentryCache cache(4);
+    auto dir = fbl::AdoptRef<fs::Vnode>(new fs::PseudoDir());
+    fbl::RefPtr<fs::Vnode> out;
+    const char* names[] = {"a", "b", "c", "d", "e"};
+
+    for (size_t i = 0; i < 4; i++) {
+        cache.Insert(dir, names[i], nullptr, cache.Generation());
+    }
+    // Touch "a", so "b" is the least recently used.
+    EXPECT_TRUE(cache.Lookup(dir.get(), "a", &out));
+    cache.Insert(dir, names[4], nullptr, cache.Generation());
+
+    EXPECT_TRUE(cache.Lookup(dir.get(), "a", &out));
+    EXPECT_FALSE(cache.Lookup(dir.get(), "b", &out));
+    EXPECT_TRUE(cache.Lookup(dir.get(), "c", &out));
+    EXPECT_TRUE(cache.Lookup(dir.get(), "e", &out));
+
+    fs::dentry_cache_stats_t stats;
+    cache.GetStats(&stats);
+    EXPECT_EQ(1u, stats.evictions);
+
+    END_TEST;
+}
+
+bool test_dentry_cache_purge() {
+    BEGIN_TEST;
+
+    fs::DentryCache cache(16);
+    auto root = fbl::AdoptRef<fs::Vnode>(new fs::PseudoDir());
+    auto subdir = fbl::AdoptRef<fs::Vnode>(new fs::PseudoDir());
+    auto file = fbl::AdoptRef<fs::Vnode>(new fs::UnbufferedPseudoFile());
+    fbl::RefPtr<fs::Vnode> out;
+
+    cache.Insert(root, "subdir", subdir, cache.Generation());
+    cache.Insert(subdir, "file", file, cache.Generation());
+    cache.Insert(subdir, "missing", nullptr, cache.Generation());
+    cache.Insert(root, "other", nullptr, cache.Generation());
+
+    // Invalidating a directory drops the entries within it.
+    cache.Invalidate(root.get(), "subdir");
+    EXPECT_FALSE(cache.Lookup(root.get(), "subdir", &out));
+    EXPECT_FALSE(cache.Lookup(subdir.get(), "file", &out));
+    EXPECT_FALSE(cache.Lookup(subdir.get(), "missing", &out));
+    EXPECT_TRUE(cache.Lookup(root.get(), "other", &out));
+
+    cache.Insert(subdir, "file", file, cache.Generation());
+    cache.Purge(subdir.get());
+    EXPECT_FALSE(cache.Lookup(subdir.get(), "file", &out));
+    EXPECT_TRUE(cache.Lookup(root.get(), "other", &out));
+
+    END_TEST;
+}
+
+bool test_dentry_cache_references() {
+    BEGIN_TEST;
+
+    // The cache keeps the parent alive, but not the child.
+    fs::DentryCache cache(16);
+    bool dir_destroyed = false;
+    bool subdir_destroyed = false;
+    auto dir = fbl::AdoptRef<fs::Vnode>(new TrackedDir(&dir_destroyed));
+    auto subdir = fbl::AdoptRef<fs::Vnode>(new TrackedDir(&subdir_destroyed));
+    fs::Vnode* dir_ptr = dir.get();
+    fs::Vnode* subdir_ptr = subdir.get();
+    cache.Insert(fbl::move(dir), "subdir", subdir, cache.Generation());
+
+    fbl::RefPtr<fs::Vnode> out;
+    ASSERT_TRUE(cache.Lookup(dir_ptr, "subdir", &out));
+    EXPECT_EQ(subdir_ptr, out.get());
+    out.reset();
+    EXPECT_FALSE(dir_destroyed);
+    EXPECT_FALSE(subdir_destroyed);
+
+    // Releasing the child drops its entry, and with it the parent.
+    subdir.reset();
+    EXPECT_TRUE(subdir_destroyed);
+    EXPECT_TRUE(dir_destroyed);
+
+    fs::dentry_cache_stats_t stats;
+    cache.GetStats(&stats);
+    EXPECT_EQ(1u, stats.hits);
+    EXPECT_EQ(0u, stats.evictions);
+
+    END_TEST;
+}
+
+bool test_dentry_cache_forget() {
+    BEGIN_TEST;
+
+    fs::DentryCache cache(16);
+    auto dir = fbl::AdoptRef<fs::Vnode>(new fs::PseudoDir());
+    auto file = fbl::AdoptRef<fs::Vnode>(new fs::UnbufferedPseudoFile());
+    fbl::RefPtr<fs::Vnode> out;
+
+    // A vnode cached under several names is dropped from all of them.
+    cache.Insert(dir, "a", file, cache.Generation());
+    cache.Insert(dir, "b", file, cache.Generation());
+    cache.Insert(dir, "missing", nullptr, cache.Generation());
+    file.reset();
+    EXPECT_FALSE(cache.Lookup(dir.get(), "a", &out));
+    EXPECT_FALSE(cache.Lookup(dir.get(), "b", &out));
+    EXPECT_TRUE(cache.Lookup(dir.get(), "missing", &out));
+
+    END_TEST;
+}
+
+bool test_dentry_cache_vfs_stats() {
+    BEGIN_TEST;
+
+    fs::Vfs vfs;
+    ASSERT_EQ(ZX_OK, vfs.EnableDentryCache());
+    auto root = fbl::AdoptRef<fs::PseudoDir>(new fs::PseudoDir());
+    auto a = fbl::AdoptRef<fs::PseudoDir>(new fs::PseudoDir());
+    auto b = fbl::AdoptRef<fs::PseudoDir>(new fs::PseudoDir());
+    ASSERT_EQ(ZX_OK, root->AddEntry("a", a));
+    ASSERT_EQ(ZX_OK, a->AddEntry("b", b));
+
+    fbl::RefPtr<fs::Vnode> out;
+    fbl::StringPiece pathout;
+    const uint32_t flags = ZX_FS_RIGHT_READABLE | ZX_FS_FLAG_DIRECTORY;
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(ZX_OK, vfs.Open(root, &out, "a/b", &pathout, flags, 0));
+        EXPECT_EQ(b.get(), out.get());
+    }
+    for (int i = 0; i < 2; i++) {
+        EXPECT_EQ(ZX_ERR_NOT_FOUND, vfs.Open(root, &out, "a/missing", &pathout, flags, 0));
+    }
+
+    fs::dentry_cache_stats_t stats;
+    ASSERT_EQ(ZX_OK, vfs.GetDentryCacheStats(&stats));
+    EXPECT_EQ(4u, stats.hits);
+    EXPECT_EQ(1u, stats.negative_hits);
+    EXPECT_EQ(3u, stats.misses);
+
+    END_TEST;
+}
+
+} // namespace
+
+BEGIN_TEST_CASE(dentry_cache_tests)
+RUN_TEST(test_dentry_cache_lookup)
+RUN_TEST(test_dentry_cache_uncacheable)
+RUN_TEST(test_dentry_cache_stale_insert)
+RUN_TEST(test_dentry_cache_eviction)
+RUN_TEST(test_dentry_cache_purge)
+RUN_TEST(test_dentry_cache_references)
+RUN_TEST(test_dentry_cache_forget)
+RUN_TEST(test_dentry_cache_vfs_stats)
+END_TEST_CASE(dentry_cache_tests)
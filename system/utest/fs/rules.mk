@@ -24,6 +24,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/test-clone.cpp \
     $(LOCAL_DIR)/test-directory.cpp \
     $(LOCAL_DIR)/test-dot-dot.c \
+    $(LOCAL_DIR)/test-large-io.cpp \
     $(LOCAL_DIR)/test-link.c \
     $(LOCAL_DIR)/test-fcntl.cpp \
     $(LOCAL_DIR)/test-maxfile.cpp \
@@ -32,6 +33,7 @@ MODULE_SRCS := \
     $(LOCAL_DIR)/test-overflow.c \
     $(LOCAL_DIR)/test-persist.cpp \
     $(LOCAL_DIR)/test-random-op.c \
+    $(LOCAL_DIR)/test-readahead.cpp \
     $(LOCAL_DIR)/test-realpath.cpp \
     $(LOCAL_DIR)/test-rename.c \
     $(LOCAL_DIR)/test-resize.cpp \
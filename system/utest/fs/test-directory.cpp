@@ -74,6 +74,60 @@ bool test_directory_large(void) {
     END_TEST;
 }
 
+bool test_directory_large_mixed(void) {
+    BEGIN_TEST;
+
+    // Fill a directory, punch holes in it, and refill those holes with names
+    // of varying lengths, checking that lookups remain correct throughout.
+    const int num_files = 2048;
+    char path[LARGE_PATH_LENGTH + 1];
+    struct stat st;
+    for (int i = 0; i < num_files; i++) {
+        snprintf(path, sizeof(path), "::mixed%0*d", 32, i);
+        int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+        ASSERT_GT(fd, 0, "");
+        ASSERT_EQ(close(fd), 0, "");
+    }
+    for (int i = 0; i < num_files; i += 2) {
+        snprintf(path, sizeof(path), "::mixed%0*d", 32, i);
+        ASSERT_EQ(unlink(path), 0, "");
+    }
+    for (int i = 0; i < num_files; i += 2) {
+        snprintf(path, sizeof(path), "::m%0*d", 1 + (i % 64), i);
+        int fd = open(path, O_RDWR | O_CREAT | O_EXCL, 0644);
+        ASSERT_GT(fd, 0, "");
+        ASSERT_EQ(close(fd), 0, "");
+    }
+    for (int i = 0; i < num_files; i++) {
+        snprintf(path, sizeof(path), "::mixed%0*d", 32, i);
+        ASSERT_EQ(stat(path, &st), (i % 2) ? 0 : -1, "");
+        if (i % 2 == 0) {
+            snprintf(path, sizeof(path), "::m%0*d", 1 + (i % 64), i);
+            ASSERT_EQ(stat(path, &st), 0, "");
+        }
+    }
+
+    // Rename the remaining long names, then clean up.
+    for (int i = 1; i < num_files; i += 2) {
+        char newpath[LARGE_PATH_LENGTH + 1];
+        snprintf(path, sizeof(path), "::mixed%0*d", 32, i);
+        snprintf(newpath, sizeof(newpath), "::r%d", i);
+        ASSERT_EQ(rename(path, newpath), 0, "");
+        ASSERT_EQ(stat(path, &st), -1, "");
+        ASSERT_EQ(stat(newpath, &st), 0, "");
+    }
+    for (int i = 0; i < num_files; i++) {
+        if (i % 2) {
+            snprintf(path, sizeof(path), "::r%d", i);
+        } else {
+            snprintf(path, sizeof(path), "::m%0*d", 1 + (i % 64), i);
+        }
+        ASSERT_EQ(unlink(path), 0, "");
+    }
+
+    END_TEST;
+}
+
 bool test_directory_max(void) {
     BEGIN_TEST;
 
@@ -457,6 +511,7 @@ RUN_FOR_ALL_FILESYSTEMS(directory_tests,
     RUN_TEST_MEDIUM(test_directory_coalesce_large_record)
     RUN_TEST_MEDIUM(test_directory_filename_max)
     RUN_TEST_LARGE(test_directory_large)
+    RUN_TEST_LARGE(test_directory_large_mixed)
     RUN_TEST_MEDIUM(test_directory_trailing_slash)
     RUN_TEST_MEDIUM(test_directory_readdir)
     RUN_TEST_LARGE(test_directory_readdir_rm_all)
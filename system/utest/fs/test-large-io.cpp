@@ -0,0 +1,357 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zircon/syscalls.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
+#include <fdio/limits.h>
+#include <fdio/remoteio.h>
+#include <fdio/util.h>
+#include <unittest/unittest.h>
+
+#include "filesystems.h"
+
+namespace {
+
+// Larger than both a single RIO message and the buffer fdio shares with the
+// server, so that transfers span several buffered calls.
+constexpr size_t kLargeSize = 600 * 1024 + 17;
+
+bool fill_random(uint8_t* buf, size_t len) {
+    unsigned int seed = static_cast<unsigned int>(zx_ticks_get());
+    unittest_printf("Large I/O test using seed: %u\n", seed);
+    for (size_t i = 0; i < len; i++) {
+        buf[i] = (uint8_t) rand_r(&seed);
+    }
+    return true;
+}
+
+bool test_large_read_write(void) {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> wbuf(new (&ac) uint8_t[kLargeSize]);
+    ASSERT_TRUE(ac.check());
+    fbl::unique_ptr<uint8_t[]> rbuf(new (&ac) uint8_t[kLargeSize]);
+    ASSERT_TRUE(ac.check());
+    ASSERT_TRUE(fill_random(wbuf.get(), kLargeSize));
+
+    int fd = open("::large", O_RDWR | O_CREAT, 0644);
+    ASSERT_GT(fd, 0);
+    ASSERT_EQ(write(fd, wbuf.get(), kLargeSize), kLargeSize);
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), kLargeSize);
+
+    // Sequential reads advance the seek offset.
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0);
+    ASSERT_EQ(read(fd, rbuf.get(), kLargeSize), kLargeSize);
+    ASSERT_EQ(memcmp(wbuf.get(), rbuf.get(), kLargeSize), 0);
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), kLargeSize);
+
+    // A short read at the end of the file.
+    ASSERT_EQ(lseek(fd, 100, SEEK_SET), 100);
+    ASSERT_EQ(read(fd, rbuf.get(), kLargeSize), kLargeSize - 100);
+    ASSERT_EQ(memcmp(wbuf.get() + 100, rbuf.get(), kLargeSize - 100), 0);
+
+    // Positional I/O leaves the seek offset alone.
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0);
+    ASSERT_EQ(pwrite(fd, wbuf.get(), kLargeSize, 4096), kLargeSize);
+    ASSERT_EQ(pread(fd, rbuf.get(), kLargeSize, 4096), kLargeSize);
+    ASSERT_EQ(memcmp(wbuf.get(), rbuf.get(), kLargeSize), 0);
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), 0);
+
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink("::large"), 0);
+
+    END_TEST;
+}
+
+bool test_large_append(void) {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> wbuf(new (&ac) uint8_t[kLargeSize]);
+    ASSERT_TRUE(ac.check());
+    fbl::unique_ptr<uint8_t[]> rbuf(new (&ac) uint8_t[kLargeSize]);
+    ASSERT_TRUE(ac.check());
+    ASSERT_TRUE(fill_random(wbuf.get(), kLargeSize));
+
+    int fd = open("::large", O_RDWR | O_CREAT | O_APPEND, 0644);
+    ASSERT_GT(fd, 0);
+    ASSERT_EQ(write(fd, "a", 1), 1);
+    ASSERT_EQ(lseek(fd, 0, SEEK_SET), 0);
+    ASSERT_EQ(write(fd, wbuf.get(), kLargeSize), kLargeSize);
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), kLargeSize + 1);
+
+    struct stat st;
+    ASSERT_EQ(fstat(fd, &st), 0);
+    ASSERT_EQ(st.st_size, kLargeSize + 1);
+    ASSERT_EQ(pread(fd, rbuf.get(), kLargeSize, 1), kLargeSize);
+    ASSERT_EQ(memcmp(wbuf.get(), rbuf.get(), kLargeSize), 0);
+
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink("::large"), 0);
+
+    END_TEST;
+}
+
+// Appends from one descriptor land at the end of the file, even once
+// another descriptor has extended it.
+bool test_large_append_shared(void) {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> wbuf(new (&ac) uint8_t[kLargeSize]);
+    ASSERT_TRUE(ac.check());
+    fbl::unique_ptr<uint8_t[]> rbuf(new (&ac) uint8_t[kLargeSize]);
+    ASSERT_TRUE(ac.check());
+    ASSERT_TRUE(fill_random(wbuf.get(), kLargeSize));
+
+    int fd = open("::large", O_RDWR | O_CREAT | O_APPEND, 0644);
+    ASSERT_GT(fd, 0);
+    int fd2 = open("::large", O_RDWR);
+    ASSERT_GT(fd2, 0);
+    ASSERT_EQ(write(fd, wbuf.get(), kLargeSize), kLargeSize);
+    ASSERT_EQ(pwrite(fd2, wbuf.get(), kLargeSize, kLargeSize), kLargeSize);
+    ASSERT_EQ(write(fd, wbuf.get(), kLargeSize), kLargeSize);
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), 3 * kLargeSize);
+
+    for (size_t i = 0; i < 3; i++) {
+        ASSERT_EQ(pread(fd2, rbuf.get(), kLargeSize, i * kLargeSize), kLargeSize);
+        ASSERT_EQ(memcmp(wbuf.get(), rbuf.get(), kLargeSize), 0);
+    }
+
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(close(fd2), 0);
+    ASSERT_EQ(unlink("::large"), 0);
+
+    END_TEST;
+}
+
+// Positional transfers which start or end beyond the end of the file.
+bool test_large_at_eof(void) {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> wbuf(new (&ac) uint8_t[kLargeSize]);
+    ASSERT_TRUE(ac.check());
+    fbl::unique_ptr<uint8_t[]> rbuf(new (&ac) uint8_t[kLargeSize]);
+    ASSERT_TRUE(ac.check());
+    ASSERT_TRUE(fill_random(wbuf.get(), kLargeSize));
+
+    int fd = open("::large", O_RDWR | O_CREAT, 0644);
+    ASSERT_GT(fd, 0);
+
+    // Writing past the end leaves a hole which reads as zero.
+    constexpr off_t kHole = 3 * 8192 + 5;
+    ASSERT_EQ(pwrite(fd, wbuf.get(), kLargeSize, kHole), kLargeSize);
+    ASSERT_EQ(pread(fd, rbuf.get(), kHole, 0), kHole);
+    for (off_t i = 0; i < kHole; i++) {
+        ASSERT_EQ(rbuf[i], 0);
+    }
+
+    // Reads which straddle the end are short; reads beyond it are empty.
+    ASSERT_EQ(pread(fd, rbuf.get(), kLargeSize, kHole + 1000), kLargeSize - 1000);
+    ASSERT_EQ(memcmp(wbuf.get() + 1000, rbuf.get(), kLargeSize - 1000), 0);
+    ASSERT_EQ(pread(fd, rbuf.get(), kLargeSize, kHole + kLargeSize), 0);
+    ASSERT_EQ(pread(fd, rbuf.get(), kLargeSize, 2 * (kHole + kLargeSize)), 0);
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), 0);
+
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink("::large"), 0);
+
+    END_TEST;
+}
+
+// Sends a single RIO message on |h|, bypassing the client's own checks, and
+// returns the status of the reply. |out_off| receives the offset returned.
+zx_status_t rio_call(zx_handle_t h, uint32_t op, int32_t arg, int64_t off,
+                     zx_handle_t handle, int64_t* out_off) {
+    zxrio_msg_t msg;
+    memset(&msg, 0, ZXRIO_HDR_SZ);
+    msg.op = op;
+    msg.arg = arg;
+    msg.arg2.off = off;
+    if (handle != ZX_HANDLE_INVALID) {
+        msg.handle[0] = handle;
+        msg.hcount = 1;
+    }
+
+    zx_channel_call_args_t args;
+    args.wr_bytes = &msg;
+    args.wr_handles = msg.handle;
+    args.rd_bytes = &msg;
+    args.rd_handles = msg.handle;
+    args.wr_num_bytes = ZXRIO_HDR_SZ;
+    args.wr_num_handles = msg.hcount;
+    args.rd_num_bytes = sizeof(msg);
+    args.rd_num_handles = FDIO_MAX_HANDLES;
+    uint32_t actual_bytes;
+    uint32_t actual_handles;
+    zx_status_t read_status;
+    zx_status_t status = zx_channel_call(h, 0, ZX_TIME_INFINITE, &args, &actual_bytes,
+                                         &actual_handles, &read_status);
+    if (status == ZX_ERR_CALL_FAILED) {
+        return read_status;
+    } else if (status != ZX_OK) {
+        return status;
+    }
+    if (out_off != nullptr) {
+        *out_off = msg.arg2.off;
+    }
+    return msg.arg;
+}
+
+// Opens a connection to |path| which the test speaks to directly.
+bool open_rio(const char* path, int flags, zx_handle_t* out) {
+    BEGIN_HELPER;
+    int fd = open(path, flags, 0644);
+    ASSERT_GT(fd, 0);
+    zx_handle_t handles[FDIO_MAX_HANDLES];
+    uint32_t types[FDIO_MAX_HANDLES];
+    zx_status_t r = fdio_clone_fd(fd, 0, handles, types);
+    ASSERT_GT(r, 0);
+    for (zx_status_t i = 1; i < r; i++) {
+        zx_handle_close(handles[i]);
+    }
+    ASSERT_EQ(close(fd), 0);
+    *out = handles[0];
+    END_HELPER;
+}
+
+// The server rejects buffered transfers without a buffer, with a negative
+// length, or larger than the buffer.
+bool test_buffer_bounds(void) {
+    BEGIN_TEST;
+
+    zx_handle_t h;
+    ASSERT_TRUE(open_rio("::large", O_RDWR | O_CREAT, &h));
+    ASSERT_EQ(rio_call(h, ZXRIO_READ_BUFFER, 1, 0, ZX_HANDLE_INVALID, nullptr),
+              ZX_ERR_BAD_STATE);
+    ASSERT_EQ(rio_call(h, ZXRIO_WRITE_AT_BUFFER, 1, 0, ZX_HANDLE_INVALID, nullptr),
+              ZX_ERR_BAD_STATE);
+
+    constexpr size_t kBufferSize = 64 * 1024;
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(kBufferSize, 0, &vmo), ZX_OK);
+    zx_handle_t dup;
+    ASSERT_EQ(zx_handle_duplicate(vmo, ZX_RIGHT_SAME_RIGHTS, &dup), ZX_OK);
+    ASSERT_EQ(rio_call(h, ZXRIO_SETBUFFER, 0, 0, dup, nullptr), ZX_OK);
+
+    const uint32_t ops[] = {
+        ZXRIO_READ_BUFFER, ZXRIO_READ_AT_BUFFER, ZXRIO_WRITE_BUFFER, ZXRIO_WRITE_AT_BUFFER,
+    };
+    for (uint32_t op : ops) {
+        ASSERT_EQ(rio_call(h, op, -1, 0, ZX_HANDLE_INVALID, nullptr), ZX_ERR_INVALID_ARGS);
+        ASSERT_EQ(rio_call(h, op, INT32_MIN, 0, ZX_HANDLE_INVALID, nullptr),
+                  ZX_ERR_INVALID_ARGS);
+        ASSERT_EQ(rio_call(h, op, kBufferSize + 1, 0, ZX_HANDLE_INVALID, nullptr),
+                  ZX_ERR_INVALID_ARGS);
+    }
+
+    // A transfer of the whole buffer is accepted, and moves the offset only
+    // for the variants without one.
+    uint8_t data[kBufferSize];
+    memset(data, 'x', sizeof(data));
+    size_t actual;
+    ASSERT_EQ(zx_vmo_write(vmo, data, 0, sizeof(data), &actual), ZX_OK);
+    int64_t off;
+    ASSERT_EQ(rio_call(h, ZXRIO_WRITE_AT_BUFFER, kBufferSize, 100, ZX_HANDLE_INVALID, nullptr),
+              static_cast<zx_status_t>(kBufferSize));
+    ASSERT_EQ(rio_call(h, ZXRIO_WRITE_BUFFER, kBufferSize, 0, ZX_HANDLE_INVALID, &off),
+              static_cast<zx_status_t>(kBufferSize));
+    ASSERT_EQ(off, static_cast<int64_t>(kBufferSize));
+    ASSERT_EQ(rio_call(h, ZXRIO_READ_AT_BUFFER, kBufferSize, 100, ZX_HANDLE_INVALID, nullptr),
+              static_cast<zx_status_t>(kBufferSize));
+    ASSERT_EQ(rio_call(h, ZXRIO_READ_BUFFER, kBufferSize, 0, ZX_HANDLE_INVALID, &off),
+              100);
+    ASSERT_EQ(off, static_cast<int64_t>(kBufferSize + 100));
+    ASSERT_EQ(rio_call(h, ZXRIO_READ_BUFFER, kBufferSize, 0, ZX_HANDLE_INVALID, &off), 0);
+    ASSERT_EQ(zx_vmo_read(vmo, data, 0, sizeof(data), &actual), ZX_OK);
+    for (size_t i = 0; i < kBufferSize; i++) {
+        ASSERT_EQ(data[i], 'x');
+    }
+
+    // The usable size of a larger buffer is capped, so that the count of
+    // transferred bytes always fits in the reply.
+    zx_handle_t big;
+    ASSERT_EQ(zx_vmo_create(1ull << 32, 0, &big), ZX_OK);
+    ASSERT_EQ(rio_call(h, ZXRIO_SETBUFFER, 0, 0, big, nullptr), ZX_OK);
+    ASSERT_EQ(rio_call(h, ZXRIO_READ_AT_BUFFER, INT32_MAX, 0, ZX_HANDLE_INVALID, nullptr),
+              ZX_ERR_INVALID_ARGS);
+    ASSERT_EQ(rio_call(h, ZXRIO_WRITE_AT_BUFFER, INT32_MAX, 0, ZX_HANDLE_INVALID, nullptr),
+              ZX_ERR_INVALID_ARGS);
+
+    ASSERT_EQ(zx_handle_close(vmo), ZX_OK);
+    ASSERT_EQ(zx_handle_close(h), ZX_OK);
+    ASSERT_EQ(unlink("::large"), 0);
+
+    END_TEST;
+}
+
+// Buffered writes on a connection opened for appending go to the end of
+// the file, unless they give an offset.
+bool test_buffer_append(void) {
+    BEGIN_TEST;
+
+    zx_handle_t h;
+    ASSERT_TRUE(open_rio("::large", O_RDWR | O_CREAT | O_APPEND, &h));
+    constexpr size_t kBufferSize = 8192;
+    zx_handle_t vmo;
+    ASSERT_EQ(zx_vmo_create(kBufferSize, 0, &vmo), ZX_OK);
+    zx_handle_t dup;
+    ASSERT_EQ(zx_handle_duplicate(vmo, ZX_RIGHT_SAME_RIGHTS, &dup), ZX_OK);
+    ASSERT_EQ(rio_call(h, ZXRIO_SETBUFFER, 0, 0, dup, nullptr), ZX_OK);
+
+    uint8_t data[kBufferSize];
+    memset(data, 'a', sizeof(data));
+    size_t actual;
+    ASSERT_EQ(zx_vmo_write(vmo, data, 0, sizeof(data), &actual), ZX_OK);
+    int64_t off;
+    ASSERT_EQ(rio_call(h, ZXRIO_WRITE_BUFFER, kBufferSize, 0, ZX_HANDLE_INVALID, &off),
+              static_cast<zx_status_t>(kBufferSize));
+    ASSERT_EQ(off, static_cast<int64_t>(kBufferSize));
+
+    // Another writer extends the file.
+    int fd = open("::large", O_RDWR);
+    ASSERT_GT(fd, 0);
+    ASSERT_EQ(pwrite(fd, "b", 1, kBufferSize), 1);
+
+    ASSERT_EQ(rio_call(h, ZXRIO_WRITE_BUFFER, kBufferSize, 0, ZX_HANDLE_INVALID, &off),
+              static_cast<zx_status_t>(kBufferSize));
+    ASSERT_EQ(off, static_cast<int64_t>(2 * kBufferSize + 1));
+    ASSERT_EQ(rio_call(h, ZXRIO_WRITE_AT_BUFFER, 1, 0, ZX_HANDLE_INVALID, nullptr), 1);
+
+    struct stat st;
+    ASSERT_EQ(fstat(fd, &st), 0);
+    ASSERT_EQ(st.st_size, static_cast<off_t>(2 * kBufferSize + 1));
+    char c;
+    ASSERT_EQ(pread(fd, &c, 1, kBufferSize), 1);
+    ASSERT_EQ(c, 'b');
+
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(zx_handle_close(vmo), ZX_OK);
+    ASSERT_EQ(zx_handle_close(h), ZX_OK);
+    ASSERT_EQ(unlink("::large"), 0);
+
+    END_TEST;
+}
+
+} // namespace
+
+RUN_FOR_ALL_FILESYSTEMS(large_io_tests,
+    RUN_TEST_MEDIUM(test_large_read_write)
+    RUN_TEST_MEDIUM(test_large_append)
+    RUN_TEST_MEDIUM(test_large_append_shared)
+    RUN_TEST_MEDIUM(test_large_at_eof)
+    RUN_TEST_MEDIUM(test_buffer_bounds)
+    RUN_TEST_MEDIUM(test_buffer_append)
+)
@@ -7,6 +7,7 @@
 #include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <minfs/format.h>
@@ -44,6 +45,20 @@ bool QueryInfo(size_t expected_nodes) {
     return true;
 }
 
+bool GetUsedBytes(uint64_t* used_bytes) {
+    int fd = open(MOUNT_PATH, O_RDONLY | O_DIRECTORY);
+    ASSERT_GT(fd, 0);
+
+    char buf[sizeof(vfs_query_info_t) + MAX_FS_NAME_LEN + 1];
+    vfs_query_info_t* info = reinterpret_cast<vfs_query_info_t*>(buf);
+    ssize_t rv = ioctl_vfs_query_fs(fd, info, sizeof(buf) - 1);
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_GE(rv, static_cast<ssize_t>(sizeof(vfs_query_info_t)), "Failed to query filesystem");
+
+    *used_bytes = info->used_bytes;
+    return true;
+}
+
 }  // namespace
 
 bool TestQueryInfo(void) {
@@ -64,9 +79,47 @@ bool TestQueryInfo(void) {
     END_TEST;
 }
 
+// Unlinks a file with several extents, which must release all of them.
+bool TestUnlinkFragmented(void) {
+    BEGIN_TEST;
+
+    uint64_t used_before;
+    ASSERT_TRUE(GetUsedBytes(&used_before));
+
+    char path[128];
+    snprintf(path, sizeof(path) - 1, "%s/fragmented", MOUNT_PATH);
+    int fd = open(path, O_CREAT | O_RDWR, 0644);
+    ASSERT_GT(fd, 0, "Failed to create file");
+
+    // Write every other block, so that each block written is its own extent.
+    constexpr size_t kExtents = 8;
+    static_assert(kExtents >= 6 && kExtents < minfs::kMinfsInodeExtents,
+                  "File must stay extent-mapped");
+    char buf[minfs::kMinfsBlockSize];
+    memset(buf, 'a', sizeof(buf));
+    for (size_t i = 0; i < kExtents; i++) {
+        ASSERT_EQ(pwrite(fd, buf, sizeof(buf), 2 * i * sizeof(buf)),
+                  static_cast<ssize_t>(sizeof(buf)));
+    }
+    ASSERT_EQ(fsync(fd), 0);
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink(path), 0);
+
+    // fsck fails if the file's blocks or inode were not released.
+    ASSERT_EQ(test_info->unmount(test_root_path), 0);
+    ASSERT_EQ(test_info->fsck(test_disk_path), 0);
+    ASSERT_EQ(test_info->mount(test_disk_path, test_root_path), 0);
+
+    uint64_t used_after;
+    ASSERT_TRUE(GetUsedBytes(&used_after));
+    ASSERT_EQ(used_after, used_before, "Blocks leaked by unlink");
+    END_TEST;
+}
+
 #define RUN_MINFS_TESTS(name, CASE_TESTS) \
     FS_TEST_CASE(name, DEFAULT_DISK_SIZE, CASE_TESTS, FS_TEST_FVM, minfs, 1)
 
 RUN_MINFS_TESTS(FsMinfsTestsFvm,
     RUN_TEST_MEDIUM(TestQueryInfo)
+    RUN_TEST_MEDIUM(TestUnlinkFragmented)
 )
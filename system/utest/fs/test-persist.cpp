@@ -172,6 +172,74 @@ bool test_persist_with_data(void) {
     END_TEST;
 }
 
+// Appends small writes to several open files at once, truncating each
+// partway through, so the data written is not yet allocated on disk when
+// the files are shrunk and later closed.
+template <size_t Files, size_t Writes>
+bool test_persist_interleaved_appends(void) {
+    BEGIN_TEST;
+
+    if (!test_info->can_be_mounted) {
+        fprintf(stderr, "Filesystem cannot be mounted; cannot test persistence\n");
+        return true;
+    }
+
+    constexpr size_t kWriteSize = 1000;
+    constexpr size_t kTruncateSize = (Writes / 2) * kWriteSize + 7;
+    constexpr size_t kFileSize = Writes * kWriteSize;
+    static_assert(kTruncateSize < kFileSize, "Truncation must shrink the file");
+
+    char path[Files][32];
+    int fds[Files];
+    for (size_t i = 0; i < Files; i++) {
+        snprintf(path[i], sizeof(path[i]), "::interleaved-%zu", i);
+        fds[i] = open(path[i], O_RDWR | O_CREAT | O_APPEND, 0644);
+        ASSERT_GT(fds[i], 0);
+    }
+
+    // Byte |j| of file |i| is (i + j) % 251, except that bytes between the
+    // truncation point and the final size are zero.
+    uint8_t buf[kWriteSize];
+    for (size_t w = 0; w < Writes; w++) {
+        for (size_t i = 0; i < Files; i++) {
+            if (w == Writes / 2 + 1) {
+                ASSERT_EQ(ftruncate(fds[i], kTruncateSize), 0);
+                ASSERT_EQ(ftruncate(fds[i], w * kWriteSize), 0);
+            }
+            for (size_t j = 0; j < kWriteSize; j++) {
+                buf[j] = static_cast<uint8_t>((i + w * kWriteSize + j) % 251);
+            }
+            ASSERT_EQ(write(fds[i], buf, kWriteSize), static_cast<ssize_t>(kWriteSize));
+        }
+    }
+    for (size_t i = 0; i < Files; i++) {
+        ASSERT_EQ(close(fds[i]), 0);
+    }
+
+    ASSERT_TRUE(check_remount(), "Could not remount filesystem");
+
+    for (size_t i = 0; i < Files; i++) {
+        int fd = open(path[i], O_RDONLY, 0644);
+        ASSERT_GT(fd, 0);
+        struct stat st;
+        ASSERT_EQ(fstat(fd, &st), 0);
+        ASSERT_EQ(st.st_size, static_cast<off_t>(kFileSize));
+        for (size_t w = 0; w < Writes; w++) {
+            ASSERT_EQ(read(fd, buf, kWriteSize), static_cast<ssize_t>(kWriteSize));
+            for (size_t j = 0; j < kWriteSize; j++) {
+                const size_t off = w * kWriteSize + j;
+                const bool truncated = (off >= kTruncateSize) &&
+                                       (off < (Writes / 2 + 1) * kWriteSize);
+                ASSERT_EQ(buf[j], truncated ? 0 : static_cast<uint8_t>((i + off) % 251));
+            }
+        }
+        ASSERT_EQ(close(fd), 0);
+        ASSERT_EQ(unlink(path[i]), 0);
+    }
+
+    END_TEST;
+}
+
 constexpr size_t kMaxLoopLength = 26;
 
 template <bool MoveDirectory, size_t LoopLength, size_t Moves>
@@ -268,6 +336,7 @@ RUN_FOR_ALL_FILESYSTEMS(persistence_tests,
     RUN_TEST_LARGE((test_persist_with_data<8192>))
     RUN_TEST_LARGE((test_persist_with_data<8192 + 1>))
     RUN_TEST_LARGE((test_persist_with_data<8192 * 128>))
+    RUN_TEST_MEDIUM((test_persist_interleaved_appends<4, 64>))
     RUN_TEST_MEDIUM((test_rename_loop<false, 2, 2>));
     RUN_TEST_LARGE((test_rename_loop<false, 2, 100>));
     RUN_TEST_LARGE((test_rename_loop<false, 15, 100>));
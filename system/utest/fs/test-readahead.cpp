@@ -0,0 +1,164 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zircon/syscalls.h>
+#include <fbl/algorithm.h>
+#include <fbl/alloc_checker.h>
+#include <fbl/unique_ptr.h>
+#include <unittest/unittest.h>
+
+#include "filesystems.h"
+
+namespace {
+
+constexpr size_t kFileSize = 256 * 1024 + 123;
+constexpr size_t kReadSize = 1000;
+
+bool create_file(const char* path, uint8_t* buf) {
+    unsigned int seed = static_cast<unsigned int>(zx_ticks_get());
+    unittest_printf("Read-ahead test using seed: %u\n", seed);
+    for (size_t i = 0; i < kFileSize; i++) {
+        buf[i] = (uint8_t) rand_r(&seed);
+    }
+    int fd = open(path, O_RDWR | O_CREAT, 0644);
+    ASSERT_GT(fd, 0);
+    ASSERT_EQ(write(fd, buf, kFileSize), kFileSize);
+    ASSERT_EQ(close(fd), 0);
+    return true;
+}
+
+bool test_readahead_sequential(void) {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kFileSize]);
+    ASSERT_TRUE(ac.check());
+    ASSERT_TRUE(create_file("::readahead", data.get()));
+
+    int fd = open("::readahead", O_RDONLY);
+    ASSERT_GT(fd, 0);
+    uint8_t buf[kReadSize];
+    size_t pos = 0;
+    while (pos < kFileSize) {
+        size_t expected = fbl::min(kReadSize, kFileSize - pos);
+        ASSERT_EQ(read(fd, buf, kReadSize), expected);
+        ASSERT_EQ(memcmp(buf, &data[pos], expected), 0);
+        pos += expected;
+    }
+    ASSERT_EQ(read(fd, buf, kReadSize), 0);
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), kFileSize);
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink("::readahead"), 0);
+
+    END_TEST;
+}
+
+bool test_readahead_interrupted(void) {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kFileSize]);
+    ASSERT_TRUE(ac.check());
+    ASSERT_TRUE(create_file("::readahead", data.get()));
+
+    int fd = open("::readahead", O_RDWR);
+    ASSERT_GT(fd, 0);
+    uint8_t buf[kReadSize];
+    for (size_t i = 0; i < 20; i++) {
+        ASSERT_EQ(read(fd, buf, kReadSize), kReadSize);
+    }
+
+    // The seek offset reflects what has been read, not what was read ahead.
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), 20 * kReadSize);
+    ASSERT_EQ(lseek(fd, 100, SEEK_CUR), 20 * kReadSize + 100);
+    ASSERT_EQ(read(fd, buf, kReadSize), kReadSize);
+    ASSERT_EQ(memcmp(buf, &data[20 * kReadSize + 100], kReadSize), 0);
+
+    // Writes land at the seek offset, and are seen by later reads.
+    for (size_t i = 0; i < 10; i++) {
+        ASSERT_EQ(read(fd, buf, kReadSize), kReadSize);
+    }
+    off_t off = lseek(fd, 0, SEEK_CUR);
+    memset(buf, 'a', sizeof(buf));
+    ASSERT_EQ(write(fd, buf, kReadSize), kReadSize);
+    ASSERT_EQ(lseek(fd, off, SEEK_SET), off);
+    for (size_t i = 0; i < 3; i++) {
+        ASSERT_EQ(read(fd, buf, kReadSize), kReadSize);
+        if (i == 0) {
+            for (size_t j = 0; j < kReadSize; j++) {
+                ASSERT_EQ(buf[j], 'a');
+            }
+        } else {
+            ASSERT_EQ(memcmp(buf, &data[off + i * kReadSize], kReadSize), 0);
+        }
+    }
+
+    // The end of the file is reported, but reading resumes once it grows.
+    ASSERT_EQ(lseek(fd, kFileSize - 10, SEEK_SET), kFileSize - 10);
+    ASSERT_EQ(read(fd, buf, kReadSize), 10);
+    ASSERT_EQ(read(fd, buf, kReadSize), 0);
+    ASSERT_EQ(pwrite(fd, "hello", 5, kFileSize), 5);
+    ASSERT_EQ(read(fd, buf, kReadSize), 5);
+    ASSERT_EQ(memcmp(buf, "hello", 5), 0);
+
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink("::readahead"), 0);
+
+    END_TEST;
+}
+
+bool test_readahead_other_writer(void) {
+    BEGIN_TEST;
+
+    fbl::AllocChecker ac;
+    fbl::unique_ptr<uint8_t[]> data(new (&ac) uint8_t[kFileSize]);
+    ASSERT_TRUE(ac.check());
+    ASSERT_TRUE(create_file("::readahead", data.get()));
+
+    int fd = open("::readahead", O_RDONLY);
+    ASSERT_GT(fd, 0);
+    uint8_t buf[kReadSize];
+    for (size_t i = 0; i < 20; i++) {
+        ASSERT_EQ(read(fd, buf, kReadSize), kReadSize);
+    }
+
+    // Writes through another descriptor, just past what has been read and
+    // so within what may have been read ahead, are seen by the reader.
+    int fd2 = open("::readahead", O_RDWR);
+    ASSERT_GT(fd2, 0);
+    memset(buf, 'b', sizeof(buf));
+    ASSERT_EQ(pwrite(fd2, buf, kReadSize, 21 * kReadSize), kReadSize);
+    ASSERT_EQ(close(fd2), 0);
+
+    ASSERT_EQ(read(fd, buf, kReadSize), kReadSize);
+    ASSERT_EQ(memcmp(buf, &data[20 * kReadSize], kReadSize), 0);
+    ASSERT_EQ(read(fd, buf, kReadSize), kReadSize);
+    for (size_t j = 0; j < kReadSize; j++) {
+        ASSERT_EQ(buf[j], 'b');
+    }
+    ASSERT_EQ(read(fd, buf, kReadSize), kReadSize);
+    ASSERT_EQ(memcmp(buf, &data[22 * kReadSize], kReadSize), 0);
+    ASSERT_EQ(lseek(fd, 0, SEEK_CUR), 23 * kReadSize);
+
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(unlink("::readahead"), 0);
+
+    END_TEST;
+}
+
+} // namespace
+
+RUN_FOR_ALL_FILESYSTEMS(readahead_tests,
+    RUN_TEST_MEDIUM(test_readahead_sequential)
+    RUN_TEST_MEDIUM(test_readahead_interrupted)
+    RUN_TEST_MEDIUM(test_readahead_other_writer)
+)
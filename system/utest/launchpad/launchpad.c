@@ -15,6 +15,7 @@
 #include <zircon/processargs.h>
 #include <zircon/syscalls.h>
 #include <zircon/syscalls/object.h>
+#include <inttypes.h>
 #include <limits.h>
 
 #include <fdio/util.h>
@@ -125,9 +126,117 @@ static bool argument_size_test(void) {
     return ok;
 }
 
+static const char* const sh_argv[] = { "/boot/bin/sh", "-c", ":" };
+
+// Launches sh_argv, loaded from tmpl if it's not NULL, and waits for it
+// to exit.
+static bool run_sh(const launchpad_template_t* tmpl) {
+    BEGIN_HELPER;
+
+    launchpad_t* lp;
+    ASSERT_EQ(launchpad_create(ZX_HANDLE_INVALID, "template test", &lp),
+              ZX_OK, "");
+    EXPECT_EQ(launchpad_set_args(lp, countof(sh_argv), sh_argv), ZX_OK, "");
+    if (tmpl != NULL) {
+        EXPECT_EQ(launchpad_load_from_template(lp, tmpl), ZX_OK, "");
+    } else {
+        EXPECT_EQ(launchpad_load_from_file(lp, sh_argv[0]), ZX_OK, "");
+    }
+
+    zx_handle_t proc = ZX_HANDLE_INVALID;
+    const char* errmsg = "???";
+    ASSERT_EQ(launchpad_go(lp, &proc, &errmsg), ZX_OK, errmsg);
+
+    EXPECT_EQ(zx_object_wait_one(proc, ZX_PROCESS_TERMINATED,
+                                 ZX_TIME_INFINITE, NULL), ZX_OK, "");
+    zx_info_process_t info;
+    EXPECT_EQ(zx_object_get_info(proc, ZX_INFO_PROCESS,
+                                 &info, sizeof(info), NULL, NULL), ZX_OK, "");
+    EXPECT_EQ(zx_handle_close(proc), ZX_OK, "");
+
+    EXPECT_EQ(info.return_code, 0, "shell exit status");
+
+    END_HELPER;
+}
+
+static bool template_test(void) {
+    BEGIN_TEST;
+
+    launchpad_template_t* tmpl;
+    ASSERT_EQ(launchpad_template_create_from_file(sh_argv[0], &tmpl),
+              ZX_OK, "launchpad_template_create_from_file");
+
+    // The template can be used for any number of processes.
+    for (int i = 0; i < 3; ++i)
+        EXPECT_TRUE(run_sh(tmpl), "");
+
+    launchpad_template_destroy(tmpl);
+
+    END_TEST;
+}
+
+#define BENCHMARK_LAUNCHES 100
+
+// Compares loading and running a short-lived process from its file
+// with loading it from a template.
+static bool template_benchmark(void) {
+    BEGIN_TEST;
+
+    launchpad_template_t* tmpl;
+    ASSERT_EQ(launchpad_template_create_from_file(sh_argv[0], &tmpl),
+              ZX_OK, "launchpad_template_create_from_file");
+
+    // Loading alone, without starting the process.
+    zx_time_t start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    for (int i = 0; i < BENCHMARK_LAUNCHES; ++i) {
+        launchpad_t* lp;
+        ASSERT_EQ(launchpad_create(ZX_HANDLE_INVALID, "benchmark", &lp),
+                  ZX_OK, "");
+        EXPECT_EQ(launchpad_load_from_file(lp, sh_argv[0]), ZX_OK, "");
+        launchpad_destroy(lp);
+    }
+    zx_time_t file_load = zx_clock_get(ZX_CLOCK_MONOTONIC) - start;
+
+    start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    for (int i = 0; i < BENCHMARK_LAUNCHES; ++i) {
+        launchpad_t* lp;
+        ASSERT_EQ(launchpad_create(ZX_HANDLE_INVALID, "benchmark", &lp),
+                  ZX_OK, "");
+        EXPECT_EQ(launchpad_load_from_template(lp, tmpl), ZX_OK, "");
+        launchpad_destroy(lp);
+    }
+    zx_time_t template_load = zx_clock_get(ZX_CLOCK_MONOTONIC) - start;
+
+    // Launching the process and waiting for it to exit.
+    start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    for (int i = 0; i < BENCHMARK_LAUNCHES; ++i)
+        ASSERT_TRUE(run_sh(NULL), "");
+    zx_time_t file_run = zx_clock_get(ZX_CLOCK_MONOTONIC) - start;
+
+    start = zx_clock_get(ZX_CLOCK_MONOTONIC);
+    for (int i = 0; i < BENCHMARK_LAUNCHES; ++i)
+        ASSERT_TRUE(run_sh(tmpl), "");
+    zx_time_t template_run = zx_clock_get(ZX_CLOCK_MONOTONIC) - start;
+
+    launchpad_template_destroy(tmpl);
+
+    unittest_printf("load: %" PRIu64 " ns from file, %" PRIu64
+                    " ns from template\n",
+                    file_load / BENCHMARK_LAUNCHES,
+                    template_load / BENCHMARK_LAUNCHES);
+    unittest_printf("launch and exit: %" PRIu64 " ns from file, %" PRIu64
+                    " ns from template\n",
+                    file_run / BENCHMARK_LAUNCHES,
+                    template_run / BENCHMARK_LAUNCHES);
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(launchpad_tests)
 RUN_TEST(launchpad_test);
 RUN_TEST(argument_size_test);
+RUN_TEST(template_test);
+RUN_TEST_PERFORMANCE(template_benchmark);
 END_TEST_CASE(launchpad_tests)
 
 int main(int argc, char **argv)
@@ -5,11 +5,17 @@
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <threads.h>
 #include <unistd.h>
 
 #include <async/cpp/loop.h>
+#include <fdio/io.h>
 #include <fdio/util.h>
 #include <memfs/memfs.h>
 #include <unittest/unittest.h>
@@ -130,10 +136,202 @@ bool test_memfs_close_during_access() {
     END_TEST;
 }
 
+bool test_memfs_grow_and_mmap() {
+    BEGIN_TEST;
+
+    async::Loop loop;
+    ASSERT_EQ(loop.StartThread(), ZX_OK);
+
+    memfs_filesystem_t* vfs;
+    zx_handle_t root;
+    ASSERT_EQ(memfs_create_filesystem(loop.async(), &vfs, &root), ZX_OK);
+    uint32_t type = PA_FDIO_REMOTE;
+    int root_fd;
+    ASSERT_EQ(fdio_create_fd(&root, &type, 1, &root_fd), ZX_OK);
+
+    // Grow the file with small writes, crossing several pages.
+    int fd = openat(root_fd, "file", O_CREAT | O_RDWR);
+    ASSERT_GE(fd, 0);
+    constexpr size_t kChunk = 100;
+    constexpr size_t kLen = kChunk * 200;
+    uint8_t data[kLen];
+    for (size_t i = 0; i < kLen; i++) {
+        data[i] = static_cast<uint8_t>(i * 7);
+    }
+    for (size_t off = 0; off < kLen; off += kChunk) {
+        ASSERT_EQ(write(fd, data + off, kChunk), static_cast<ssize_t>(kChunk));
+    }
+    struct stat st;
+    ASSERT_EQ(fstat(fd, &st), 0);
+    ASSERT_EQ(st.st_size, static_cast<off_t>(kLen));
+
+    // A private mapping reads the file's pages until it writes to them, so it
+    // is not a snapshot: later writes to the file show through.
+    void* addr = mmap(nullptr, kLen, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+    ASSERT_NE(addr, MAP_FAILED);
+    uint8_t* mapped = static_cast<uint8_t*>(addr);
+    ASSERT_EQ(memcmp(mapped, data, kLen), 0);
+    uint8_t zeros[kChunk];
+    memset(zeros, 0, sizeof(zeros));
+    ASSERT_EQ(pwrite(fd, zeros, sizeof(zeros), 0), static_cast<ssize_t>(sizeof(zeros)));
+    ASSERT_EQ(memcmp(mapped, zeros, kChunk), 0);
+    ASSERT_EQ(memcmp(mapped + kChunk, data + kChunk, kLen - kChunk), 0);
+
+    // Writes through the private mapping do not reach the file.
+    memset(mapped + PAGE_SIZE, 0xcd, kChunk);
+    uint8_t buf[kLen];
+    ASSERT_EQ(pread(fd, buf, kChunk, PAGE_SIZE), static_cast<ssize_t>(kChunk));
+    ASSERT_EQ(memcmp(buf, data + PAGE_SIZE, kChunk), 0);
+    ASSERT_EQ(munmap(addr, kLen), 0);
+
+    // A shared mapping may write past the end of the file, but the file only
+    // grows over zeros.
+    constexpr size_t kMapLen = (kLen + PAGE_SIZE - 1) / PAGE_SIZE * PAGE_SIZE;
+    static_assert(kMapLen > kLen, "The file should end partway through a page");
+    addr = mmap(nullptr, kMapLen, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT_NE(addr, MAP_FAILED);
+    memset(static_cast<uint8_t*>(addr) + kLen, 0xab, kMapLen - kLen);
+    ASSERT_EQ(munmap(addr, kMapLen), 0);
+    ASSERT_EQ(ftruncate(fd, kMapLen), 0);
+    ASSERT_EQ(pread(fd, buf, kMapLen - kLen, kLen), static_cast<ssize_t>(kMapLen - kLen));
+    for (size_t i = 0; i < kMapLen - kLen; i++) {
+        ASSERT_EQ(buf[i], 0);
+    }
+
+    // Truncating and re-extending the file exposes only zeros.
+    ASSERT_EQ(ftruncate(fd, kChunk / 2), 0);
+    ASSERT_EQ(ftruncate(fd, kLen), 0);
+    ASSERT_EQ(pread(fd, buf, kLen, 0), static_cast<ssize_t>(kLen));
+    for (size_t i = 0; i < kLen; i++) {
+        ASSERT_EQ(buf[i], 0);
+    }
+
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(close(root_fd), 0);
+    loop.Shutdown();
+    ASSERT_EQ(memfs_free_filesystem(vfs, 0), ZX_OK);
+
+    END_TEST;
+}
+
+bool test_memfs_get_vmo() {
+    BEGIN_TEST;
+
+    async::Loop loop;
+    ASSERT_EQ(loop.StartThread(), ZX_OK);
+
+    memfs_filesystem_t* vfs;
+    zx_handle_t root;
+    ASSERT_EQ(memfs_create_filesystem(loop.async(), &vfs, &root), ZX_OK);
+    uint32_t type = PA_FDIO_REMOTE;
+    int root_fd;
+    ASSERT_EQ(fdio_create_fd(&root, &type, 1, &root_fd), ZX_OK);
+
+    int fd = openat(root_fd, "file", O_CREAT | O_RDWR);
+    ASSERT_GE(fd, 0);
+    constexpr size_t kLen = PAGE_SIZE * 3 + 100;
+    static uint8_t data[kLen];
+    for (size_t i = 0; i < kLen; i++) {
+        data[i] = static_cast<uint8_t>(i * 13);
+    }
+    ASSERT_EQ(write(fd, data, kLen), static_cast<ssize_t>(kLen));
+
+    // The VMO holds exactly the contents of the file, and is read-only.
+    zx_handle_t vmo;
+    ASSERT_EQ(fdio_get_vmo(fd, &vmo), ZX_OK);
+    uint64_t size;
+    ASSERT_EQ(zx_vmo_get_size(vmo, &size), ZX_OK);
+    ASSERT_EQ(size, kLen);
+    zx_info_handle_basic_t info;
+    ASSERT_EQ(zx_object_get_info(vmo, ZX_INFO_HANDLE_BASIC, &info, sizeof(info),
+                                 nullptr, nullptr), ZX_OK);
+    ASSERT_EQ(info.rights & ZX_RIGHT_WRITE, 0u);
+    static uint8_t buf[kLen];
+    size_t actual;
+    ASSERT_EQ(zx_vmo_read(vmo, buf, 0, kLen, &actual), ZX_OK);
+    ASSERT_EQ(actual, kLen);
+    ASSERT_EQ(memcmp(buf, data, kLen), 0);
+
+    // The VMO is a clone rather than a copy, so writes to the file, including
+    // those made through a shared mapping, show through it.
+    void* addr = mmap(nullptr, PAGE_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT_NE(addr, MAP_FAILED);
+    memset(addr, 0xab, PAGE_SIZE);
+    ASSERT_EQ(munmap(addr, PAGE_SIZE), 0);
+    ASSERT_EQ(pread(fd, buf, PAGE_SIZE, 0), static_cast<ssize_t>(PAGE_SIZE));
+    for (size_t i = 0; i < PAGE_SIZE; i++) {
+        ASSERT_EQ(buf[i], 0xab);
+    }
+    ASSERT_EQ(zx_vmo_read(vmo, buf, 0, kLen, &actual), ZX_OK);
+    for (size_t i = 0; i < PAGE_SIZE; i++) {
+        ASSERT_EQ(buf[i], 0xab);
+    }
+    ASSERT_EQ(memcmp(buf + PAGE_SIZE, data + PAGE_SIZE, kLen - PAGE_SIZE), 0);
+    ASSERT_EQ(zx_handle_close(vmo), ZX_OK);
+
+    ASSERT_EQ(close(fd), 0);
+    ASSERT_EQ(close(root_fd), 0);
+    loop.Shutdown();
+    ASSERT_EQ(memfs_free_filesystem(vfs, 0), ZX_OK);
+
+    END_TEST;
+}
+
+// Creates, looks up and removes many entries in a single directory.
+bool test_memfs_large_directory() {
+    BEGIN_TEST;
+
+    async::Loop loop;
+    ASSERT_EQ(loop.StartThread(), ZX_OK);
+
+    memfs_filesystem_t* vfs;
+    zx_handle_t root;
+    ASSERT_EQ(memfs_create_filesystem(loop.async(), &vfs, &root), ZX_OK);
+    uint32_t type = PA_FDIO_REMOTE;
+    int root_fd;
+    ASSERT_EQ(fdio_create_fd(&root, &type, 1, &root_fd), ZX_OK);
+
+    constexpr size_t kNumEntries = 100000;
+    char name[32];
+    uint64_t start = zx_ticks_get();
+    for (size_t i = 0; i < kNumEntries; i++) {
+        snprintf(name, sizeof(name), "file-%zu", i);
+        int fd = openat(root_fd, name, O_CREAT | O_EXCL | O_RDWR);
+        ASSERT_GE(fd, 0);
+        ASSERT_EQ(close(fd), 0);
+    }
+    uint64_t created = zx_ticks_get();
+    for (size_t i = 0; i < kNumEntries; i++) {
+        snprintf(name, sizeof(name), "file-%zu", i);
+        struct stat st;
+        ASSERT_EQ(fstatat(root_fd, name, &st, 0), 0);
+    }
+    uint64_t looked_up = zx_ticks_get();
+    for (size_t i = 0; i < kNumEntries; i++) {
+        snprintf(name, sizeof(name), "file-%zu", i);
+        ASSERT_EQ(unlinkat(root_fd, name, 0), 0);
+    }
+    uint64_t unlinked = zx_ticks_get();
+
+    uint64_t per_ms = zx_ticks_per_second() / 1000;
+    unittest_printf("\n    %zu entries: create %" PRIu64 " ms, lookup %" PRIu64
+                    " ms, unlink %" PRIu64 " ms\n", kNumEntries, (created - start) / per_ms,
+                    (looked_up - created) / per_ms, (unlinked - looked_up) / per_ms);
+
+    ASSERT_EQ(close(root_fd), 0);
+    loop.Shutdown();
+    ASSERT_EQ(memfs_free_filesystem(vfs, 0), ZX_OK);
+
+    END_TEST;
+}
+
 } // namespace
 
 BEGIN_TEST_CASE(memfs_tests)
 RUN_TEST(test_memfs_null)
 RUN_TEST(test_memfs_basic)
 RUN_TEST(test_memfs_close_during_access)
+RUN_TEST(test_memfs_grow_and_mmap)
+RUN_TEST(test_memfs_get_vmo)
+RUN_TEST_PERFORMANCE(test_memfs_large_directory)
 END_TEST_CASE(memfs_tests)
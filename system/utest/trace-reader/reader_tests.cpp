@@ -178,6 +178,44 @@ bool empty_buffer_test() {
     END_TEST;
 }
 
+bool padding_test() {
+    BEGIN_TEST;
+
+    fbl::Vector<trace::Record> records;
+    fbl::String error;
+    trace::TraceReader reader(MakeRecordConsumer(&records), MakeErrorHandler(&error));
+
+    uint64_t kData[] = {
+        // padding record covering 3 words
+        (3 << 4) | (4 << 16),
+        0xdeadbeef,
+        0xdeadbeef,
+        // initialization record
+        (2 << 4) | 1,
+        1000,
+        // padding record covering only its header
+        (1 << 4) | (4 << 16),
+        // zero words
+        0,
+        0,
+        // initialization record
+        (2 << 4) | 1,
+        2000,
+        0,
+    };
+
+    trace::Chunk chunk(kData, fbl::count_of(kData));
+    EXPECT_TRUE(reader.ReadRecords(chunk));
+    ASSERT_EQ(2u, records.size());
+    EXPECT_EQ(trace::RecordType::kInitialization, records[0].type());
+    EXPECT_EQ(1000u, records[0].GetInitialization().ticks_per_second);
+    EXPECT_EQ(trace::RecordType::kInitialization, records[1].type());
+    EXPECT_EQ(2000u, records[1].GetInitialization().ticks_per_second);
+    EXPECT_TRUE(error.empty());
+
+    END_TEST;
+}
+
 // NOTE: Most of the reader is covered by the libtrace tests.
 
 } // namespace
@@ -187,4 +225,5 @@ RUN_TEST(empty_chunk_test)
 RUN_TEST(non_empty_chunk_test)
 RUN_TEST(initial_state_test)
 RUN_TEST(empty_buffer_test)
+RUN_TEST(padding_test)
 END_TEST_CASE(reader_tests)
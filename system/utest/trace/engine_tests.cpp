@@ -330,7 +330,7 @@ bool test_register_string_literal_table_overflow() {
             if (trace_is_inline_string_ref(&r))
                 break;
         }
-        EXPECT_GT(n, 100); // at least 100 string can be cached per thread
+        EXPECT_GT(n, 1000); // at least 1000 strings can be cached per thread
     }
 
     END_TRACE_TEST;
@@ -387,6 +387,195 @@ bool test_event_with_inline_everything() {
     END_TRACE_TEST;
 }
 
+constexpr size_t kRollingTestBufferSize = 256 * 1024;
+constexpr uint64_t kRollingTestEventCount = 20000u;
+
+// Writes |count| instant events, each carrying its sequence number, using
+// indexed strings and threads which refer to records in the durable buffer.
+void WriteNumberedEvents(uint64_t count) {
+    auto context = trace::TraceContext::Acquire();
+
+    trace_string_ref_t cat, name, arg_name;
+    trace_context_register_string_literal(context.get(), "+cat", &cat);
+    trace_context_register_string_literal(context.get(), "name", &name);
+    trace_context_register_string_literal(context.get(), "seq", &arg_name);
+    trace_thread_ref_t thread;
+    trace_context_register_current_thread(context.get(), &thread);
+
+    for (uint64_t i = 0; i < count; i++) {
+        trace_arg_t args[] = {trace_make_arg(arg_name, trace_make_uint64_arg_value(i))};
+        trace_context_write_instant_event_record(context.get(), zx_ticks_get(),
+                                                 &thread, &cat, &name,
+                                                 TRACE_SCOPE_THREAD,
+                                                 args, fbl::count_of(args));
+    }
+}
+
+// Checks that the events written by |WriteNumberedEvents()| form a
+// contiguous run which ends with the last event.
+bool CheckNumberedEvents(const fbl::Vector<trace::Record>& records,
+                         uint64_t count, uint64_t* out_num_events) {
+    BEGIN_HELPER;
+
+    uint64_t num_events = 0u;
+    uint64_t next_seq = 0u;
+    for (const auto& record : records) {
+        if (record.type() != trace::RecordType::kEvent)
+            continue;
+        const auto& event = record.GetEvent();
+        ASSERT_TRUE(event.category == "+cat");
+        ASSERT_TRUE(event.name == "name");
+        ASSERT_TRUE(event.process_thread);
+        ASSERT_EQ(1u, event.arguments.size());
+        ASSERT_TRUE(event.arguments[0].name() == "seq");
+        uint64_t seq = event.arguments[0].value().GetUint64();
+        if (num_events > 0u) {
+            ASSERT_EQ(next_seq, seq, "events must not be missing or reordered");
+        }
+        next_seq = seq + 1u;
+        num_events++;
+    }
+    EXPECT_EQ(count, next_seq, "last event must be present");
+    *out_num_events = num_events;
+
+    END_HELPER;
+}
+
+bool test_circular_mode() {
+    BEGIN_TRACE_TEST_ETC(TRACE_BUFFERING_MODE_CIRCULAR, kRollingTestBufferSize);
+
+    fixture_start_tracing();
+    WriteNumberedEvents(kRollingTestEventCount);
+
+    fbl::Vector<trace::Record> records;
+    ASSERT_TRUE(fixture_read_records(&records));
+    EXPECT_EQ(ZX_OK, fixture_get_disposition());
+
+    // The oldest events have been overwritten but strings and threads which
+    // they refer to survive.
+    uint64_t num_events;
+    ASSERT_TRUE(CheckNumberedEvents(records, kRollingTestEventCount, &num_events));
+    EXPECT_GT(num_events, 0u);
+    EXPECT_LT(num_events, kRollingTestEventCount);
+
+    END_TRACE_TEST;
+}
+
+bool test_streaming_mode() {
+    BEGIN_TRACE_TEST_ETC(TRACE_BUFFERING_MODE_STREAMING, kRollingTestBufferSize);
+
+    fixture_start_tracing();
+    WriteNumberedEvents(kRollingTestEventCount);
+
+    fbl::Vector<trace::Record> records;
+    ASSERT_TRUE(fixture_read_records(&records));
+    EXPECT_EQ(ZX_OK, fixture_get_disposition());
+
+    // The fixture saves each buffer as soon as it fills so nothing is lost.
+    uint64_t num_events;
+    ASSERT_TRUE(CheckNumberedEvents(records, kRollingTestEventCount, &num_events));
+    EXPECT_EQ(kRollingTestEventCount, num_events);
+
+    END_TRACE_TEST;
+}
+
+bool test_streaming_mode_deferred_save() {
+    BEGIN_TRACE_TEST_ETC(TRACE_BUFFERING_MODE_STREAMING, kRollingTestBufferSize);
+
+    constexpr uint64_t kNumStalledEvents = 10u;
+
+    fixture_defer_buffer_saves();
+    fixture_start_tracing();
+
+    // Fill the first rolling buffer, leaving this thread with a chunk of the
+    // second one.  Then have another thread fill the second rolling buffer,
+    // so that the engine stalls on it.
+    uint64_t num_written = 0u;
+    while (fixture_get_num_deferred_saves() == 0u) {
+        WriteNumberedEvents(1u);
+        num_written++;
+    }
+    thrd_t thread;
+    ASSERT_EQ(thrd_success, thrd_create(&thread, [](void* arg) {
+        WriteNumberedEvents(kRollingTestEventCount);
+        return 0;
+    }, nullptr));
+    ASSERT_EQ(thrd_success, thrd_join(thread, nullptr));
+    num_written += kRollingTestEventCount;
+    ASSERT_EQ(2u, fixture_get_num_deferred_saves());
+
+    // The second rolling buffer has been handed off to be saved, so these
+    // events must not be written to this thread's chunk of it.
+    WriteNumberedEvents(kNumStalledEvents);
+    num_written += kNumStalledEvents;
+
+    fixture_save_deferred_buffers();
+    WriteNumberedEvents(kNumStalledEvents);
+    num_written += kNumStalledEvents;
+
+    fbl::Vector<trace::Record> records;
+    ASSERT_TRUE(fixture_read_records(&records));
+    EXPECT_EQ(ZX_OK, fixture_get_disposition());
+
+    // Every event was either saved, or counted as dropped.
+    uint64_t num_events = 0u;
+    for (const auto& record : records) {
+        if (record.type() == trace::RecordType::kEvent)
+            num_events++;
+    }
+    uint64_t num_dropped = fixture_get_num_records_dropped();
+    EXPECT_GE(num_dropped, kNumStalledEvents);
+    EXPECT_EQ(num_written, num_events + num_dropped);
+
+    END_TRACE_TEST;
+}
+
+bool test_concurrent_writers() {
+    BEGIN_TRACE_TEST;
+
+    constexpr size_t kNumThreads = 4u;
+    constexpr uint64_t kNumEventsPerThread = 2000u;
+
+    fixture_start_tracing();
+
+    thrd_t threads[kNumThreads];
+    for (size_t i = 0; i < kNumThreads; i++) {
+        ASSERT_EQ(thrd_success, thrd_create(&threads[i], [](void* arg) {
+            WriteNumberedEvents(kNumEventsPerThread);
+            return 0;
+        }, nullptr));
+    }
+    for (size_t i = 0; i < kNumThreads; i++) {
+        ASSERT_EQ(thrd_success, thrd_join(threads[i], nullptr));
+    }
+
+    fbl::Vector<trace::Record> records;
+    ASSERT_TRUE(fixture_read_records(&records));
+    EXPECT_EQ(ZX_OK, fixture_get_disposition());
+
+    // Each thread's events appear in the order in which it wrote them.
+    zx_koid_t thread_koids[kNumThreads] = {};
+    uint64_t next_seqs[kNumThreads] = {};
+    for (const auto& record : records) {
+        if (record.type() != trace::RecordType::kEvent)
+            continue;
+        const auto& event = record.GetEvent();
+        size_t i = 0;
+        while (i < kNumThreads && thread_koids[i] &&
+               thread_koids[i] != event.process_thread.thread_koid())
+            i++;
+        ASSERT_LT(i, kNumThreads, "too many threads");
+        thread_koids[i] = event.process_thread.thread_koid();
+        ASSERT_EQ(next_seqs[i], event.arguments[0].value().GetUint64());
+        next_seqs[i]++;
+    }
+    for (size_t i = 0; i < kNumThreads; i++) {
+        EXPECT_EQ(kNumEventsPerThread, next_seqs[i]);
+    }
+
+    END_TRACE_TEST;
+}
+
 // NOTE: The functions for writing trace records are exercised by other trace tests.
 
 } // namespace
@@ -406,4 +595,8 @@ RUN_TEST(test_register_string_literal_multiple_threads)
 RUN_TEST(test_register_string_literal_table_overflow)
 RUN_TEST(test_maximum_record_length)
 RUN_TEST(test_event_with_inline_everything)
+RUN_TEST(test_circular_mode)
+RUN_TEST(test_streaming_mode)
+RUN_TEST(test_streaming_mode_deferred_save)
+RUN_TEST(test_concurrent_writers)
 END_TEST_CASE(engine_tests)
@@ -15,9 +15,12 @@
 #include <zx/event.h>
 #include <fbl/algorithm.h>
 #include <fbl/array.h>
+#include <fbl/auto_lock.h>
+#include <fbl/mutex.h>
 #include <fbl/string.h>
 #include <fbl/string_buffer.h>
 #include <fbl/vector.h>
+#include <trace-engine/buffer_internal.h>
 #include <trace-reader/reader.h>
 #include <trace/handler.h>
 #include <unittest/unittest.h>
@@ -28,8 +31,8 @@ static constexpr size_t kBufferSizeBytes = 1024 * 1024;
 
 class Fixture : private trace::TraceHandler {
 public:
-    Fixture()
-        : buffer_(new uint8_t[kBufferSizeBytes], kBufferSizeBytes) {
+    Fixture(trace_buffering_mode_t mode, size_t buffer_size)
+        : mode_(mode), buffer_(new uint8_t[buffer_size], buffer_size) {
         zx_status_t status = zx::event::create(0u, &trace_stopped_);
         ZX_DEBUG_ASSERT(status == ZX_OK);
     }
@@ -46,8 +49,8 @@ public:
         loop_.StartThread("trace test");
 
         // Asynchronously start the engine.
-        zx_status_t status = trace_start_engine(loop_.async(), this,
-                                                buffer_.get(), buffer_.size());
+        zx_status_t status = trace_start_engine_with_mode(loop_.async(), this, mode_,
+                                                          buffer_.get(), buffer_.size());
         ZX_DEBUG_ASSERT(status == ZX_OK);
     }
 
@@ -80,23 +83,81 @@ public:
         return disposition_;
     }
 
+    uint64_t num_records_dropped() const {
+        ZX_DEBUG_ASSERT(!trace_running_);
+        auto header = reinterpret_cast<const trace_buffer_header_t*>(buffer_.get());
+        return header->num_records_dropped;
+    }
+
+    void DeferBufferSaves() {
+        fbl::AutoLock lock(&saved_records_mutex_);
+        defer_saves_ = true;
+    }
+
+    size_t num_deferred_saves() {
+        fbl::AutoLock lock(&saved_records_mutex_);
+        return deferred_saves_.size();
+    }
+
+    // Hands the buffers filled since saves were deferred back to the engine,
+    // in the order in which they filled, and saves later buffers right away.
+    void SaveDeferredBuffers() {
+        fbl::Vector<DeferredSave> saves;
+        {
+            fbl::AutoLock lock(&saved_records_mutex_);
+            defer_saves_ = false;
+            saves.swap(deferred_saves_);
+        }
+        for (const auto& save : saves) {
+            zx_status_t status = trace_engine_mark_buffer_saved(save.wrapped_count,
+                                                                save.durable_data_end);
+            ZX_DEBUG_ASSERT(status == ZX_OK);
+        }
+    }
+
     bool ReadRecords(fbl::Vector<trace::Record>* out_records,
                      fbl::Vector<fbl::String>* out_errors) {
         trace::TraceReader reader(
             [out_records](trace::Record record) { out_records->push_back(fbl::move(record)); },
             [out_errors](fbl::String error) { out_errors->push_back(fbl::move(error)); });
-        trace::Chunk chunk(reinterpret_cast<uint64_t*>(buffer_.get()),
-                           buffer_bytes_written_ / 8u);
         if (buffer_bytes_written_ & 7u) {
             out_errors->push_back(fbl::String("Buffer contains extraneous bytes"));
         }
-        if (!reader.ReadRecords(chunk)) {
+        bool ok;
+        if (mode_ == TRACE_BUFFERING_MODE_STREAMING) {
+            ok = ReadStreamedRecords(&reader);
+        } else {
+            ok = reader.ReadBuffer(buffer_.get(), buffer_bytes_written_ & ~7u);
+        }
+        if (!ok) {
             out_errors->push_back(fbl::String("Trace data is corrupted"));
         }
         return out_errors->is_empty();
     }
 
 private:
+    // Reads the durable records, then the rolling buffers saved while tracing
+    // in the order in which they were saved, then what is left in the buffer.
+    bool ReadStreamedRecords(trace::TraceReader* reader) {
+        auto header = reinterpret_cast<const trace_buffer_header_t*>(buffer_.get());
+        const uint8_t* durable_buffer = buffer_.get() + sizeof(*header);
+        trace::Chunk durable(reinterpret_cast<const uint64_t*>(durable_buffer),
+                             header->durable_data_end / 8u);
+        if (!reader->ReadRecords(durable))
+            return false;
+
+        trace::Chunk saved(saved_records_.get(), saved_records_.size());
+        if (!reader->ReadRecords(saved))
+            return false;
+
+        uint32_t current = header->wrapped_count & 1u;
+        const uint8_t* rolling_buffer = durable_buffer + header->durable_buffer_size +
+                                        current * header->rolling_buffer_size;
+        trace::Chunk rest(reinterpret_cast<const uint64_t*>(rolling_buffer),
+                          header->rolling_data_end[current] / 8u);
+        return reader->ReadRecords(rest);
+    }
+
     bool IsCategoryEnabled(const char* category) override {
         // All categories which begin with + are enabled.
         return category[0] == '+';
@@ -114,6 +175,35 @@ private:
         trace_stopped_.signal(0u, ZX_EVENT_SIGNALED);
     }
 
+    // Copies the records out of a full rolling buffer right away, as the
+    // trace manager would.  Unless saves are deferred, the buffer is then
+    // handed back to the engine.
+    void NotifyBufferFull(uint32_t wrapped_count, uint64_t durable_data_end) override {
+        auto header = reinterpret_cast<const trace_buffer_header_t*>(buffer_.get());
+        uint32_t index = wrapped_count & 1u;
+        auto rolling_buffer = reinterpret_cast<const uint64_t*>(
+            buffer_.get() + sizeof(*header) + header->durable_buffer_size +
+            index * header->rolling_buffer_size);
+        {
+            fbl::AutoLock lock(&saved_records_mutex_);
+            for (size_t i = 0; i < header->rolling_data_end[index] / 8u; i++)
+                saved_records_.push_back(rolling_buffer[i]);
+            if (defer_saves_) {
+                deferred_saves_.push_back(DeferredSave{wrapped_count, durable_data_end});
+                return;
+            }
+        }
+
+        zx_status_t status = trace_engine_mark_buffer_saved(wrapped_count, durable_data_end);
+        ZX_DEBUG_ASSERT(status == ZX_OK);
+    }
+
+    struct DeferredSave {
+        uint32_t wrapped_count;
+        uint64_t durable_data_end;
+    };
+
+    trace_buffering_mode_t const mode_;
     async::Loop loop_;
     fbl::Array<uint8_t> buffer_;
     bool trace_running_ = false;
@@ -121,6 +211,12 @@ private:
     size_t buffer_bytes_written_ = 0u;
     zx::event trace_stopped_;
     bool observed_stopped_callback_ = false;
+
+    // Contents of the rolling buffers saved in streaming mode.
+    fbl::Mutex saved_records_mutex_;
+    fbl::Vector<uint64_t> saved_records_;
+    bool defer_saves_ = false;
+    fbl::Vector<DeferredSave> deferred_saves_;
 };
 
 Fixture* g_fixture{nullptr};
@@ -128,8 +224,12 @@ Fixture* g_fixture{nullptr};
 } // namespace
 
 void fixture_set_up(void) {
+    fixture_set_up_with_mode(TRACE_BUFFERING_MODE_ONESHOT, kBufferSizeBytes);
+}
+
+void fixture_set_up_with_mode(trace_buffering_mode_t mode, size_t buffer_size) {
     ZX_DEBUG_ASSERT(!g_fixture);
-    g_fixture = new Fixture();
+    g_fixture = new Fixture(mode, buffer_size);
 }
 
 void fixture_tear_down(void) {
@@ -158,26 +258,55 @@ zx_status_t fixture_get_disposition(void) {
     return g_fixture->disposition();
 }
 
-bool fixture_compare_records(const char* expected) {
+uint64_t fixture_get_num_records_dropped(void) {
+    ZX_DEBUG_ASSERT(g_fixture);
+    return g_fixture->num_records_dropped();
+}
+
+void fixture_defer_buffer_saves(void) {
+    ZX_DEBUG_ASSERT(g_fixture);
+    g_fixture->DeferBufferSaves();
+}
+
+size_t fixture_get_num_deferred_saves(void) {
+    ZX_DEBUG_ASSERT(g_fixture);
+    return g_fixture->num_deferred_saves();
+}
+
+void fixture_save_deferred_buffers(void) {
+    ZX_DEBUG_ASSERT(g_fixture);
+    g_fixture->SaveDeferredBuffers();
+}
+
+bool fixture_read_records(fbl::Vector<trace::Record>* out_records) {
     ZX_DEBUG_ASSERT(g_fixture);
     BEGIN_HELPER;
 
     g_fixture->StopTracing(false);
 
-    fbl::Vector<trace::Record> records;
     fbl::Vector<fbl::String> errors;
-    EXPECT_TRUE(g_fixture->ReadRecords(&records, &errors), "read error");
+    EXPECT_TRUE(g_fixture->ReadRecords(out_records, &errors), "read error");
 
     for (const auto& error : errors)
         printf("error: %s\n", error.c_str());
     ASSERT_EQ(0u, errors.size(), "errors encountered");
 
-    ASSERT_GE(records.size(), 1u, "expected an initialization record");
-    ASSERT_EQ(trace::RecordType::kInitialization, records[0].type(),
+    ASSERT_GE(out_records->size(), 1u, "expected an initialization record");
+    ASSERT_EQ(trace::RecordType::kInitialization, (*out_records)[0].type(),
               "expected initialization record");
     EXPECT_EQ(zx_ticks_per_second(),
-              records[0].GetInitialization().ticks_per_second);
-    records.erase(0);
+              (*out_records)[0].GetInitialization().ticks_per_second);
+    out_records->erase(0);
+
+    END_HELPER;
+}
+
+bool fixture_compare_records(const char* expected) {
+    ZX_DEBUG_ASSERT(g_fixture);
+    BEGIN_HELPER;
+
+    fbl::Vector<trace::Record> records;
+    ASSERT_TRUE(fixture_read_records(&records));
 
     // Append all records to the buffer, replacing each match of a parenthesized
     // subexpression of the regex with "<>".  This is used to strip out timestamps
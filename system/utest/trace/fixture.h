@@ -9,17 +9,26 @@
 
 #pragma once
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include <zircon/compiler.h>
+#include <trace-engine/handler.h>
 #include <unittest/unittest.h>
 
 __BEGIN_CDECLS
 
 void fixture_set_up(void);
+void fixture_set_up_with_mode(trace_buffering_mode_t mode, size_t buffer_size);
 void fixture_tear_down(void);
 void fixture_start_tracing(void);
 void fixture_stop_tracing(void);
 void fixture_stop_tracing_hard(void);
 zx_status_t fixture_get_disposition(void);
+uint64_t fixture_get_num_records_dropped(void);
+void fixture_defer_buffer_saves(void);
+size_t fixture_get_num_deferred_saves(void);
+void fixture_save_deferred_buffers(void);
 bool fixture_compare_records(const char* expected);
 
 inline void fixture_scope_cleanup(bool* scope) {
@@ -32,6 +41,12 @@ inline void fixture_scope_cleanup(bool* scope) {
     (void)__scope;                                                \
     fixture_set_up();
 
+#define BEGIN_TRACE_TEST_ETC(mode, buffer_size)                   \
+    BEGIN_TEST;                                                   \
+    __attribute__((cleanup(fixture_scope_cleanup))) bool __scope; \
+    (void)__scope;                                                \
+    fixture_set_up_with_mode((mode), (buffer_size));
+
 #define END_TRACE_TEST \
     END_TEST;
 
@@ -49,3 +64,14 @@ inline void fixture_scope_cleanup(bool* scope) {
 #endif // NTRACE
 
 __END_CDECLS
+
+#ifdef __cplusplus
+
+#include <fbl/vector.h>
+#include <trace-reader/records.h>
+
+// Stops tracing and reads back all records, other than the initialization
+// record, in the order in which they were written.
+bool fixture_read_records(fbl::Vector<trace::Record>* out_records);
+
+#endif // __cplusplus
@@ -0,0 +1,81 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <unittest/unittest.h>
+#include <zircon/syscalls.h>
+#include <zircon/types.h>
+#include <zxcrypt/volume.h>
+
+#include "test-device.h"
+
+namespace zxcrypt {
+namespace testing {
+namespace {
+
+// See test-device.h; the following macros allow reusing tests for each of the supported versions.
+#define EACH_PARAM(OP, Test) OP(Test, Volume, AES256_XTS_SHA256)
+
+// Geometry of the ramdisk used to measure throughput.  Each request is large enough to be split
+// across several workers.
+const size_t kBenchmarkBlockSize = 4096;
+const size_t kBenchmarkDeviceSize = 16 * 1024 * 1024;
+const size_t kBenchmarkRequestSize = 1024 * 1024;
+const size_t kBenchmarkPasses = 4;
+
+// Prints the throughput, in MiB/s, of transferring |len| bytes in |ticks|.
+void PrintThroughput(const char* what, size_t len, uint64_t ticks) {
+    uint64_t ms = (ticks * 1000) / zx_ticks_per_second();
+    uint64_t rate = ms == 0 ? 0 : (len * 1000) / (ms * 1024 * 1024);
+    unittest_printf("\n    %s: %zu bytes in %" PRIu64 " ms (%" PRIu64 " MiB/s)", what, len, ms,
+                    rate);
+}
+
+bool TestThroughput(Volume::Version version) {
+    BEGIN_TEST;
+
+    TestDevice device;
+    ASSERT_OK(device.GenerateKey(version));
+    ASSERT_OK(device.Create(kBenchmarkDeviceSize, kBenchmarkBlockSize, false /* not FVM */));
+    ASSERT_OK(Volume::Create(device.parent(), device.key()));
+    ASSERT_OK(device.BindZxcrypt());
+
+    size_t block_size = device.block_size();
+    size_t n = kBenchmarkRequestSize / block_size;
+    size_t count = device.block_count() - (device.block_count() % n);
+    size_t total = kBenchmarkPasses * count * block_size;
+
+    uint64_t start = zx_ticks_get();
+    for (size_t pass = 0; pass < kBenchmarkPasses; ++pass) {
+        for (size_t off = 0; off < count; off += n) {
+            ASSERT_OK(device.WriteVmo(off, n));
+        }
+    }
+    PrintThroughput("write", total, zx_ticks_get() - start);
+
+    start = zx_ticks_get();
+    for (size_t pass = 0; pass < kBenchmarkPasses; ++pass) {
+        for (size_t off = 0; off < count; off += n) {
+            ASSERT_OK(device.ReadVmo(off, n));
+        }
+    }
+    PrintThroughput("read", total, zx_ticks_get() - start);
+    unittest_printf("\n");
+
+    EXPECT_TRUE(device.CheckMatch(0, count * block_size));
+
+    END_TEST;
+}
+DEFINE_EACH(TestThroughput);
+
+BEGIN_TEST_CASE(ZxcryptBenchmark)
+RUN_TEST_PERFORMANCE(TestThroughput_AES256_XTS_SHA256)
+END_TEST_CASE(ZxcryptBenchmark)
+
+} // namespace
+} // namespace testing
+} // namespace zxcrypt
@@ -36,11 +36,15 @@
 #include <runtime/processargs.h>
 #include <runtime/thread.h>
 
+struct dso;
+
 static void early_init(void);
 static void error(const char*, ...);
 static void debugmsg(const char*, ...);
 static void log_write(const void* buf, size_t len);
 static zx_status_t get_library_vmo(const char* name, zx_handle_t* vmo);
+static void prefetch_deps(const struct dso* p);
+static void prefetch_release(void);
 static void loader_svc_config(const char* config);
 
 #define MAXP2(a, b) (-(-(a) & -(b)))
@@ -933,11 +937,15 @@ static size_t count_syms(struct dso* p) {
     return nsym;
 }
 
+__NO_SAFESTACK static bool dso_has_name(struct dso* p, const char* name) {
+    return (!strcmp(p->l_map.l_name, name) ||
+            (p->soname != NULL && !strcmp(p->soname, name)));
+}
+
 __NO_SAFESTACK static struct dso* find_library_in(struct dso* p,
                                                   const char* name) {
     while (p != NULL) {
-        if (!strcmp(p->l_map.l_name, name) ||
-            (p->soname != NULL && !strcmp(p->soname, name))) {
+        if (dso_has_name(p, name)) {
             ++p->refcnt;
             break;
         }
@@ -946,6 +954,20 @@ __NO_SAFESTACK static struct dso* find_library_in(struct dso* p,
     return p;
 }
 
+// Like find_library, but without taking a reference or moving anything
+// between lists.
+__NO_SAFESTACK static bool is_library_loaded(const char* name) {
+    for (struct dso* p = head; p != NULL; p = dso_next(p)) {
+        if (dso_has_name(p, name))
+            return true;
+    }
+    for (struct dso* p = detached_head; p != NULL; p = dso_next(p)) {
+        if (dso_has_name(p, name))
+            return true;
+    }
+    return false;
+}
+
 __NO_SAFESTACK static struct dso* find_library(const char* name) {
     // First see if it's in the general list.
     struct dso* p = find_library_in(head, name);
@@ -1245,6 +1267,7 @@ __NO_SAFESTACK static void load_deps(struct dso* p) {
         // The two preallocated DSOs don't get space allocated for ->deps.
         if (runtime && p->deps == NULL && p != &ldso && p != &vdso)
             deps = p->deps = p->buf;
+        prefetch_deps(p);
         for (size_t i = 0; p->l_map.l_ld[i].d_tag; i++) {
             if (p->l_map.l_ld[i].d_tag != DT_NEEDED)
                 continue;
@@ -1254,12 +1277,15 @@ __NO_SAFESTACK static void load_deps(struct dso* p) {
             if (status != ZX_OK) {
                 error("Error loading shared library %s: %s (needed by %s)",
                       name, _zx_status_get_string(status), p->l_map.l_name);
-                if (runtime)
+                if (runtime) {
+                    prefetch_release();
                     longjmp(*rtld_fail, 1);
+                }
             } else if (deps != NULL) {
                 *deps++ = dep;
             }
         }
+        prefetch_release();
     }
 }
 
@@ -2160,10 +2186,12 @@ __attribute__((__visibility__("hidden"))) void __dl_vseterr(const char*, va_list
 static bool loader_svc_rpc_in_progress;
 static atomic_uint_fast32_t loader_svc_txid;
 
-__NO_SAFESTACK static zx_status_t loader_svc_rpc(uint32_t opcode,
-                                                 const void* data, size_t len,
-                                                 zx_handle_t request_handle,
-                                                 zx_handle_t* result) {
+// Returns in |results| the handles from the reply, of which there are at
+// most |max_results|, and sets |*result_count| to their number.
+__NO_SAFESTACK static zx_status_t loader_svc_rpc_handles(
+    uint32_t opcode, const void* data, size_t len,
+    zx_handle_t request_handle,
+    zx_handle_t* results, uint32_t max_results, uint32_t* result_count) {
     // Use a static buffer rather than one on the stack to avoid growing
     // the stack size too much.  Calls to this function are always
     // serialized anyway, so there is no danger of collision.
@@ -2175,6 +2203,7 @@ __NO_SAFESTACK static zx_status_t loader_svc_rpc(uint32_t opcode,
     loader_svc_rpc_in_progress = true;
 
     zx_status_t status;
+    uint32_t handle_count = 0;
     if (len >= sizeof msg.data) {
         _zx_handle_close(request_handle);
         error("message of %zu bytes too large for loader service protocol",
@@ -2188,11 +2217,6 @@ __NO_SAFESTACK static zx_status_t loader_svc_rpc(uint32_t opcode,
     msg.header.opcode = opcode;
     memcpy(msg.data, data, len);
     msg.data[len] = 0;
-    if (result != NULL) {
-      // Don't return an uninitialized value if the channel call
-      // succeeds but doesn't provide any handles.
-      *result = ZX_HANDLE_INVALID;
-    }
 
     zx_channel_call_args_t call = {
         .wr_bytes = &msg,
@@ -2201,17 +2225,17 @@ __NO_SAFESTACK static zx_status_t loader_svc_rpc(uint32_t opcode,
         .wr_num_handles = request_handle == ZX_HANDLE_INVALID ? 0 : 1,
         .rd_bytes = &msg,
         .rd_num_bytes = sizeof(msg),
-        .rd_handles = result,
-        .rd_num_handles = result == NULL ? 0 : 1,
+        .rd_handles = results,
+        .rd_num_handles = max_results,
     };
 
     uint32_t reply_size;
-    uint32_t handle_count;
     zx_status_t read_status = ZX_OK;
     status = _zx_channel_call(loader_svc, 0, ZX_TIME_INFINITE,
                               &call, &reply_size, &handle_count,
                               &read_status);
     if (status != ZX_OK) {
+        handle_count = 0;
         error("_zx_channel_call of %u bytes to loader service: "
               "%d (%s), read %d (%s)",
               call.wr_num_bytes, status, _zx_status_get_string(status),
@@ -2230,21 +2254,25 @@ __NO_SAFESTACK static zx_status_t loader_svc_rpc(uint32_t opcode,
         goto out;
     }
     if (msg.header.opcode != LOADER_SVC_OP_STATUS) {
-        if (handle_count > 0) {
-            _zx_handle_close(*result);
-            *result = ZX_HANDLE_INVALID;
+        for (uint32_t i = 0; i < handle_count; ++i) {
+            _zx_handle_close(results[i]);
+            results[i] = ZX_HANDLE_INVALID;
         }
+        handle_count = 0;
         error("loader service reply opcode %u != %u",
               msg.header.opcode, LOADER_SVC_OP_STATUS);
         status = ZX_ERR_INVALID_ARGS;
         goto out;
     }
     if (msg.header.arg != ZX_OK) {
-        // |result| is non-null if |handle_count| > 0, because
-        // |handle_count| <= |rd_num_handles|.
-        if (handle_count > 0 && *result != ZX_HANDLE_INVALID) {
+        // |results| is non-null if |handle_count| > 0, because
+        // |handle_count| <= |rd_num_handles|.  Only a batched load
+        // returns handles along with an error: those for the objects
+        // before the one that failed.
+        if (handle_count > 0 && opcode != LOADER_SVC_OP_LOAD_OBJECTS &&
+            *results != ZX_HANDLE_INVALID) {
             error("loader service error %d reply contains handle %#x",
-                  msg.header.arg, *result);
+                  msg.header.arg, *results);
             status = ZX_ERR_INVALID_ARGS;
             goto out;
         }
@@ -2253,9 +2281,25 @@ __NO_SAFESTACK static zx_status_t loader_svc_rpc(uint32_t opcode,
 
 out:
     loader_svc_rpc_in_progress = false;
+    *result_count = handle_count;
     return status;
 }
 
+__NO_SAFESTACK static zx_status_t loader_svc_rpc(uint32_t opcode,
+                                                 const void* data, size_t len,
+                                                 zx_handle_t request_handle,
+                                                 zx_handle_t* result) {
+    if (result != NULL) {
+      // Don't return an uninitialized value if the channel call
+      // succeeds but doesn't provide any handles.
+      *result = ZX_HANDLE_INVALID;
+    }
+    uint32_t result_count;
+    return loader_svc_rpc_handles(opcode, data, len, request_handle,
+                                  result, result == NULL ? 0 : 1,
+                                  &result_count);
+}
+
 __NO_SAFESTACK static void loader_svc_config(const char* config) {
     zx_status_t status = loader_svc_rpc(LOADER_SVC_OP_CONFIG,
                                         config, strlen(config),
@@ -2265,8 +2309,71 @@ __NO_SAFESTACK static void loader_svc_config(const char* config) {
                  config, _zx_status_get_string(status));
 }
 
+// The VMOs for one DSO's dependencies, fetched by prefetch_deps in a
+// single LOADER_SVC_OP_LOAD_OBJECTS request rather than one request
+// each.  Each is consumed by get_library_vmo, and any left over are
+// closed by prefetch_release.  The names point into the DSO's strings.
+static const char* prefetch_names[ZX_CHANNEL_MAX_MSG_HANDLES];
+static zx_handle_t prefetch_vmos[ZX_CHANNEL_MAX_MSG_HANDLES];
+static uint32_t prefetch_count;
+
+// Set when the loader service turns out not to support batched loads.
+static bool loader_svc_no_batch;
+
+__NO_SAFESTACK static void prefetch_deps(const struct dso* p) {
+    if (loader_svc == ZX_HANDLE_INVALID || loader_svc_no_batch)
+        return;
+
+    // Collect the names of the dependencies not already loaded, as
+    // many as fit in one request.
+    static char names[LOADER_SVC_MSG_MAX - sizeof(zx_loader_svc_msg_t)];
+    size_t len = 0;
+    uint32_t count = 0;
+    for (size_t i = 0; p->l_map.l_ld[i].d_tag; i++) {
+        if (p->l_map.l_ld[i].d_tag != DT_NEEDED)
+            continue;
+        const char* name = p->strings + p->l_map.l_ld[i].d_un.d_val;
+        size_t size = strlen(name) + 1;
+        if (size == 1 || is_library_loaded(name))
+            continue;
+        if (count == ZX_CHANNEL_MAX_MSG_HANDLES || len + size >= sizeof(names))
+            break;
+        memcpy(&names[len], name, size);
+        len += size;
+        prefetch_names[count++] = name;
+    }
+
+    // A single name is no cheaper to load this way.
+    if (count < 2)
+        return;
+
+    zx_status_t status = loader_svc_rpc_handles(
+        LOADER_SVC_OP_LOAD_OBJECTS, names, len, ZX_HANDLE_INVALID,
+        prefetch_vmos, count, &prefetch_count);
+    if (status == ZX_ERR_NOT_SUPPORTED || status == ZX_ERR_INVALID_ARGS)
+        loader_svc_no_batch = true;
+    // Whatever was not fetched (if anything) is loaded by name as usual,
+    // which reports the error.
+}
+
+__NO_SAFESTACK static void prefetch_release(void) {
+    for (uint32_t i = 0; i < prefetch_count; ++i) {
+        if (prefetch_vmos[i] != ZX_HANDLE_INVALID)
+            _zx_handle_close(prefetch_vmos[i]);
+    }
+    prefetch_count = 0;
+}
+
 __NO_SAFESTACK static zx_status_t get_library_vmo(const char* name,
                                                   zx_handle_t* result) {
+    for (uint32_t i = 0; i < prefetch_count; ++i) {
+        if (prefetch_vmos[i] != ZX_HANDLE_INVALID &&
+            !strcmp(prefetch_names[i], name)) {
+            *result = prefetch_vmos[i];
+            prefetch_vmos[i] = ZX_HANDLE_INVALID;
+            return ZX_OK;
+        }
+    }
     if (loader_svc == ZX_HANDLE_INVALID) {
         error("cannot look up \"%s\" with no loader service", name);
         return ZX_ERR_UNAVAILABLE;
@@ -6,15 +6,41 @@
 
 #if defined(OPENSSL_AARCH64) && !defined(OPENSSL_STATIC_ARMCAP)
 
+#include <zircon/features.h>
+#include <zircon/syscalls.h>
+#include <zircon/types.h>
+
 #include <openssl/arm_arch.h>
 
 #include "internal.h"
 
+extern "C" {
+extern uint32_t OPENSSL_armcap_P;
+}
+
 void OPENSSL_cpuid_setup(void) {
-    // TODO(aarongreen): Determine processor cryptographic capabilities. See
-    // zircon/third_party/ulib/musl/include/sys/auxv.h. Without a mechanism
-    // similar to AT_HWCAP, there's currently nothing discoverable.
-    return;
+    uint32_t hwcap;
+    if (zx_system_get_features(ZX_FEATURE_KIND_CPU, &hwcap) != ZX_OK) {
+        return;
+    }
+    // Matches the logic in cpu-aarch64-linux.c: the cryptographic extensions are only used if
+    // NEON is also present.
+    if ((hwcap & ZX_ARM64_FEATURE_ISA_ASIMD) == 0) {
+        return;
+    }
+    OPENSSL_armcap_P |= ARMV7_NEON;
+    if (hwcap & ZX_ARM64_FEATURE_ISA_AES) {
+        OPENSSL_armcap_P |= ARMV8_AES;
+    }
+    if (hwcap & ZX_ARM64_FEATURE_ISA_PMULL) {
+        OPENSSL_armcap_P |= ARMV8_PMULL;
+    }
+    if (hwcap & ZX_ARM64_FEATURE_ISA_SHA1) {
+        OPENSSL_armcap_P |= ARMV8_SHA1;
+    }
+    if (hwcap & ZX_ARM64_FEATURE_ISA_SHA2) {
+        OPENSSL_armcap_P |= ARMV8_SHA256;
+    }
 }
 
 #endif // OPENSSL_AARCH64 && !OPENSSL_STATIC_ARMCAP
@@ -45,7 +45,13 @@ my $comm = sub {
 	$ret .= ".indirect_symbol\t_$name\n";
 	$ret .= ".long\t0";
 	$name = "_$name";
-    } else			{ $ret = ".comm\t".join(',',@args); }
+    } else			{
+	$ret = ".comm\t".join(',',@args);
+	# Like globals, common symbols are hidden so that they may be
+	# referenced PC-relatively from within a shared library, unless
+	# an earlier .extern already did so.
+	$ret .= "\n".&$hidden($name) if (!defined($$global));
+    }
 
     $$global = $name;
     $ret;
@@ -69,7 +75,11 @@ my $globl = sub {
 };
 my $global = $globl;
 my $extern = sub {
+    my $seen = defined($GLOBALS{$_[0]});
     &$globl(@_);
+    # External symbols are defined within the same library, and are hidden
+    # there.
+    if ($flavour =~ /linux/ && !$seen)	{ return &$hidden(@_); }
     return;	# return nothing
 };
 my $type = sub {
@@ -53,9 +53,33 @@
 #include <openssl/aes.h>
 #include <openssl/cipher.h>
 
+#include "../crypto/fipsmodule/aes/internal.h"
 #include "../crypto/fipsmodule/modes/internal.h"
 
 
+#if !defined(OPENSSL_NO_ASM) && defined(OPENSSL_X86_64)
+#define AESNI_XTS
+static char aesni_capable(void) {
+  return (OPENSSL_ia32cap_P[1] & (1 << (57 - 32))) != 0;
+}
+
+int aesni_set_encrypt_key(const uint8_t *userKey, int bits, AES_KEY *key);
+int aesni_set_decrypt_key(const uint8_t *userKey, int bits, AES_KEY *key);
+
+void aesni_xts_encrypt(const uint8_t *in, uint8_t *out, size_t length,
+                       const AES_KEY *key1, const AES_KEY *key2,
+                       const uint8_t iv[16]);
+void aesni_xts_decrypt(const uint8_t *in, uint8_t *out, size_t length,
+                       const AES_KEY *key1, const AES_KEY *key2,
+                       const uint8_t iv[16]);
+#endif
+
+// xts128_stream_f transforms |len| bytes from |in| to |out| in one call,
+// including the encryption of the tweak.
+typedef void (*xts128_stream_f)(const uint8_t *in, uint8_t *out, size_t len,
+                                const AES_KEY *key1, const AES_KEY *key2,
+                                const uint8_t iv[16]);
+
 typedef struct xts128_context {
   void *key1, *key2;
   block128_f block1, block2;
@@ -173,6 +197,7 @@ typedef struct {
     AES_KEY ks;
   } ks1, ks2;  // AES key schedules to use
   XTS128_CONTEXT xts;
+  xts128_stream_f stream;  // Optional, complete XTS implementation
 } EVP_AES_XTS_CTX;
 
 static int aes_xts_init_key(EVP_CIPHER_CTX *ctx, const uint8_t *key,
@@ -184,17 +209,45 @@ static int aes_xts_init_key(EVP_CIPHER_CTX *ctx, const uint8_t *key,
 
   if (key) {
     // key_len is two AES keys
-    if (enc) {
-      AES_set_encrypt_key(key, ctx->key_len * 4, &xctx->ks1.ks);
-      xctx->xts.block1 = (block128_f) AES_encrypt;
+    xctx->stream = NULL;
+#if defined(AESNI_XTS)
+    if (aesni_capable()) {
+      if (enc) {
+        aesni_set_encrypt_key(key, ctx->key_len * 4, &xctx->ks1.ks);
+        xctx->stream = aesni_xts_encrypt;
+      } else {
+        aesni_set_decrypt_key(key, ctx->key_len * 4, &xctx->ks1.ks);
+        xctx->stream = aesni_xts_decrypt;
+      }
+      aesni_set_encrypt_key(key + ctx->key_len / 2, ctx->key_len * 4,
+                            &xctx->ks2.ks);
+    } else
+#endif
+    if (hwaes_capable()) {
+      if (enc) {
+        aes_hw_set_encrypt_key(key, ctx->key_len * 4, &xctx->ks1.ks);
+        xctx->xts.block1 = (block128_f) aes_hw_encrypt;
+      } else {
+        aes_hw_set_decrypt_key(key, ctx->key_len * 4, &xctx->ks1.ks);
+        xctx->xts.block1 = (block128_f) aes_hw_decrypt;
+      }
+
+      aes_hw_set_encrypt_key(key + ctx->key_len / 2,
+                             ctx->key_len * 4, &xctx->ks2.ks);
+      xctx->xts.block2 = (block128_f) aes_hw_encrypt;
     } else {
-      AES_set_decrypt_key(key, ctx->key_len * 4, &xctx->ks1.ks);
-      xctx->xts.block1 = (block128_f) AES_decrypt;
-    }
+      if (enc) {
+        AES_set_encrypt_key(key, ctx->key_len * 4, &xctx->ks1.ks);
+        xctx->xts.block1 = (block128_f) AES_encrypt;
+      } else {
+        AES_set_decrypt_key(key, ctx->key_len * 4, &xctx->ks1.ks);
+        xctx->xts.block1 = (block128_f) AES_decrypt;
+      }
 
-    AES_set_encrypt_key(key + ctx->key_len / 2,
-                        ctx->key_len * 4, &xctx->ks2.ks);
-    xctx->xts.block2 = (block128_f) AES_encrypt;
+      AES_set_encrypt_key(key + ctx->key_len / 2,
+                          ctx->key_len * 4, &xctx->ks2.ks);
+      xctx->xts.block2 = (block128_f) AES_encrypt;
+    }
     xctx->xts.key1 = &xctx->ks1;
   }
 
@@ -213,8 +266,14 @@ static int aes_xts_cipher(EVP_CIPHER_CTX *ctx, uint8_t *out,
       !xctx->xts.key2 ||
       !out ||
       !in ||
-      len < AES_BLOCK_SIZE ||
-      !CRYPTO_xts128_encrypt(&xctx->xts, ctx->iv, in, out, len, ctx->encrypt)) {
+      len < AES_BLOCK_SIZE) {
+    return 0;
+  }
+  if (xctx->stream) {
+    (*xctx->stream)(in, out, len, &xctx->ks1.ks, &xctx->ks2.ks, ctx->iv);
+    return 1;
+  }
+  if (!CRYPTO_xts128_encrypt(&xctx->xts, ctx->iv, in, out, len, ctx->encrypt)) {
     return 0;
   }
   return 1;
@@ -244,6 +303,7 @@ static int aes_xts_ctrl(EVP_CIPHER_CTX *c, int type, int arg, void *ptr) {
   // key1 and key2 are used as an indicator both key and IV are set
   xctx->xts.key1 = NULL;
   xctx->xts.key2 = NULL;
+  xctx->stream = NULL;
   return 1;
 }
 
@@ -44,10 +44,6 @@ SHARED_SRCS := \
     $(LOCAL_DIR)/decrepit/xts/xts.c \
 
 ifeq ($(ARCH),arm64)
-# TODO(aarongreen): Workaround for the non-hidden OPENSSL_armcap_P symbol, which causes arm/clang to
-# fail to link.  Remove when resolved upstream.
-SHARED_COMPILEFLAGS += -DOPENSSL_NO_ASM
-
 SHARED_SRCS += \
     $(LOCAL_DIR)/asm/aes-arm64.S \
     $(LOCAL_DIR)/asm/chacha-arm64.S \